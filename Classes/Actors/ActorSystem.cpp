@@ -0,0 +1,262 @@
+//
+//  ActorSystem.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "ActorSystem.hpp"
+
+using namespace mikedotcpp;
+
+/**
+ * Spritesheet frame names of the states, in ActorState order.
+ */
+static const char* const ACTOR_STATE_NAMES[ACTOR_STATE_COUNT] = { "idle", "walk", "attack", "pain", "dying", "dead" };
+
+ActorSystem::ActorSystem( cocos2d::Layer* layer )
+{
+    _contentScaleFactor = cocos2d::Director::getInstance()->getContentScaleFactor();
+    _batch = BillboardBatch::create();
+    _batch->setCameraMask( (unsigned short)cocos2d::CameraFlag::USER1 );
+    _batch->retain();
+    layer->addChild( _batch );
+}
+
+ActorSystem::~ActorSystem()
+{
+    _batch->removeFromParent();
+    CC_SAFE_RELEASE( _batch );
+}
+
+int ActorSystem::spawn( const std::string& type, const cocos2d::Vec3& position, float yaw )
+{
+    _x.push_back( position.x );
+    _y.push_back( position.y );
+    _z.push_back( position.z );
+    _yaw.push_back( yaw );
+    _types.push_back( (uint16_t)getTypeIndex( type ) );
+    _states.push_back( ActorState::idle );
+    _frames.push_back( 0 );
+    _frameTimes.push_back( 0.0f );
+    return (int)_x.size() - 1;
+}
+
+int ActorSystem::getTypeIndex( const std::string& type )
+{
+    for( int i = 0; i < _typeNames.size(); ++i )
+    {
+        if( _typeNames[i] == type )
+        {
+            return i;
+        }
+    }
+    
+    float radius = 0.0f;
+    bool hasFrames = false;
+    for( int state = 0; state < ACTOR_STATE_COUNT; ++state )
+    {
+        Animation animation;
+        hasFrames = loadAnimation( type, (ActorState)state, animation, radius ) || hasFrames;
+        _animations.push_back( animation );
+    }
+    if( !hasFrames )
+    {
+        CCLOG( "ActorSystem - no frames found for actor type %s, its actors are not drawn.", type.c_str() );
+    }
+    _typeNames.push_back( type );
+    _typeRadii.push_back( radius );
+    return (int)_typeNames.size() - 1;
+}
+
+bool ActorSystem::loadAnimation( const std::string& type, ActorState state, Animation& animation, float& radius )
+{
+    cocos2d::SpriteFrameCache* frameCache = cocos2d::SpriteFrameCache::getInstance();
+    std::string prefix = type + "_" + ACTOR_STATE_NAMES[(int)state] + "_";
+    std::vector< cocos2d::SpriteFrame* > frames;
+    int directionCount = 0;
+    for( int frame = 0; ; ++frame )
+    {
+        std::string name = prefix + std::to_string( frame );
+        if( frameCache->getSpriteFrameByName( name + "_0.png" ) )
+        {
+            // The first frame decides; directional and plain frames don't mix within an animation.
+            directionCount = ( directionCount == 0 ) ? ACTOR_DIRECTION_COUNT : directionCount;
+            if( directionCount != ACTOR_DIRECTION_COUNT )
+            {
+                break;
+            }
+            cocos2d::SpriteFrame* front = frameCache->getSpriteFrameByName( name + "_0.png" );
+            for( int direction = 0; direction < ACTOR_DIRECTION_COUNT; ++direction )
+            {
+                cocos2d::SpriteFrame* sideFrame = frameCache->getSpriteFrameByName( name + "_" + std::to_string( direction ) + ".png" );
+                frames.push_back( sideFrame ? sideFrame : front );
+            }
+        }
+        else if( frameCache->getSpriteFrameByName( name + ".png" ) && directionCount != ACTOR_DIRECTION_COUNT )
+        {
+            directionCount = 1;
+            frames.push_back( frameCache->getSpriteFrameByName( name + ".png" ) );
+        }
+        else
+        {
+            break;
+        }
+    }
+    
+    if( frames.empty() && state == ActorState::idle && frameCache->getSpriteFrameByName( type + ".png" ) )
+    {
+        directionCount = 1;
+        frames.push_back( frameCache->getSpriteFrameByName( type + ".png" ) );
+    }
+    if( frames.empty() )
+    {
+        return false;
+    }
+    
+    animation.firstSource = _sourceCount;
+    animation.directionCount = directionCount;
+    animation.frameCount = (int)frames.size() / directionCount;
+    for( auto frame : frames )
+    {
+        addSource( frame, radius );
+    }
+    return true;
+}
+
+int ActorSystem::addSource( cocos2d::SpriteFrame* frame, float& radius )
+{
+    int source = _sourceCount++;
+    _batch->setSource( source, frame, _contentScaleFactor );
+    if( frame )
+    {
+        cocos2d::Size size = frame->getRect().size;
+        radius = MAX( radius, size.width * 0.5f * _contentScaleFactor );
+    }
+    return source;
+}
+
+int ActorSystem::getCount() const
+{
+    return (int)_x.size();
+}
+
+void ActorSystem::setState( int actor, ActorState state )
+{
+    CCASSERT( actor >= 0 && actor < _x.size(), "Actor index out of range!" );
+    _states[actor] = state;
+    _frames[actor] = 0;
+    _frameTimes[actor] = 0.0f;
+}
+
+ActorState ActorSystem::getState( int actor ) const
+{
+    return _states[actor];
+}
+
+void ActorSystem::setPosition( int actor, const cocos2d::Vec3& position )
+{
+    CCASSERT( actor >= 0 && actor < _x.size(), "Actor index out of range!" );
+    _x[actor] = position.x;
+    _y[actor] = position.y;
+    _z[actor] = position.z;
+}
+
+cocos2d::Vec3 ActorSystem::getPosition( int actor ) const
+{
+    return cocos2d::Vec3( _x[actor], _y[actor], _z[actor] );
+}
+
+void ActorSystem::setYaw( int actor, float yaw )
+{
+    CCASSERT( actor >= 0 && actor < _x.size(), "Actor index out of range!" );
+    _yaw[actor] = yaw;
+}
+
+float ActorSystem::getYaw( int actor ) const
+{
+    return _yaw[actor];
+}
+
+const std::string& ActorSystem::getType( int actor ) const
+{
+    return _typeNames[ _types[actor] ];
+}
+
+void ActorSystem::setFrameDuration( float seconds )
+{
+    _frameDuration = MAX( 0.001f, seconds );
+}
+
+void ActorSystem::update( float delta )
+{
+    int count = (int)_x.size();
+    for( int i = 0; i < count; ++i )
+    {
+        _frameTimes[i] += delta;
+        if( _frameTimes[i] < _frameDuration )
+        {
+            continue;
+        }
+        
+        int steps = (int)( _frameTimes[i] / _frameDuration );
+        _frameTimes[i] -= steps * _frameDuration;
+        const Animation& animation = _animations[ _types[i] * ACTOR_STATE_COUNT + (int)_states[i] ];
+        if( animation.frameCount == 0 )
+        {
+            continue;
+        }
+        
+        bool loops = ( _states[i] == ActorState::idle || _states[i] == ActorState::walk );
+        int frame = _frames[i] + steps;
+        _frames[i] = (uint16_t)( loops ? frame % animation.frameCount : MIN( frame, animation.frameCount - 1 ) );
+    }
+}
+
+void ActorSystem::submit( GBRaycaster& raycaster, const cocos2d::Vec3& cameraPosition )
+{
+    _batch->clear();
+    _visibleCount = 0;
+    _occludedCount = 0;
+    
+    int count = (int)_x.size();
+    for( int i = 0; i < count; ++i )
+    {
+        const Animation& animation = _animations[ _types[i] * ACTOR_STATE_COUNT + (int)_states[i] ];
+        if( animation.frameCount == 0 )
+        {
+            continue;
+        }
+        if( raycaster.isOccluded( Point3f( _x[i], _y[i], _z[i] ), _typeRadii[ _types[i] ] ) )
+        {
+            ++_occludedCount;
+            continue;
+        }
+        
+        // Angle from the actor to the camera in the raycaster's frame (x along world z, y along world x), relative
+        // to where the actor faces, rounded to the nearest of the eight directions.
+        int direction = 0;
+        if( animation.directionCount > 1 )
+        {
+            float toCamera = CC_RADIANS_TO_DEGREES( atan2f( cameraPosition.x - _x[i], cameraPosition.z - _z[i] ) );
+            float relative = toCamera - _yaw[i];
+            relative -= floorf( relative / 360.0f ) * 360.0f;
+            direction = (int)floorf( relative / ( 360.0f / ACTOR_DIRECTION_COUNT ) + 0.5f ) % ACTOR_DIRECTION_COUNT;
+        }
+        
+        int source = animation.firstSource + _frames[i] * animation.directionCount + direction;
+        _batch->add( source, cocos2d::Vec3( _x[i], _y[i], _z[i] ) );
+        ++_visibleCount;
+    }
+}
+
+int ActorSystem::getVisibleCount() const
+{
+    return _visibleCount;
+}
+
+int ActorSystem::getOccludedCount() const
+{
+    return _occludedCount;
+}
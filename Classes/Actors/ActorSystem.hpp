@@ -0,0 +1,167 @@
+//
+//  ActorSystem.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef ActorSystem_hpp
+#define ActorSystem_hpp
+
+#include "cocos2d.h"
+#include "../Rendering/BillboardBatch.hpp"
+#include "../Rendering/Raycaster/GBRaycaster.hpp"
+
+/**
+ * Viewing directions of a directional animation frame. Direction 0 shows the actor's front; from direction d the
+ * camera sits d * 45 degrees counter-clockwise from the way the actor faces.
+ */
+#define ACTOR_DIRECTION_COUNT 8
+
+namespace mikedotcpp
+{
+    /**
+     * What an actor is doing; selects its animation. idle and walk loop, the others stop on their last frame.
+     */
+    enum class ActorState : uint8_t
+    {
+        idle, walk, attack, pain, dying, dead
+    };
+    
+    /**
+     * Number of ActorState values.
+     */
+    static const int ACTOR_STATE_COUNT = 6;
+    
+    /**
+     * Animates and draws the actors of a map other than the player (Actor::type "Player1").
+     *
+     * Actors are kept as parallel arrays (position, yaw, type, state, animation frame) so the per-frame passes run
+     * straight over memory: update() advances the animations and submit() picks each actor's viewing direction,
+     * drops the actors the raycaster's per-ray wall depth hides (GBRaycaster::isOccluded) and queues the rest in one
+     * BillboardBatch, so several hundred actors cost a handful of draws.
+     *
+     * Animation frames come from the spritesheets of the map, found by name when an actor type is first spawned:
+     *
+     *     <type>_<state>_<frame>_<direction>.png   directional frames (direction 0-7, see ACTOR_DIRECTION_COUNT)
+     *     <type>_<state>_<frame>.png               frames that look the same from every side
+     *     <type>.png                               a single idle frame, when the type has no idle animation
+     *
+     * where state is one of idle, walk, attack, pain, dying and dead and frames count up from 0. A directional
+     * frame with some directions missing shows direction 0 in their place.
+     */
+    class ActorSystem
+    {
+    public:
+        /**
+         * Adds the actor batch to layer, seen by the player camera. The batch leaves the layer with the system.
+         */
+        ActorSystem( cocos2d::Layer* layer );
+        ~ActorSystem();
+        
+        /**
+         * Adds an actor of type at position (world, center of its sprite) facing yaw (degrees, in the angle
+         * convention of the raycaster) in the idle state. Returns its index.
+         */
+        int spawn( const std::string& type, const cocos2d::Vec3& position, float yaw );
+        
+        /**
+         * Number of actors spawned.
+         */
+        int getCount() const;
+        
+        /**
+         * Per actor accessors. Changing the state restarts the animation.
+         */
+        void setState( int actor, ActorState state );
+        ActorState getState( int actor ) const;
+        void setPosition( int actor, const cocos2d::Vec3& position );
+        cocos2d::Vec3 getPosition( int actor ) const;
+        void setYaw( int actor, float yaw );
+        float getYaw( int actor ) const;
+        const std::string& getType( int actor ) const;
+        
+        /**
+         * Seconds each animation frame is shown.
+         */
+        void setFrameDuration( float seconds );
+        
+        /**
+         * Advances every animation by delta seconds.
+         */
+        void update( float delta );
+        
+        /**
+         * Queues the visible actors for the coming frame. Call after raycaster.castRays() from cameraPosition.
+         */
+        void submit( GBRaycaster& raycaster, const cocos2d::Vec3& cameraPosition );
+        
+        /**
+         * Actors queued and actors rejected by the wall depth in the last submit().
+         */
+        int getVisibleCount() const;
+        int getOccludedCount() const;
+    
+    protected:
+        /**
+         * Frames of one animation (a type and state) in the batch: frameCount frames of directionCount (1 or
+         * ACTOR_DIRECTION_COUNT) sources each, starting at firstSource. Frame f seen from direction d is source
+         * firstSource + f * directionCount + d.
+         */
+        struct Animation
+        {
+            int firstSource = 0;
+            int frameCount = 0;
+            int directionCount = 1;
+        };
+        
+        /**
+         * Actor types in spawn order and their animations, ACTOR_STATE_COUNT per type.
+         */
+        std::vector< std::string > _typeNames;
+        std::vector< Animation > _animations;
+        int _sourceCount = 0;
+        
+        /**
+         * One entry per actor.
+         */
+        std::vector< float > _x;
+        std::vector< float > _y;
+        std::vector< float > _z;
+        std::vector< float > _yaw;
+        std::vector< uint16_t > _types;
+        std::vector< ActorState > _states;
+        std::vector< uint16_t > _frames;
+        std::vector< float > _frameTimes;
+        
+        float _frameDuration = 0.125f;
+        
+        /**
+         * Half the widest frame of each type (world units): the radius tested against the wall depth.
+         */
+        std::vector< float > _typeRadii;
+        
+        BillboardBatch* _batch = nullptr;
+        float _contentScaleFactor = 1.0f;
+        int _visibleCount = 0;
+        int _occludedCount = 0;
+        
+        /**
+         * Returns the index of type, looking up its frames on first use.
+         */
+        int getTypeIndex( const std::string& type );
+        
+        /**
+         * Finds the frames of one animation and hands them to the batch. Returns FALSE if the type has none.
+         */
+        bool loadAnimation( const std::string& type, ActorState state, Animation& animation, float& radius );
+        
+        /**
+         * Adds a batch source for frame (which may be NULL) and returns its index.
+         */
+        int addSource( cocos2d::SpriteFrame* frame, float& radius );
+    };
+}
+
+#endif /* ActorSystem_hpp */
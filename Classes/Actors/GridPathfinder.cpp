@@ -0,0 +1,659 @@
+//
+//  GridPathfinder.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "GridPathfinder.hpp"
+
+using namespace mikedotcpp;
+
+/**
+ * The eight moves; the first four are straight.
+ */
+static const int DIRECTION_X[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int DIRECTION_Y[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+/**
+ * The index of the reverse of each move.
+ */
+static const uint8_t OPPOSITE_DIRECTION[8] = { 1, 0, 3, 2, 7, 6, 5, 4 };
+
+#define FLOW_STEP_NONE 0xFF
+#define FLOW_COST_UNREACHED 0xFFFFFFFF
+#define FLOW_STRAIGHT_COST 10
+#define FLOW_DIAGONAL_COST 14
+
+/**
+ * The flow field checks the clock once per this many settled cells.
+ */
+#define FLOW_CELLS_PER_CLOCK_CHECK 256
+
+/**
+ * Octile distance: the cost of the shortest 8-way move between two cells on an empty grid.
+ */
+static inline float octileDistance( int x0, int y0, int x1, int y1 )
+{
+    int dx = abs( x1 - x0 );
+    int dy = abs( y1 - y0 );
+    return (float)MAX( dx, dy ) + 0.41421356f * (float)MIN( dx, dy );
+}
+
+static inline int sign( int value )
+{
+    return ( value > 0 ) - ( value < 0 );
+}
+
+GridPathfinder::GridPathfinder( const MapInfo& mapInfo, int planeIndex )
+: _width( mapInfo.width )
+, _height( mapInfo.height )
+, _planeIndex( planeIndex )
+, _nextRequest( 0 )
+{
+    CCASSERT( planeIndex >= 0 && planeIndex < mapInfo.planes.size(), "Plane index out of range!" );
+    
+    _walkable.assign( _width * _height, 0 );
+    if( mapInfo.isChunked() )
+    {
+        // No cell flags are stored for chunked maps; derive them from the tiles.
+        for( int y = 0; y < _height; ++y )
+        {
+            for( int x = 0; x < _width; ++x )
+            {
+                uint16_t tile = mapInfo.getCell( planeIndex, x, y );
+                uint32_t flags = ( tile > 0 && tile <= mapInfo.tileFlags.size() ) ? mapInfo.tileFlags[ tile - 1 ] : 0;
+                _walkable[ y * _width + x ] = ( flags & ( MAP_TILE_FLAG_SOLID | MAP_TILE_FLAG_BLOCKING ) ) ? 0 : 1;
+            }
+        }
+    }
+    else
+    {
+        for( int i = 0; i < _width * _height; ++i )
+        {
+            _walkable[i] = ( mapInfo.getCellFlags( planeIndex, i ) & MAP_CELL_WALKABLE ) ? 1 : 0;
+        }
+    }
+    
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    _workerCount = MIN( 3, MAX( 1, (int)hardwareThreads ) - 1 );
+    _contexts.resize( 1 );
+}
+
+GridPathfinder::~GridPathfinder()
+{
+    stopWorkers();
+}
+
+int GridPathfinder::getWidth() const
+{
+    return _width;
+}
+
+int GridPathfinder::getHeight() const
+{
+    return _height;
+}
+
+int GridPathfinder::getPlaneIndex() const
+{
+    return _planeIndex;
+}
+
+void GridPathfinder::setWalkable( int x, int y, bool walkable )
+{
+    if( (unsigned)x >= (unsigned)_width || (unsigned)y >= (unsigned)_height || _walkable[ y * _width + x ] == walkable )
+    {
+        return;
+    }
+    _walkable[ y * _width + x ] = walkable ? 1 : 0;
+    if( _hasFlowTarget )
+    {
+        beginFlowField();
+    }
+}
+
+//==============================================================================
+//
+// JUMP POINT SEARCH
+//
+//==============================================================================
+
+bool GridPathfinder::findPath( const Point2i& start, const Point2i& goal, std::vector< Point2i >& path )
+{
+    return search( _contexts[0], start, goal, path );
+}
+
+bool GridPathfinder::search( SearchContext& context, const Point2i& start, const Point2i& goal, std::vector< Point2i >& path ) const
+{
+    path.clear();
+    if( !isWalkable( start.x, start.y ) || !isWalkable( goal.x, goal.y ) )
+    {
+        return false;
+    }
+    if( start.x == goal.x && start.y == goal.y )
+    {
+        path.push_back( start );
+        return true;
+    }
+    
+    int cellCount = _width * _height;
+    if( context.costs.size() != cellCount )
+    {
+        context.costs.assign( cellCount, 0.0f );
+        context.parents.assign( cellCount, -1 );
+        context.touched.assign( cellCount, 0 );
+        context.closed.assign( cellCount, 0 );
+        context.stamp = 0;
+    }
+    if( ++context.stamp == 0 )
+    {
+        std::fill( context.touched.begin(), context.touched.end(), 0 );
+        std::fill( context.closed.begin(), context.closed.end(), 0 );
+        context.stamp = 1;
+    }
+    uint32_t stamp = context.stamp;
+    
+    // A min-heap on the estimated total cost.
+    auto greater = []( const std::pair< float, int >& a, const std::pair< float, int >& b ) { return a.first > b.first; };
+    std::vector< std::pair< float, int > >& open = context.open;
+    open.clear();
+    
+    int startIndex = start.y * _width + start.x;
+    int goalIndex = goal.y * _width + goal.x;
+    context.touched[startIndex] = stamp;
+    context.costs[startIndex] = 0.0f;
+    context.parents[startIndex] = -1;
+    open.push_back( std::make_pair( octileDistance( start.x, start.y, goal.x, goal.y ), startIndex ) );
+    
+    int directionsX[8];
+    int directionsY[8];
+    while( !open.empty() )
+    {
+        std::pop_heap( open.begin(), open.end(), greater );
+        int current = open.back().second;
+        open.pop_back();
+        if( context.closed[current] == stamp )
+        {
+            continue;
+        }
+        context.closed[current] = stamp;
+        
+        if( current == goalIndex )
+        {
+            for( int cell = goalIndex; cell >= 0; cell = context.parents[cell] )
+            {
+                path.push_back( Point2i( cell % _width, cell / _width ) );
+            }
+            std::reverse( path.begin(), path.end() );
+            return true;
+        }
+        
+        int x = current % _width;
+        int y = current / _width;
+        int directionCount = getPrunedDirections( x, y, context.parents[current], directionsX, directionsY );
+        for( int i = 0; i < directionCount; ++i )
+        {
+            int jumpX, jumpY;
+            if( !jump( x + directionsX[i], y + directionsY[i], directionsX[i], directionsY[i], goal, jumpX, jumpY ) )
+            {
+                continue;
+            }
+            int next = jumpY * _width + jumpX;
+            if( context.closed[next] == stamp )
+            {
+                continue;
+            }
+            
+            float cost = context.costs[current] + octileDistance( x, y, jumpX, jumpY );
+            if( context.touched[next] != stamp || cost < context.costs[next] )
+            {
+                context.touched[next] = stamp;
+                context.costs[next] = cost;
+                context.parents[next] = current;
+                open.push_back( std::make_pair( cost + octileDistance( jumpX, jumpY, goal.x, goal.y ), next ) );
+                std::push_heap( open.begin(), open.end(), greater );
+            }
+        }
+    }
+    return false;
+}
+
+int GridPathfinder::getPrunedDirections( int x, int y, int parent, int directionsX[8], int directionsY[8] ) const
+{
+    int count = 0;
+    auto add = [&]( int dx, int dy )
+    {
+        directionsX[count] = dx;
+        directionsY[count] = dy;
+        ++count;
+    };
+    
+    if( parent < 0 )
+    {
+        for( int i = 0; i < 8; ++i )
+        {
+            int dx = DIRECTION_X[i];
+            int dy = DIRECTION_Y[i];
+            if( isWalkable( x + dx, y + dy ) && isWalkable( x + dx, y ) && isWalkable( x, y + dy ) )
+            {
+                add( dx, dy );
+            }
+        }
+        return count;
+    }
+    
+    int dx = sign( x - parent % _width );
+    int dy = sign( y - parent / _width );
+    if( dx != 0 && dy != 0 )
+    {
+        bool vertical = isWalkable( x, y + dy );
+        bool horizontal = isWalkable( x + dx, y );
+        if( vertical )
+        {
+            add( 0, dy );
+        }
+        if( horizontal )
+        {
+            add( dx, 0 );
+        }
+        if( vertical && horizontal )
+        {
+            add( dx, dy );
+        }
+    }
+    else if( dx != 0 )
+    {
+        bool next = isWalkable( x + dx, y );
+        bool up = isWalkable( x, y + 1 );
+        bool down = isWalkable( x, y - 1 );
+        if( next )
+        {
+            add( dx, 0 );
+            if( up )
+            {
+                add( dx, 1 );
+            }
+            if( down )
+            {
+                add( dx, -1 );
+            }
+        }
+        if( up )
+        {
+            add( 0, 1 );
+        }
+        if( down )
+        {
+            add( 0, -1 );
+        }
+    }
+    else
+    {
+        bool next = isWalkable( x, y + dy );
+        bool right = isWalkable( x + 1, y );
+        bool left = isWalkable( x - 1, y );
+        if( next )
+        {
+            add( 0, dy );
+            if( right )
+            {
+                add( 1, dy );
+            }
+            if( left )
+            {
+                add( -1, dy );
+            }
+        }
+        if( right )
+        {
+            add( 1, 0 );
+        }
+        if( left )
+        {
+            add( -1, 0 );
+        }
+    }
+    return count;
+}
+
+bool GridPathfinder::jump( int x, int y, int dx, int dy, const Point2i& goal, int& jumpX, int& jumpY ) const
+{
+    if( dx == 0 || dy == 0 )
+    {
+        return jumpStraight( x, y, dx, dy, goal, jumpX, jumpY );
+    }
+    
+    int ignoredX, ignoredY;
+    while( isWalkable( x, y ) )
+    {
+        // A diagonal run stops where one of its straight runs finds something.
+        if( ( x == goal.x && y == goal.y ) ||
+            jumpStraight( x + dx, y, dx, 0, goal, ignoredX, ignoredY ) ||
+            jumpStraight( x, y + dy, 0, dy, goal, ignoredX, ignoredY ) )
+        {
+            jumpX = x;
+            jumpY = y;
+            return true;
+        }
+        if( !isWalkable( x + dx, y ) || !isWalkable( x, y + dy ) )
+        {
+            return false;
+        }
+        x += dx;
+        y += dy;
+    }
+    return false;
+}
+
+bool GridPathfinder::jumpStraight( int x, int y, int dx, int dy, const Point2i& goal, int& jumpX, int& jumpY ) const
+{
+    while( isWalkable( x, y ) )
+    {
+        // Forced neighbours: a side opens up right after a wall that ran along the previous cell.
+        bool forced = ( dx != 0 ) ? ( ( isWalkable( x, y - 1 ) && !isWalkable( x - dx, y - 1 ) ) ||
+                                      ( isWalkable( x, y + 1 ) && !isWalkable( x - dx, y + 1 ) ) )
+                                  : ( ( isWalkable( x - 1, y ) && !isWalkable( x - 1, y - dy ) ) ||
+                                      ( isWalkable( x + 1, y ) && !isWalkable( x + 1, y - dy ) ) );
+        if( forced || ( x == goal.x && y == goal.y ) )
+        {
+            jumpX = x;
+            jumpY = y;
+            return true;
+        }
+        x += dx;
+        y += dy;
+    }
+    return false;
+}
+
+//==============================================================================
+//
+// REQUESTS
+//
+//==============================================================================
+
+int GridPathfinder::requestPath( const Point2i& start, const Point2i& goal )
+{
+    PathRequest request;
+    request.ticket = _nextTicket++;
+    request.start = start;
+    request.goal = goal;
+    _requests.push_back( request );
+    return request.ticket;
+}
+
+PathStatus GridPathfinder::getPathResult( int ticket, std::vector< Point2i >& path )
+{
+    auto result = _results.find( ticket );
+    if( result != _results.end() )
+    {
+        bool found = result->second.found;
+        path.swap( result->second.path );
+        _results.erase( result );
+        return found ? PathStatus::found : PathStatus::notFound;
+    }
+    if( !_requests.empty() && ticket >= _requests.front().ticket && ticket < _nextTicket )
+    {
+        return PathStatus::pending;
+    }
+    return PathStatus::unknown;
+}
+
+int GridPathfinder::getPendingCount() const
+{
+    return (int)_requests.size();
+}
+
+void GridPathfinder::setWorkerCount( int count )
+{
+    stopWorkers();
+    _workerCount = MAX( 0, count );
+}
+
+void GridPathfinder::startWorkers()
+{
+    _stopWorkers = false;
+    _contexts.resize( _workerCount + 1 );
+    for( int i = 0; i < _workerCount; ++i )
+    {
+        _workers.push_back( std::thread( &GridPathfinder::workerLoop, this, i ) );
+    }
+}
+
+void GridPathfinder::stopWorkers()
+{
+    {
+        std::lock_guard< std::mutex > lock( _workerMutex );
+        _stopWorkers = true;
+    }
+    _workerWake.notify_all();
+    for( auto& worker : _workers )
+    {
+        worker.join();
+    }
+    _workers.clear();
+}
+
+void GridPathfinder::workerLoop( int workerIndex )
+{
+    int generation = 0;
+    while( true )
+    {
+        {
+            std::unique_lock< std::mutex > lock( _workerMutex );
+            _workerWake.wait( lock, [&]() { return _stopWorkers || _workerGeneration != generation; } );
+            if( _stopWorkers )
+            {
+                return;
+            }
+            generation = _workerGeneration;
+        }
+        
+        processRequests( _contexts[ workerIndex + 1 ] );
+        {
+            std::lock_guard< std::mutex > lock( _workerMutex );
+            --_activeWorkers;
+        }
+        _workerDone.notify_all();
+    }
+}
+
+void GridPathfinder::processRequests( SearchContext& context )
+{
+    while( std::chrono::steady_clock::now() < _deadline )
+    {
+        int index = _nextRequest.fetch_add( 1 );
+        if( index >= _requestLimit )
+        {
+            return;
+        }
+        PathRequest& request = _requests[index];
+        request.found = search( context, request.start, request.goal, request.path );
+    }
+}
+
+void GridPathfinder::update( float budget )
+{
+    _deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >( std::chrono::duration< float >( budget ) );
+    
+    // The queue isn't touched by anyone else until the workers are done with it.
+    bool hasRequests = !_requests.empty();
+    if( hasRequests )
+    {
+        if( _workers.size() != _workerCount )
+        {
+            startWorkers();
+        }
+        _requestLimit = (int)_requests.size();
+        _nextRequest = 0;
+        {
+            std::lock_guard< std::mutex > lock( _workerMutex );
+            _activeWorkers = (int)_workers.size();
+            ++_workerGeneration;
+        }
+        _workerWake.notify_all();
+    }
+    
+    if( _buildingFlowField )
+    {
+        advanceFlowField();
+    }
+    
+    if( hasRequests )
+    {
+        processRequests( _contexts[0] );
+        {
+            std::unique_lock< std::mutex > lock( _workerMutex );
+            _workerDone.wait( lock, [this]() { return _activeWorkers == 0; } );
+        }
+        
+        // Every request that was taken has been finished.
+        int finished = MIN( (int)_nextRequest, _requestLimit );
+        for( int i = 0; i < finished; ++i )
+        {
+            int ticket = _requests[i].ticket;
+            _results[ticket] = std::move( _requests[i] );
+        }
+        _requests.erase( _requests.begin(), _requests.begin() + finished );
+    }
+}
+
+//==============================================================================
+//
+// FLOW FIELD
+//
+//==============================================================================
+
+void GridPathfinder::setFlowFieldTarget( const Point2i& target )
+{
+    const Point2i& current = _buildingFlowField ? _buildTarget : _flowTarget;
+    if( _hasFlowTarget && current.x == target.x && current.y == target.y )
+    {
+        return;
+    }
+    _hasFlowTarget = true;
+    _buildTarget = target;
+    beginFlowField();
+}
+
+void GridPathfinder::beginFlowField()
+{
+    int cellCount = _width * _height;
+    _buildCosts.assign( cellCount, FLOW_COST_UNREACHED );
+    _buildSteps.assign( cellCount, FLOW_STEP_NONE );
+    _buildOpen = decltype( _buildOpen )();
+    _buildingFlowField = true;
+    if( (unsigned)_buildTarget.x < (unsigned)_width && (unsigned)_buildTarget.y < (unsigned)_height )
+    {
+        int target = _buildTarget.y * _width + _buildTarget.x;
+        _buildCosts[target] = 0;
+        _buildOpen.push( std::make_pair( 0u, target ) );
+    }
+}
+
+void GridPathfinder::advanceFlowField()
+{
+    int settled = 0;
+    while( !_buildOpen.empty() )
+    {
+        if( ++settled % FLOW_CELLS_PER_CLOCK_CHECK == 0 && std::chrono::steady_clock::now() >= _deadline )
+        {
+            return;
+        }
+        
+        std::pair< uint32_t, int > top = _buildOpen.top();
+        _buildOpen.pop();
+        int current = top.second;
+        if( top.first != _buildCosts[current] )
+        {
+            continue;
+        }
+        
+        int x = current % _width;
+        int y = current / _width;
+        for( int i = 0; i < 8; ++i )
+        {
+            int dx = DIRECTION_X[i];
+            int dy = DIRECTION_Y[i];
+            bool diagonal = ( i >= 4 );
+            if( !isWalkable( x + dx, y + dy ) || ( diagonal && ( !isWalkable( x + dx, y ) || !isWalkable( x, y + dy ) ) ) )
+            {
+                continue;
+            }
+            
+            int next = ( y + dy ) * _width + x + dx;
+            uint32_t cost = top.first + ( diagonal ? FLOW_DIAGONAL_COST : FLOW_STRAIGHT_COST );
+            if( cost < _buildCosts[next] )
+            {
+                // The step from next leads back here: the opposite move.
+                _buildCosts[next] = cost;
+                _buildSteps[next] = OPPOSITE_DIRECTION[i];
+                _buildOpen.push( std::make_pair( cost, next ) );
+            }
+        }
+    }
+    
+#if COCOS2D_DEBUG > 0
+    verifyFlowField();
+#endif
+    
+    _flowCosts.swap( _buildCosts );
+    _flowSteps.swap( _buildSteps );
+    _flowTarget = _buildTarget;
+    _hasFlowField = true;
+    _buildingFlowField = false;
+}
+
+#if COCOS2D_DEBUG > 0
+void GridPathfinder::verifyFlowField() const
+{
+    // Every step has to land on a cell exactly one move cheaper, so following the flow from any reached cell
+    // (diagonal steps included) ends at the goal.
+    for( int cell = 0; cell < (int)_buildCosts.size(); ++cell )
+    {
+        uint8_t step = _buildSteps[cell];
+        if( step == FLOW_STEP_NONE )
+        {
+            CCASSERT( _buildCosts[cell] == 0 || _buildCosts[cell] == FLOW_COST_UNREACHED, "Flow field cell has a cost but no step" );
+            continue;
+        }
+        int x = cell % _width + DIRECTION_X[step];
+        int y = cell / _width + DIRECTION_Y[step];
+        CCASSERT( (unsigned)x < (unsigned)_width && (unsigned)y < (unsigned)_height, "Flow field step leaves the grid" );
+        uint32_t moveCost = ( step >= 4 ) ? FLOW_DIAGONAL_COST : FLOW_STRAIGHT_COST;
+        CCASSERT( _buildCosts[ y * _width + x ] + moveCost == _buildCosts[cell], "Flow field step does not lead towards the goal" );
+    }
+}
+#endif
+
+bool GridPathfinder::hasFlowField() const
+{
+    return _hasFlowField;
+}
+
+int GridPathfinder::getFlowDistance( int x, int y ) const
+{
+    if( !_hasFlowField || (unsigned)x >= (unsigned)_width || (unsigned)y >= (unsigned)_height )
+    {
+        return -1;
+    }
+    uint32_t cost = _flowCosts[ y * _width + x ];
+    return ( cost == FLOW_COST_UNREACHED ) ? -1 : (int)cost;
+}
+
+bool GridPathfinder::getFlowStep( int x, int y, Point2i& next ) const
+{
+    if( !_hasFlowField || (unsigned)x >= (unsigned)_width || (unsigned)y >= (unsigned)_height )
+    {
+        return false;
+    }
+    uint8_t step = _flowSteps[ y * _width + x ];
+    if( step == FLOW_STEP_NONE )
+    {
+        return false;
+    }
+    next = Point2i( x + DIRECTION_X[step], y + DIRECTION_Y[step] );
+    return true;
+}
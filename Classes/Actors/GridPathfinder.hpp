@@ -0,0 +1,261 @@
+//
+//  GridPathfinder.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef GridPathfinder_hpp
+#define GridPathfinder_hpp
+
+#include "cocos2d.h"
+#include "../Map/MapInfo.hpp"
+#include "../Rendering/Raycaster/GBRTypes.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+namespace mikedotcpp
+{
+    /**
+     * State of a path requested with GridPathfinder::requestPath().
+     */
+    enum class PathStatus : uint8_t
+    {
+        pending, found, notFound, unknown
+    };
+    
+    /**
+     * Navigation over the cells of one map plane, for actors. A cell is walkable when the plane holds nothing there
+     * or a tile that is neither solid nor blocking (MAP_CELL_WALKABLE); moves go to the eight neighbours, diagonals
+     * only between two walkable sides. Cells are addressed like GBRaycaster map coordinates (x column, y row).
+     *
+     * Single agents get jump point search A* paths: findPath() right away, or requestPath() to have the search run
+     * in the next update() on the worker threads. Hordes share one flow field, a Dijkstra map toward a target (the
+     * player) that tells every cell which neighbour to step to. Moving the target rebuilds the field across as many
+     * update() calls as it needs; the previous field stays in use until the new one is complete.
+     *
+     * The walkable grid is a copy taken at construction; keep it in sync with setWalkable() when cells change.
+     */
+    class GridPathfinder
+    {
+    public:
+        /**
+         * Copies the walkable cells of the plane. Chunked maps are read from their compiled chunks.
+         */
+        GridPathfinder( const MapInfo& mapInfo, int planeIndex );
+        
+        /**
+         * Stops the worker threads; pending requests are dropped.
+         */
+        ~GridPathfinder();
+        
+        int getWidth() const;
+        int getHeight() const;
+        int getPlaneIndex() const;
+        
+        inline bool isWalkable( int x, int y ) const
+        {
+            return (unsigned)x < (unsigned)_width && (unsigned)y < (unsigned)_height && _walkable[ y * _width + x ];
+        }
+        
+        /**
+         * Marks a cell as walkable or not (a door opened, a wall pushed). A flow field is rebuilt to match.
+         */
+        void setWalkable( int x, int y, bool walkable );
+        
+        /**
+         * Finds a path on the calling thread. path receives the jump points from start to goal (both included);
+         * consecutive points are joined by straight or diagonal runs of walkable cells. Not to be called while
+         * update() runs.
+         */
+        bool findPath( const Point2i& start, const Point2i& goal, std::vector< Point2i >& path );
+        
+        /**
+         * Queues a path search for the worker threads and returns its ticket.
+         */
+        int requestPath( const Point2i& start, const Point2i& goal );
+        
+        /**
+         * Hands over the result of a request (see findPath() for the path) once it is found or not found; the
+         * ticket is forgotten afterwards.
+         */
+        PathStatus getPathResult( int ticket, std::vector< Point2i >& path );
+        
+        /**
+         * Number of requests waiting for update().
+         */
+        int getPendingCount() const;
+        
+        /**
+         * Sets the cell the flow field leads to. The field is rebuilt by update() when the target changes cells.
+         */
+        void setFlowFieldTarget( const Point2i& target );
+        
+        /**
+         * TRUE once a flow field has been completed.
+         */
+        bool hasFlowField() const;
+        
+        /**
+         * Cost to the target of the current flow field (10 per straight step, 14 per diagonal one), -1 where it
+         * can't be reached.
+         */
+        int getFlowDistance( int x, int y ) const;
+        
+        /**
+         * The neighbour to step to from a cell to get closer to the target of the current flow field. Returns FALSE
+         * on the target itself and where it can't be reached.
+         */
+        bool getFlowStep( int x, int y, Point2i& next ) const;
+        
+        /**
+         * Threads (besides the caller of update()) that run the requested searches. Defaults to the hardware
+         * threads minus one, at most three.
+         */
+        void setWorkerCount( int count );
+        
+        /**
+         * Spends up to budget seconds: the workers and the calling thread take requests off the queue while the
+         * calling thread also advances the flow field. Blocks until the workers are done; a search that has started
+         * always finishes, so one long search can overrun the budget.
+         */
+        void update( float budget );
+    
+    protected:
+        int _width = 0;
+        int _height = 0;
+        int _planeIndex = 0;
+        std::vector< uint8_t > _walkable;
+        
+        /**
+         * Scratch of one search, sized to the map on first use. Cells count as touched (and closed) by the
+         * current search when their stamp equals stamp, so nothing is cleared between searches.
+         */
+        struct SearchContext
+        {
+            std::vector< float > costs;
+            std::vector< int > parents;
+            std::vector< uint32_t > touched;
+            std::vector< uint32_t > closed;
+            std::vector< std::pair< float, int > > open;
+            uint32_t stamp = 0;
+        };
+        
+        /**
+         * Context 0 belongs to the thread that calls findPath() and update(), the others to the workers.
+         */
+        std::vector< SearchContext > _contexts;
+        
+        /**
+         * A* over jump points with the context's scratch. Reads the grid only, so contexts can search in parallel.
+         */
+        bool search( SearchContext& context, const Point2i& start, const Point2i& goal, std::vector< Point2i >& path ) const;
+        
+        /**
+         * The directions worth exploring from a cell reached from parent (-1 for the start), pruned by the jump
+         * point rules. Returns how many were written.
+         */
+        int getPrunedDirections( int x, int y, int parent, int directionsX[8], int directionsY[8] ) const;
+        
+        /**
+         * Follows a direction from a cell until it reaches the goal or a jump point (returned in jumpX, jumpY).
+         * Returns FALSE when it runs into a wall first.
+         */
+        bool jump( int x, int y, int dx, int dy, const Point2i& goal, int& jumpX, int& jumpY ) const;
+        bool jumpStraight( int x, int y, int dx, int dy, const Point2i& goal, int& jumpX, int& jumpY ) const;
+        
+        //-----------------------------------------------------
+        //
+        // REQUESTS
+        //
+        //-----------------------------------------------------
+        struct PathRequest
+        {
+            int ticket;
+            Point2i start;
+            Point2i goal;
+            bool found = false;
+            std::vector< Point2i > path;
+        };
+        
+        /**
+         * Requests waiting for update(), in ticket order, and the finished ones not handed over yet.
+         */
+        std::vector< PathRequest > _requests;
+        std::unordered_map< int, PathRequest > _results;
+        int _nextTicket = 0;
+        
+        /**
+         * During update(): the next request to take and how many may be taken.
+         */
+        std::atomic< int > _nextRequest;
+        int _requestLimit = 0;
+        std::chrono::steady_clock::time_point _deadline;
+        
+        /**
+         * Worker threads, woken by a new generation and counted back down in _activeWorkers.
+         */
+        std::vector< std::thread > _workers;
+        int _workerCount = 0;
+        std::mutex _workerMutex;
+        std::condition_variable _workerWake;
+        std::condition_variable _workerDone;
+        int _workerGeneration = 0;
+        int _activeWorkers = 0;
+        bool _stopWorkers = false;
+        
+        void startWorkers();
+        void stopWorkers();
+        void workerLoop( int workerIndex );
+        
+        /**
+         * Takes requests off the queue until they run out or the deadline passes.
+         */
+        void processRequests( SearchContext& context );
+        
+        //-----------------------------------------------------
+        //
+        // FLOW FIELD
+        //
+        //-----------------------------------------------------
+        /**
+         * The current field (costs and, per cell, the index of the direction to step in) and the one being built.
+         */
+        std::vector< uint32_t > _flowCosts;
+        std::vector< uint8_t > _flowSteps;
+        std::vector< uint32_t > _buildCosts;
+        std::vector< uint8_t > _buildSteps;
+        std::priority_queue< std::pair< uint32_t, int >, std::vector< std::pair< uint32_t, int > >, std::greater< std::pair< uint32_t, int > > > _buildOpen;
+        Point2i _flowTarget;
+        Point2i _buildTarget;
+        bool _hasFlowTarget = false;
+        bool _hasFlowField = false;
+        bool _buildingFlowField = false;
+        
+        /**
+         * Starts building the field for _buildTarget.
+         */
+        void beginFlowField();
+        
+        /**
+         * Runs the Dijkstra search of the field being built until it completes (and replaces the current field)
+         * or the deadline passes.
+         */
+        void advanceFlowField();
+        
+#if COCOS2D_DEBUG > 0
+        /**
+         * Asserts that every step of the completed build field leads one move closer to the goal.
+         */
+        void verifyFlowField() const;
+#endif
+    };
+}
+
+#endif /* GridPathfinder_hpp */
@@ -1,5 +1,6 @@
 #include "AppDelegate.h"
 #include "Scenes/FPScene.hpp"
+#include "Rendering/Batched/BatchedGLProgram.hpp"
 
 //
 // NOTE: Allows use of the glfwSetInputMode() function that centers the mouse pointer and hides it from view.
@@ -11,6 +12,7 @@
 #endif
 
 #define kStartInFullscreen "startInFullscreen"
+#define kProgramBinaryCache "programBinaryCache"
 
 USING_NS_CC;
 
@@ -72,6 +74,9 @@ bool AppDelegate::applicationDidFinishLaunching()
         director->setOpenGLView( glview );
     }
 
+    // reuse linked shader programs across launches where the driver allows it
+    mikedotcpp::BatchedGLProgram::setBinaryCacheEnabled( config->getValue( kProgramBinaryCache ).asBool() );
+    
     // turn on display FPS
     director->setDisplayStats( config->getValue( "cocos2d.x.display_fps" ).asBool() );
 
@@ -15,7 +15,11 @@ bool Game::init()
 {
     bool result = FPRenderLayer::init();
     
-    loadMap( "maps/e1m1/e1m1.json" );
+    // Parsed and built in the background while the intro plays; the camera is placed when the map is swapped in.
+    loadMapAsync( "maps/e1m1/e1m1.cwm" );
+#if COCOS2D_DEBUG > 0
+    setHotReloadEnabled( true );
+#endif
     
     return result;
 }
@@ -28,11 +32,11 @@ void Game::onEnter()
      ---------------------------------------------------------------------------------------------------
      
         Add your custom behaviors here. Behaviors **MUST** be added after the base class has already run
-        it's onEnter() method.
+        it's onEnter() method. They are used for the map behaviors that name a C++ behavior instead of
+        holding a script (see BehaviorScript.h).
      
      ---------------------------------------------------------------------------------------------------
      */
-    addBehavior( new PickupObject( _raycaster, this ) );
     
     showIntro();
 }
@@ -55,19 +59,21 @@ void Game::showIntro()
 }
 
 /**
- * When the player enters this tile, we should have it removed from the map. Additionally, you may want to call 
- * some code that increments a counter or stores a reference to the object in some sort of inventory.
+ * The map's item tiles remove themselves and play their sound ("remove; sound ...; event pickup"); the flash is
+ * added here. You may also want to increment a counter or store the item in some sort of inventory.
  */
-void PickupObject::onEnter( cocos2d::Vec3 enterPosition, cocos2d::Vec3 exitPosition )
+void Game::onBehaviorEvent( const std::string& name, const cocos2d::Vec3& position )
 {
-    _raycaster->clearTileResourceAt( mikedotcpp::Point3f( enterPosition.x, enterPosition.y, enterPosition.z ) );
-    flashScreen();
+    if( name == "pickup" )
+    {
+        flashScreen();
+    }
 }
 
 /**
  * Some feedback for the player to communicate they picked up an item.
  */
-void PickupObject::flashScreen()
+void Game::flashScreen()
 {
     cocos2d::Size winSize = cocos2d::Director::getInstance()->getWinSize();
     cocos2d::LayerColor* flash = cocos2d::LayerColor::create( cocos2d::Color4B( 255, 255, 0, 100 ), winSize.width, winSize.height );
@@ -75,6 +81,5 @@ void PickupObject::flashScreen()
     cocos2d::RemoveSelf* removeSelf = cocos2d::RemoveSelf::create();
     cocos2d::Sequence* sequence = cocos2d::Sequence::create( fade, removeSelf, NULL );
     flash->runAction( sequence );
-    _layer->addChild( flash );
-    cocos2d::experimental::AudioEngine::play2d( "sounds/dsitemup.wav" );
+    addChild( flash );
 }
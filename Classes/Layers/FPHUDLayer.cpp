@@ -15,3 +15,23 @@ mikedotcpp::FPHUDLayer::FPHUDLayer()
 mikedotcpp::FPHUDLayer::~FPHUDLayer()
 {
 }
+
+bool mikedotcpp::FPHUDLayer::init()
+{
+    bool result = cocos2d::Layer::init();
+    
+    _minimap = MinimapLayer::create();
+    addChild( _minimap );
+    
+    return result;
+}
+
+void mikedotcpp::FPHUDLayer::setRenderLayer( FPRenderLayer* renderLayer )
+{
+    _minimap->setRenderLayer( renderLayer );
+}
+
+mikedotcpp::MinimapLayer* mikedotcpp::FPHUDLayer::getMinimap() const
+{
+    return _minimap;
+}
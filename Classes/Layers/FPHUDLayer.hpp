@@ -10,6 +10,7 @@
 #define FPHUDLayer_hpp
 
 #include "cocos2d.h"
+#include "MinimapLayer.hpp"
 
 namespace mikedotcpp
 {
@@ -25,7 +26,19 @@ namespace mikedotcpp
          */
         CREATE_FUNC( FPHUDLayer );
         
+        virtual bool init() override;
+        
+        /**
+         * Hands the layer being rendered to the parts of the HUD that show it, such as the minimap.
+         */
+        void setRenderLayer( FPRenderLayer* renderLayer );
+        
+        MinimapLayer* getMinimap() const;
+    
     protected:
+        MinimapLayer* _minimap = nullptr;
+        
+        
         /**
          * Constructor/destructor
          */
@@ -7,6 +7,21 @@
 //
 
 #include "FPRenderLayer.hpp"
+#include "../Rendering/CompressedTextures.hpp"
+#include "audio/include/AudioEngine.h"
+#include <chrono>
+
+/**
+ * Share of the asynchronous load progress reached after parsing and after decoding the images; block creation
+ * covers the rest.
+ */
+#define MAP_LOAD_PARSED_PROGRESS 0.1f
+#define MAP_LOAD_TEXTURES_PROGRESS 0.6f
+
+/**
+ * How far (0 to 1) a door has to be open before the player can walk through it.
+ */
+#define DOOR_PASSABLE_AMOUNT 0.8f
 
 using namespace mikedotcpp;
 
@@ -59,6 +74,23 @@ void FPRenderLayer::addBehavior( BehaviorObject* behaviorObject )
 
 void FPRenderLayer::update(float delta)
 {
+    if( _mapFileWatcher )
+    {
+        processMapFileChanges();
+    }
+    if( _fpsCamera == nullptr || _raycaster == nullptr )
+    {
+        return;
+    }
+    _actorSystem->update( delta );
+    triggerActorBehaviors();
+    updatePathfinder();
+    updateTileMotions( delta );
+    if( _lightGrid && getScene() )
+    {
+        _lightGrid->update( getScene()->getLights(), _fpsCamera->getPosition3D() );
+    }
+    
     cocos2d::Vec3 rotation =  cocos2d::Vec3( _fpsCamera->getRotation3D().x, _fpsCamera->getRotation3D().y, _fpsCamera->getRotation3D().z );
     float adjustedRotation = ( rotation.y + _cameraRotationOffset ) * ( MATH_PI/180.0f );
     
@@ -96,49 +128,456 @@ void FPRenderLayer::update(float delta)
     triggerBehaviors( _fpsCamera->getPosition3D(), pos );
 }
 
+void FPRenderLayer::updatePathfinder()
+{
+    if( _actorSystem->getCount() == 0 )
+    {
+        return;
+    }
+    
+    Point3f playerPosition( _fpsCamera->getPosition3D().x, _fpsCamera->getPosition3D().y, _fpsCamera->getPosition3D().z );
+    if( _pathfinder == nullptr )
+    {
+        int planeIndex = getPlaneIndexForHeight( playerPosition.y );
+        if( planeIndex < 0 )
+        {
+            return;
+        }
+        _pathfinder = new GridPathfinder( *_mapInfo, planeIndex );
+    }
+    _pathfinder->setFlowFieldTarget( _raycaster->getMapCoordForPosition( playerPosition ) );
+    _pathfinder->update( _pathfindingBudget );
+}
+
 void FPRenderLayer::triggerBehaviors( const cocos2d::Vec3& previousPosition, const cocos2d::Vec3& currentPosition )
 {
     _fpsCamera->setPosition3D( currentPosition );
     
-    Point3f enterPosition = Point3f( currentPosition.x, currentPosition.y, currentPosition.z );
-    Point3f exitPosition = Point3f( previousPosition.x, previousPosition.y, previousPosition.z );
-    Point3f triggers[] = { enterPosition, exitPosition };
+    int previousCell = _playerTriggerCell;
+    int currentCell = _raycaster->getTriggerCell( Point3f( currentPosition.x, currentPosition.y, currentPosition.z ) );
+    if( currentCell == previousCell )
+    {
+        return;
+    }
+    
+    // Walls being pushed are off their planes, but still in the way.
+    if( currentCell >= 0 && _raycaster->isLiftedCell( currentCell % ( _mapInfo->width * _mapInfo->height ) ) )
+    {
+        _fpsCamera->setPosition3D( previousPosition );
+        return;
+    }
+    
+    // Looked up before onEnter runs, which may change either tile.
+    int enterBehavior = _raycaster->getCellBehavior( currentCell );
+    int exitBehavior = _raycaster->getCellBehavior( previousCell );
+    dispatchBehavior( enterBehavior, BEHAVIOR_EVENT_ENTER, currentPosition, previousPosition, currentCell );
     
-    for( int i = 0; i < sizeof( triggers[0] )/sizeof( Point3f ); ++i )
+    // The behavior may have moved the camera; halt puts it back where it came from.
+    cocos2d::Vec3 position = _fpsCamera->getPosition3D();
+    _playerTriggerCell = _raycaster->getTriggerCell( Point3f( position.x, position.y, position.z ) );
+    if( _playerTriggerCell != previousCell )
+    {
+        dispatchBehavior( exitBehavior, BEHAVIOR_EVENT_EXIT, currentPosition, previousPosition, previousCell );
+    }
+}
+
+void FPRenderLayer::triggerActorBehaviors()
+{
+    int count = _actorSystem->getCount();
+    for( int i = 0; i < count; ++i )
+    {
+        cocos2d::Vec3 position = _actorSystem->getPosition( i );
+        int cell = _raycaster->getTriggerCell( Point3f( position.x, position.y, position.z ) );
+        if( i == _actorTriggerCells.size() )
+        {
+            // Spawned since the map was activated.
+            _actorTriggerCells.push_back( cell );
+            continue;
+        }
+        int previousCell = _actorTriggerCells[i];
+        if( cell == previousCell )
+        {
+            continue;
+        }
+        
+        _actorTriggerCells[i] = cell;
+        int exitBehavior = _raycaster->getCellBehavior( previousCell );
+        if( exitBehavior >= 0 && exitBehavior < _behaviorFunctions.size() )
+        {
+            _behaviorFunctions[exitBehavior]->onActorExit( i, position );
+        }
+        int enterBehavior = _raycaster->getCellBehavior( cell );
+        if( enterBehavior >= 0 && enterBehavior < _behaviorFunctions.size() )
+        {
+            _behaviorFunctions[enterBehavior]->onActorEnter( i, position );
+        }
+    }
+}
+
+void FPRenderLayer::dispatchBehavior( int behavior, BehaviorEvent event, const cocos2d::Vec3& enterPosition,
+                                      const cocos2d::Vec3& exitPosition, int triggerCell )
+{
+    int entry = _mapInfo->behaviorProgram.getEntry( behavior, event );
+    if( entry >= 0 )
+    {
+        runBehaviorScript( entry, enterPosition, exitPosition, triggerCell, true );
+    }
+    else if( behavior >= 0 && behavior < _behaviorFunctions.size() )
+    {
+        if( event == BEHAVIOR_EVENT_ENTER )
+        {
+            _behaviorFunctions[behavior]->onEnter( enterPosition, exitPosition );
+        }
+        else if( event == BEHAVIOR_EVENT_EXIT )
+        {
+            _behaviorFunctions[behavior]->onExit( enterPosition, exitPosition );
+        }
+    }
+}
+
+void FPRenderLayer::runBehaviorScript( int entry, const cocos2d::Vec3& enterPosition, const cocos2d::Vec3& exitPosition,
+                                       int triggerCell, bool player )
+{
+    const BehaviorProgram& program = _mapInfo->behaviorProgram;
+    bool cellsChanged = false;
+    for( const BehaviorInstruction* instruction = &program.code[entry]; instruction->op != BehaviorOp::end; ++instruction )
     {
-        int tileResourceIndex = _raycaster->getTileResourceIndex( triggers[i] );
-        if( tileResourceIndex >= 0 )
+        switch( instruction->op )
         {
-            int behaviorIndex = _mapInfo->tiles[tileResourceIndex].tag;
-            if( behaviorIndex >= 0 )
+            case BehaviorOp::halt:
+                if( player )
+                {
+                    _fpsCamera->setPosition3D( exitPosition );
+                }
+                break;
+            
+            case BehaviorOp::remove:
+            case BehaviorOp::door:
             {
-                if( behaviorIndex < _behaviorFunctions.size() )
+                int planeIndex = _raycaster->getTriggerPlane( triggerCell );
+                int x = triggerCell % _mapInfo->width;
+                int y = ( triggerCell / _mapInfo->width ) % _mapInfo->height;
+                if( planeIndex < 0 )
                 {
-                    _behaviorFunctions[behaviorIndex]->onEnter( currentPosition, previousPosition );
+                    break;
                 }
+                if( instruction->op == BehaviorOp::door && ( _mapInfo->tileFlags[ _raycaster->getTileIndexAt( planeIndex, x, y ) ] & MAP_TILE_FLAG_DOOR ) )
+                {
+                    // The player waits for the door to slide open.
+                    if( !openDoor( planeIndex, x, y, triggerCell, (float)instruction->a ) && player )
+                    {
+                        _fpsCamera->setPosition3D( exitPosition );
+                    }
+                }
+                else
+                {
+                    setCellTile( planeIndex, x, y, -1 );
+                    cellsChanged = true;
+                }
+                break;
             }
+            
+            case BehaviorOp::pushwall:
+                cellsChanged = pushTile( triggerCell, enterPosition - exitPosition, instruction->a ) || cellsChanged;
+                break;
+            
+            case BehaviorOp::teleport:
+                if( player )
+                {
+                    // Map coordinates given like an actor's.
+                    Point3f cellPosition = _raycaster->tilePositionForCoord( Point2i( instruction->b, instruction->a ) );
+                    _fpsCamera->setPosition3D( cocos2d::Vec3( cellPosition.x, _fpsCamera->getPosition3D().y, cellPosition.y ) );
+                }
+                break;
+            
+            case BehaviorOp::damage:
+                if( player )
+                {
+                    setPlayerHealth( _playerHealth - instruction->a );
+                }
+                break;
+            
+            case BehaviorOp::sound:
+                cocos2d::experimental::AudioEngine::play2d( program.strings[instruction->a] );
+                break;
+            
+            case BehaviorOp::event:
+                onBehaviorEvent( program.strings[instruction->a], enterPosition );
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    if( cellsChanged )
+    {
+        _mapInfo->refreshCellFlags();
+    }
+}
+
+void FPRenderLayer::runCreateScripts()
+{
+    const BehaviorProgram& program = _mapInfo->behaviorProgram;
+    bool hasCreateScripts = false;
+    for( int i = 0; i < _mapInfo->behaviors.size() && !hasCreateScripts; ++i )
+    {
+        hasCreateScripts = program.getEntry( i, BEHAVIOR_EVENT_CREATE ) >= 0;
+    }
+    if( !hasCreateScripts )
+    {
+        return;
+    }
+    
+    int width = _mapInfo->width;
+    int height = _mapInfo->height;
+    int cellCount = (int)_mapInfo->planeLevels.size() * width * height;
+    for( int cell = 0; cell < cellCount; ++cell )
+    {
+        int entry = program.getEntry( _raycaster->getCellBehavior( cell ), BEHAVIOR_EVENT_CREATE );
+        if( entry >= 0 )
+        {
+            Point3f cellPosition = _raycaster->tilePositionForCoord( cell % width, ( cell / width ) % height );
+            float levelHeight = (float)_mapInfo->planeLevels[ cell / ( width * height ) ].height;
+            cocos2d::Vec3 position( cellPosition.y, levelHeight, cellPosition.x );
+            runBehaviorScript( entry, position, position, cell, false );
         }
     }
 }
 
+bool FPRenderLayer::pushTile( int triggerCell, const cocos2d::Vec3& direction, int cells )
+{
+    int planeIndex = _raycaster->getTriggerPlane( triggerCell );
+    if( planeIndex < 0 || ( direction.x == 0.0f && direction.z == 0.0f ) )
+    {
+        return false;
+    }
+    
+    // Map columns run along world z and rows along -x (see GBRaycaster::getMapCoordForPosition).
+    int width = _mapInfo->width;
+    int height = _mapInfo->height;
+    bool alongColumns = fabsf( direction.z ) >= fabsf( direction.x );
+    int dx = alongColumns ? ( direction.z > 0.0f ? 1 : -1 ) : 0;
+    int dy = alongColumns ? 0 : ( direction.x > 0.0f ? -1 : 1 );
+    int x = triggerCell % width;
+    int y = ( triggerCell / width ) % height;
+    if( cells < 1 || !canPushInto( planeIndex, x + dx, y + dy ) )
+    {
+        return false;
+    }
+    
+    // Lifted off the plane: the cells it leaves and enters are drawn and blocked through the raycaster.
+    TileMotion motion;
+    motion.tile = { planeIndex, _raycaster->getTileIndexAt( planeIndex, x, y ), Point2i( x, y ), Point2i( dx, dy ), 0.0f };
+    motion.triggerCell = triggerCell;
+    motion.door = false;
+    motion.cellsLeft = cells - 1;
+    motion.speed = _pushwallSpeed;
+    motion.holdTime = 0.0f;
+    motion.heldTime = 0.0f;
+    setCellTile( planeIndex, x, y, -1 );
+    _raycaster->setMovingTile( motion.tile );
+    setPathWalkable( planeIndex, Point2i( x, y ), false );
+    setPathWalkable( planeIndex, Point2i( x + dx, y + dy ), false );
+    _tileMotions.push_back( motion );
+    return true;
+}
+
+void FPRenderLayer::setCellTile( int planeIndex, int x, int y, int tileIndex )
+{
+    _raycaster->setTileIndexAt( planeIndex, x, y, tileIndex );
+    uint32_t flags = ( tileIndex >= 0 ) ? _mapInfo->tileFlags[tileIndex] : 0;
+    setPathWalkable( planeIndex, Point2i( x, y ), !( flags & ( MAP_TILE_FLAG_SOLID | MAP_TILE_FLAG_BLOCKING ) ) );
+}
+
+void FPRenderLayer::setPathWalkable( int planeIndex, const Point2i& cell, bool walkable )
+{
+    if( _pathfinder && _pathfinder->getPlaneIndex() == planeIndex )
+    {
+        _pathfinder->setWalkable( cell.x, cell.y, walkable );
+    }
+}
+
+bool FPRenderLayer::canPushInto( int planeIndex, int x, int y )
+{
+    if( x < 0 || y < 0 || x >= _mapInfo->width || y >= _mapInfo->height )
+    {
+        return false;
+    }
+    return _raycaster->getTileIndexAt( planeIndex, x, y ) < 0 && !_raycaster->isLiftedCell( y * _mapInfo->width + x );
+}
+
+bool FPRenderLayer::openDoor( int planeIndex, int x, int y, int triggerCell, float holdTime )
+{
+    for( auto& motion : _tileMotions )
+    {
+        if( motion.door && motion.triggerCell == triggerCell )
+        {
+            // Closing doors open again, open ones stay open a while longer.
+            motion.speed = ( motion.tile.amount < 1.0f ) ? _doorSpeed : 0.0f;
+            motion.holdTime = holdTime;
+            motion.heldTime = 0.0f;
+            return motion.tile.amount >= DOOR_PASSABLE_AMOUNT;
+        }
+    }
+    
+    // NS doors slide along their row, EW doors along their column, toward the lower map coordinate.
+    int tileIndex = _raycaster->getTileIndexAt( planeIndex, x, y );
+    bool alongRow = ( _mapInfo->tileFlags[tileIndex] & MAP_TILE_FLAG_DOOR_NS ) != 0;
+    TileMotion motion;
+    motion.tile = { planeIndex, tileIndex, Point2i( x, y ), Point2i( alongRow ? -1 : 0, alongRow ? 0 : -1 ), 0.0f };
+    motion.triggerCell = triggerCell;
+    motion.door = true;
+    motion.cellsLeft = 0;
+    motion.speed = _doorSpeed;
+    motion.holdTime = holdTime;
+    motion.heldTime = 0.0f;
+    _raycaster->setMovingTile( motion.tile );
+    _tileMotions.push_back( motion );
+    return false;
+}
+
+void FPRenderLayer::updateTileMotions( float delta )
+{
+    bool cellsChanged = false;
+    for( int i = 0; i < _tileMotions.size(); )
+    {
+        TileMotion& motion = _tileMotions[i];
+        MovingTile& tile = motion.tile;
+        bool stopped = false;
+        if( motion.door )
+        {
+            if( motion.speed < 0.0f && isTriggerCellOccupied( motion.triggerCell ) )
+            {
+                // Someone stepped in while it was closing.
+                motion.speed = _doorSpeed;
+            }
+            if( motion.speed == 0.0f )
+            {
+                motion.heldTime += delta;
+                if( motion.holdTime > 0.0f && motion.heldTime >= motion.holdTime && !isTriggerCellOccupied( motion.triggerCell ) )
+                {
+                    motion.speed = -_doorSpeed;
+                }
+                ++i;
+                continue;
+            }
+            
+            tile.amount = MAX( 0.0f, MIN( 1.0f, tile.amount + motion.speed * delta ) );
+            motion.speed = ( tile.amount == 1.0f ) ? 0.0f : motion.speed;
+            stopped = ( tile.amount == 0.0f );
+            if( stopped )
+            {
+                _raycaster->removeMovingTile( tile.planeIndex, tile.cell.x, tile.cell.y );
+            }
+        }
+        else
+        {
+            tile.amount += motion.speed * delta;
+            while( !stopped && tile.amount >= 1.0f )
+            {
+                // Into the next cell, then on while there is room and cells left.
+                setPathWalkable( tile.planeIndex, tile.cell, true );
+                tile.cell = Point2i( tile.cell.x + tile.direction.x, tile.cell.y + tile.direction.y );
+                tile.amount -= 1.0f;
+                stopped = ( motion.cellsLeft-- <= 0 || !canPushInto( tile.planeIndex, tile.cell.x + tile.direction.x, tile.cell.y + tile.direction.y ) );
+            }
+            if( stopped )
+            {
+                _raycaster->removeMovingTile( tile.planeIndex, tile.cell.x, tile.cell.y );
+                setCellTile( tile.planeIndex, tile.cell.x, tile.cell.y, tile.tileIndex );
+                cellsChanged = true;
+            }
+            else
+            {
+                setPathWalkable( tile.planeIndex, Point2i( tile.cell.x + tile.direction.x, tile.cell.y + tile.direction.y ), false );
+            }
+        }
+        
+        if( stopped )
+        {
+            _tileMotions[i] = _tileMotions.back();
+            _tileMotions.pop_back();
+            continue;
+        }
+        _raycaster->setMovingTile( tile );
+        ++i;
+    }
+    
+    if( cellsChanged )
+    {
+        _mapInfo->refreshCellFlags();
+    }
+}
+
+bool FPRenderLayer::isTriggerCellOccupied( int triggerCell ) const
+{
+    if( triggerCell == _playerTriggerCell )
+    {
+        return true;
+    }
+    for( int cell : _actorTriggerCells )
+    {
+        if( cell == triggerCell )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FPRenderLayer::onBehaviorEvent( const std::string& name, const cocos2d::Vec3& position )
+{
+}
+
+int FPRenderLayer::getPlayerHealth() const
+{
+    return _playerHealth;
+}
+
+void FPRenderLayer::setPlayerHealth( int health )
+{
+    _playerHealth = MAX( 0, health );
+}
+
 void FPRenderLayer::visit( cocos2d::Renderer *renderer, const cocos2d::Mat4& parentTransform, uint32_t parentFlags)
 {
+    if( _fpsCamera == nullptr || _mapInfo == nullptr )
+    {
+        cocos2d::Layer::visit( renderer, parentTransform, parentFlags );
+        return;
+    }
+    
     cocos2d::Vec3 rotation =  cocos2d::Vec3( _fpsCamera->getRotation3D().x, _fpsCamera->getRotation3D().y, _fpsCamera->getRotation3D().z );
     float adjustedRotation = ( rotation.y + _cameraRotationOffset ) * ( MATH_PI/180.0f );
     Point3f playerPosition( _fpsCamera->getPosition3D().x, _fpsCamera->getPosition3D().y, _fpsCamera->getPosition3D().z );
 
     _blockManager->reclaimAllBlocks();
+    BatchedMeshCommand::beginFrame();
+    
+    MapChunkStreamer* chunkStreamer = _raycaster->getChunkStreamer();
+    if( chunkStreamer )
+    {
+        Point2i playerCell = _raycaster->getMapCoordForPosition( playerPosition );
+        chunkStreamer->update( playerCell.x, playerCell.y );
+    }
     
     resetVisitedPlanes();
+    _cameraPlaneIndex = getPlaneIndexForHeight( playerPosition.y );
     _raycaster->castRays( playerPosition, adjustedRotation );
+    _actorSystem->submit( *_raycaster, _fpsCamera->getPosition3D() );
     
     if( _mapInfo->useRealtimeLighting )
     {
-        for( int i = 0; i < _tileCounter.size(); ++i )
+        _instanceCuller.update( _fpsCamera );
+        for( int i = 0; i < _instanceArena.getRegionCount(); ++i )
         {
+            _instanceArena.truncate( i, _instanceCuller.cull( _instanceArena.getRegionData( i ), _instanceArena.getCount( i ) ) );
+            
             BatchedSprite3D* blockMesh = _blockManager->getMeshBlock( i );
-            blockMesh->setInstanceCount( _tileCounter[i] );
-            blockMesh->setPositionPalette( _tilePositions[i] );
+            InstanceSpan span = _instanceArena.getSpan( i );
+            blockMesh->setInstanceCount( span.count );
+            blockMesh->setPositionPalette( span );
         }
     }
     
@@ -147,101 +586,578 @@ void FPRenderLayer::visit( cocos2d::Renderer *renderer, const cocos2d::Mat4& par
 
 void FPRenderLayer::resetVisitedPlanes()
 {
-    int mapSize = _mapInfo->width * _mapInfo->height;
+    // Chunked maps only track the cells that can be resident.
+    MapChunkStreamer* chunkStreamer = _raycaster->getChunkStreamer();
+    int windowSize = chunkStreamer ? chunkStreamer->getWindowSize() : 0;
+    int mapSize = chunkStreamer ? windowSize * windowSize : _mapInfo->width * _mapInfo->height;
     unsigned long planeCount = _mapInfo->planes.size();
-    if( _visitedPlanes.size() > 0 )
+    if( _visitedPlanes.size() != planeCount )
     {
+        releaseVisitedPlanes();
         for( int i = 0; i < planeCount; ++i )
         {
-            delete _visitedPlanes[i];
+            _visitedPlanes.push_back( new int[mapSize]() );
         }
-        _visitedPlanes.clear();
     }
-    
-    for( int i = 0; i < planeCount; ++i )
+    else
     {
-        _visitedPlanes.push_back( new int[mapSize]() );
+        for( int i = 0; i < planeCount; ++i )
+        {
+            memset( _visitedPlanes[i], 0, sizeof( int ) * mapSize );
+        }
     }
     
-    for( int i = 0; i < _tileCounter.size(); ++i )
+    _instanceArena.beginFrame();
+    _mergedRegion = 0;
+}
+
+void FPRenderLayer::releaseVisitedPlanes()
+{
+    for( int i = 0; i < _visitedPlanes.size(); ++i )
     {
-        _tileCounter[i] = 0;
-        _tilePositions[i].clear();
+        delete[] _visitedPlanes[i];
     }
+    _visitedPlanes.clear();
 }
 
 bool FPRenderLayer::processHit( int index, float angle, Point3f hit, int tileIndex, int planeIndex )
 {
     CCASSERT( tileIndex < _mapInfo->tiles.size(), "Index out of range!" );
     
-    int tag = _mapInfo->tiles[tileIndex].tag;
-    bool continueProcessing = ( planeIndex != getPlaneIndexForHeight( _fpsCamera->getPosition3D().y ) || tag != 0 );
+    int tag = _mapInfo->tileDescriptors[tileIndex].tag;
+    bool continueProcessing = ( planeIndex != _cameraPlaneIndex || tag != 0 );
     
-    if( _visitedPlanes[planeIndex][index] == 0 )
+    MapChunkStreamer* chunkStreamer = _raycaster->getChunkStreamer();
+    int visitedIndex = chunkStreamer ? chunkStreamer->getWindowIndex( index % _mapInfo->width, index / _mapInfo->width ) : index;
+    if( visitedIndex >= 0 && _visitedPlanes[planeIndex][visitedIndex] == 0 )
     {
-        drawBlock( hit, tileIndex );
-        _visitedPlanes[planeIndex][index] = 1;
+        // Pushed walls show every face while they move.
+        uint8_t exposedFaces = _mapInfo->getCellFlags( planeIndex, index ) & MAP_CELL_EXPOSED_MASK;
+        exposedFaces = _raycaster->isLiftedCell( index ) ? MAP_CELL_EXPOSED_MASK : exposedFaces;
+        drawBlock( hit, tileIndex, exposedFaces, planeIndex, index );
+        _visitedPlanes[planeIndex][visitedIndex] = 1;
+        
+        // Rays stop at the walls of the player's plane and pass through its objects and the other planes.
+        ExploredKind kind = ( planeIndex != _cameraPlaneIndex ) ? EXPLORED_FLOOR : ( continueProcessing ? EXPLORED_OBJECT : EXPLORED_WALL );
+        _exploredCells.mark( index, kind );
     }
     return continueProcessing;
 }
 
 int FPRenderLayer::getPlaneIndexForHeight( float height )
 {
-    int index = -1;
-    for( int i = 0; i < _mapInfo->planes.size(); ++i )
-    {
-        if( _mapInfo->planes[i].height == height )
-        {
-            index = i;
-            break;
-        }
-    }
-    return index;
+    return _mapInfo->getPlaneIndexForHeight( height );
 }
 
-void FPRenderLayer::drawBlock( Point3f hit, int tileIndex )
+void FPRenderLayer::drawBlock( Point3f hit, int tileIndex, uint8_t exposedFaces, int planeIndex, int cellIndex )
 {
     cocos2d::Vec3 point = cocos2d::Vec3( hit.x, hit.y, hit.z );
     
     if( _mapInfo->useRealtimeLighting )
     {
-        _tileCounter[ tileIndex ] += 1;
-        _tilePositions[ tileIndex ].push_back( point );
+        if( _blockManager->usesMergedMaterial() )
+        {
+            float selector = _blockManager->getInstanceSelector( tileIndex );
+            if( selector >= 0.0f )
+            {
+                cocos2d::Vec4 instance( point.x, point.y, point.z, selector );
+                while( _mergedRegion < _instanceArena.getRegionCount() && !_instanceArena.push( _mergedRegion, instance ) )
+                {
+                    ++_mergedRegion;
+                }
+            }
+        }
+        else
+        {
+            _instanceArena.push( tileIndex, cocos2d::Vec4( point.x, point.y, point.z, 0.0f ) );
+        }
     }
-    else
+    else if( !_blockManager->addBillboard( tileIndex, point ) )
     {
         cocos2d::Sprite3D* block = _blockManager->getBlock( tileIndex );
         if( block )
         {
             block->setPosition3D( point );
+            _blockManager->setExposedFaces( *block, exposedFaces );
+            if( _lightMap )
+            {
+                _blockManager->setFaceLights( *block, _lightMap->getFaceColors( planeIndex, cellIndex ) );
+            }
         }
     }
 }
 
 void FPRenderLayer::loadMap( const std::string& filename )
 {
+    // The raycaster (and its chunk streamer) reads from the MapInfo, so it goes first.
+    CC_SAFE_DELETE( _blockManager );
+    CC_SAFE_DELETE( _lightMap );
+    CC_SAFE_DELETE( _lightGrid );
+    CC_SAFE_DELETE( _raycaster );
     CC_SAFE_DELETE( _mapInfo );
-    _mapInfo = new MapInfo( filename.c_str() );
     
-    CC_SAFE_DELETE( _raycaster );
+    _mapPath = cocos2d::FileUtils::getInstance()->fullPathForFilename( filename );
+    _mapInfo = new MapInfo( _mapPath.c_str() );
+    if( !_mapInfo->isLoaded() )
+    {
+        cocos2d::log( "FPRenderLayer::loadMap - could not load %s.", filename.c_str() );
+        CC_SAFE_DELETE( _mapInfo );
+        return;
+    }
     _raycaster = new GBRaycaster( *_mapInfo, this );
-    
-    CC_SAFE_DELETE( _blockManager );
     _blockManager = new BlockManager( *_mapInfo, _layer3D );
+    _exploredCells.reset( _mapInfo->width, _mapInfo->height );
     
-    _visitedPlanes.clear();
-    _visitedPlanes.reserve( _mapInfo->width * _mapInfo->height );
-    resetVisitedPlanes();
+    activateMap();
+    watchMapFiles();
+}
+
+void FPRenderLayer::activateMap()
+{
+    releaseVisitedPlanes();
+    _tileMotions.clear();
+    _raycaster->clearMovingTiles();
+    
+    if( _mapInfo->useRealtimeLighting )
+    {
+        _instanceArena.init( _blockManager->getInstanceCapacities() );
+        _instanceCuller.setRadius( _mapInfo->tileSize * 0.5f * sqrtf( 3.0f ) );
+    }
+    else
+    {
+        _instanceArena.init( std::vector< int >() );
+    }
     
+    // Baked again after every hot reload, since edited cells change the shadows.
+    CC_SAFE_DELETE( _lightMap );
+    if( !_mapInfo->lights.empty() && _mapInfo->hasCellFlags() )
+    {
+        _lightMap = new LightMap( *_mapInfo );
+        _blockManager->applyLightMap( *_lightMap );
+    }
+    CC_SAFE_DELETE( _lightGrid );
     if( _mapInfo->useRealtimeLighting )
     {
-        for( int i = 0; i < _mapInfo->tiles.size(); ++i )
+        _lightGrid = new LightGrid( *_mapInfo );
+        _blockManager->applyLightGrid( *_lightGrid );
+    }
+    resetVisitedPlanes();
+    spawnMapActors();
+    runCreateScripts();
+    resetTriggerCells();
+}
+
+void FPRenderLayer::spawnMapActors()
+{
+    CC_SAFE_DELETE( _pathfinder );
+    CC_SAFE_DELETE( _actorSystem );
+    _actorSystem = new ActorSystem( _layer3D );
+    if( _mapInfo->actors.size() < 2 )
+    {
+        return;
+    }
+    
+    // The actor frames are looked up in the map's spritesheets, which only the sprite path loads itself.
+    cocos2d::SpriteFrameCache* frameCache = cocos2d::SpriteFrameCache::getInstance();
+    for( const auto& name : _mapInfo->spritesheets )
+    {
+        frameCache->addSpriteFramesWithFile( name + ".plist", CompressedTextures::resolve( name + ".png" ) );
+    }
+    for( int i = 1; i < _mapInfo->actors.size(); ++i )
+    {
+        const Actor& actor = _mapInfo->actors[i];
+        _actorSystem->spawn( actor.type, getActorPosition( actor ), actor.yaw );
+    }
+}
+
+bool FPRenderLayer::loadMapAsync( const std::string& filename,
+                                  const std::function< void( float ) >& progress,
+                                  const std::function< void() >& complete )
+{
+    if( _mapLoadState != MapLoadState::idle )
+    {
+        CCLOG( "FPRenderLayer::loadMapAsync - %s ignored, a map is already loading.", filename.c_str() );
+        return false;
+    }
+    
+    _mapLoadState = MapLoadState::parsing;
+    _mapLoadProgressCallback = progress;
+    _mapLoadCompleteCallback = complete;
+    setMapLoadProgress( 0.0f );
+    
+    // Kept alive until the map has been swapped in; the worker and the texture callbacks point back here.
+    retain();
+    
+    // Resolve on this thread: FileUtils caches lookups and that cache is not thread-safe.
+    std::string fullPath = cocos2d::FileUtils::getInstance()->fullPathForFilename( filename );
+    _pendingMapPath = fullPath;
+    cocos2d::AsyncTaskPool::getInstance()->enqueue( cocos2d::AsyncTaskPool::TaskType::TASK_IO, [this]( void* )
+    {
+        onMapParsed();
+    }, nullptr, [this, fullPath]()
+    {
+        _pendingMapInfo = new MapInfo( fullPath.c_str() );
+        if( _pendingMapInfo->isLoaded() )
         {
-            std::vector< cocos2d::Vec3 > positions;
-            _tilePositions.push_back( positions );
-            _tileCounter.push_back( 0 );
+            _pendingRaycaster = new GBRaycaster( *_pendingMapInfo, this );
         }
+    } );
+    return true;
+}
+
+void FPRenderLayer::onMapParsed()
+{
+    if( !_pendingMapInfo->isLoaded() )
+    {
+        cocos2d::log( "FPRenderLayer::loadMapAsync - could not load %s.", _pendingMapPath.c_str() );
+        CC_SAFE_DELETE( _pendingMapInfo );
+        _mapLoadState = MapLoadState::idle;
+        _mapLoadProgressCallback = nullptr;
+        _mapLoadCompleteCallback = nullptr;
+        release();
+        return;
+    }
+    
+    _mapLoadState = MapLoadState::loadingTextures;
+    setMapLoadProgress( MAP_LOAD_PARSED_PROGRESS );
+    
+    std::vector< std::string > filenames = BlockManager::getTextureFilenames( *_pendingMapInfo );
+    _pendingTextureCount = (int)filenames.size();
+    _loadedTextureCount = 0;
+    if( filenames.empty() )
+    {
+        beginBuildingBlocks();
+        return;
+    }
+    
+    // Cached images call back immediately, the others once decoded on the texture cache's loader thread.
+    cocos2d::TextureCache* textureCache = cocos2d::Director::getInstance()->getTextureCache();
+    for( const auto& filename : filenames )
+    {
+        textureCache->addImageAsync( filename, CC_CALLBACK_1( FPRenderLayer::onMapTextureLoaded, this ) );
+    }
+}
+
+void FPRenderLayer::onMapTextureLoaded( cocos2d::Texture2D* texture )
+{
+    if( texture == nullptr )
+    {
+        CCLOG( "FPRenderLayer::onMapTextureLoaded - an image of the map failed to load." );
+    }
+    
+    ++_loadedTextureCount;
+    float loaded = (float)_loadedTextureCount / _pendingTextureCount;
+    setMapLoadProgress( MAP_LOAD_PARSED_PROGRESS + ( MAP_LOAD_TEXTURES_PROGRESS - MAP_LOAD_PARSED_PROGRESS ) * loaded );
+    if( _loadedTextureCount == _pendingTextureCount )
+    {
+        beginBuildingBlocks();
+    }
+}
+
+void FPRenderLayer::beginBuildingBlocks()
+{
+    _mapLoadState = MapLoadState::buildingBlocks;
+    
+    _pendingLayer3D = cocos2d::Layer::create();
+    _pendingLayer3D->retain();
+    _pendingBlockManager = new BlockManager( *_pendingMapInfo, _pendingLayer3D, true );
+    schedule( CC_SCHEDULE_SELECTOR( FPRenderLayer::stepMapLoad ) );
+}
+
+void FPRenderLayer::stepMapLoad( float delta )
+{
+    bool done = _pendingBlockManager->initNextBlocks( _mapLoadTimeSlice );
+    setMapLoadProgress( MAP_LOAD_TEXTURES_PROGRESS + ( 1.0f - MAP_LOAD_TEXTURES_PROGRESS ) * _pendingBlockManager->getInitProgress() );
+    if( done )
+    {
+        unschedule( CC_SCHEDULE_SELECTOR( FPRenderLayer::stepMapLoad ) );
+        swapInPendingMap();
+    }
+}
+
+void FPRenderLayer::swapInPendingMap()
+{
+    // Scheduled callbacks run between frames, so no visit() ever sees half of each map.
+    addChild( _pendingLayer3D );
+    if( _fpsCamera )
+    {
+        _fpsCamera->removeFromParentAndCleanup( false );
+        _pendingLayer3D->addChild( _fpsCamera );
+    }
+    removeChild( _layer3D );
+    _layer3D = _pendingLayer3D;
+    _pendingLayer3D->release();
+    _pendingLayer3D = nullptr;
+    
+    CC_SAFE_DELETE( _blockManager );
+    CC_SAFE_DELETE( _lightMap );
+    CC_SAFE_DELETE( _lightGrid );
+    CC_SAFE_DELETE( _raycaster );
+    CC_SAFE_DELETE( _mapInfo );
+    _mapInfo = _pendingMapInfo;
+    _raycaster = _pendingRaycaster;
+    _blockManager = _pendingBlockManager;
+    _mapPath = _pendingMapPath;
+    _pendingMapInfo = nullptr;
+    _pendingRaycaster = nullptr;
+    _pendingBlockManager = nullptr;
+    _exploredCells.reset( _mapInfo->width, _mapInfo->height );
+    
+    activateMap();
+    watchMapFiles();
+    if( _fpsCamera )
+    {
+        placeCameraAtPlayerStart();
+    }
+    
+    _mapLoadState = MapLoadState::idle;
+    setMapLoadProgress( 1.0f );
+    if( _mapLoadCompleteCallback )
+    {
+        _mapLoadCompleteCallback();
+    }
+    _mapLoadProgressCallback = nullptr;
+    _mapLoadCompleteCallback = nullptr;
+    release();
+}
+
+void FPRenderLayer::setMapLoadProgress( float progress )
+{
+    _mapLoadProgress = progress;
+    if( _mapLoadProgressCallback )
+    {
+        _mapLoadProgressCallback( progress );
+    }
+}
+
+bool FPRenderLayer::isLoadingMap() const
+{
+    return _mapLoadState != MapLoadState::idle;
+}
+
+float FPRenderLayer::getMapLoadProgress() const
+{
+    return _mapLoadProgress;
+}
+
+void FPRenderLayer::setMapLoadTimeSlice( float seconds )
+{
+    _mapLoadTimeSlice = seconds;
+}
+
+GBRaycaster* FPRenderLayer::getRaycaster() const
+{
+    return _raycaster;
+}
+
+ActorSystem* FPRenderLayer::getActorSystem() const
+{
+    return _actorSystem;
+}
+
+GridPathfinder* FPRenderLayer::getPathfinder() const
+{
+    return _pathfinder;
+}
+
+const ExploredCells& FPRenderLayer::getExploredCells() const
+{
+    return _exploredCells;
+}
+
+cocos2d::Vec2 FPRenderLayer::getPlayerMapPosition() const
+{
+    if( _fpsCamera == nullptr || _mapInfo == nullptr )
+    {
+        return cocos2d::Vec2::ZERO;
     }
+    // Columns run along +z and rows along -x (see GBRaycaster::tilePositionForCoord).
+    cocos2d::Vec3 position = _fpsCamera->getPosition3D();
+    return cocos2d::Vec2( position.z / _mapInfo->tileSize, _mapInfo->height - position.x / _mapInfo->tileSize );
+}
+
+cocos2d::Vec2 FPRenderLayer::getPlayerMapDirection() const
+{
+    if( _fpsCamera == nullptr )
+    {
+        return cocos2d::Vec2::ZERO;
+    }
+    // The player moves along ( sin, cos ) of the adjusted rotation in x and z (see update()).
+    float adjustedRotation = ( _fpsCamera->getRotation3D().y + _cameraRotationOffset ) * ( MATH_PI/180.0f );
+    return cocos2d::Vec2( cosf( adjustedRotation ), -sinf( adjustedRotation ) );
+}
+
+void FPRenderLayer::setPathfindingBudget( float seconds )
+{
+    _pathfindingBudget = MAX( 0.0f, seconds );
+}
+
+void FPRenderLayer::setTileMotionSpeeds( float doorSpeed, float pushwallSpeed )
+{
+    _doorSpeed = doorSpeed;
+    _pushwallSpeed = pushwallSpeed;
+}
+
+void FPRenderLayer::setInstanceCullDistance( float distance )
+{
+    _instanceCuller.setMaxDistance( distance );
+}
+
+const InstanceCullStats& FPRenderLayer::getInstanceCullStats() const
+{
+    return _instanceCuller.getStats();
+}
+
+const BatchedDrawStats& FPRenderLayer::getInstancedDrawStats() const
+{
+    return BatchedMeshCommand::getFrameStats();
+}
+
+void FPRenderLayer::setHotReloadEnabled( bool enabled )
+{
+    if( !enabled )
+    {
+        CC_SAFE_DELETE( _mapFileWatcher );
+        return;
+    }
+    if( !MapFileWatcher::isSupported() )
+    {
+        CCLOG( "FPRenderLayer::setHotReloadEnabled - file watching is not supported on this platform." );
+        return;
+    }
+    if( _mapFileWatcher == nullptr )
+    {
+        _mapFileWatcher = new MapFileWatcher();
+        watchMapFiles();
+    }
+}
+
+void FPRenderLayer::watchMapFiles()
+{
+    if( _mapFileWatcher == nullptr || _mapInfo == nullptr )
+    {
+        return;
+    }
+    
+    // Spritesheet plists live next to their images.
+    cocos2d::FileUtils* fileUtils = cocos2d::FileUtils::getInstance();
+    _mapFileWatcher->clear();
+    _mapFileWatcher->watch( _mapPath );
+    _mapSourcePath = MapInfo::getSourcePath( _mapPath );
+    if( _mapSourcePath != _mapPath && fileUtils->isFileExist( _mapSourcePath ) )
+    {
+        _mapFileWatcher->watch( _mapSourcePath );
+    }
+    for( const auto& filename : BlockManager::getTextureFilenames( *_mapInfo ) )
+    {
+        _mapFileWatcher->watch( fileUtils->fullPathForFilename( filename ) );
+    }
+}
+
+void FPRenderLayer::processMapFileChanges()
+{
+    std::vector< std::string > paths = _mapFileWatcher->poll();
+    if( paths.empty() || isLoadingMap() || _mapInfo == nullptr )
+    {
+        return;
+    }
+    
+    cocos2d::FileUtils* fileUtils = cocos2d::FileUtils::getInstance();
+    cocos2d::TextureCache* textureCache = cocos2d::Director::getInstance()->getTextureCache();
+    std::string changedMapPath;
+    bool framesChanged = false;
+    for( const auto& path : paths )
+    {
+        // An edited JSON source wins over a compiled map that changed at the same time.
+        if( path == _mapPath || path == _mapSourcePath )
+        {
+            if( changedMapPath.empty() || path == _mapSourcePath )
+            {
+                changedMapPath = path;
+            }
+            continue;
+        }
+        
+        bool isSpritesheet = false;
+        for( const auto& name : _mapInfo->spritesheets )
+        {
+            if( fileUtils->fullPathForFilename( name + ".plist" ) == path )
+            {
+                // Cached frames would be kept by the next load otherwise.
+                cocos2d::SpriteFrameCache::getInstance()->removeSpriteFramesFromFile( name + ".plist" );
+                isSpritesheet = true;
+            }
+        }
+        if( isSpritesheet )
+        {
+            framesChanged = true;
+        }
+        else if( _blockManager->reloadTexture( path, *_mapInfo ) )
+        {
+            CCLOG( "HOT RELOAD: texture %s", path.c_str() );
+        }
+        else
+        {
+            std::string resolved = CompressedTextures::resolve( path );
+            if( resolved != path && textureCache->getTextureForKey( resolved ) )
+            {
+                CCLOG( "HOT RELOAD: %s is loaded as %s, run tools/texcompiler again.", path.c_str(), resolved.c_str() );
+            }
+        }
+    }
+    
+    if( framesChanged )
+    {
+        reloadMapInPlace();
+    }
+    else if( !changedMapPath.empty() )
+    {
+        hotReloadMap( changedMapPath );
+    }
+}
+
+void FPRenderLayer::hotReloadMap( const std::string& path )
+{
+    auto start = std::chrono::steady_clock::now();
+    MapInfo* edited = new MapInfo( path.c_str() );
+    if( !edited->isLoaded() )
+    {
+        cocos2d::log( "HOT RELOAD: %s could not be loaded, keeping the current map.", path.c_str() );
+        delete edited;
+        return;
+    }
+    MapEdit edit = _mapInfo->applyEdits( *edited );
+    delete edited;
+    
+    if( !edit.requiresFullReload && _blockManager->rebuildTiles( *_mapInfo, _layer3D, edit.changedTiles ) )
+    {
+        // Instance capacities follow the placements, the behavior index the cells.
+        _raycaster->buildBehaviorIndex();
+        activateMap();
+        std::chrono::duration< float, std::milli > elapsed = std::chrono::steady_clock::now() - start;
+        CCLOG( "HOT RELOAD: %i cells and %i tiles changed in %.1f ms", edit.changedCells, (int)edit.changedTiles.size(), elapsed.count() );
+    }
+    else
+    {
+        reloadMapInPlace( path );
+        std::chrono::duration< float, std::milli > elapsed = std::chrono::steady_clock::now() - start;
+        CCLOG( "HOT RELOAD: map reloaded in %.1f ms", elapsed.count() );
+    }
+}
+
+void FPRenderLayer::reloadMapInPlace( const std::string& path )
+{
+    // Blocks are never removed from their layer, so the old ones go with it.
+    cocos2d::Layer* layer3D = cocos2d::Layer::create();
+    addChild( layer3D );
+    if( _fpsCamera )
+    {
+        _fpsCamera->removeFromParentAndCleanup( false );
+        layer3D->addChild( _fpsCamera );
+    }
+    removeChild( _layer3D );
+    _layer3D = layer3D;
+    loadMap( path.empty() ? _mapPath : path );
 }
 
 void FPRenderLayer::addFPSCamera( float fieldOfView, float nearPlane, float farPlane )
@@ -249,19 +1165,50 @@ void FPRenderLayer::addFPSCamera( float fieldOfView, float nearPlane, float farP
     if( _fpsCamera == nullptr )
     {
         cocos2d::Size winSize = cocos2d::Director::getInstance()->getWinSize();
-        Actor player = _mapInfo->actors[0];
-        _viewerHeight = player.y;
-        
-        Point3f startingPos( _raycaster->tilePositionForCoord( Point2i( player.z, player.x ) ) );
         _fpsCamera = cocos2d::Camera::createPerspective( fieldOfView, (GLfloat)winSize.width/winSize.height, nearPlane, farPlane );
-        _fpsCamera->setPosition3D( cocos2d::Vec3( startingPos.x, _viewerHeight, startingPos.y ) );
-        _fpsCamera->setRotation3D( cocos2d::Vec3( 0.0f, -_cameraRotationOffset - player.yaw, 0.0f ) );
+        placeCameraAtPlayerStart();
         _fpsCamera->setCameraFlag( cocos2d::CameraFlag::USER1 );
         _fpsCamera->retain();
         _layer3D->addChild( _fpsCamera );
     }
 }
 
+void FPRenderLayer::placeCameraAtPlayerStart()
+{
+    if( _mapInfo == nullptr )
+    {
+        return;
+    }
+    Actor player = _mapInfo->actors[0];
+    _viewerHeight = player.y;
+    
+    _fpsCamera->setPosition3D( getActorPosition( player ) );
+    _fpsCamera->setRotation3D( cocos2d::Vec3( 0.0f, -_cameraRotationOffset - player.yaw, 0.0f ) );
+    resetTriggerCells();
+}
+
+void FPRenderLayer::resetTriggerCells()
+{
+    // Where the player and actors start (or stand after a reload) is not entered by moving there.
+    if( _fpsCamera )
+    {
+        cocos2d::Vec3 position = _fpsCamera->getPosition3D();
+        _playerTriggerCell = _raycaster->getTriggerCell( Point3f( position.x, position.y, position.z ) );
+    }
+    _actorTriggerCells.resize( _actorSystem->getCount() );
+    for( int i = 0; i < _actorTriggerCells.size(); ++i )
+    {
+        cocos2d::Vec3 position = _actorSystem->getPosition( i );
+        _actorTriggerCells[i] = _raycaster->getTriggerCell( Point3f( position.x, position.y, position.z ) );
+    }
+}
+
+cocos2d::Vec3 FPRenderLayer::getActorPosition( const Actor& actor )
+{
+    Point3f cellPosition( _raycaster->tilePositionForCoord( Point2i( actor.z, actor.x ) ) );
+    return cocos2d::Vec3( cellPosition.x, actor.y, cellPosition.y );
+}
+
 cocos2d::Vec3 FPRenderLayer::calculateCameraRotation( cocos2d::Vec2 currentScreenPosition, bool invertPitch )
 {
     cocos2d::Vec3 cameraRotation = _fpsCamera->getRotation3D();
@@ -412,6 +1359,12 @@ FPRenderLayer::~FPRenderLayer()
         delete _blockManager;
     }
     _blockManager = nullptr;
+    CC_SAFE_DELETE( _pathfinder );
+    CC_SAFE_DELETE( _actorSystem );
+    CC_SAFE_DELETE( _lightMap );
+    CC_SAFE_DELETE( _lightGrid );
+    releaseVisitedPlanes();
+    CC_SAFE_DELETE( _mapFileWatcher );
 }
 
 void FPRenderLayer::setViewerHeight( float height )
@@ -12,7 +12,13 @@
 #include "cocos2d.h"
 #include "../Rendering/Raycaster/GBRaycaster.hpp"
 #include "../Rendering/BlockManager.hpp"
+#include "../Rendering/Batched/InstanceArena.hpp"
+#include "../Rendering/Batched/InstanceCuller.hpp"
+#include "../Actors/ActorSystem.hpp"
+#include "../Actors/GridPathfinder.hpp"
 #include "../Map/MapInfo.hpp"
+#include "../Map/MapFileWatcher.hpp"
+#include "../Map/ExploredCells.hpp"
 
 namespace mikedotcpp
 {
@@ -25,6 +31,12 @@ namespace mikedotcpp
      * Subclass BehaviorObject to define the functionality for onEnter and onExit triggers (functions). Additional
      * parameters can be defined as member variables to subclassed objects.
      *
+     * Triggers fire once per move from one tile into another, not while standing in a tile. onEnter and onExit
+     * are the player's: enterPosition is where the player moved to, exitPosition where it came from. onEnter
+     * runs first; when it puts the player back in the tile it came from (as HaltMove does), the move never
+     * happened and the tile left gets no onExit. The actors of the map (see ActorSystem) trigger onActorEnter and
+     * onActorExit instead, which do nothing unless overridden.
+     *
      * See the default behavior HaltMove as an example for subclassing.
      */
     class BehaviorObject
@@ -32,6 +44,8 @@ namespace mikedotcpp
     public:
         virtual void onEnter( cocos2d::Vec3 enterPosition, cocos2d::Vec3 exitPosition ) = 0;
         virtual void onExit( cocos2d::Vec3 enterPosition, cocos2d::Vec3 exitPosition ) = 0;
+        virtual void onActorEnter( int actor, cocos2d::Vec3 position ) {};
+        virtual void onActorExit( int actor, cocos2d::Vec3 position ) {};
         virtual ~BehaviorObject() = 0;
     };
     inline BehaviorObject::~BehaviorObject(){}
@@ -107,11 +121,117 @@ namespace mikedotcpp
          */
         void loadMap( const std::string& filename );
         
+        /**
+         * Loads the map in the background and swaps it in once it is ready; the current map keeps running until
+         * then. The map file is parsed on a worker thread, images are decoded with TextureCache::addImageAsync and
+         * only block creation (GL objects and nodes) runs on the main thread, a slice of at most
+         * setMapLoadTimeSlice() seconds per frame. progress receives values in [0, 1]; complete is called right
+         * after the swap. Returns FALSE if a load is already in progress.
+         */
+        bool loadMapAsync( const std::string& filename,
+                           const std::function< void( float ) >& progress=nullptr,
+                           const std::function< void() >& complete=nullptr );
+        
+        /**
+         * TRUE while loadMapAsync() has not swapped in its map yet.
+         */
+        bool isLoadingMap() const;
+        
+        /**
+         * Progress [0, 1] of the current (or last) asynchronous map load.
+         */
+        float getMapLoadProgress() const;
+        
+        /**
+         * Main-thread time (in seconds) an asynchronous map load may spend creating blocks per frame.
+         */
+        void setMapLoadTimeSlice( float seconds );
+        
+        /**
+         * Returns the raycaster of the current map. It is replaced whenever a map is loaded, so don't hold on to
+         * it across loads.
+         */
+        mikedotcpp::GBRaycaster* getRaycaster() const;
+        
+        /**
+         * Returns the actors of the current map (everything in its "actors" but Player1). Replaced whenever a map is
+         * loaded, like the raycaster.
+         */
+        mikedotcpp::ActorSystem* getActorSystem() const;
+        
+        /**
+         * Returns the pathfinder of the plane the player is on, or NULL until the map has actors and the player
+         * stands on a plane. Its flow field leads to the player; replaced whenever a map is loaded.
+         */
+        mikedotcpp::GridPathfinder* getPathfinder() const;
+        
+        /**
+         * The cells of the current map the raycaster has hit so far. Reset whenever a map is loaded.
+         */
+        const mikedotcpp::ExploredCells& getExploredCells() const;
+        
+        /**
+         * Where the player stands on the map, in cells (fractional column and row), and the direction it faces as
+         * a unit vector in cells. Zero before a map is loaded.
+         */
+        cocos2d::Vec2 getPlayerMapPosition() const;
+        cocos2d::Vec2 getPlayerMapDirection() const;
+        
+        /**
+         * Seconds per update spent on path requests and flow field rebuilds (default 0.002).
+         */
+        void setPathfindingBudget( float seconds );
+        
+        /**
+         * Tiles per second at which doors open and close and pushwalls slide (defaults 1.5 and 1).
+         */
+        void setTileMotionSpeeds( float doorSpeed, float pushwallSpeed );
+        
         /**
          * Add user-defined behaviors to the onEnter and onExit triggers.
          */
         void addBehavior( BehaviorObject* behaviorObject );
         
+        /**
+         * Called by the "event" instruction of behavior scripts (see BehaviorScript.h) with its name and where the
+         * player entered (or the cell, for onCreate). Override to add feedback such as flashes; does nothing by
+         * default.
+         */
+        virtual void onBehaviorEvent( const std::string& name, const cocos2d::Vec3& position );
+        
+        /**
+         * The player's health, lowered by the "damage" instruction of behavior scripts. Starts at 100 and stops at 0.
+         */
+        int getPlayerHealth() const;
+        void setPlayerHealth( int health );
+        
+        /**
+         * Instanced tiles further than this distance from the camera are not drawn. Zero (default) disables the
+         * cutoff; frustum culling is always on.
+         */
+        void setInstanceCullDistance( float distance );
+        
+        /**
+         * Returns how many instances were submitted and culled during the last frame (instanced rendering only).
+         */
+        const mikedotcpp::InstanceCullStats& getInstanceCullStats() const;
+        
+        /**
+         * Returns program switches, texture binds, render-state binds and draw calls of the last rendered frame
+         * (instanced rendering only).
+         */
+        const mikedotcpp::BatchedDrawStats& getInstancedDrawStats() const;
+        
+        /**
+         * Development aid (Linux only, see MapFileWatcher): watches the map file and its images while the game
+         * runs. An edited map is merged into the running one and only the tiles it changed are rebuilt; edits the
+         * blocks can't absorb (dimensions, planes, rendering settings, tile count, chunked maps) reload the whole
+         * map in place, keeping the camera where it is. Rewritten images are uploaded again into their textures.
+         * A compiled map is edited through its JSON source, which is loaded directly without recompiling. An edit
+         * that doesn't load (malformed JSON, missing values) is logged and the running map is kept.
+         */
+        void setHotReloadEnabled( bool enabled );
+    
     protected:
         /**
          * There is a difference between the camera's rotation and the raycaster's viewpoint. It needs a counter-
@@ -138,41 +258,74 @@ namespace mikedotcpp
         /**
          * Parses and stores map data to be used by BlockManager and GBRaycaster.
          */
-        mikedotcpp::MapInfo* _mapInfo;
+        mikedotcpp::MapInfo* _mapInfo = nullptr;
         
         /**
          * Performs the raycasting algorithm and provides a potentially visible set for rendering.
          */
-        mikedotcpp::GBRaycaster* _raycaster;
+        mikedotcpp::GBRaycaster* _raycaster = nullptr;
         
         /**
          * Manages pools (blocks) of sprites.
          */
-        mikedotcpp::BlockManager* _blockManager;
+        mikedotcpp::BlockManager* _blockManager = nullptr;
         
         /**
-         * Keeps count of each tile that is visible at any given moment. This is used specifically for geometry-
-         * instancing.
+         * Animates the actors of the map and draws the ones the raycaster's wall depth doesn't hide.
          */
-        std::vector< int > _tileCounter;
+        mikedotcpp::ActorSystem* _actorSystem = nullptr;
+        
+        /**
+         * Navigation for the actors, created on the first update with actors around.
+         */
+        mikedotcpp::GridPathfinder* _pathfinder = nullptr;
+        float _pathfindingBudget = 0.002f;
+        
+        /**
+         * The map's lights, baked when the map is activated. NULL for maps without lights and chunked maps.
+         */
+        mikedotcpp::LightMap* _lightMap = nullptr;
+        
+        /**
+         * The scene's point and spot lights, assigned to map cells every frame. NULL for the sprite rendering path.
+         */
+        mikedotcpp::LightGrid* _lightGrid = nullptr;
+        
+        /**
+         * Every cell a ray has hit since the map was loaded: walls and objects on the player's plane, floor on the
+         * others.
+         */
+        mikedotcpp::ExploredCells _exploredCells;
         
         /**
          * Keeps track of which plane was visited during the raycasting algorithm so as not to render the same 
-         * object more than once. Reset to 0 before running the raycast algorithm.
+         * object more than once. Allocated once per map and reset to 0 before running the raycast algorithm.
          */
         std::vector< int* > _visitedPlanes;
         
         /**
-         * A collection that stores unique positions of tile objects. Used in geometry-instanced rendering. This
-         * list is built up as a result of the raycasting algorithm and cleared before each iteration.
+         * Stores the unique positions (and therefore the counts) of visible tile objects, one region per tile.
+         * Used in geometry-instanced rendering. The arena is filled in place as a result of the raycasting
+         * algorithm and the BatchedSprite3D objects reference it by span. See InstanceArena for the lifetime rules.
+         */
+        mikedotcpp::InstanceArena _instanceArena;
+        
+        /**
+         * Merged-material rendering only: the arena region (batch) currently being filled.
+         */
+        int _mergedRegion = 0;
+        
+        /**
+         * Filters each region of the _instanceArena against the player camera before it is submitted.
          */
-        std::vector< std::vector< cocos2d::Vec3 > > _tilePositions;
+        mikedotcpp::InstanceCuller _instanceCuller;
         
         /**
          * Pulls the next availalbe block from the BlockManager and draws it in the world. For instanced rendering
-         * this code simply updates the _tileCounter and _tilePositions for the tile at tileIndex. 
+         * this code simply updates the _tileCounter and _tilePositions for the tile at tileIndex. The plane and
+         * cell pick the block's baked light.
          */
-        void drawBlock( mikedotcpp::Point3f hit, int tileIndex );
+        void drawBlock( mikedotcpp::Point3f hit, int tileIndex, uint8_t exposedFaces, int planeIndex, int cellIndex );
         
         /**
          * Keeps track of the tiles that have already been visited during the raycasting algorithm. Records a 1 for each
@@ -180,11 +333,46 @@ namespace mikedotcpp
          */
         void resetVisitedPlanes();
         
+        /**
+         * Frees the per-plane visited arrays.
+         */
+        void releaseVisitedPlanes();
+        
+        /**
+         * Sizes the per-frame buffers (visited planes, instance arena, culler) for the current map.
+         */
+        void activateMap();
+        
+        /**
+         * Points the flow field at the player and spends the pathfinding budget.
+         */
+        void updatePathfinder();
+        
+        /**
+         * Moves the player camera to the Player1 actor of the current map.
+         */
+        void placeCameraAtPlayerStart();
+        
+        /**
+         * World position of a map actor: its cell (as the player start is placed) at height actor.y.
+         */
+        cocos2d::Vec3 getActorPosition( const mikedotcpp::Actor& actor );
+        
+        /**
+         * Replaces the ActorSystem with one holding the actors of the current map.
+         */
+        void spawnMapActors();
+        
         /**
          * Returns the layer index for the height provided. 
          */
         int getPlaneIndexForHeight( float height );
         
+        /**
+         * Plane index of the camera height, looked up once per frame before the rays are cast.
+         */
+        int _cameraPlaneIndex = -1;
+        
         /**
          * Constructor/destructor
          */
@@ -209,17 +397,219 @@ namespace mikedotcpp
          */
         std::vector< BehaviorObject* > _behaviorFunctions;
         
+        /**
+         * The trigger cell (see GBRaycaster::getTriggerCell) the player and each actor were last seen in.
+         */
+        int _playerTriggerCell = -1;
+        std::vector< int > _actorTriggerCells;
+        
         /**
          * Simply appends any behavior functions to the _behaviorFunctions trigger list.
          */
         void addDefaultBehaviors();
         
         /**
-         * Maps previous and current positions to enter/exit position variables to determine what (if any)
-         * BehaviorFunctions should be called. 
+         * Moves the player camera and, when that takes it into another tile, calls the onEnter of the new tile's
+         * behavior and the onExit of the old one's.
          */
         void triggerBehaviors( const cocos2d::Vec3& previousPosition, const cocos2d::Vec3& currentPosition );
         
+        /**
+         * Calls onActorEnter and onActorExit for the actors that moved into another tile since the last call.
+         */
+        void triggerActorBehaviors();
+        
+        /**
+         * Sets the trigger cells to where the player and actors stand now, without triggering anything.
+         */
+        void resetTriggerCells();
+        
+        int _playerHealth = 100;
+        
+        /**
+         * Runs the script of a behavior for an event, or calls the BehaviorObject at its index when the map has no
+         * script for it. The player's behaviors get the positions of the move and the trigger cell of the tile.
+         */
+        void dispatchBehavior( int behavior, BehaviorEvent event, const cocos2d::Vec3& enterPosition,
+                               const cocos2d::Vec3& exitPosition, int triggerCell );
+        
+        /**
+         * The interpreter: runs the instructions of _mapInfo->behaviorProgram from entry up to the next end. Only
+         * the player's scripts (player TRUE) can halt, teleport or damage; tile instructions act on triggerCell.
+         */
+        void runBehaviorScript( int entry, const cocos2d::Vec3& enterPosition, const cocos2d::Vec3& exitPosition,
+                                int triggerCell, bool player );
+        
+        /**
+         * Runs the onCreate scripts once for every cell holding a tile of their behavior.
+         */
+        void runCreateScripts();
+        
+        /**
+         * Starts sliding the tile of a trigger cell up to cells cells along the larger axis of direction (world
+         * units); it goes on while the cells ahead are empty. The tile is lifted off its plane until it stops.
+         * Returns TRUE if it started.
+         */
+        bool pushTile( int triggerCell, const cocos2d::Vec3& direction, int cells );
+        
+        /**
+         * Writes a cell through the raycaster and keeps the pathfinder's grid in step.
+         */
+        void setCellTile( int planeIndex, int x, int y, int tileIndex );
+        
+        /**
+         * A door or pushwall on its way, drawn through the raycaster's moving tiles. Doors open (speed > 0), stay
+         * open holdTime seconds (0 for good) and close (speed < 0); pushwalls have cellsLeft cells to go after the
+         * one they are moving into.
+         */
+        struct TileMotion
+        {
+            mikedotcpp::MovingTile tile;
+            int triggerCell;
+            bool door;
+            int cellsLeft;
+            float speed;
+            float holdTime;
+            float heldTime;
+        };
+        
+        /**
+         * The tiles in motion, and doors until they are closed again. Only these are looked at every frame.
+         */
+        std::vector< TileMotion > _tileMotions;
+        float _doorSpeed = 1.5f;
+        float _pushwallSpeed = 1.0f;
+        
+        /**
+         * Starts (or keeps) opening the door tile of a plane's cell and resets the time it stays open. Returns TRUE
+         * once it is open enough to walk through.
+         */
+        bool openDoor( int planeIndex, int x, int y, int triggerCell, float holdTime );
+        
+        /**
+         * Moves the tiles in motion on by delta seconds. Doors only change their opening; pushwalls rewrite their
+         * cells as they cross them and are put back on their plane when they stop.
+         */
+        void updateTileMotions( float delta );
+        
+        /**
+         * TRUE when a pushwall could move into a plane's cell: on the map, empty and not taken by another one.
+         */
+        bool canPushInto( int planeIndex, int x, int y );
+        
+        /**
+         * Marks a cell of the pathfinder's plane walkable or not, when there is a pathfinder for planeIndex.
+         */
+        void setPathWalkable( int planeIndex, const mikedotcpp::Point2i& cell, bool walkable );
+        
+        /**
+         * TRUE while the player or an actor stands in a trigger cell.
+         */
+        bool isTriggerCellOccupied( int triggerCell ) const;
+        
+        //-----------------------------------------------------
+        //
+        // ASYNC MAP LOADING CODE
+        //
+        //-----------------------------------------------------
+    protected:
+        enum class MapLoadState
+        {
+            idle, parsing, loadingTextures, buildingBlocks
+        };
+        
+        MapLoadState _mapLoadState = MapLoadState::idle;
+        float _mapLoadProgress = 1.0f;
+        float _mapLoadTimeSlice = 0.004f;
+        std::function< void( float ) > _mapLoadProgressCallback;
+        std::function< void() > _mapLoadCompleteCallback;
+        
+        /**
+         * The map being loaded. Nothing here is visible to the rest of the layer until swapInPendingMap(); the
+         * blocks are created in their own (detached) 3D layer.
+         */
+        std::string _pendingMapPath;
+        mikedotcpp::MapInfo* _pendingMapInfo = nullptr;
+        mikedotcpp::GBRaycaster* _pendingRaycaster = nullptr;
+        mikedotcpp::BlockManager* _pendingBlockManager = nullptr;
+        cocos2d::Layer* _pendingLayer3D = nullptr;
+        
+        /**
+         * Number of images requested from, and delivered by, TextureCache::addImageAsync.
+         */
+        int _pendingTextureCount = 0;
+        int _loadedTextureCount = 0;
+        
+        /**
+         * Main thread: the worker has parsed the map; starts decoding its images.
+         */
+        void onMapParsed();
+        
+        /**
+         * Main thread: one image has been decoded and uploaded.
+         */
+        void onMapTextureLoaded( cocos2d::Texture2D* texture );
+        
+        /**
+         * Creates the detached 3D layer and the deferred BlockManager of the pending map.
+         */
+        void beginBuildingBlocks();
+        
+        /**
+         * Scheduled while building blocks: creates blocks for one time slice and swaps the map in when done.
+         */
+        void stepMapLoad( float delta );
+        
+        /**
+         * Replaces the current map with the pending one between two frames.
+         */
+        void swapInPendingMap();
+        
+        void setMapLoadProgress( float progress );
+        
+        //-----------------------------------------------------
+        //
+        // HOT RELOAD CODE
+        //
+        //-----------------------------------------------------
+    protected:
+        /**
+         * Full path of the current map file.
+         */
+        std::string _mapPath;
+        
+        /**
+         * Hot reload: the JSON a compiled _mapPath is built from (see MapInfo::getSourcePath). Edits to it are loaded
+         * directly, so the map doesn't have to be recompiled to see them.
+         */
+        std::string _mapSourcePath;
+        
+        /**
+         * NULL unless setHotReloadEnabled( true ).
+         */
+        mikedotcpp::MapFileWatcher* _mapFileWatcher = nullptr;
+        
+        /**
+         * Points the watcher at the directories of the map file and of its images.
+         */
+        void watchMapFiles();
+        
+        /**
+         * Called from update(): applies the files the watcher reports as changed.
+         */
+        void processMapFileChanges();
+        
+        /**
+         * Merges the edited map file at path into the running map, rebuilding only what changed. A file that fails
+         * to load is logged and the current map is kept.
+         */
+        void hotReloadMap( const std::string& path );
+        
+        /**
+         * Loads the map at path (the current one by default) into a fresh 3D layer; the camera keeps its position.
+         */
+        void reloadMapInPlace( const std::string& path="" );
+        
         //-----------------------------------------------------
         //
         // PLAYER CONTROL CODE
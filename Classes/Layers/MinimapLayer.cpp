@@ -0,0 +1,316 @@
+//
+//  MinimapLayer.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "MinimapLayer.hpp"
+
+/**
+ * Pixels of the corner view's margin, and of the player marker at its smallest.
+ */
+#define MINIMAP_MARGIN 10.0f
+#define MINIMAP_MARKER_SIZE 6.0f
+
+/**
+ * Screen points dragged per doubling of the full-screen zoom (iOS), and wheel steps per doubling (Mac).
+ */
+#define MINIMAP_DRAG_PER_ZOOM 200.0f
+#define MINIMAP_SCROLL_PER_ZOOM 4.0f
+
+using namespace mikedotcpp;
+
+/**
+ * Texel colors, in ExploredKind order.
+ */
+static const cocos2d::Color4B EXPLORED_COLORS[] =
+{
+    cocos2d::Color4B( 0, 0, 0, 0 ),
+    cocos2d::Color4B( 48, 48, 48, 255 ),
+    cocos2d::Color4B( 208, 176, 48, 255 ),
+    cocos2d::Color4B( 112, 136, 200, 255 )
+};
+
+MinimapLayer::MinimapLayer()
+{
+}
+
+MinimapLayer::~MinimapLayer()
+{
+    CC_SAFE_RELEASE( _texture );
+}
+
+bool MinimapLayer::init()
+{
+    bool result = cocos2d::Layer::init();
+    
+    _clipNode = cocos2d::ClippingRectangleNode::create();
+    addChild( _clipNode );
+    _background = cocos2d::DrawNode::create();
+    _clipNode->addChild( _background );
+    _mapSprite = cocos2d::Sprite::create();
+    _mapSprite->setAnchorPoint( cocos2d::Vec2::ZERO );
+    _clipNode->addChild( _mapSprite );
+    _playerMarker = cocos2d::DrawNode::create();
+    _clipNode->addChild( _playerMarker );
+    setVisible( false );
+    
+    setupControls();
+    scheduleUpdate();
+    
+    return result;
+}
+
+void MinimapLayer::setRenderLayer( FPRenderLayer* renderLayer )
+{
+    _renderLayer = renderLayer;
+}
+
+void MinimapLayer::setFullScreen( bool fullScreen )
+{
+    _fullScreen = fullScreen;
+}
+
+bool MinimapLayer::isFullScreen() const
+{
+    return _fullScreen;
+}
+
+void MinimapLayer::setZoom( float zoom )
+{
+    _zoom = cocos2d::clampf( zoom, MINIMAP_MIN_ZOOM, MINIMAP_MAX_ZOOM );
+}
+
+void MinimapLayer::update( float delta )
+{
+    if( _renderLayer == nullptr )
+    {
+        return;
+    }
+    
+    const ExploredCells& exploredCells = _renderLayer->getExploredCells();
+    if( exploredCells.getGeneration() != _generation )
+    {
+        rebuildTexture( exploredCells );
+    }
+    else
+    {
+        uploadNewCells( exploredCells );
+    }
+    
+    setVisible( _texture != nullptr );
+    if( _texture )
+    {
+        layoutView();
+    }
+}
+
+void MinimapLayer::rebuildTexture( const ExploredCells& exploredCells )
+{
+    _generation = exploredCells.getGeneration();
+    _logPosition = exploredCells.getLog().size();
+    _width = exploredCells.getWidth();
+    _height = exploredCells.getHeight();
+    CC_SAFE_RELEASE_NULL( _texture );
+    
+    int maxSize = cocos2d::Configuration::getInstance()->getMaxTextureSize();
+    if( _width <= 0 || _height <= 0 || _width > maxSize || _height > maxSize )
+    {
+        return;
+    }
+    
+    // Texel rows follow the map rows, so row 0 is at the top of the sprite like in the map files.
+    _pixels.resize( (size_t)_width * _height * 4 );
+    for( int cell = 0; cell < _width * _height; ++cell )
+    {
+        const cocos2d::Color4B& color = EXPLORED_COLORS[ exploredCells.getKind( cell ) ];
+        uint8_t* texel = &_pixels[ (size_t)cell * 4 ];
+        texel[0] = color.r;
+        texel[1] = color.g;
+        texel[2] = color.b;
+        texel[3] = color.a;
+    }
+    _texture = new (std::nothrow) cocos2d::Texture2D();
+    _texture->initWithData( &_pixels[0], _pixels.size(), cocos2d::Texture2D::PixelFormat::RGBA8888, _width, _height,
+                            cocos2d::Size( _width, _height ) );
+    cocos2d::Texture2D::TexParams params = { GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE };
+    _texture->setTexParameters( params );
+    _mapSprite->setTexture( _texture );
+    _mapSprite->setTextureRect( cocos2d::Rect( 0.0f, 0.0f, _width, _height ) );
+}
+
+void MinimapLayer::uploadNewCells( const ExploredCells& exploredCells )
+{
+    const std::vector< int >& log = exploredCells.getLog();
+    if( _texture == nullptr || _logPosition >= log.size() )
+    {
+        _logPosition = log.size();
+        return;
+    }
+    
+    int minX = _width;
+    int minY = _height;
+    int maxX = -1;
+    int maxY = -1;
+    _newCells.assign( log.begin() + _logPosition, log.end() );
+    _logPosition = log.size();
+    for( int cell : _newCells )
+    {
+        const cocos2d::Color4B& color = EXPLORED_COLORS[ exploredCells.getKind( cell ) ];
+        uint8_t* texel = &_pixels[ (size_t)cell * 4 ];
+        texel[0] = color.r;
+        texel[1] = color.g;
+        texel[2] = color.b;
+        texel[3] = color.a;
+        
+        int x = cell % _width;
+        int y = cell / _width;
+        minX = std::min( minX, x );
+        maxX = std::max( maxX, x );
+        minY = std::min( minY, y );
+        maxY = std::max( maxY, y );
+    }
+    
+    size_t area = (size_t)( maxX - minX + 1 ) * ( maxY - minY + 1 );
+    if( area <= _newCells.size() * MINIMAP_DIRTY_RECT_SLACK )
+    {
+        uploadRect( minX, minY, maxX - minX + 1, maxY - minY + 1 );
+        return;
+    }
+    
+    // Cells far apart (a long corridor coming into view): one span per row, bridging small gaps.
+    std::sort( _newCells.begin(), _newCells.end() );
+    size_t start = 0;
+    for( size_t i = 1; i <= _newCells.size(); ++i )
+    {
+        bool sameSpan = i < _newCells.size() && _newCells[i] / _width == _newCells[start] / _width &&
+                        _newCells[i] - _newCells[ i - 1 ] <= MINIMAP_DIRTY_RECT_SLACK;
+        if( !sameSpan )
+        {
+            int first = _newCells[start];
+            uploadRect( first % _width, first / _width, _newCells[ i - 1 ] - first + 1, 1 );
+            start = i;
+        }
+    }
+}
+
+void MinimapLayer::uploadRect( int x, int y, int width, int height )
+{
+    size_t rowSize = (size_t)width * 4;
+    _uploadBuffer.resize( rowSize * height );
+    for( int row = 0; row < height; ++row )
+    {
+        const uint8_t* source = &_pixels[ ( (size_t)( y + row ) * _width + x ) * 4 ];
+        std::copy( source, source + rowSize, &_uploadBuffer[ row * rowSize ] );
+    }
+    _texture->updateWithData( &_uploadBuffer[0], x, y, width, height );
+}
+
+void MinimapLayer::layoutView()
+{
+    cocos2d::Size winSize = cocos2d::Director::getInstance()->getWinSize();
+    cocos2d::Rect region = _fullScreen ? cocos2d::Rect( 0.0f, 0.0f, winSize.width, winSize.height ) : getCornerRect();
+    cocos2d::Vec2 center( region.getMidX(), region.getMidY() );
+    
+    // Sprite points are cells with the rows flipped: row 0 is at the top.
+    cocos2d::Vec2 playerCell = _renderLayer->getPlayerMapPosition();
+    cocos2d::Vec2 player( playerCell.x, _height - playerCell.y );
+    float cellSize = region.size.width / MINIMAP_CORNER_CELLS;
+    cocos2d::Vec2 focus = player;
+    if( _fullScreen )
+    {
+        // The whole map at zoom 1, the player's surroundings beyond.
+        cellSize = std::min( region.size.width / _width, region.size.height / _height ) * _zoom;
+        focus = ( _zoom > MINIMAP_MIN_ZOOM ) ? player : cocos2d::Vec2( _width * 0.5f, _height * 0.5f );
+    }
+    cocos2d::Vec2 origin = center - focus * cellSize;
+    _mapSprite->setScale( cellSize );
+    _mapSprite->setPosition( origin );
+    _clipNode->setClippingRegion( region );
+    
+    _background->clear();
+    _background->drawSolidRect( region.origin, region.origin + cocos2d::Vec2( region.size.width, region.size.height ),
+                                cocos2d::Color4F( 0.0f, 0.0f, 0.0f, _fullScreen ? 0.85f : 0.5f ) );
+    
+    // Screen up is map row -1.
+    cocos2d::Vec2 direction = _renderLayer->getPlayerMapDirection();
+    cocos2d::Vec2 forward( direction.x, -direction.y );
+    cocos2d::Vec2 side( -forward.y, forward.x );
+    float markerSize = std::max( cellSize * 0.6f, MINIMAP_MARKER_SIZE );
+    cocos2d::Vec2 tip = origin + player * cellSize + forward * markerSize;
+    cocos2d::Vec2 base = tip - forward * markerSize * 1.6f;
+    _playerMarker->clear();
+    _playerMarker->drawTriangle( tip, base + side * markerSize * 0.6f, base - side * markerSize * 0.6f, cocos2d::Color4F::RED );
+}
+
+cocos2d::Rect MinimapLayer::getCornerRect() const
+{
+    cocos2d::Size winSize = cocos2d::Director::getInstance()->getWinSize();
+    float size = winSize.height * MINIMAP_CORNER_SIZE;
+    return cocos2d::Rect( winSize.width - size - MINIMAP_MARGIN, winSize.height - size - MINIMAP_MARGIN, size, size );
+}
+
+void MinimapLayer::setupControls()
+{
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_WIN32) || (CC_TARGET_PLATFORM == CC_PLATFORM_MAC) || (CC_TARGET_PLATFORM == CC_PLATFORM_LINUX)
+    setKeyboardEnabled( true );
+    cocos2d::EventListenerMouse* mouseListener = cocos2d::EventListenerMouse::create();
+    mouseListener->onMouseScroll = CC_CALLBACK_1( MinimapLayer::onMouseScroll, this );
+    _eventDispatcher->addEventListenerWithSceneGraphPriority( mouseListener, this );
+#else
+    // Touches on the map are not passed on to the player controls.
+    cocos2d::EventListenerTouchOneByOne* listener = cocos2d::EventListenerTouchOneByOne::create();
+    listener->setSwallowTouches( true );
+    listener->onTouchBegan = CC_CALLBACK_2( MinimapLayer::onTouchBegan, this );
+    listener->onTouchMoved = CC_CALLBACK_2( MinimapLayer::onTouchMoved, this );
+    listener->onTouchEnded = CC_CALLBACK_2( MinimapLayer::onTouchEnded, this );
+    _eventDispatcher->addEventListenerWithSceneGraphPriority( listener, this );
+#endif
+}
+
+void MinimapLayer::onKeyPressed( cocos2d::EventKeyboard::KeyCode keyCode, cocos2d::Event* event )
+{
+    if( keyCode == cocos2d::EventKeyboard::KeyCode::KEY_M )
+    {
+        setFullScreen( !_fullScreen );
+    }
+}
+
+void MinimapLayer::onMouseScroll( cocos2d::Event* event )
+{
+    if( _fullScreen )
+    {
+        cocos2d::EventMouse* mouseEvent = static_cast< cocos2d::EventMouse* >( event );
+        setZoom( _zoom * powf( 2.0f, -mouseEvent->getScrollY() / MINIMAP_SCROLL_PER_ZOOM ) );
+    }
+}
+
+bool MinimapLayer::onTouchBegan( cocos2d::Touch* touch, cocos2d::Event* event )
+{
+    if( !isVisible() || ( !_fullScreen && !getCornerRect().containsPoint( touch->getLocation() ) ) )
+    {
+        return false;
+    }
+    _touchStart = touch->getLocation();
+    return true;
+}
+
+void MinimapLayer::onTouchMoved( cocos2d::Touch* touch, cocos2d::Event* event )
+{
+    if( _fullScreen )
+    {
+        float dragged = touch->getLocation().y - touch->getPreviousLocation().y;
+        setZoom( _zoom * powf( 2.0f, dragged / MINIMAP_DRAG_PER_ZOOM ) );
+    }
+}
+
+void MinimapLayer::onTouchEnded( cocos2d::Touch* touch, cocos2d::Event* event )
+{
+    // A tap, not a zoom.
+    if( touch->getLocation().distance( _touchStart ) < MINIMAP_MARGIN )
+    {
+        setFullScreen( !_fullScreen );
+    }
+}
@@ -0,0 +1,133 @@
+//
+//  MinimapLayer.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef MinimapLayer_hpp
+#define MinimapLayer_hpp
+
+#include "cocos2d.h"
+#include "FPRenderLayer.hpp"
+
+/**
+ * Cells across the corner view, and its size as a fraction of the window height.
+ */
+#define MINIMAP_CORNER_CELLS 24
+#define MINIMAP_CORNER_SIZE 0.3f
+
+/**
+ * Zoom range of the full-screen view; 1 fits the whole map.
+ */
+#define MINIMAP_MIN_ZOOM 1.0f
+#define MINIMAP_MAX_ZOOM 8.0f
+
+/**
+ * New cells are uploaded as their bounding rectangle while it is at most this many times their number, and row by
+ * row otherwise.
+ */
+#define MINIMAP_DIRTY_RECT_SLACK 4
+
+namespace mikedotcpp
+{
+    /**
+     * The automap: the explored cells of the map (see FPRenderLayer::getExploredCells) in one texture with a texel
+     * per cell, drawn either in a corner, following the player, or full screen.
+     *
+     * The texture is filled once per map and then only written where the exploration log grew, with
+     * glTexSubImage2D over the rectangle (or row spans) of the new cells, so a frame costs in proportion to what
+     * was just explored rather than to the map.
+     *
+     * Controls: M toggles the full-screen view and the mouse wheel zooms it (Mac); touching the corner view
+     * toggles it, and dragging up or down zooms (iOS).
+     */
+    class MinimapLayer : public cocos2d::Layer
+    {
+    public:
+        CREATE_FUNC( MinimapLayer );
+        
+        virtual bool init() override;
+        
+        /**
+         * Uploads the newly explored cells and places the map and player marker.
+         */
+        virtual void update( float delta ) override;
+        
+        /**
+         * The layer whose raycaster explores the map. Not retained; it must outlive this layer.
+         */
+        void setRenderLayer( FPRenderLayer* renderLayer );
+        
+        void setFullScreen( bool fullScreen );
+        bool isFullScreen() const;
+        
+        /**
+         * Zoom of the full-screen view, clamped to [MINIMAP_MIN_ZOOM, MINIMAP_MAX_ZOOM].
+         */
+        void setZoom( float zoom );
+    
+    protected:
+        FPRenderLayer* _renderLayer = nullptr;
+        
+        /**
+         * The generation of the explored cells the texture holds, and how much of their log it has uploaded.
+         */
+        unsigned int _generation = 0;
+        size_t _logPosition = 0;
+        
+        int _width = 0;
+        int _height = 0;
+        
+        /**
+         * RGBA texel of every cell, as uploaded, and room to gather a rectangle of them for glTexSubImage2D.
+         */
+        std::vector< uint8_t > _pixels;
+        std::vector< uint8_t > _uploadBuffer;
+        std::vector< int > _newCells;
+        
+        cocos2d::Texture2D* _texture = nullptr;
+        cocos2d::ClippingRectangleNode* _clipNode = nullptr;
+        cocos2d::DrawNode* _background = nullptr;
+        cocos2d::Sprite* _mapSprite = nullptr;
+        cocos2d::DrawNode* _playerMarker = nullptr;
+        
+        bool _fullScreen = false;
+        float _zoom = MINIMAP_MIN_ZOOM;
+        cocos2d::Vec2 _touchStart;
+        
+        /**
+         * Recreates the texture from every explored cell, after a map was loaded.
+         */
+        void rebuildTexture( const ExploredCells& exploredCells );
+        
+        /**
+         * Writes the cells the exploration log gained since the last call.
+         */
+        void uploadNewCells( const ExploredCells& exploredCells );
+        void uploadRect( int x, int y, int width, int height );
+        
+        /**
+         * Scales and positions the map for the current view, centered on the player.
+         */
+        void layoutView();
+        
+        /**
+         * Screen rectangle of the corner view.
+         */
+        cocos2d::Rect getCornerRect() const;
+        
+        void setupControls();
+        virtual void onKeyPressed( cocos2d::EventKeyboard::KeyCode keyCode, cocos2d::Event* event ) override;
+        void onMouseScroll( cocos2d::Event* event );
+        virtual bool onTouchBegan( cocos2d::Touch* touch, cocos2d::Event* event ) override;
+        virtual void onTouchMoved( cocos2d::Touch* touch, cocos2d::Event* event ) override;
+        virtual void onTouchEnded( cocos2d::Touch* touch, cocos2d::Event* event ) override;
+        
+        MinimapLayer();
+        ~MinimapLayer();
+    };
+}
+
+#endif /* MinimapLayer_hpp */
@@ -0,0 +1,234 @@
+//
+//  BehaviorScript.h
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef BehaviorScript_h
+#define BehaviorScript_h
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/**
+ * The scripts of a map's behaviors (the onEnter, onExit and onCreate strings of MapInfo::behaviors) and their
+ * compiler. A script is a list of instructions separated by ';', each a name followed by its arguments:
+ *
+ *     halt                 puts the player back where it came from (walls)
+ *     remove               removes the tile that triggered the script (pickups)
+ *     door [seconds]       slides open the door tile that triggered the script (MAP_TILE_FLAG_DOOR tiles; any
+ *                          other tile is removed) and holds the player back until it is open. The door closes
+ *                          again after seconds, once nobody stands in it; without seconds it stays open
+ *     pushwall [cells]     slides the tile that triggered the script away from the player, 2 cells by default,
+ *                          stopping early at the first cell that is not empty
+ *     teleport <x> <z>     moves the player to a map cell, given like the x and z of an actor
+ *     damage <amount>      takes amount from the player's health (damage floors)
+ *     sound <file>         plays a sound effect
+ *     event <name>         calls FPRenderLayer::onBehaviorEvent, for feedback the game implements itself
+ *
+ * for example "remove; sound sounds/dsitemup.wav; event pickup". Maps compile every script once, at load, into
+ * one flat BehaviorInstruction array that FPRenderLayer interprets.
+ *
+ * A script made of a single word that is not an instruction (such as "haltMove") names a C++ behavior instead:
+ * it compiles to nothing and the trigger goes to the BehaviorObject registered at the behavior's index.
+ *
+ * This header is shared with the compiler tool, so it must not depend on cocos2d.
+ */
+namespace mikedotcpp
+{
+    enum class BehaviorOp : uint8_t
+    {
+        end, halt, remove, door, pushwall, teleport, damage, sound, event
+    };
+
+    /**
+     * The scripts of a behavior, in MapBinaryBehavior / Behavior field order.
+     */
+    enum BehaviorEvent
+    {
+        BEHAVIOR_EVENT_ENTER,
+        BEHAVIOR_EVENT_EXIT,
+        BEHAVIOR_EVENT_CREATE,
+        BEHAVIOR_EVENT_COUNT
+    };
+
+    /**
+     * One instruction; the meaning of the arguments depends on op (string arguments index BehaviorProgram::strings).
+     */
+    struct BehaviorInstruction
+    {
+        BehaviorOp op;
+        int32_t a;
+        int32_t b;
+    };
+
+    struct BehaviorProgram
+    {
+        /**
+         * The instructions of every script, each script ending with BehaviorOp::end.
+         */
+        std::vector< BehaviorInstruction > code;
+        std::vector< std::string > strings;
+
+        /**
+         * BEHAVIOR_EVENT_COUNT entries per behavior: where its script starts in code, -1 when it has none (empty,
+         * a C++ behavior name or a script that failed to compile).
+         */
+        std::vector< int32_t > entries;
+
+        inline int32_t getEntry( int behavior, BehaviorEvent event ) const
+        {
+            int index = behavior * BEHAVIOR_EVENT_COUNT + event;
+            return ( behavior >= 0 && index < (int)entries.size() ) ? entries[index] : -1;
+        }
+    };
+
+    /**
+     * Instruction names and argument counts, in BehaviorOp order. Arguments past the required ones are optional.
+     */
+    struct BehaviorOpInfo
+    {
+        const char* name;
+        int requiredArguments;
+        int maxArguments;
+        bool stringArgument;
+    };
+
+    static const BehaviorOpInfo BEHAVIOR_OPS[] =
+    {
+        { "", 0, 0, false },
+        { "halt", 0, 0, false },
+        { "remove", 0, 0, false },
+        { "door", 0, 1, false },
+        { "pushwall", 0, 1, false },
+        { "teleport", 2, 2, false },
+        { "damage", 1, 1, false },
+        { "sound", 1, 1, true },
+        { "event", 1, 1, true }
+    };
+
+    /**
+     * Splits a script into its instructions, each a list of whitespace separated words.
+     */
+    inline std::vector< std::vector< std::string > > splitBehaviorScript( const std::string& source )
+    {
+        std::vector< std::vector< std::string > > statements( 1 );
+        std::string word;
+        for( size_t i = 0; i <= source.size(); ++i )
+        {
+            char c = ( i < source.size() ) ? source[i] : ';';
+            if( c == ';' || isspace( (unsigned char)c ) )
+            {
+                if( !word.empty() )
+                {
+                    statements.back().push_back( word );
+                    word.clear();
+                }
+                if( c == ';' && !statements.back().empty() )
+                {
+                    statements.push_back( std::vector< std::string >() );
+                }
+            }
+            else
+            {
+                word += c;
+            }
+        }
+        if( statements.back().empty() )
+        {
+            statements.pop_back();
+        }
+        return statements;
+    }
+
+    inline int findBehaviorOp( const std::string& name )
+    {
+        for( int op = 1; op < (int)( sizeof( BEHAVIOR_OPS ) / sizeof( BEHAVIOR_OPS[0] ) ); ++op )
+        {
+            if( name == BEHAVIOR_OPS[op].name )
+            {
+                return op;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Compiles one script onto the end of program.code. entry receives where it starts, or -1 when it compiles to
+     * nothing (empty or a C++ behavior name). Returns FALSE with error set (and program unchanged) when the
+     * script is malformed.
+     */
+    inline bool compileBehaviorScript( const std::string& source, BehaviorProgram& program, int32_t& entry, std::string& error )
+    {
+        entry = -1;
+        std::vector< std::vector< std::string > > statements = splitBehaviorScript( source );
+        if( statements.empty() || ( statements.size() == 1 && statements[0].size() == 1 && findBehaviorOp( statements[0][0] ) < 0 ) )
+        {
+            return true;
+        }
+
+        size_t codeSize = program.code.size();
+        size_t stringCount = program.strings.size();
+        for( const auto& words : statements )
+        {
+            int op = findBehaviorOp( words[0] );
+            const BehaviorOpInfo* info = ( op >= 0 ) ? &BEHAVIOR_OPS[op] : nullptr;
+            int argumentCount = (int)words.size() - 1;
+            if( info == nullptr )
+            {
+                error = "unknown instruction \"" + words[0] + "\"";
+            }
+            else if( argumentCount < info->requiredArguments || argumentCount > info->maxArguments )
+            {
+                error = words[0] + " takes " + std::to_string( info->requiredArguments ) +
+                        ( info->maxArguments > info->requiredArguments ? " to " + std::to_string( info->maxArguments ) : "" ) +
+                        " argument(s), not " + std::to_string( argumentCount );
+            }
+
+            BehaviorInstruction instruction = { (BehaviorOp)( op >= 0 ? op : 0 ), 0, 0 };
+            int32_t* arguments[] = { &instruction.a, &instruction.b };
+            for( int i = 0; error.empty() && i < argumentCount; ++i )
+            {
+                const std::string& word = words[ i + 1 ];
+                if( info->stringArgument )
+                {
+                    *arguments[i] = (int32_t)program.strings.size();
+                    program.strings.push_back( word );
+                    continue;
+                }
+                char* parsed = nullptr;
+                long value = strtol( word.c_str(), &parsed, 10 );
+                if( *parsed != '\0' )
+                {
+                    error = words[0] + ": \"" + word + "\" is not an integer";
+                }
+                *arguments[i] = (int32_t)value;
+            }
+            if( !error.empty() )
+            {
+                program.code.resize( codeSize );
+                program.strings.resize( stringCount );
+                return false;
+            }
+
+            // Defaults of the optional arguments.
+            if( instruction.op == BehaviorOp::pushwall && argumentCount == 0 )
+            {
+                instruction.a = 2;
+            }
+            program.code.push_back( instruction );
+        }
+
+        BehaviorInstruction end = { BehaviorOp::end, 0, 0 };
+        program.code.push_back( end );
+        entry = (int32_t)codeSize;
+        return true;
+    }
+}
+
+#endif /* BehaviorScript_h */
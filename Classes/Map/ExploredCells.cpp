@@ -0,0 +1,20 @@
+//
+//  ExploredCells.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "ExploredCells.hpp"
+
+using namespace mikedotcpp;
+
+void ExploredCells::reset( int width, int height )
+{
+    _width = width;
+    _height = height;
+    _kinds.assign( (size_t)width * height, EXPLORED_NONE );
+    _log.clear();
+    ++_generation;
+}
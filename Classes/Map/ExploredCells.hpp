@@ -0,0 +1,94 @@
+//
+//  ExploredCells.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef ExploredCells_hpp
+#define ExploredCells_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mikedotcpp
+{
+    /**
+     * What the player has seen of a cell, in increasing order: a cell seen as floor that turns out to hold a wall
+     * is raised to EXPLORED_WALL, never lowered.
+     */
+    enum ExploredKind : uint8_t
+    {
+        EXPLORED_NONE,
+        EXPLORED_FLOOR,
+        EXPLORED_OBJECT,
+        EXPLORED_WALL
+    };
+    
+    /**
+     * The cells of a map the raycaster has hit since the map was loaded, for the automap. Every change is also
+     * appended to a log, so a reader that remembers how far it got only visits the cells explored since.
+     */
+    class ExploredCells
+    {
+    public:
+        /**
+         * Forgets everything explored and starts a new log for a map of width * height cells.
+         */
+        void reset( int width, int height );
+        
+        /**
+         * Raises the kind of a cell (cell = y * width + x), logging it when that changes anything.
+         */
+        inline void mark( int cell, ExploredKind kind )
+        {
+            if( kind > _kinds[cell] )
+            {
+                _kinds[cell] = kind;
+                _log.push_back( cell );
+            }
+        }
+        
+        inline int getWidth() const
+        {
+            return _width;
+        }
+        
+        inline int getHeight() const
+        {
+            return _height;
+        }
+        
+        inline ExploredKind getKind( int cell ) const
+        {
+            return (ExploredKind)_kinds[cell];
+        }
+        
+        /**
+         * The cells in the order they were explored or raised. A cell raised twice is listed twice.
+         */
+        inline const std::vector< int >& getLog() const
+        {
+            return _log;
+        }
+        
+        /**
+         * Incremented by every reset(), so readers of the log know to start over.
+         */
+        inline unsigned int getGeneration() const
+        {
+            return _generation;
+        }
+    
+    protected:
+        int _width = 0;
+        int _height = 0;
+        unsigned int _generation = 0;
+        std::vector< uint8_t > _kinds;
+        std::vector< int > _log;
+    };
+}
+
+#endif /* ExploredCells_hpp */
@@ -0,0 +1,296 @@
+//
+//  MapBinaryFormat.h
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef MapBinaryFormat_h
+#define MapBinaryFormat_h
+
+#include <stdint.h>
+
+/**
+ * Compiled map format (".cwm"). Produced from the JSON map definition by tools/mapcompiler and loaded by MapInfo
+ * without any per-element parsing: the plane arrays are used in place.
+ *
+ * Layout (all offsets are from the start of the file, all values little-endian):
+ *
+ *     MapBinaryHeader
+ *     string table      NUL-terminated strings; offset 0 is always the empty string
+ *     uint32_t[]        spritesheet names (string offsets)
+ *     MapBinaryTile[]
+ *     MapBinaryActor[]
+ *     MapBinaryBehavior[]
+ *     MapBinaryTrigger[]
+ *     MapBinaryLight[]
+ *     MapBinaryPlane[]
+ *     MapBinaryPlaneLevel[]
+ *     uint16_t[]        plane indices sorted by height (see MapBinaryPlaneLevel)
+ *     uint8_t[]         one width * height array of MAP_CELL_* flags per plane
+ *     uint16_t[]        one width * height array per plane, each aligned to MAP_BINARY_ALIGNMENT
+ *
+ * Chunked maps (MAP_BINARY_FLAG_CHUNKED, used for large maps that are streamed, see MapChunkStreamer) store the
+ * planes chunk by chunk instead, so each chunk is one contiguous read:
+ *
+ *     MapBinaryPlane[]     mapOffset is 0
+ *     MapBinaryPlaneLevel[], plane indices   as above; there are no cell flags (cellFlagsOffset is 0)
+ *     MapBinaryChunk[]     planeCount * chunksWide * chunksHigh records, plane-major then row-major
+ *     MapBinaryTileUsage[] the tile usage lists of all chunks
+ *     uint16_t[]           chunkSize * chunkSize tile indices per chunk; edge chunks are padded with 0 (void)
+ *
+ * Everything the runtime would otherwise derive from the tiles and planes at every start (tile instance counts,
+ * tile and cell flags, the plane height index) is computed once by the compiler, see MapPrecompute.h.
+ *
+ * This header is shared with the compiler tool, so it must not depend on cocos2d.
+ */
+#define MAP_BINARY_MAGIC "CWM1"
+#define MAP_BINARY_VERSION 5
+#define MAP_BINARY_EXTENSION ".cwm"
+#define MAP_BINARY_ALIGNMENT 4
+
+#define MAP_BINARY_FLAG_REALTIME_LIGHTING 0x1
+#define MAP_BINARY_FLAG_MERGED_MATERIAL   0x2
+#define MAP_BINARY_FLAG_CHUNKED           0x4
+#define MAP_BINARY_FLAG_GENERATE_MIPMAPS  0x8
+
+/**
+ * Chunk edge (in cells) written by the compiler. Maps with more cells than MAP_BINARY_CHUNKED_MIN_CELLS are
+ * chunked by default.
+ */
+#define MAP_BINARY_CHUNK_SIZE 32
+#define MAP_BINARY_CHUNKED_MIN_CELLS ( 256 * 256 )
+
+/**
+ * MapBinaryTile::flags bits. SOLID tiles are opaque cubes (every side textured, no billboard or model) that hide
+ * the faces of their neighbours; BLOCKING tiles are tagged with MAP_BLOCKING_TAG. DOOR tiles are a single center
+ * span and nothing else: the raycaster treats them as a thin plane through the middle of the cell, lying along the
+ * map row (NS) or column (EW), that can slide open.
+ */
+#define MAP_TILE_FLAG_SOLID    0x1
+#define MAP_TILE_FLAG_BLOCKING 0x2
+#define MAP_TILE_FLAG_DOOR_NS  0x4
+#define MAP_TILE_FLAG_DOOR_EW  0x8
+#define MAP_TILE_FLAG_DOOR     ( MAP_TILE_FLAG_DOOR_NS | MAP_TILE_FLAG_DOOR_EW )
+
+/**
+ * Behavior index of the default HaltMove behavior (see FPRenderLayer::addDefaultBehaviors).
+ */
+#define MAP_BLOCKING_TAG 0
+
+/**
+ * Cell flags, one byte per cell of every plane. The low six bits are the faces of the cell's block that are not
+ * covered by a solid neighbour, one bit per FaceDirection (north, south, east, west, top, bottom). WALKABLE cells
+ * are empty or hold a tile that is neither solid nor blocking.
+ */
+#define MAP_CELL_EXPOSED_MASK 0x3F
+#define MAP_CELL_SOLID        0x40
+#define MAP_CELL_WALKABLE     0x80
+
+namespace mikedotcpp
+{
+    /**
+     * String fields of a Tile, in the order they are stored in MapBinaryTile::strings.
+     */
+    enum MapBinaryTileString
+    {
+        TILE_TEXTURE_NORTH = 0,
+        TILE_TEXTURE_EAST,
+        TILE_TEXTURE_SOUTH,
+        TILE_TEXTURE_WEST,
+        TILE_TEXTURE_FLOOR,
+        TILE_TEXTURE_CEILING,
+        TILE_TEXTURE_ALL,
+        TILE_TEXTURE_CENTER_SPAN_NS,
+        TILE_TEXTURE_CENTER_SPAN_EW,
+        TILE_NORMAL_NORTH,
+        TILE_NORMAL_EAST,
+        TILE_NORMAL_SOUTH,
+        TILE_NORMAL_WEST,
+        TILE_NORMAL_FLOOR,
+        TILE_NORMAL_CEILING,
+        TILE_NORMAL_ALL,
+        TILE_BILLBOARD_TEXTURE,
+        TILE_VERTEX_SHADER,
+        TILE_FRAGMENT_SHADER,
+        TILE_MODEL,
+        TILE_TEXTURE_WRAP_MODE,
+        TILE_TEXTURE_MIN_FILTER,
+        TILE_TEXTURE_MAG_FILTER,
+        TILE_STRING_COUNT
+    };
+
+    /**
+     * JSON keys of the Tile string fields, indexed by MapBinaryTileString.
+     */
+    static const char* const MAP_BINARY_TILE_KEYS[TILE_STRING_COUNT] =
+    {
+        "textureNorth", "textureEast", "textureSouth", "textureWest", "textureFloor", "textureCeiling",
+        "textureAll", "textureCenterSpanNS", "textureCenterSpanEW",
+        "normalNorth", "normalEast", "normalSouth", "normalWest", "normalFloor", "normalCeiling", "normalAll",
+        "billboardTexture", "vertexShader", "fragmentShader", "model",
+        "textureWrapMode", "textureMinFilter", "textureMagFilter"
+    };
+
+    struct MapBinaryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t fileSize;
+
+        /**
+         * MAP_BINARY_FLAG_* bits.
+         */
+        uint32_t flags;
+
+        int32_t tileSize;
+        int32_t width;
+        int32_t height;
+
+        /**
+         * String table offsets.
+         */
+        uint32_t path;
+        uint32_t name;
+        uint32_t mapVersion;
+        uint32_t diffuseAtlas;
+        uint32_t normalAtlas;
+
+        uint32_t stringTableOffset;
+        uint32_t stringTableSize;
+
+        uint32_t spritesheetCount;
+        uint32_t spritesheetOffset;
+        uint32_t tileCount;
+        uint32_t tileOffset;
+        uint32_t actorCount;
+        uint32_t actorOffset;
+        uint32_t behaviorCount;
+        uint32_t behaviorOffset;
+        uint32_t triggerCount;
+        uint32_t triggerOffset;
+        uint32_t planeCount;
+        uint32_t planeOffset;
+
+        /**
+         * Chunked maps only (0 otherwise).
+         */
+        uint32_t chunkSize;
+        uint32_t chunkOffset;
+        uint32_t tileUsageCount;
+        uint32_t tileUsageOffset;
+
+        float maxAnisotropy;
+
+        /**
+         * Plane height index (MapBinaryPlaneLevel records and planeCount sorted plane indices) and, for maps that
+         * are not chunked, the cell flags (0 otherwise).
+         */
+        uint32_t planeLevelCount;
+        uint32_t planeLevelOffset;
+        uint32_t planeOrderOffset;
+        uint32_t cellFlagsOffset;
+
+        /**
+         * Static lights baked into the light map at load, and the light every face gets without them.
+         */
+        uint32_t lightCount;
+        uint32_t lightOffset;
+        float ambientLight[3];
+    };
+
+    struct MapBinaryTile
+    {
+        uint32_t strings[TILE_STRING_COUNT];
+        int32_t tag;
+        float textureLodBias;
+
+        /**
+         * MAP_TILE_FLAG_* bits.
+         */
+        uint32_t flags;
+
+        /**
+         * Placements of the tile over all planes, and the most placements in any single chunk (chunked maps only).
+         */
+        uint32_t instanceCount;
+        uint32_t maxChunkInstances;
+    };
+
+    struct MapBinaryActor
+    {
+        uint32_t type;
+        int32_t x;
+        int32_t y;
+        int32_t z;
+        float yaw;
+    };
+
+    struct MapBinaryBehavior
+    {
+        uint32_t onEnter;
+        uint32_t onExit;
+        uint32_t onCreate;
+    };
+
+    struct MapBinaryTrigger
+    {
+        uint32_t continueRaycast;
+    };
+
+    struct MapBinaryLight
+    {
+        float x;
+        float y;
+        float height;
+        float color[3];
+        float radius;
+    };
+
+    struct MapBinaryChunk
+    {
+        /**
+         * Offset of the chunkSize * chunkSize tile indices of this chunk.
+         */
+        uint32_t cellOffset;
+
+        /**
+         * Range of this chunk in the tile usage records.
+         */
+        uint32_t usageIndex;
+        uint32_t usageCount;
+    };
+
+    /**
+     * One distinct tile (1-based, as in the planes) placed in a chunk and how many times.
+     */
+    struct MapBinaryTileUsage
+    {
+        uint16_t tile;
+        uint16_t count;
+    };
+
+    struct MapBinaryPlane
+    {
+        int32_t height;
+
+        /**
+         * Offset of the width * height uint16_t tile indices of this plane.
+         */
+        uint32_t mapOffset;
+    };
+
+    /**
+     * One distinct plane height, ascending. Its planes are planeOrder[first] to planeOrder[first + count - 1], in
+     * plane order.
+     */
+    struct MapBinaryPlaneLevel
+    {
+        int32_t height;
+        uint32_t first;
+        uint32_t count;
+    };
+}
+
+#endif /* MapBinaryFormat_h */
@@ -0,0 +1,256 @@
+//
+//  MapChunkStreamer.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "MapChunkStreamer.hpp"
+#include <thread>
+
+/**
+ * Columns are evicted beyond this distance (in chunks) from the player's chunk.
+ */
+#define MAP_CHUNK_EVICT_RADIUS ( MAP_CHUNK_RESIDENT_RADIUS + 2 )
+
+using namespace mikedotcpp;
+
+MapChunkStreamer::MapChunkStreamer( const MapInfo& mapInfo ) : _mapInfo( mapInfo )
+{
+    CCASSERT( mapInfo.isChunked(), "MapChunkStreamer requires a chunked map." );
+    _chunkSize = mapInfo.chunkSize;
+    _planeCount = (int)mapInfo.planes.size();
+    _residentCells.assign( mapInfo.chunks.size(), nullptr );
+    _dirtyChunks.assign( mapInfo.chunks.size(), false );
+    _columnStates.assign( mapInfo.chunksWide * mapInfo.chunksHigh, evicted );
+    _activeColumns.reserve( getMaxResidentColumns() );
+    _loadQueue = std::make_shared< LoadQueue >();
+}
+
+MapChunkStreamer::~MapChunkStreamer()
+{
+    // Loads still copying read from the MapInfo; loads already copied are dropped by their callback.
+    _loadQueue->alive = false;
+    while( _loadQueue->inFlight > 0 )
+    {
+        std::this_thread::yield();
+    }
+    for( int column : _activeColumns )
+    {
+        evictColumn( column );
+    }
+}
+
+void MapChunkStreamer::update( int cellX, int cellY )
+{
+    int chunkX = MAX( 0, MIN( cellX / _chunkSize, _mapInfo.chunksWide - 1 ) );
+    int chunkY = MAX( 0, MIN( cellY / _chunkSize, _mapInfo.chunksHigh - 1 ) );
+    if( chunkX == _centerChunkX && chunkY == _centerChunkY )
+    {
+        return;
+    }
+    moveCenter( chunkX, chunkY );
+    
+    // One ring beyond the raycaster's reach, so the next chunks are usually resident before they are needed.
+    for( int column : getColumnsAround( chunkX, chunkY, MAP_CHUNK_RESIDENT_RADIUS + 1 ) )
+    {
+        if( _columnStates[column] != evicted )
+        {
+            continue;
+        }
+        _columnStates[column] = loading;
+        _activeColumns.push_back( column );
+        
+        std::shared_ptr< LoadQueue > queue = _loadQueue;
+        auto cells = std::make_shared< std::vector< uint16_t* > >();
+        ++queue->inFlight;
+        cocos2d::AsyncTaskPool::getInstance()->enqueue( cocos2d::AsyncTaskPool::TaskType::TASK_IO, [this, queue, cells, column]( void* )
+        {
+            // Evicted (or re-requested) while loading: the copy is stale.
+            if( !queue->alive || _columnStates[column] != loading )
+            {
+                for( uint16_t* planeCells : *cells )
+                {
+                    delete[] planeCells;
+                }
+                return;
+            }
+            publishColumn( column, *cells );
+        }, nullptr, [this, queue, cells, column]()
+        {
+            *cells = copyColumn( column );
+            --queue->inFlight;
+        } );
+    }
+}
+
+void MapChunkStreamer::preload( int cellX, int cellY )
+{
+    int chunkX = MAX( 0, MIN( cellX / _chunkSize, _mapInfo.chunksWide - 1 ) );
+    int chunkY = MAX( 0, MIN( cellY / _chunkSize, _mapInfo.chunksHigh - 1 ) );
+    moveCenter( chunkX, chunkY );
+    for( int column : getColumnsAround( chunkX, chunkY, MAP_CHUNK_RESIDENT_RADIUS + 1 ) )
+    {
+        if( _columnStates[column] == evicted )
+        {
+            _activeColumns.push_back( column );
+        }
+        if( _columnStates[column] != resident )
+        {
+            _columnStates[column] = loading;
+            publishColumn( column, copyColumn( column ) );
+        }
+    }
+}
+
+void MapChunkStreamer::setColumnListener( const std::function< void( int column, bool resident ) >& listener )
+{
+    _columnListener = listener;
+}
+
+void MapChunkStreamer::setCell( int planeIndex, int x, int y, uint16_t value )
+{
+    int chunkX = x / _chunkSize;
+    int chunkY = y / _chunkSize;
+    int chunk = ( planeIndex * _mapInfo.chunksHigh + chunkY ) * _mapInfo.chunksWide + chunkX;
+    if( _residentCells[chunk] )
+    {
+        _residentCells[chunk][ ( y - chunkY * _chunkSize ) * _chunkSize + x - chunkX * _chunkSize ] = value;
+        _dirtyChunks[chunk] = true;
+    }
+}
+
+int MapChunkStreamer::getReach() const
+{
+    return MAP_CHUNK_RESIDENT_RADIUS * _chunkSize;
+}
+
+int MapChunkStreamer::getWindowIndex( int x, int y ) const
+{
+    int localX = x - ( _centerChunkX - MAP_CHUNK_EVICT_RADIUS ) * _chunkSize;
+    int localY = y - ( _centerChunkY - MAP_CHUNK_EVICT_RADIUS ) * _chunkSize;
+    int size = getWindowSize();
+    if( (unsigned)localX >= (unsigned)size || (unsigned)localY >= (unsigned)size )
+    {
+        return -1;
+    }
+    return localY * size + localX;
+}
+
+int MapChunkStreamer::getWindowSize() const
+{
+    return ( 2 * MAP_CHUNK_EVICT_RADIUS + 1 ) * _chunkSize;
+}
+
+int MapChunkStreamer::getMaxResidentColumns()
+{
+    return ( 2 * MAP_CHUNK_EVICT_RADIUS + 1 ) * ( 2 * MAP_CHUNK_EVICT_RADIUS + 1 );
+}
+
+int MapChunkStreamer::getResidentColumnCount() const
+{
+    int count = 0;
+    for( int column : _activeColumns )
+    {
+        count += ( _columnStates[column] == resident ) ? 1 : 0;
+    }
+    return count;
+}
+
+size_t MapChunkStreamer::getResidentBytes() const
+{
+    return (size_t)getResidentColumnCount() * _planeCount * _chunkSize * _chunkSize * sizeof( uint16_t );
+}
+
+std::vector< int > MapChunkStreamer::getColumnsAround( int chunkX, int chunkY, int radius ) const
+{
+    std::vector< int > columns;
+    for( int ring = 0; ring <= radius; ++ring )
+    {
+        for( int y = chunkY - ring; y <= chunkY + ring; ++y )
+        {
+            for( int x = chunkX - ring; x <= chunkX + ring; ++x )
+            {
+                bool onRing = ( abs( x - chunkX ) == ring || abs( y - chunkY ) == ring );
+                if( onRing && x >= 0 && y >= 0 && x < _mapInfo.chunksWide && y < _mapInfo.chunksHigh )
+                {
+                    columns.push_back( y * _mapInfo.chunksWide + x );
+                }
+            }
+        }
+    }
+    return columns;
+}
+
+std::vector< uint16_t* > MapChunkStreamer::copyColumn( int column ) const
+{
+    int columnCount = _mapInfo.chunksWide * _mapInfo.chunksHigh;
+    int cellCount = _chunkSize * _chunkSize;
+    std::vector< uint16_t* > cells( _planeCount );
+    for( int plane = 0; plane < _planeCount; ++plane )
+    {
+        cells[plane] = new uint16_t[cellCount];
+        memcpy( cells[plane], _mapInfo.chunks[ plane * columnCount + column ].cells, sizeof( uint16_t ) * cellCount );
+    }
+    return cells;
+}
+
+void MapChunkStreamer::publishColumn( int column, const std::vector< uint16_t* >& cells )
+{
+    int columnCount = _mapInfo.chunksWide * _mapInfo.chunksHigh;
+    for( int plane = 0; plane < _planeCount; ++plane )
+    {
+        _residentCells[ plane * columnCount + column ] = cells[plane];
+    }
+    _columnStates[column] = resident;
+    if( _columnListener )
+    {
+        _columnListener( column, true );
+    }
+}
+
+void MapChunkStreamer::evictColumn( int column )
+{
+    if( _columnStates[column] == resident && _columnListener )
+    {
+        _columnListener( column, false );
+    }
+    
+    int columnCount = _mapInfo.chunksWide * _mapInfo.chunksHigh;
+    for( int plane = 0; plane < _planeCount; ++plane )
+    {
+        int chunk = plane * columnCount + column;
+        if( _residentCells[chunk] && _dirtyChunks[chunk] )
+        {
+            memcpy( _mapInfo.chunks[chunk].cells, _residentCells[chunk], sizeof( uint16_t ) * _chunkSize * _chunkSize );
+            _dirtyChunks[chunk] = false;
+        }
+        delete[] _residentCells[chunk];
+        _residentCells[chunk] = nullptr;
+    }
+    _columnStates[column] = evicted;
+}
+
+void MapChunkStreamer::moveCenter( int chunkX, int chunkY )
+{
+    _centerChunkX = chunkX;
+    _centerChunkY = chunkY;
+    
+    std::vector< int > kept;
+    kept.reserve( _activeColumns.size() );
+    for( int column : _activeColumns )
+    {
+        int x = column % _mapInfo.chunksWide;
+        int y = column / _mapInfo.chunksWide;
+        if( MAX( abs( x - chunkX ), abs( y - chunkY ) ) > MAP_CHUNK_EVICT_RADIUS )
+        {
+            evictColumn( column );
+        }
+        else
+        {
+            kept.push_back( column );
+        }
+    }
+    _activeColumns.swap( kept );
+}
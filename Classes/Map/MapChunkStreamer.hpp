@@ -0,0 +1,176 @@
+//
+//  MapChunkStreamer.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef MapChunkStreamer_hpp
+#define MapChunkStreamer_hpp
+
+#include "cocos2d.h"
+#include "MapInfo.hpp"
+
+/**
+ * Chunks within this many chunks (Chebyshev distance) of the player's chunk are kept resident; the raycaster
+ * reaches MAP_CHUNK_RESIDENT_RADIUS * chunkSize cells. The next ring is loaded ahead of movement and chunks are
+ * only evicted once they are MAP_CHUNK_RESIDENT_RADIUS + 2 chunks away.
+ */
+#define MAP_CHUNK_RESIDENT_RADIUS 3
+
+namespace mikedotcpp
+{
+    /**
+     * Keeps the chunks of a chunked map (see MapInfo::isChunked) resident around the player and evicts the rest,
+     * so the memory used by the planes depends on MAP_CHUNK_RESIDENT_RADIUS, not on the size of the map.
+     *
+     * A "column" is the stack of same-position chunks of every plane; columns are loaded and evicted together.
+     * Loads copy the chunk cells out of the mapped compiled map on an AsyncTaskPool IO worker (so the page faults
+     * happen there) and are published on the main thread. Cells of non-resident chunks read as 0 (void).
+     *
+     * The MapInfo must outlive the streamer.
+     */
+    class MapChunkStreamer
+    {
+    public:
+        MapChunkStreamer( const mikedotcpp::MapInfo& mapInfo );
+        ~MapChunkStreamer();
+        
+        /**
+         * Main thread, once per frame: requests the columns around the player's cell (nearest first) and evicts
+         * those that are too far away. Only does work when the player enters another chunk.
+         */
+        void update( int cellX, int cellY );
+        
+        /**
+         * Synchronously loads every column update() would request for this cell. Used at level start, may be
+         * called from any thread before the streamer is shared.
+         */
+        void preload( int cellX, int cellY );
+        
+        /**
+         * Returns the tile index (1-based, 0 is void) of a cell, or 0 when its chunk is not resident.
+         */
+        inline uint16_t getCell( int planeIndex, int x, int y ) const
+        {
+            if( (unsigned)x >= (unsigned)_mapInfo.width || (unsigned)y >= (unsigned)_mapInfo.height )
+            {
+                return 0;
+            }
+            int chunkX = x / _chunkSize;
+            int chunkY = y / _chunkSize;
+            const uint16_t* cells = _residentCells[ ( planeIndex * _mapInfo.chunksHigh + chunkY ) * _mapInfo.chunksWide + chunkX ];
+            return cells ? cells[ ( y - chunkY * _chunkSize ) * _chunkSize + x - chunkX * _chunkSize ] : 0;
+        }
+        
+        /**
+         * Changes a resident cell. The edit is written back to the map when the chunk is evicted.
+         */
+        void setCell( int planeIndex, int x, int y, uint16_t value );
+        
+        /**
+         * Called with TRUE right after a column becomes resident and with FALSE right before a resident column is
+         * evicted, on the thread doing so (the main thread, or the caller of preload()).
+         */
+        void setColumnListener( const std::function< void( int column, bool resident ) >& listener );
+        
+        /**
+         * Distance (in cells) from the player within which every cell is resident.
+         */
+        int getReach() const;
+        
+        /**
+         * Cells that can be resident at once form a square window around the player's chunk. Returns the index of
+         * a cell within that window (row-major, getWindowSize() cells per side) or -1 outside of it.
+         */
+        int getWindowIndex( int x, int y ) const;
+        int getWindowSize() const;
+        
+        /**
+         * Upper bound on the number of resident columns.
+         */
+        static int getMaxResidentColumns();
+        
+        /**
+         * Resident columns and the memory used by their cells.
+         */
+        int getResidentColumnCount() const;
+        size_t getResidentBytes() const;
+    
+    protected:
+        enum ColumnState : uint8_t
+        {
+            evicted, loading, resident
+        };
+        
+        /**
+         * Shared with the load tasks, which may finish after the streamer is gone.
+         */
+        struct LoadQueue
+        {
+            std::atomic< bool > alive{ true };
+            std::atomic< int > inFlight{ 0 };
+        };
+        
+        const mikedotcpp::MapInfo& _mapInfo;
+        int _chunkSize;
+        int _planeCount;
+        
+        /**
+         * Per chunk (plane-major, as in MapInfo::chunks): the resident copy of its cells or NULL.
+         */
+        std::vector< uint16_t* > _residentCells;
+        std::vector< bool > _dirtyChunks;
+        
+        /**
+         * Per column.
+         */
+        std::vector< ColumnState > _columnStates;
+        
+        /**
+         * Columns that are loading or resident.
+         */
+        std::vector< int > _activeColumns;
+        
+        /**
+         * Chunk the player was in at the last update().
+         */
+        int _centerChunkX = -1;
+        int _centerChunkY = -1;
+        
+        std::shared_ptr< LoadQueue > _loadQueue;
+        
+        /**
+         * See setColumnListener().
+         */
+        std::function< void( int, bool ) > _columnListener;
+        
+        /**
+         * Returns the columns within radius of the chunk, nearest first.
+         */
+        std::vector< int > getColumnsAround( int chunkX, int chunkY, int radius ) const;
+        
+        /**
+         * Copies the cells of every plane of a column into new buffers (planeCount entries).
+         */
+        std::vector< uint16_t* > copyColumn( int column ) const;
+        
+        /**
+         * Makes the copied cells of a column visible to getCell().
+         */
+        void publishColumn( int column, const std::vector< uint16_t* >& cells );
+        
+        /**
+         * Writes back edited chunks and frees the cells of a column.
+         */
+        void evictColumn( int column );
+        
+        /**
+         * Sets the window center and evicts the columns that fell out of it.
+         */
+        void moveCenter( int chunkX, int chunkY );
+    };
+}
+
+#endif /* MapChunkStreamer_hpp */
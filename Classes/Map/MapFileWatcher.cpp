@@ -0,0 +1,128 @@
+//
+//  MapFileWatcher.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "MapFileWatcher.hpp"
+
+#if ( CC_TARGET_PLATFORM == CC_PLATFORM_LINUX )
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#define MAP_FILE_WATCH_SUPPORTED 1
+#endif
+
+/**
+ * Size of the buffer events are read into; large enough for many events per read.
+ */
+#define MAP_FILE_WATCH_BUFFER_SIZE 4096
+
+using namespace mikedotcpp;
+
+MapFileWatcher::MapFileWatcher()
+{
+#ifdef MAP_FILE_WATCH_SUPPORTED
+    _fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if( _fd < 0 )
+    {
+        cocos2d::log( "MapFileWatcher - inotify_init1 failed (%i), hot reload disabled.", errno );
+    }
+#endif
+}
+
+MapFileWatcher::~MapFileWatcher()
+{
+#ifdef MAP_FILE_WATCH_SUPPORTED
+    if( _fd >= 0 )
+    {
+        close( _fd );
+    }
+#endif
+}
+
+bool MapFileWatcher::isSupported()
+{
+#ifdef MAP_FILE_WATCH_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MapFileWatcher::watch( const std::string& fullPath )
+{
+#ifdef MAP_FILE_WATCH_SUPPORTED
+    if( _fd < 0 )
+    {
+        return false;
+    }
+    size_t slash = fullPath.find_last_of( '/' );
+    std::string directory = ( slash == std::string::npos ) ? "./" : fullPath.substr( 0, slash + 1 );
+    for( const auto& entry : _directories )
+    {
+        if( entry.second == directory )
+        {
+            return true;
+        }
+    }
+    
+    int descriptor = inotify_add_watch( _fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+    if( descriptor < 0 )
+    {
+        CCLOG( "MapFileWatcher - can't watch %s (%i).", directory.c_str(), errno );
+        return false;
+    }
+    _directories[descriptor] = directory;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MapFileWatcher::clear()
+{
+#ifdef MAP_FILE_WATCH_SUPPORTED
+    for( const auto& entry : _directories )
+    {
+        inotify_rm_watch( _fd, entry.first );
+    }
+#endif
+    _directories.clear();
+}
+
+std::vector< std::string > MapFileWatcher::poll()
+{
+    std::vector< std::string > paths;
+#ifdef MAP_FILE_WATCH_SUPPORTED
+    if( _fd < 0 )
+    {
+        return paths;
+    }
+    
+    alignas( struct inotify_event ) char buffer[MAP_FILE_WATCH_BUFFER_SIZE];
+    ssize_t length;
+    while( ( length = read( _fd, buffer, sizeof( buffer ) ) ) > 0 )
+    {
+        for( char* cursor = buffer; cursor < buffer + length; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)cursor;
+            cursor += sizeof( struct inotify_event ) + event->len;
+            
+            auto directory = _directories.find( event->wd );
+            if( directory == _directories.end() || event->len == 0 )
+            {
+                continue;
+            }
+            std::string path = directory->second + event->name;
+            if( std::find( paths.begin(), paths.end(), path ) == paths.end() )
+            {
+                paths.push_back( path );
+            }
+        }
+    }
+#endif
+    return paths;
+}
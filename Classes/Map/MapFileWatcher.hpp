@@ -0,0 +1,64 @@
+//
+//  MapFileWatcher.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef MapFileWatcher_hpp
+#define MapFileWatcher_hpp
+
+#include "cocos2d.h"
+
+namespace mikedotcpp
+{
+    /**
+     * Development aid: reports files that were rewritten in watched directories, for hot-reloading maps and their
+     * images (see FPRenderLayer::setHotReloadEnabled). Uses inotify, so it only works on Linux; elsewhere watch()
+     * returns FALSE and poll() never reports anything.
+     *
+     * Directories are watched rather than files because editors usually save by writing a temporary file and
+     * renaming it over the original, which would silently end a watch on the file itself.
+     */
+    class MapFileWatcher
+    {
+    public:
+        MapFileWatcher();
+        ~MapFileWatcher();
+        
+        /**
+         * Starts reporting changes to files in the directory of fullPath. Watching a directory twice is a no-op.
+         */
+        bool watch( const std::string& fullPath );
+        
+        /**
+         * Stops watching every directory.
+         */
+        void clear();
+        
+        /**
+         * Non-blocking, main thread: returns the full paths of the files written (closed after writing, or moved
+         * into place) since the last call, without duplicates.
+         */
+        std::vector< std::string > poll();
+        
+        /**
+         * TRUE on platforms with inotify.
+         */
+        static bool isSupported();
+    
+    protected:
+        /**
+         * The inotify instance, -1 when unsupported or failed.
+         */
+        int _fd = -1;
+        
+        /**
+         * Watched directories (with a trailing '/') by watch descriptor.
+         */
+        std::unordered_map< int, std::string > _directories;
+    };
+}
+
+#endif /* MapFileWatcher_hpp */
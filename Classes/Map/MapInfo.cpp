@@ -7,6 +7,17 @@
 //
 
 #include "MapInfo.hpp"
+#include <algorithm>
+#include <sstream>
+#include <zlib.h>
+
+#if ( CC_TARGET_PLATFORM != CC_PLATFORM_WIN32 ) && ( CC_TARGET_PLATFORM != CC_PLATFORM_WINRT )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAP_FILE_MMAP_SUPPORTED 1
+#endif
 
 #define ASSERT_FAILED_NANO "Document is NanO (Not an Object)"
 
@@ -14,46 +25,1318 @@
 #define PLAYER_ACTOR_UNDEFINED_ERR_MSG "Player1 actor not defined! Add Player1 as custom Actor in the first position of the map definition file."
 #define TRIGGERS_UNDEFINED_ERR_MSG "Must provide default trigger as first element in map definition file."
 #define SPRITESHEET_UNDEFINED_ERR_MSG "Spritesheets undefined! You must use a spritesheet with the .png/.plist combination for the sprite-rendering path, see default.json for example."
+#define MATERIAL_ATLAS_UNDEFINED_ERR_MSG "A materialAtlas must name at least a diffuse spritesheet."
+#define BINARY_MAP_INVALID_ERR_MSG "Not a compiled map file (bad magic, version or size). Recompile it with tools/mapcompiler."
 #define MESH_RENDERING_REMINDER "\n\n**NOTE**\nEnabling realtime lighting automatically means using the mesh-rendering path which is not compatible with spritesheets at this time. Please import individual PNG's into project.\n\n"
 
-#define KEY_PROPERTIES "properties"
-#define KEY_TILES "tiles"
-#define KEY_PLANES "planes"
-#define KEY_ACTORS "actors"
-#define KEY_BEHAVIORS "behaviors"
-#define KEY_TRIGGERS "triggers"
+#define KEY_PROPERTIES "properties"
+#define KEY_TILES "tiles"
+#define KEY_PLANES "planes"
+#define KEY_ACTORS "actors"
+#define KEY_BEHAVIORS "behaviors"
+#define KEY_TRIGGERS "triggers"
+#define KEY_LIGHTS "lights"
+
+#define TMX_LAYER_HEIGHT_PROPERTY "height"
+#define TMX_ACTORS_GROUP "actors"
+#define TMX_BEHAVIORS_GROUP "behaviors"
+#define TMX_LIGHTS_GROUP "lights"
+
+using namespace mikedotcpp;
+
+/**
+ * Fills fields with pointers to the string members of the tile, in MapBinaryTileString order.
+ */
+static void getTileStringFields( Tile& tile, std::string* fields[TILE_STRING_COUNT] )
+{
+    std::string* ordered[TILE_STRING_COUNT] =
+    {
+        &tile.textureNorth, &tile.textureEast, &tile.textureSouth, &tile.textureWest, &tile.textureFloor,
+        &tile.textureCeiling, &tile.textureAll, &tile.textureCenterSpanNS, &tile.textureCenterSpanEW,
+        &tile.normalNorth, &tile.normalEast, &tile.normalSouth, &tile.normalWest, &tile.normalFloor,
+        &tile.normalCeiling, &tile.normalAll, &tile.billboardTexture, &tile.vertexShader, &tile.fragmentShader,
+        &tile.model, &tile.textureWrapMode, &tile.textureMinFilter, &tile.textureMagFilter
+    };
+    for( int i = 0; i < TILE_STRING_COUNT; ++i )
+    {
+        fields[i] = ordered[i];
+    }
+}
+
+/**
+ * Reads a color written as "r,g,b" (TMX properties). Missing components are left as they are.
+ */
+static void parseColorList( const std::string& text, float color[3] )
+{
+    std::stringstream components( text );
+    std::string component;
+    for( int i = 0; i < 3 && std::getline( components, component, ',' ); ++i )
+    {
+        color[i] = (float)atof( component.c_str() );
+    }
+}
+
+/**
+ * Returns an empty string when the compiled map in bytes is complete: the header matches this build, every
+ * section, string and plane or chunk array lies inside the file and the first actor is Player1. Otherwise returns
+ * what is wrong.
+ */
+static std::string validateBinaryMap( const unsigned char* bytes, size_t size )
+{
+    if( !bytes || size < sizeof( MapBinaryHeader ) )
+    {
+        return "truncated header";
+    }
+    const MapBinaryHeader* header = (const MapBinaryHeader*)bytes;
+    if( memcmp( header->magic, MAP_BINARY_MAGIC, sizeof( header->magic ) ) != 0 )
+    {
+        return "bad magic";
+    }
+    if( header->version != MAP_BINARY_VERSION )
+    {
+        return "version " + std::to_string( header->version ) + ", expected " + std::to_string( MAP_BINARY_VERSION );
+    }
+    if( header->fileSize != size )
+    {
+        return "size " + std::to_string( size ) + ", expected " + std::to_string( header->fileSize );
+    }
+    if( header->tileSize <= 0 || header->width <= 0 || header->height <= 0 )
+    {
+        return "bad map size";
+    }
+    
+    // 64-bit arithmetic, so huge counts or offsets can't wrap around.
+    auto fits = [size]( uint64_t offset, uint64_t count, uint64_t recordSize )
+    {
+        return offset + count * recordSize <= size;
+    };
+    uint64_t cellCount = (uint64_t)header->width * header->height;
+    bool chunked = ( header->flags & MAP_BINARY_FLAG_CHUNKED ) != 0;
+    if( !fits( header->stringTableOffset, header->stringTableSize, 1 ) || header->stringTableSize == 0 ||
+        bytes[ header->stringTableOffset + header->stringTableSize - 1 ] != '\0' ||
+        !fits( header->spritesheetOffset, header->spritesheetCount, sizeof( uint32_t ) ) ||
+        !fits( header->tileOffset, header->tileCount, sizeof( MapBinaryTile ) ) ||
+        !fits( header->actorOffset, header->actorCount, sizeof( MapBinaryActor ) ) ||
+        !fits( header->behaviorOffset, header->behaviorCount, sizeof( MapBinaryBehavior ) ) ||
+        !fits( header->triggerOffset, header->triggerCount, sizeof( MapBinaryTrigger ) ) ||
+        !fits( header->lightOffset, header->lightCount, sizeof( MapBinaryLight ) ) ||
+        !fits( header->planeOffset, header->planeCount, sizeof( MapBinaryPlane ) ) ||
+        !fits( header->planeLevelOffset, header->planeLevelCount, sizeof( MapBinaryPlaneLevel ) ) ||
+        !fits( header->planeOrderOffset, header->planeCount, sizeof( uint16_t ) ) ||
+        ( header->cellFlagsOffset != 0 && !fits( header->cellFlagsOffset, header->planeCount * cellCount, 1 ) ) )
+    {
+        return "section out of bounds";
+    }
+    
+    // The string table ends with a NUL, so every offset inside it reads a terminated string.
+    uint32_t stringCount = header->stringTableSize;
+    std::vector< uint32_t > stringOffsets = { header->path, header->name, header->mapVersion, header->diffuseAtlas, header->normalAtlas };
+    const uint32_t* spritesheetNames = (const uint32_t*)( bytes + header->spritesheetOffset );
+    stringOffsets.insert( stringOffsets.end(), spritesheetNames, spritesheetNames + header->spritesheetCount );
+    const MapBinaryTile* tileRecords = (const MapBinaryTile*)( bytes + header->tileOffset );
+    for( uint32_t i = 0; i < header->tileCount; ++i )
+    {
+        stringOffsets.insert( stringOffsets.end(), tileRecords[i].strings, tileRecords[i].strings + TILE_STRING_COUNT );
+    }
+    const MapBinaryActor* actorRecords = (const MapBinaryActor*)( bytes + header->actorOffset );
+    for( uint32_t i = 0; i < header->actorCount; ++i )
+    {
+        stringOffsets.push_back( actorRecords[i].type );
+    }
+    const MapBinaryBehavior* behaviorRecords = (const MapBinaryBehavior*)( bytes + header->behaviorOffset );
+    for( uint32_t i = 0; i < header->behaviorCount; ++i )
+    {
+        stringOffsets.insert( stringOffsets.end(), { behaviorRecords[i].onEnter, behaviorRecords[i].onExit, behaviorRecords[i].onCreate } );
+    }
+    for( uint32_t offset : stringOffsets )
+    {
+        if( offset >= stringCount )
+        {
+            return "string out of bounds";
+        }
+    }
+    const char* strings = (const char*)bytes + header->stringTableOffset;
+    if( header->actorCount == 0 || strcmp( strings + actorRecords[0].type, PLAYER_ACTOR_STR ) != 0 )
+    {
+        return PLAYER_ACTOR_UNDEFINED_ERR_MSG;
+    }
+    
+    const MapBinaryPlaneLevel* levelRecords = (const MapBinaryPlaneLevel*)( bytes + header->planeLevelOffset );
+    for( uint32_t i = 0; i < header->planeLevelCount; ++i )
+    {
+        if( (uint64_t)levelRecords[i].first + levelRecords[i].count > header->planeCount )
+        {
+            return "plane level out of bounds";
+        }
+    }
+    const uint16_t* orderRecords = (const uint16_t*)( bytes + header->planeOrderOffset );
+    for( uint32_t i = 0; i < header->planeCount; ++i )
+    {
+        if( orderRecords[i] >= header->planeCount )
+        {
+            return "plane order out of bounds";
+        }
+    }
+    
+    if( !chunked )
+    {
+        const MapBinaryPlane* planeRecords = (const MapBinaryPlane*)( bytes + header->planeOffset );
+        for( uint32_t i = 0; i < header->planeCount; ++i )
+        {
+            if( !fits( planeRecords[i].mapOffset, cellCount, sizeof( uint16_t ) ) )
+            {
+                return "plane out of bounds";
+            }
+        }
+        return "";
+    }
+    
+    if( header->chunkSize == 0 )
+    {
+        return "bad chunk size";
+    }
+    uint64_t chunkCount = (uint64_t)header->planeCount * ( ( header->width + header->chunkSize - 1 ) / header->chunkSize ) *
+                          ( ( header->height + header->chunkSize - 1 ) / header->chunkSize );
+    if( !fits( header->chunkOffset, chunkCount, sizeof( MapBinaryChunk ) ) ||
+        !fits( header->tileUsageOffset, header->tileUsageCount, sizeof( MapBinaryTileUsage ) ) )
+    {
+        return "chunk section out of bounds";
+    }
+    const MapBinaryChunk* chunkRecords = (const MapBinaryChunk*)( bytes + header->chunkOffset );
+    for( uint64_t i = 0; i < chunkCount; ++i )
+    {
+        if( !fits( chunkRecords[i].cellOffset, (uint64_t)header->chunkSize * header->chunkSize, sizeof( uint16_t ) ) ||
+            (uint64_t)chunkRecords[i].usageIndex + chunkRecords[i].usageCount > header->tileUsageCount )
+        {
+            return "chunk out of bounds";
+        }
+    }
+    return "";
+}
+
+typedef bool ( rapidjson::Value::*JSONTypeCheck )() const;
+
+/**
+ * TRUE when obj has key with the type isType checks (such as &rapidjson::Value::IsString); optional members may
+ * also be missing.
+ */
+static bool hasJSONMember( const rapidjson::Value& obj, const char* key, JSONTypeCheck isType )
+{
+    return obj.HasMember( key ) && ( obj[key].*isType )();
+}
+
+static bool hasOptionalJSONMember( const rapidjson::Value& obj, const char* key, JSONTypeCheck isType )
+{
+    return !obj.HasMember( key ) || ( obj[key].*isType )();
+}
+
+/**
+ * TRUE when obj has no key or an array of count numbers under it.
+ */
+static bool hasOptionalJSONNumbers( const rapidjson::Value& obj, const char* key, rapidjson::SizeType count )
+{
+    if( !obj.HasMember( key ) )
+    {
+        return true;
+    }
+    const rapidjson::Value& array = obj[key];
+    if( !array.IsArray() || array.Size() != count )
+    {
+        return false;
+    }
+    for( rapidjson::SizeType i = 0; i < count; ++i )
+    {
+        if( !array[i].IsNumber() )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns an empty string when the parsed JSON map has every section and value the loaders (loadJSONProperties()
+ * and the others) read, with the types they expect, and every plane covers the map with existing tiles. Otherwise
+ * returns what is wrong.
+ */
+static std::string validateJSONMap( const rapidjson::Document& doc )
+{
+    if( doc.HasParseError() )
+    {
+        return "parse error at offset " + std::to_string( doc.GetErrorOffset() );
+    }
+    if( !doc.IsObject() )
+    {
+        return ASSERT_FAILED_NANO;
+    }
+    
+    //
+    // PROPERTIES
+    //
+    if( !hasJSONMember( doc, KEY_PROPERTIES, &rapidjson::Value::IsObject ) )
+    {
+        return "properties missing";
+    }
+    const rapidjson::Value& props = doc[KEY_PROPERTIES];
+    if( !hasJSONMember( props, "path", &rapidjson::Value::IsString ) || !hasJSONMember( props, "name", &rapidjson::Value::IsString ) ||
+        !hasJSONMember( props, "version", &rapidjson::Value::IsString ) || !hasJSONMember( props, "tileSize", &rapidjson::Value::IsInt ) ||
+        !hasJSONMember( props, "width", &rapidjson::Value::IsInt ) || !hasJSONMember( props, "height", &rapidjson::Value::IsInt ) ||
+        !hasJSONMember( props, "useRealtimeLighting", &rapidjson::Value::IsBool ) ||
+        !hasOptionalJSONMember( props, "generateMipmaps", &rapidjson::Value::IsBool ) ||
+        !hasOptionalJSONMember( props, "maxAnisotropy", &rapidjson::Value::IsNumber ) ||
+        !hasOptionalJSONMember( props, "useMergedMaterial", &rapidjson::Value::IsBool ) ||
+        !hasOptionalJSONNumbers( props, "ambientLight", 3 ) )
+    {
+        return "a property is missing or has the wrong type";
+    }
+    int width = props["width"].GetInt();
+    int height = props["height"].GetInt();
+    if( width <= 0 || height <= 0 || props["tileSize"].GetInt() <= 0 )
+    {
+        return "map size out of range";
+    }
+    if( !props["useRealtimeLighting"].GetBool() )
+    {
+        if( !hasJSONMember( props, "spritesheets", &rapidjson::Value::IsArray ) )
+        {
+            return SPRITESHEET_UNDEFINED_ERR_MSG;
+        }
+        const rapidjson::Value& sheets = props["spritesheets"];
+        for( rapidjson::Value::ConstValueIterator itr = sheets.Begin(); itr != sheets.End(); ++itr )
+        {
+            const rapidjson::Value& sheet = *itr;
+            if( !sheet.IsString() )
+            {
+                return "spritesheet names must be strings";
+            }
+        }
+    }
+    else if( props.HasMember( "materialAtlas" ) && props.HasMember( "useMergedMaterial" ) && props["useMergedMaterial"].GetBool() )
+    {
+        const rapidjson::Value& atlas = props["materialAtlas"];
+        if( !atlas.IsObject() || !hasJSONMember( atlas, "diffuse", &rapidjson::Value::IsString ) ||
+            !hasOptionalJSONMember( atlas, "normal", &rapidjson::Value::IsString ) )
+        {
+            return MATERIAL_ATLAS_UNDEFINED_ERR_MSG;
+        }
+    }
+    
+    //
+    // TILES
+    //
+    if( !hasJSONMember( doc, KEY_TILES, &rapidjson::Value::IsArray ) )
+    {
+        return "tiles missing";
+    }
+    const rapidjson::Value& tiles = doc[KEY_TILES];
+    for( rapidjson::Value::ConstValueIterator itr = tiles.Begin(); itr != tiles.End(); ++itr )
+    {
+        const rapidjson::Value& tile = *itr;
+        if( !tile.IsObject() )
+        {
+            return "tile is not an object";
+        }
+        for( int field = 0; field < TILE_STRING_COUNT; ++field )
+        {
+            if( !hasOptionalJSONMember( tile, MAP_BINARY_TILE_KEYS[field], &rapidjson::Value::IsString ) )
+            {
+                return std::string( "tile " ) + MAP_BINARY_TILE_KEYS[field] + " is not a string";
+            }
+        }
+        if( !hasOptionalJSONMember( tile, "tag", &rapidjson::Value::IsInt ) ||
+            !hasOptionalJSONMember( tile, "textureLodBias", &rapidjson::Value::IsNumber ) )
+        {
+            return "tile tag or textureLodBias has the wrong type";
+        }
+    }
+    
+    //
+    // PLANES
+    //
+    if( !hasJSONMember( doc, KEY_PLANES, &rapidjson::Value::IsArray ) )
+    {
+        return "planes missing";
+    }
+    const rapidjson::Value& planes = doc[KEY_PLANES];
+    for( rapidjson::Value::ConstValueIterator itr = planes.Begin(); itr != planes.End(); ++itr )
+    {
+        const rapidjson::Value& plane = *itr;
+        if( !plane.IsObject() || !hasJSONMember( plane, "height", &rapidjson::Value::IsInt ) ||
+            !hasJSONMember( plane, "map", &rapidjson::Value::IsArray ) )
+        {
+            return "plane needs a height and a map";
+        }
+        const rapidjson::Value& map = plane["map"];
+        if( map.Size() != (rapidjson::SizeType)( width * height ) )
+        {
+            return "plane map is not width * height cells";
+        }
+        for( rapidjson::Value::ConstValueIterator cellItr = map.Begin(); cellItr != map.End(); ++cellItr )
+        {
+            const rapidjson::Value& cell = *cellItr;
+            if( !cell.IsInt() || cell.GetInt() < 0 || cell.GetInt() > (int)tiles.Size() )
+            {
+                return "plane cell is not a tile index";
+            }
+        }
+    }
+    
+    //
+    // ACTORS/BEHAVIORS/TRIGGERS/LIGHTS
+    //
+    if( !hasJSONMember( doc, KEY_ACTORS, &rapidjson::Value::IsArray ) )
+    {
+        return "actors missing";
+    }
+    bool definesPlayerObject = false;
+    const rapidjson::Value& actors = doc[KEY_ACTORS];
+    for( rapidjson::Value::ConstValueIterator itr = actors.Begin(); itr != actors.End(); ++itr )
+    {
+        const rapidjson::Value& actor = *itr;
+        if( !actor.IsObject() || !hasJSONMember( actor, "type", &rapidjson::Value::IsString ) ||
+            !hasJSONMember( actor, "x", &rapidjson::Value::IsInt ) || !hasJSONMember( actor, "y", &rapidjson::Value::IsInt ) ||
+            !hasJSONMember( actor, "z", &rapidjson::Value::IsInt ) || !hasJSONMember( actor, "yaw", &rapidjson::Value::IsDouble ) )
+        {
+            return "actor needs a type, x, y, z and yaw";
+        }
+        definesPlayerObject = definesPlayerObject || strcmp( actor["type"].GetString(), PLAYER_ACTOR_STR ) == 0;
+    }
+    if( !definesPlayerObject )
+    {
+        return PLAYER_ACTOR_UNDEFINED_ERR_MSG;
+    }
+    
+    if( !hasOptionalJSONMember( doc, KEY_BEHAVIORS, &rapidjson::Value::IsArray ) )
+    {
+        return "behaviors is not an array";
+    }
+    if( doc.HasMember( KEY_BEHAVIORS ) )
+    {
+        const rapidjson::Value& behaviors = doc[KEY_BEHAVIORS];
+        for( rapidjson::Value::ConstValueIterator itr = behaviors.Begin(); itr != behaviors.End(); ++itr )
+        {
+            const rapidjson::Value& behavior = *itr;
+            if( !behavior.IsObject() || !hasOptionalJSONMember( behavior, "onEnter", &rapidjson::Value::IsString ) ||
+                !hasOptionalJSONMember( behavior, "onExit", &rapidjson::Value::IsString ) ||
+                !hasOptionalJSONMember( behavior, "onCreate", &rapidjson::Value::IsString ) )
+            {
+                return "behavior scripts must be strings";
+            }
+        }
+    }
+    
+    if( !hasJSONMember( doc, KEY_TRIGGERS, &rapidjson::Value::IsArray ) )
+    {
+        return TRIGGERS_UNDEFINED_ERR_MSG;
+    }
+    const rapidjson::Value& triggers = doc[KEY_TRIGGERS];
+    for( rapidjson::Value::ConstValueIterator itr = triggers.Begin(); itr != triggers.End(); ++itr )
+    {
+        const rapidjson::Value& trigger = *itr;
+        if( !trigger.IsObject() || !hasOptionalJSONMember( trigger, "continueRaycast", &rapidjson::Value::IsBool ) )
+        {
+            return "trigger is not an object";
+        }
+    }
+    
+    if( !hasOptionalJSONMember( doc, KEY_LIGHTS, &rapidjson::Value::IsArray ) )
+    {
+        return "lights is not an array";
+    }
+    if( doc.HasMember( KEY_LIGHTS ) )
+    {
+        const rapidjson::Value& lights = doc[KEY_LIGHTS];
+        for( rapidjson::Value::ConstValueIterator itr = lights.Begin(); itr != lights.End(); ++itr )
+        {
+            const rapidjson::Value& light = *itr;
+            if( !light.IsObject() || !hasJSONMember( light, "x", &rapidjson::Value::IsNumber ) ||
+                !hasJSONMember( light, "y", &rapidjson::Value::IsNumber ) ||
+                !hasOptionalJSONMember( light, "height", &rapidjson::Value::IsNumber ) ||
+                !hasOptionalJSONMember( light, "radius", &rapidjson::Value::IsNumber ) || !hasOptionalJSONNumbers( light, "color", 3 ) )
+            {
+                return "light needs a numeric x and y, and numbers for its other values";
+            }
+        }
+    }
+    return "";
+}
+
+std::string MapInfo::getSourcePath( const std::string& fullPath )
+{
+    size_t extension = fullPath.rfind( MAP_BINARY_EXTENSION );
+    return ( extension != std::string::npos ) ? fullPath.substr( 0, extension ) + ".json" : fullPath;
+}
+
+bool MapInfo::loadMapInfo( std::string fullPath )
+{
+    _loaded = false;
+    bool compiled = fullPath.find( MAP_BINARY_EXTENSION ) != std::string::npos;
+    if( fullPath.find( ".json" ) != std::string::npos )
+    {
+        if( !loadJSONData( cocos2d::FileUtils::getInstance()->getDataFromFile( fullPath.c_str() ) ) )
+        {
+            return false;
+        }
+    }
+    else if( compiled && !loadBinaryData( fullPath ) )
+    {
+        // A stale or damaged compiled map: the JSON it was compiled from is the next best thing.
+        std::string jsonPath = getSourcePath( fullPath );
+        if( !cocos2d::FileUtils::getInstance()->isFileExist( jsonPath ) )
+        {
+            return false;
+        }
+        cocos2d::log( "MapInfo - loading %s instead.", jsonPath.c_str() );
+        compiled = false;
+        if( !loadJSONData( cocos2d::FileUtils::getInstance()->getDataFromFile( jsonPath ) ) )
+        {
+            return false;
+        }
+    }
+    else if( fullPath.find( ".tmx" ) != std::string::npos )
+    {
+        if( !loadTMXData( fullPath ) )
+        {
+            return false;
+        }
+    }
+    else if( !compiled )
+    {
+        cocos2d::log( "MapInfo - %s: unsupported file type.", fullPath.c_str() );
+        return false;
+    }
+    buildTileDescriptors();
+    
+    // Compiled maps carry it already.
+    if( !compiled )
+    {
+        precomputeMapData();
+    }
+    compileBehaviors();
+    _loaded = true;
+    return true;
+}
+
+bool MapInfo::isLoaded() const
+{
+    return _loaded;
+}
+
+void MapInfo::buildTileDescriptors()
+{
+    tileDescriptors.clear();
+    tileDescriptors.reserve( tiles.size() );
+    for( auto& tile : tiles )
+    {
+        TileDescriptor descriptor;
+        std::string* fields[TILE_STRING_COUNT];
+        getTileStringFields( tile, fields );
+        for( int field = 0; field < TILE_STRING_COUNT; ++field )
+        {
+            descriptor.strings[field] = strings.intern( *fields[field] );
+        }
+        descriptor.tag = tile.tag;
+        descriptor.textureLodBias = tile.textureLodBias;
+        
+        // Same interpretation BlockManager::addCustomTexParams always used: wrap mode switches the parameters on,
+        // anything but the named GL constants falls back to the defaults.
+        if( !tile.textureWrapMode.empty() )
+        {
+            descriptor.wrapMode = ( tile.textureWrapMode == "GL_REPEAT" ) ? TextureWrapMode::repeat : TextureWrapMode::clampToEdge;
+            descriptor.flags |= TILE_FLAG_CUSTOM_TEX_PARAMS;
+        }
+        if( !tile.textureMinFilter.empty() )
+        {
+            descriptor.minFilter = ( tile.textureMinFilter == "GL_LINEAR" ) ? TextureFilter::linear :
+                                   ( tile.textureMinFilter == "GL_NEAREST" ) ? TextureFilter::nearest : TextureFilter::linearMipmapLinear;
+        }
+        if( !tile.textureMagFilter.empty() )
+        {
+            descriptor.magFilter = ( tile.textureMagFilter == "GL_LINEAR" ) ? TextureFilter::linear : TextureFilter::nearest;
+        }
+        
+        descriptor.flags |= tile.billboardTexture.empty() ? 0 : TILE_FLAG_BILLBOARD;
+        descriptor.flags |= tile.model.empty() ? 0 : TILE_FLAG_MODEL;
+        descriptor.flags |= tile.textureAll.empty() ? 0 : TILE_FLAG_TEXTURE_ALL;
+        tileDescriptors.push_back( descriptor );
+    }
+}
+
+void MapInfo::precomputeMapData()
+{
+    tileFlags.clear();
+    for( const auto& descriptor : tileDescriptors )
+    {
+        bool hasField[TILE_STRING_COUNT];
+        for( int field = 0; field < TILE_STRING_COUNT; ++field )
+        {
+            hasField[field] = descriptor.strings[field] != STRING_ID_NONE;
+        }
+        tileFlags.push_back( computeTileFlags( hasField, descriptor.tag ) );
+    }
+    
+    std::vector< const uint16_t* > planeMaps;
+    std::vector< int > heights;
+    for( const auto& plane : planes )
+    {
+        planeMaps.push_back( plane.map );
+        heights.push_back( plane.height );
+    }
+    std::vector< uint32_t > counts;
+    computeTileInstanceCounts( planeMaps, (size_t)width * height, tiles.size(), counts );
+    tileInstanceCounts.assign( counts.begin(), counts.end() );
+    
+    computePlaneLevels( heights, planeLevels, planeOrder );
+    refreshCellFlags();
+}
+
+void MapInfo::refreshCellFlags()
+{
+    if( isChunked() )
+    {
+        return;
+    }
+    
+    std::vector< const uint16_t* > planeMaps;
+    std::vector< int > heights;
+    for( const auto& plane : planes )
+    {
+        planeMaps.push_back( plane.map );
+        heights.push_back( plane.height );
+    }
+    computeCellFlags( planeMaps, heights, width, height, tileSize, tileFlags, planeLevels, planeOrder, _cellFlagStorage );
+    _cellFlags = _cellFlagStorage.empty() ? nullptr : &_cellFlagStorage[0];
+}
+
+void MapInfo::compileBehaviors()
+{
+#if COCOS2D_DEBUG > 0
+    const char* eventNames[BEHAVIOR_EVENT_COUNT] = { "onEnter", "onExit", "onCreate" };
+#endif
+    behaviorProgram = BehaviorProgram();
+    for( int i = 0; i < behaviors.size(); ++i )
+    {
+        const std::string* scripts[BEHAVIOR_EVENT_COUNT] = { &behaviors[i].onEnter, &behaviors[i].onExit, &behaviors[i].onCreate };
+        for( int event = 0; event < BEHAVIOR_EVENT_COUNT; ++event )
+        {
+            int32_t entry = -1;
+            std::string error;
+            if( !compileBehaviorScript( *scripts[event], behaviorProgram, entry, error ) )
+            {
+                CCLOG( "MapInfo - behaviors[%i].%s: %s", i, eventNames[event], error.c_str() );
+            }
+            behaviorProgram.entries.push_back( entry );
+        }
+    }
+}
+
+int MapInfo::getPlaneLevel( float height ) const
+{
+    return findPlaneLevel( planeLevels, height );
+}
+
+int MapInfo::getPlaneIndexForHeight( float height ) const
+{
+    int level = getPlaneLevel( height );
+    return ( level >= 0 ) ? planeOrder[ planeLevels[level].first ] : -1;
+}
+
+bool MapInfo::hasCellFlags() const
+{
+    return _cellFlags != nullptr;
+}
+
+/**
+ * TRUE when both tiles are drawn the same way.
+ */
+static bool isSameTile( Tile& a, Tile& b )
+{
+    std::string* fieldsA[TILE_STRING_COUNT];
+    std::string* fieldsB[TILE_STRING_COUNT];
+    getTileStringFields( a, fieldsA );
+    getTileStringFields( b, fieldsB );
+    for( int i = 0; i < TILE_STRING_COUNT; ++i )
+    {
+        if( *fieldsA[i] != *fieldsB[i] )
+        {
+            return false;
+        }
+    }
+    return a.tag == b.tag && a.textureLodBias == b.textureLodBias;
+}
+
+MapEdit MapInfo::applyEdits( MapInfo& edited )
+{
+    MapEdit edit;
+    bool samePlanes = ( planes.size() == edited.planes.size() );
+    for( int i = 0; samePlanes && i < planes.size(); ++i )
+    {
+        samePlanes = ( planes[i].height == edited.planes[i].height );
+    }
+    edit.requiresFullReload = !samePlanes || isChunked() || edited.isChunked() || path != edited.path || width != edited.width ||
+                              height != edited.height || tileSize != edited.tileSize ||
+                              tiles.size() != edited.tiles.size() || useRealtimeLighting != edited.useRealtimeLighting ||
+                              useMergedMaterial != edited.useMergedMaterial || diffuseAtlas != edited.diffuseAtlas ||
+                              normalAtlas != edited.normalAtlas || spritesheets != edited.spritesheets ||
+                              generateMipmaps != edited.generateMipmaps || maxAnisotropy != edited.maxAnisotropy ||
+                              lights.empty() != edited.lights.empty();
+    if( edit.requiresFullReload )
+    {
+        return edit;
+    }
+    
+    std::vector< bool > changed( tiles.size(), false );
+    for( int i = 0; i < tiles.size(); ++i )
+    {
+        if( !isSameTile( tiles[i], edited.tiles[i] ) )
+        {
+            tiles[i] = edited.tiles[i];
+            changed[i] = true;
+        }
+    }
+    
+    // The plane arrays may point into a mapped compiled map; that mapping is private, so they are written in place.
+    size_t mapSize = (size_t)width * height;
+    for( int i = 0; i < planes.size(); ++i )
+    {
+        for( size_t cell = 0; cell < mapSize; ++cell )
+        {
+            if( planes[i].map[cell] != edited.planes[i].map[cell] )
+            {
+                planes[i].map[cell] = edited.planes[i].map[cell];
+                ++edit.changedCells;
+            }
+        }
+    }
+    
+    actors = edited.actors;
+    behaviors = edited.behaviors;
+    triggers = edited.triggers;
+    lights = edited.lights;
+    memcpy( ambientLight, edited.ambientLight, sizeof( ambientLight ) );
+    
+    // Pools and instance buffers are sized by the placements, so a tile placed more (or less) often is rebuilt too.
+    std::vector< int > previousCounts = tileInstanceCounts;
+    buildTileDescriptors();
+    precomputeMapData();
+    compileBehaviors();
+    for( int i = 0; i < tiles.size(); ++i )
+    {
+        if( changed[i] || i >= previousCounts.size() || previousCounts[i] != tileInstanceCounts[i] )
+        {
+            edit.changedTiles.push_back( i );
+        }
+    }
+    return edit;
+}
+
+//==============================================================================
+//
+// TMX PARSER
+//
+//==============================================================================
+
+/**
+ * TMXMapInfo that decodes the <data> of base64 and csv layers straight into 16-bit plane arrays instead of the
+ * engine's 32-bit gid array per layer. Compressed data is inflated through a small scratch buffer.
+ * planes holds one entry per layer; it is nullptr for xml-encoded layers, which the engine decodes into _tiles.
+ */
+class TMXPlaneReader : public cocos2d::TMXMapInfo
+{
+public:
 
-using namespace mikedotcpp;
+    std::vector<uint16_t*> planes;
+    uint32_t maxGid = 0;
+    bool gidOutOfRange = false;
+    
+    ~TMXPlaneReader()
+    {
+        for( auto plane : planes )
+        {
+            delete[] plane;
+        }
+    }
+    
+    void endElement( void* ctx, const char* name ) override
+    {
+        int attribs = getLayerAttribs();
+        if( strcmp( name, "data" ) != 0 || !( attribs & ( cocos2d::TMXLayerAttribBase64 | cocos2d::TMXLayerAttribCSV ) ) )
+        {
+            cocos2d::TMXMapInfo::endElement( ctx, name );
+            return;
+        }
+        
+        setStoringCharacters( false );
+        const cocos2d::Size& layerSize = getLayers().back()->_layerSize;
+        _planeSize = (int)layerSize.width * (int)layerSize.height;
+        _plane = new uint16_t[_planeSize]{0};
+        _gid = 0;
+        _byteIndex = 0;
+        
+        // Same precedence as the engine: the attribute bits accumulate across layers.
+        bool decoded = ( attribs & cocos2d::TMXLayerAttribBase64 ) ? decodeBase64( attribs ) : decodeCSV();
+        if( !decoded )
+        {
+            CCLOG( "TMX: failed to decode the data of layer %s.", getLayers().back()->_name.c_str() );
+        }
+        
+        planes.resize( getLayers().size(), nullptr );
+        planes.back() = _plane;
+        _plane = nullptr;
+        setCurrentString( "" );
+    }
+
+private:
+
+    uint16_t* _plane = nullptr;
+    int _planeSize = 0;
+    uint32_t _gid = 0;
+    size_t _byteIndex = 0;
+    
+    /**
+     * Stores one decoded gid in the current plane, dropping the flip flags.
+     */
+    void storeGid( int index, uint32_t gid )
+    {
+        if( index >= _planeSize )
+        {
+            return;
+        }
+        gid &= cocos2d::kTMXFlippedMask;
+        gidOutOfRange = gidOutOfRange || gid > 0xFFFF;
+        _plane[index] = (uint16_t)gid;
+        maxGid = MAX( maxGid, gid );
+    }
+    
+    /**
+     * Appends raw little-endian gid bytes; a gid may straddle two calls.
+     */
+    void storeGidBytes( const unsigned char* bytes, size_t length )
+    {
+        for( size_t i = 0; i < length; ++i, ++_byteIndex )
+        {
+            _gid |= (uint32_t)bytes[i] << ( 8 * ( _byteIndex % 4 ) );
+            if( _byteIndex % 4 == 3 )
+            {
+                storeGid( (int)( _byteIndex / 4 ), _gid );
+                _gid = 0;
+            }
+        }
+    }
+    
+    bool decodeBase64( int attribs )
+    {
+        const std::string& text = getCurrentString();
+        unsigned char* buffer = nullptr;
+        int length = cocos2d::base64Decode( (const unsigned char*)text.c_str(), (unsigned int)text.length(), &buffer );
+        if( !buffer )
+        {
+            return false;
+        }
+        
+        bool decoded = true;
+        if( attribs & ( cocos2d::TMXLayerAttribGzip | cocos2d::TMXLayerAttribZlib ) )
+        {
+            z_stream stream = {};
+            // 15 window bits + 32: accept both zlib and gzip headers.
+            decoded = inflateInit2( &stream, 15 + 32 ) == Z_OK;
+            stream.next_in = buffer;
+            stream.avail_in = (uInt)length;
+            
+            unsigned char scratch[4096];
+            int result = Z_OK;
+            while( decoded && result == Z_OK )
+            {
+                stream.next_out = scratch;
+                stream.avail_out = sizeof( scratch );
+                result = inflate( &stream, Z_NO_FLUSH );
+                decoded = result == Z_OK || result == Z_STREAM_END;
+                storeGidBytes( scratch, sizeof( scratch ) - stream.avail_out );
+            }
+            inflateEnd( &stream );
+        }
+        else
+        {
+            storeGidBytes( buffer, (size_t)length );
+        }
+        free( buffer );
+        return decoded && _byteIndex == (size_t)_planeSize * 4;
+    }
+    
+    bool decodeCSV()
+    {
+        const char* cursor = getCurrentString().c_str();
+        int index = 0;
+        for( ; index < _planeSize; ++index )
+        {
+            char* end = nullptr;
+            unsigned long gid = strtoul( cursor, &end, 10 );
+            if( end == cursor )
+            {
+                break;
+            }
+            storeGid( index, (uint32_t)gid );
+            cursor = end;
+            while( *cursor == ',' || isspace( (unsigned char)*cursor ) )
+            {
+                ++cursor;
+            }
+        }
+        return index == _planeSize;
+    }
+};
 
-void MapInfo::loadMapInfo( std::string fullPath )
+/**
+ * Tiled conventions used by the loader:
+ *
+ * - Map properties: the JSON "properties" keys (path, name, version, useRealtimeLighting, useMergedMaterial,
+ *   diffuseAtlas, normalAtlas, tileSize, generateMipmaps, maxAnisotropy) plus "spritesheets" as a comma-separated
+ *   list and "ambientLight" as "r,g,b". tileSize defaults to the TMX tile width.
+ * - Every tile layer becomes a Plane. Its "height" property is the plane height.
+ * - Every gid becomes a Tile (tile index = gid - 1). Per-tile properties use the JSON tile keys (textureNorth, ...,
+ *   tag, textureLodBias).
+ * - The "actors" object group holds the Actors (object type, or name, is the actor type; "z" and "yaw" are
+ *   properties). The "behaviors" object group holds the Behaviors, in order, with onEnter/onExit/onCreate
+ *   properties. The "lights" object group holds the Lights, placed at the centre of their object, with
+ *   "lightHeight" (the object's own height is its size), "radius" and "color" ("r,g,b") properties.
+ *
+ * The engine's parser reads the properties, tilesets and objects. Base64 (optionally zlib/gzip) and csv layer data
+ * is decoded by TMXPlaneReader straight into each plane, without the engine's 32-bit gid arrays; only xml-encoded
+ * layers go through the engine's arrays.
+ *
+ * Like the JSON and compiled loaders, maps that fail to parse, use gids past the 16-bit planes, lack spritesheets
+ * for the sprite path or have no Player1 actor are rejected. Player1 is moved to the front of the actors, where the renderer expects the player.
+ */
+bool MapInfo::loadTMXData( const std::string& fullPath )
 {
-    if( fullPath.find( ".json" ) != std::string::npos )
+    TMXPlaneReader* tmx = new (std::nothrow) TMXPlaneReader();
+    if( !tmx || !tmx->initWithTMXFile( fullPath ) )
     {
-        loadJSONData( cocos2d::FileUtils::getInstance()->getDataFromFile( fullPath.c_str() ) );
+        cocos2d::log( "MapInfo - %s: failed to parse the TMX map.", fullPath.c_str() );
+        CC_SAFE_RELEASE( tmx );
+        return false;
     }
-    else if( fullPath.find( ".tmx" ) != std::string::npos )
+    
+    bool gidOutOfRange = tmx->gidOutOfRange;
+    for( const auto layer : tmx->getLayers() )
+    {
+        int layerSize = (int)layer->_layerSize.width * (int)layer->_layerSize.height;
+        for( int i = 0; layer->_tiles && i < layerSize && !gidOutOfRange; ++i )
+        {
+            gidOutOfRange = ( layer->_tiles[i] & cocos2d::kTMXFlippedMask ) > 0xFFFF;
+        }
+    }
+    if( gidOutOfRange )
     {
-        loadTMXData();
+        cocos2d::log( "MapInfo - %s: gid out of range for 16-bit planes.", fullPath.c_str() );
+        tmx->release();
+        return false;
     }
-    else
+    
+    //
+    // PROPERTIES
+    //
+    const cocos2d::ValueMap& props = tmx->getProperties();
+    auto getProperty = [&props]( const char* key ) -> cocos2d::Value
+    {
+        auto found = props.find( key );
+        return ( found != props.end() ) ? found->second : cocos2d::Value::Null;
+    };
+    
+    width = (int)tmx->getMapSize().width;
+    height = (int)tmx->getMapSize().height;
+    tileSize = getProperty( "tileSize" ).isNull() ? (int)tmx->getTileSize().width : getProperty( "tileSize" ).asInt();
+    path = getProperty( "path" ).asString();
+    name = getProperty( "name" ).asString();
+    version = getProperty( "version" ).asString();
+    useRealtimeLighting = getProperty( "useRealtimeLighting" ).asBool();
+    useMergedMaterial = useRealtimeLighting && getProperty( "useMergedMaterial" ).asBool();
+    diffuseAtlas = getProperty( "diffuseAtlas" ).asString();
+    normalAtlas = getProperty( "normalAtlas" ).asString();
+    generateMipmaps = getProperty( "generateMipmaps" ).asBool();
+    maxAnisotropy = getProperty( "maxAnisotropy" ).isNull() ? 1.0f : getProperty( "maxAnisotropy" ).asFloat();
+    parseColorList( getProperty( "ambientLight" ).asString(), ambientLight );
+    
+    std::stringstream sheets( getProperty( "spritesheets" ).asString() );
+    std::string sheet;
+    while( std::getline( sheets, sheet, ',' ) )
+    {
+        if( !sheet.empty() )
+        {
+            spritesheets.push_back( sheet );
+        }
+    }
+    if( !useRealtimeLighting && spritesheets.empty() )
+    {
+        cocos2d::log( "MapInfo - %s: %s", fullPath.c_str(), SPRITESHEET_UNDEFINED_ERR_MSG );
+        tmx->release();
+        return false;
+    }
+    
+    //
+    // PLANES
+    //
+    int mapSize = width * height;
+    uint32_t maxGid = tmx->maxGid;
+    const auto& layers = tmx->getLayers();
+    tmx->planes.resize( layers.size(), nullptr );
+    planes.reserve( layers.size() );
+    for( int index = 0; index < layers.size(); ++index )
+    {
+        const auto layer = layers.at( index );
+        Plane plane;
+        auto heightProperty = layer->getProperties().find( TMX_LAYER_HEIGHT_PROPERTY );
+        if( heightProperty != layer->getProperties().end() )
+        {
+            plane.height = heightProperty->second.asInt();
+        }
+        else
+        {
+            CCLOG( "TMX: layer %s has no height property, using 0.", layer->_name.c_str() );
+            plane.height = 0;
+        }
+        
+        // Layers decoded by the reader are handed over as they are; xml layers are converted from the engine's array.
+        plane.map = tmx->planes[index];
+        tmx->planes[index] = nullptr;
+        if( plane.map == nullptr )
+        {
+            plane.map = new uint16_t[mapSize]{0};
+        }
+        else if( layer->_layerSize.width != width || layer->_layerSize.height != height )
+        {
+            CCLOG( "TMX: layer %s is not the size of the map, using an empty plane.", layer->_name.c_str() );
+            delete[] plane.map;
+            plane.map = new uint16_t[mapSize]{0};
+        }
+        if( layer->_tiles )
+        {
+            for( int i = 0; i < mapSize; ++i )
+            {
+                uint32_t gid = layer->_tiles[i] & cocos2d::kTMXFlippedMask;
+                plane.map[i] = (uint16_t)gid;
+                maxGid = MAX( maxGid, gid );
+            }
+        }
+        planes.push_back( plane );
+    }
+    
+    //
+    // TILES
+    //
+    cocos2d::ValueMapIntKey& tileProperties = tmx->getTileProperties();
+    for( const auto& entry : tileProperties )
+    {
+        maxGid = MAX( maxGid, (uint32_t)entry.first );
+    }
+    
+    tiles.resize( maxGid );
+    for( const auto& entry : tileProperties )
+    {
+        if( entry.first <= 0 || entry.second.getType() != cocos2d::Value::Type::MAP )
+        {
+            continue;
+        }
+        
+        Tile& tile = tiles[ entry.first - 1 ];
+        const cocos2d::ValueMap& properties = entry.second.asValueMap();
+        std::string* fields[TILE_STRING_COUNT];
+        getTileStringFields( tile, fields );
+        for( int field = 0; field < TILE_STRING_COUNT; ++field )
+        {
+            auto found = properties.find( MAP_BINARY_TILE_KEYS[field] );
+            if( found != properties.end() )
+            {
+                *fields[field] = found->second.asString();
+            }
+        }
+        
+        auto tag = properties.find( "tag" );
+        if( tag != properties.end() )
+        {
+            tile.tag = tag->second.asInt();
+        }
+        
+        auto lodBias = properties.find( "textureLodBias" );
+        if( lodBias != properties.end() )
+        {
+            tile.textureLodBias = lodBias->second.asFloat();
+        }
+    }
+    
+    //
+    // ACTORS/BEHAVIORS/LIGHTS
+    //
+    float tileWidth = tmx->getTileSize().width;
+    float tileHeight = tmx->getTileSize().height;
+    for( const auto group : tmx->getObjectGroups() )
+    {
+        for( const auto& object : group->getObjects() )
+        {
+            const cocos2d::ValueMap& dict = object.asValueMap();
+            auto value = [&dict]( const char* key ) -> cocos2d::Value
+            {
+                auto found = dict.find( key );
+                return ( found != dict.end() ) ? found->second : cocos2d::Value::Null;
+            };
+            
+            if( group->getGroupName() == TMX_ACTORS_GROUP )
+            {
+                Actor actor;
+                actor.type = value( "type" ).asString().empty() ? value( "name" ).asString() : value( "type" ).asString();
+                
+                // The engine flips object y into cocos coordinates; flip it back to a row index.
+                float top = tmx->getMapSize().height * tileHeight - value( "y" ).asFloat() - value( "height" ).asFloat();
+                actor.x = (int)( value( "x" ).asFloat() / tileWidth );
+                actor.y = (int)( top / tileHeight );
+                actor.z = value( "z" ).asInt();
+                actor.yaw = value( "yaw" ).asFloat();
+                actors.push_back( actor );
+            }
+            else if( group->getGroupName() == TMX_BEHAVIORS_GROUP )
+            {
+                Behavior behavior;
+                behavior.onEnter = value( "onEnter" ).asString();
+                behavior.onExit = value( "onExit" ).asString();
+                behavior.onCreate = value( "onCreate" ).asString();
+                behaviors.push_back( behavior );
+            }
+            else if( group->getGroupName() == TMX_LIGHTS_GROUP )
+            {
+                Light light;
+                float top = tmx->getMapSize().height * tileHeight - value( "y" ).asFloat() - value( "height" ).asFloat();
+                light.x = ( value( "x" ).asFloat() + value( "width" ).asFloat() * 0.5f ) / tileWidth;
+                light.y = ( top + value( "height" ).asFloat() * 0.5f ) / tileHeight;
+                light.height = value( "lightHeight" ).asFloat();
+                parseColorList( value( "color" ).asString(), light.color );
+                if( !value( "radius" ).isNull() )
+                {
+                    light.radius = value( "radius" ).asFloat();
+                }
+                lights.push_back( light );
+            }
+        }
+    }
+    
+    tmx->release();
+    
+    // Tiled keeps objects in creation order, so Player1 is moved to the front rather than required there.
+    auto player = std::find_if( actors.begin(), actors.end(), []( const Actor& actor ) { return actor.type == PLAYER_ACTOR_STR; } );
+    if( player == actors.end() )
     {
-        CCASSERT( 0, "Unsupported filetype." );
+        cocos2d::log( "MapInfo - %s: %s", fullPath.c_str(), PLAYER_ACTOR_UNDEFINED_ERR_MSG );
+        return false;
     }
+    std::rotate( actors.begin(), player, player + 1 );
+    
+    // The JSON format requires a default trigger; TMX maps always get one.
+    triggers.push_back( Trigger() );
+    return true;
 }
 
 //==============================================================================
 //
-// TMX PARSER
+// COMPILED (BINARY) MAPS
 //
 //==============================================================================
 
-/*
- 
-    TODO: Implement the TMX parser.
- 
- */
-void MapInfo::loadTMXData()
+unsigned char* MapInfo::mapFile( const std::string& fullPath, size_t& size )
+{
+#ifdef MAP_FILE_MMAP_SUPPORTED
+    int fd = open( fullPath.c_str(), O_RDONLY );
+    if( fd < 0 )
+    {
+        return nullptr;
+    }
+    
+    struct stat info;
+    void* data = MAP_FAILED;
+    if( fstat( fd, &info ) == 0 && info.st_size > 0 )
+    {
+        data = mmap( nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+    
+    if( data == MAP_FAILED )
+    {
+        return nullptr;
+    }
+    _mappedData = data;
+    _mappedSize = (size_t)info.st_size;
+    size = _mappedSize;
+    return (unsigned char*)data;
+#else
+    return nullptr;
+#endif
+}
+
+bool MapInfo::loadBinaryData( const std::string& fullPath )
+{
+    auto fileUtils = cocos2d::FileUtils::getInstance();
+    size_t size = 0;
+    unsigned char* bytes = mapFile( fileUtils->fullPathForFilename( fullPath ), size );
+    if( !bytes )
+    {
+        cocos2d::Data data = fileUtils->getDataFromFile( fullPath );
+        ssize_t dataSize = 0;
+        _fileBuffer = data.takeBuffer( &dataSize );
+        bytes = _fileBuffer;
+        size = (size_t)dataSize;
+    }
+    
+    // Checked in full up front: release builds read the file in place, so nothing may point past its end, and
+    // a rejected file leaves this MapInfo untouched for the JSON fallback.
+    std::string error = validateBinaryMap( bytes, size );
+    if( !error.empty() )
+    {
+        cocos2d::log( "MapInfo - %s: %s (%s)", fullPath.c_str(), BINARY_MAP_INVALID_ERR_MSG, error.c_str() );
+        releaseFileData();
+        return false;
+    }
+    const MapBinaryHeader* header = (const MapBinaryHeader*)bytes;
+    
+    const char* strings = (const char*)bytes + header->stringTableOffset;
+    
+    path = strings + header->path;
+    name = strings + header->name;
+    version = strings + header->mapVersion;
+    tileSize = header->tileSize;
+    width = header->width;
+    height = header->height;
+    useRealtimeLighting = ( header->flags & MAP_BINARY_FLAG_REALTIME_LIGHTING ) != 0;
+    useMergedMaterial = ( header->flags & MAP_BINARY_FLAG_MERGED_MATERIAL ) != 0;
+    diffuseAtlas = strings + header->diffuseAtlas;
+    normalAtlas = strings + header->normalAtlas;
+    generateMipmaps = ( header->flags & MAP_BINARY_FLAG_GENERATE_MIPMAPS ) != 0;
+    maxAnisotropy = header->maxAnisotropy;
+    
+    const uint32_t* spritesheetNames = (const uint32_t*)( bytes + header->spritesheetOffset );
+    spritesheets.reserve( header->spritesheetCount );
+    for( uint32_t i = 0; i < header->spritesheetCount; ++i )
+    {
+        spritesheets.push_back( strings + spritesheetNames[i] );
+    }
+    
+    const MapBinaryTile* tileRecords = (const MapBinaryTile*)( bytes + header->tileOffset );
+    tiles.resize( header->tileCount );
+    tileFlags.resize( header->tileCount );
+    tileInstanceCounts.resize( header->tileCount );
+    tileMaxChunkInstances.resize( header->tileCount );
+    for( uint32_t i = 0; i < header->tileCount; ++i )
+    {
+        Tile& tile = tiles[i];
+        std::string* fields[TILE_STRING_COUNT];
+        getTileStringFields( tile, fields );
+        for( int field = 0; field < TILE_STRING_COUNT; ++field )
+        {
+            uint32_t offset = tileRecords[i].strings[field];
+            if( offset != 0 )
+            {
+                *fields[field] = strings + offset;
+            }
+        }
+        tile.tag = tileRecords[i].tag;
+        tile.textureLodBias = tileRecords[i].textureLodBias;
+        tileFlags[i] = tileRecords[i].flags;
+        tileInstanceCounts[i] = tileRecords[i].instanceCount;
+        tileMaxChunkInstances[i] = tileRecords[i].maxChunkInstances;
+    }
+    
+    const MapBinaryActor* actorRecords = (const MapBinaryActor*)( bytes + header->actorOffset );
+    actors.resize( header->actorCount );
+    for( uint32_t i = 0; i < header->actorCount; ++i )
+    {
+        actors[i].type = strings + actorRecords[i].type;
+        actors[i].x = actorRecords[i].x;
+        actors[i].y = actorRecords[i].y;
+        actors[i].z = actorRecords[i].z;
+        actors[i].yaw = actorRecords[i].yaw;
+    }
+    
+    const MapBinaryBehavior* behaviorRecords = (const MapBinaryBehavior*)( bytes + header->behaviorOffset );
+    behaviors.resize( header->behaviorCount );
+    for( uint32_t i = 0; i < header->behaviorCount; ++i )
+    {
+        behaviors[i].onEnter = strings + behaviorRecords[i].onEnter;
+        behaviors[i].onExit = strings + behaviorRecords[i].onExit;
+        behaviors[i].onCreate = strings + behaviorRecords[i].onCreate;
+    }
+    
+    const MapBinaryTrigger* triggerRecords = (const MapBinaryTrigger*)( bytes + header->triggerOffset );
+    triggers.resize( header->triggerCount );
+    for( uint32_t i = 0; i < header->triggerCount; ++i )
+    {
+        triggers[i].continueRaycast = triggerRecords[i].continueRaycast != 0;
+    }
+    
+    const MapBinaryLight* lightRecords = (const MapBinaryLight*)( bytes + header->lightOffset );
+    lights.resize( header->lightCount );
+    for( uint32_t i = 0; i < header->lightCount; ++i )
+    {
+        lights[i].x = lightRecords[i].x;
+        lights[i].y = lightRecords[i].y;
+        lights[i].height = lightRecords[i].height;
+        memcpy( lights[i].color, lightRecords[i].color, sizeof( lights[i].color ) );
+        lights[i].radius = lightRecords[i].radius;
+    }
+    memcpy( ambientLight, header->ambientLight, sizeof( ambientLight ) );
+    
+    // The plane (or chunk) arrays are used in place.
+    bool chunked = ( header->flags & MAP_BINARY_FLAG_CHUNKED ) != 0;
+    const MapBinaryPlane* planeRecords = (const MapBinaryPlane*)( bytes + header->planeOffset );
+    planes.resize( header->planeCount );
+    for( uint32_t i = 0; i < header->planeCount; ++i )
+    {
+        planes[i].height = planeRecords[i].height;
+        planes[i].map = chunked ? nullptr : (uint16_t*)( bytes + planeRecords[i].mapOffset );
+    }
+    _ownsPlaneMaps = false;
+    
+    const MapBinaryPlaneLevel* levelRecords = (const MapBinaryPlaneLevel*)( bytes + header->planeLevelOffset );
+    const uint16_t* orderRecords = (const uint16_t*)( bytes + header->planeOrderOffset );
+    planeLevels.assign( levelRecords, levelRecords + header->planeLevelCount );
+    planeOrder.assign( orderRecords, orderRecords + header->planeCount );
+    if( header->cellFlagsOffset != 0 )
+    {
+        _cellFlags = bytes + header->cellFlagsOffset;
+    }
+    
+    if( chunked )
+    {
+        chunkSize = header->chunkSize;
+        chunksWide = ( width + chunkSize - 1 ) / chunkSize;
+        chunksHigh = ( height + chunkSize - 1 ) / chunkSize;
+        
+        const MapBinaryChunk* chunkRecords = (const MapBinaryChunk*)( bytes + header->chunkOffset );
+        const MapBinaryTileUsage* usage = (const MapBinaryTileUsage*)( bytes + header->tileUsageOffset );
+        chunks.resize( header->planeCount * chunksWide * chunksHigh );
+        for( size_t i = 0; i < chunks.size(); ++i )
+        {
+            chunks[i].cells = (uint16_t*)( bytes + chunkRecords[i].cellOffset );
+            chunks[i].usage = usage + chunkRecords[i].usageIndex;
+            chunks[i].usageCount = chunkRecords[i].usageCount;
+        }
+    }
+    return true;
+}
+
+void MapInfo::releaseFileData()
+{
+#ifdef MAP_FILE_MMAP_SUPPORTED
+    if( _mappedData )
+    {
+        munmap( _mappedData, _mappedSize );
+    }
+#endif
+    _mappedData = nullptr;
+    _mappedSize = 0;
+    free( _fileBuffer );
+    _fileBuffer = nullptr;
+}
+
+bool MapInfo::isChunked() const
 {
+    return chunkSize > 0;
 }
 
 //==============================================================================
@@ -62,11 +1345,18 @@ void MapInfo::loadTMXData()
 //
 //==============================================================================
 
-void MapInfo::loadJSONData( cocos2d::Data fileData )
+bool MapInfo::loadJSONData( cocos2d::Data fileData )
 {
     std::string json( (const char*)fileData.getBytes(), fileData.getSize() );
     rapidjson::Document doc;
     doc.Parse( json.c_str() );
+    std::string error = validateJSONMap( doc );
+    if( !error.empty() )
+    {
+        cocos2d::log( "MapInfo - invalid map definition: %s.", error.c_str() );
+        return false;
+    }
+    
     loadJSONProperties( doc );
     loadJSONTiles( doc );
     loadJSONPlanes( doc );
@@ -78,6 +1368,8 @@ void MapInfo::loadJSONData( cocos2d::Data fileData )
      
      */
     loadJSONTriggers( doc );
+    loadJSONLights( doc );
+    return true;
 }
 
 void MapInfo::loadJSONProperties( const rapidjson::Document& doc )
@@ -115,6 +1407,27 @@ void MapInfo::loadJSONProperties( const rapidjson::Document& doc )
     CCASSERT( props["version"].IsString(), "" );
     version = props["version"].GetString();
     
+    if( props.HasMember( "generateMipmaps" ) )
+    {
+        CCASSERT( props["generateMipmaps"].IsBool(), "" );
+        generateMipmaps = props["generateMipmaps"].GetBool();
+    }
+    
+    if( props.HasMember( "maxAnisotropy" ) )
+    {
+        CCASSERT( props["maxAnisotropy"].IsNumber(), "" );
+        maxAnisotropy = props["maxAnisotropy"].GetDouble();
+    }
+    
+    if( props.HasMember( "ambientLight" ) )
+    {
+        CCASSERT( props["ambientLight"].IsArray() && props["ambientLight"].Size() == 3, "" );
+        for( rapidjson::SizeType i = 0; i < 3; ++i )
+        {
+            ambientLight[i] = props["ambientLight"][i].GetDouble();
+        }
+    }
+    
     if( !useRealtimeLighting )
     {
         CCASSERT( props.HasMember( "spritesheets" ), SPRITESHEET_UNDEFINED_ERR_MSG );
@@ -131,6 +1444,28 @@ void MapInfo::loadJSONProperties( const rapidjson::Document& doc )
     else
     {
         CCLOG( MESH_RENDERING_REMINDER );
+        
+        if( props.HasMember( "useMergedMaterial" ) )
+        {
+            CCASSERT( props["useMergedMaterial"].IsBool(), "" );
+            useMergedMaterial = props["useMergedMaterial"].GetBool();
+        }
+        
+        // Without a materialAtlas the tile images are packed into one at load (see BlockManager).
+        if( useMergedMaterial && props.HasMember( "materialAtlas" ) )
+        {
+            const rapidjson::Value& atlas = props["materialAtlas"];
+            CCASSERT( atlas.IsObject(), "" );
+            CCASSERT( atlas.HasMember( "diffuse" ), MATERIAL_ATLAS_UNDEFINED_ERR_MSG );
+            CCASSERT( atlas["diffuse"].IsString(), "" );
+            diffuseAtlas = atlas["diffuse"].GetString();
+            
+            if( atlas.HasMember( "normal" ) )
+            {
+                CCASSERT( atlas["normal"].IsString(), "" );
+                normalAtlas = atlas["normal"].GetString();
+            }
+        }
     }
 }
 
@@ -318,6 +1653,12 @@ void MapInfo::loadJSONTiles( const rapidjson::Document& doc )
             tile.tag = obj["tag"].GetInt();
         }
         
+        if( obj.HasMember( "textureLodBias" ) )
+        {
+            CCASSERT( obj["textureLodBias"].IsNumber(), "" );
+            tile.textureLodBias = obj["textureLodBias"].GetDouble();
+        }
+        
         tiles.push_back( tile );
     }
 }
@@ -345,7 +1686,7 @@ void MapInfo::loadJSONPlanes( const rapidjson::Document& doc )
         CCASSERT( obj["map"].IsArray(), "" );
         const rapidjson::Value& mapArray = obj["map"];
         
-        plane.map = new int[mapArray.Size()]{0};
+        plane.map = new uint16_t[mapArray.Size()]{0};
         
         for( int i = 0; i < mapArray.Size(); ++i )
         {
@@ -431,13 +1772,13 @@ void MapInfo::loadJSONBehaviors( const rapidjson::Document& doc )
         if( obj.HasMember( "onExit" ) )
         {
             CCASSERT( obj["onExit"].IsString(), "" );
-            behavior.onEnter = obj["onExit"].GetString();
+            behavior.onExit = obj["onExit"].GetString();
         }
         
         if( obj.HasMember( "onCreate" ) )
         {
             CCASSERT( obj["onCreate"].IsString(), "" );
-            behavior.onEnter = obj["onCreate"].GetString();
+            behavior.onCreate = obj["onCreate"].GetString();
         }
         
         behaviors.push_back( behavior );
@@ -474,9 +1815,59 @@ void MapInfo::loadJSONTriggers( const rapidjson::Document& doc )
     }
 }
 
+void MapInfo::loadJSONLights( const rapidjson::Document& doc )
+{
+    CCASSERT( doc.IsObject(), ASSERT_FAILED_NANO );
+    if( !doc.HasMember( KEY_LIGHTS ) )
+    {
+        return;
+    }
+    const rapidjson::Value& array = doc[KEY_LIGHTS];
+    CCASSERT( array.IsArray(), "" );
+    
+    lights.reserve( array.Size() );
+    
+    for( rapidjson::SizeType i = 0; i < array.Size(); ++i )
+    {
+        const rapidjson::Value& obj = array[i];
+        
+        CCASSERT( obj.IsObject(), "" );
+        Light light;
+        
+        CCASSERT( obj.HasMember( "x" ) && obj["x"].IsNumber(), "" );
+        light.x = obj["x"].GetDouble();
+        
+        CCASSERT( obj.HasMember( "y" ) && obj["y"].IsNumber(), "" );
+        light.y = obj["y"].GetDouble();
+        
+        if( obj.HasMember( "height" ) )
+        {
+            CCASSERT( obj["height"].IsNumber(), "" );
+            light.height = obj["height"].GetDouble();
+        }
+        
+        if( obj.HasMember( "color" ) )
+        {
+            CCASSERT( obj["color"].IsArray() && obj["color"].Size() == 3, "" );
+            for( rapidjson::SizeType component = 0; component < 3; ++component )
+            {
+                light.color[component] = obj["color"][component].GetDouble();
+            }
+        }
+        
+        if( obj.HasMember( "radius" ) )
+        {
+            CCASSERT( obj["radius"].IsNumber(), "" );
+            light.radius = obj["radius"].GetDouble();
+        }
+        
+        lights.push_back( light );
+    }
+}
+
 int MapInfo::getBehaviorIndex( int tileResourceIndex )
 {
-    return tiles[tileResourceIndex].tag;
+    return tileDescriptors[tileResourceIndex].tag;
 }
 
 //==============================================================================
@@ -496,13 +1887,14 @@ MapInfo::MapInfo()
 
 MapInfo::~MapInfo()
 {
-    if( planes.size() > 0 )
+    if( _ownsPlaneMaps )
     {
         for( int i = 0; i < planes.size(); ++i )
         {
-            delete planes[i].map;
+            delete[] planes[i].map;
         }
     }
+    releaseFileData();
     spritesheets.clear();
     tiles.clear();
     planes.clear();
@@ -11,6 +11,10 @@
 
 #include "cocos2d.h"
 #include "external/json/document.h"
+#include "MapBinaryFormat.h"
+#include "MapPrecompute.h"
+#include "BehaviorScript.h"
+#include "StringPool.hpp"
 #include "MapStructs.h"
 
 namespace mikedotcpp
@@ -59,6 +63,32 @@ namespace mikedotcpp
          */
         bool useRealtimeLighting = false;
         
+        /**
+         * Mesh rendering path only. When TRUE every tile type is drawn from one shared cube mesh and one material
+         * so the whole wall set renders in as few instanced draws as possible.
+         */
+        bool useMergedMaterial = false;
+        
+        /**
+         * Spritesheet names (without the extension) of the diffuse and normal atlases used by the merged material.
+         * The normal atlas must be packed with the same layout as the diffuse atlas. When diffuseAtlas is empty the
+         * tile images (and their normal maps) are packed into both atlases at load time.
+         */
+        std::string diffuseAtlas;
+        std::string normalAtlas;
+        
+        /**
+         * When TRUE every texture of the map gets a full mip chain at load (glGenerateMipmap, or the levels baked
+         * into compressed variants) and is sampled with trilinear filtering, so distant walls read small mips.
+         */
+        bool generateMipmaps = false;
+        
+        /**
+         * Anisotropic filtering level applied to the map textures (1 disables it). Clamped to what the driver
+         * supports; ignored without GL_EXT_texture_filter_anisotropic.
+         */
+        float maxAnisotropy = 1.0f;
+        
         /**
          * Collection of spritesheet names that this map depends on (includes the file extension).
          */
@@ -69,11 +99,47 @@ namespace mikedotcpp
          */
         TileCollection tiles;
         
+        /**
+         * One TileDescriptor per Tile (same index), with the tile strings interned in strings. Built by
+         * loadMapInfo(); use these wherever tiles are visited per instance or per frame.
+         */
+        TileDescriptorCollection tileDescriptors;
+        StringPool strings;
+        
         /**
          * Collection of the Plane objects.
          */
         PlaneCollection planes;
         
+        /**
+         * Chunked compiled maps only (see MAP_BINARY_FLAG_CHUNKED): the edge of a chunk in cells, 0 otherwise. The
+         * planes of a chunked map have no map array (Plane::map is NULL); their cells are streamed in by a
+         * MapChunkStreamer instead.
+         */
+        int chunkSize = 0;
+        int chunksWide = 0;
+        int chunksHigh = 0;
+        
+        /**
+         * planes.size() * chunksWide * chunksHigh chunks, plane-major then row-major.
+         */
+        ChunkCollection chunks;
+        
+        /**
+         * Precomputed by tools/mapcompiler for compiled maps, derived once at load for JSON and TMX maps (see
+         * MapPrecompute.h). Per tile: MAP_TILE_FLAG_* bits, placements over all planes and, chunked maps only, the
+         * most placements in a single chunk.
+         */
+        std::vector< uint32_t > tileFlags;
+        std::vector< int > tileInstanceCounts;
+        std::vector< int > tileMaxChunkInstances;
+        
+        /**
+         * Plane height index: the distinct plane heights, ascending, each with its range in planeOrder.
+         */
+        std::vector< MapBinaryPlaneLevel > planeLevels;
+        std::vector< uint16_t > planeOrder;
+        
         /**
          * Collection of Actor objects in the map. "Player1" is REQUIRED.
          */
@@ -85,6 +151,11 @@ namespace mikedotcpp
          */
         BehaviorCollection behaviors;
         
+        /**
+         * The behaviors' scripts, compiled at load (see BehaviorScript.h).
+         */
+        BehaviorProgram behaviorProgram;
+        
         /**
          *  -- DEPRECATED --
          * Special hint to the underlying system for help in optimizing raycasting.
@@ -92,15 +163,99 @@ namespace mikedotcpp
         TriggerCollection triggers;
         
         /**
-         * Can load map data from either a compatible JSON or TMX format.
+         * Static lights, baked into a light map by LightMap when the map is activated, and the light (linear RGB)
+         * every face receives on top of them. Maps without lights are drawn unlit.
+         */
+        LightCollection lights;
+        float ambientLight[3] = { 1.0f, 1.0f, 1.0f };
+        
+        /**
+         * Can load map data from either a compatible JSON, compiled binary (MAP_BINARY_EXTENSION) or TMX format.
+         * A compiled map that is stale or damaged is logged and replaced by the JSON next to it, if any. Returns
+         * FALSE when nothing could be loaded.
+         */
+        bool loadMapInfo( std::string fullPath );
+        
+        /**
+         * TRUE once loadMapInfo() succeeded. Check it after the constructor: a map that failed to load is empty.
+         */
+        bool isLoaded() const;
+        
+        /**
+         * The JSON definition a compiled map (MAP_BINARY_EXTENSION) is built from: the same path with a .json
+         * extension. Other paths are returned as they are.
          */
-        void loadMapInfo( std::string fullPath );
+        static std::string getSourcePath( const std::string& fullPath );
+        
+        /**
+         * TRUE when the planes are split into chunks (see chunks).
+         */
+        bool isChunked() const;
         
         /**
          * Returns the behavior index for the provided tile resource.
          */
         int getBehaviorIndex( int tileResourceIndex );
         
+        /**
+         * Returns the index into planeLevels of the planes at height, or -1.
+         */
+        int getPlaneLevel( float height ) const;
+        
+        /**
+         * Returns the first plane (in plane order) at height, or -1.
+         */
+        int getPlaneIndexForHeight( float height ) const;
+        
+        /**
+         * MAP_CELL_* flags of a cell (cellIndex = y * width + x). Chunked maps store none and report every face
+         * exposed; use tileFlags for them.
+         */
+        inline uint8_t getCellFlags( int planeIndex, int cellIndex ) const
+        {
+            if( _cellFlags )
+            {
+                return _cellFlags[ planeIndex * width * height + cellIndex ];
+            }
+            return MAP_CELL_EXPOSED_MASK;
+        }
+        
+        /**
+         * TRUE when the cell flags are known per cell (every map that is not chunked).
+         */
+        bool hasCellFlags() const;
+        
+        /**
+         * Derives the cell flags again after cells changed at runtime (doors, pushwalls). Walks the whole map, so
+         * it is meant for the occasional edit; chunked maps have no cell flags.
+         */
+        void refreshCellFlags();
+        
+        /**
+         * The stored tile (1-based, 0 for void) of a cell. Chunked maps are read from the compiled chunks, which
+         * lag behind the edits of a MapChunkStreamer until it writes them back; use GBRaycaster::getTileIndexAt()
+         * around the player.
+         */
+        inline uint16_t getCell( int planeIndex, int x, int y ) const
+        {
+            if( chunkSize > 0 )
+            {
+                int chunkX = x / chunkSize;
+                int chunkY = y / chunkSize;
+                const uint16_t* cells = chunks[ ( planeIndex * chunksHigh + chunkY ) * chunksWide + chunkX ].cells;
+                return cells[ ( y - chunkY * chunkSize ) * chunkSize + x - chunkX * chunkSize ];
+            }
+            return planes[planeIndex].map[ y * width + x ];
+        }
+        
+        /**
+         * Hot reload: merges an edited copy of this map (loaded from the same file after it changed) into this one.
+         * Tile definitions, plane cells, actors, behaviors, triggers and lights are copied over and the precomputed
+         * data derived again; edited is left in an unspecified state. Nothing is applied when the edit requires a
+         * full reload (see MapEdit), which includes every chunked map.
+         */
+        MapEdit applyEdits( MapInfo& edited );
+        
         /**
          * Instantiates MapInfo and calls MapInfo::loadMapInfo(...)
          */
@@ -115,17 +270,77 @@ namespace mikedotcpp
     private:
         /**
          * These functions simply parse JSON file data into the appropriate data structures for use with the rest 
-         * of the system.
+         * of the system. loadJSONData() checks the whole document first and returns FALSE, logging why, when it is
+         * not a valid map definition; the other loaders only assert.
          */
-        void loadJSONData( cocos2d::Data fileData );
+        bool loadJSONData( cocos2d::Data fileData );
         void loadJSONProperties( const rapidjson::Document& doc );
         void loadJSONTiles( const rapidjson::Document& doc );
         void loadJSONPlanes( const rapidjson::Document& doc );
         void loadJSONActors( const rapidjson::Document& doc );
         void loadJSONBehaviors( const rapidjson::Document& doc );
         void loadJSONTriggers( const rapidjson::Document& doc );
-        void loadTMXData();
+        void loadJSONLights( const rapidjson::Document& doc );
+        
+        /**
+         * Parses a Tiled map with the engine's TMX parser. Each tile layer becomes a Plane; see the implementation
+         * for the property conventions. Returns FALSE, logging why, when the map can't be used.
+         */
+        bool loadTMXData( const std::string& fullPath );
+        
+        /**
+         * Loads a compiled map (see MapBinaryFormat.h). The file is memory-mapped where possible and the plane
+         * arrays point into it, so nothing is parsed per map element. Returns FALSE, logging why and leaving the
+         * MapInfo untouched, when the file is not a complete compiled map of the current MAP_BINARY_VERSION whose
+         * first actor is Player1.
+         */
+        bool loadBinaryData( const std::string& fullPath );
+        
+        /**
+         * Interns the tile strings and builds tileDescriptors from tiles.
+         */
+        void buildTileDescriptors();
+        
+        /**
+         * Derives the precomputed data (tileFlags, tileInstanceCounts, planeLevels, cell flags) of a map that was not
+         * compiled. Requires tileDescriptors.
+         */
+        void precomputeMapData();
+        
+        /**
+         * Compiles the scripts of behaviors into behaviorProgram. Scripts that don't compile are logged and left
+         * out.
+         */
+        void compileBehaviors();
+        
+        /**
+         * planes.size() * width * height MAP_CELL_* flags, pointing into the compiled map or into _cellFlagStorage.
+         */
+        const uint8_t* _cellFlags = nullptr;
+        std::vector< uint8_t > _cellFlagStorage;
+        
+        /**
+         * Maps the whole file copy-on-write (so plane edits such as GBRaycaster::clearTileResourceAt stay private to
+         * this process). Returns nullptr when the file cannot be mapped, e.g. when it lives inside an APK.
+         */
+        unsigned char* mapFile( const std::string& fullPath, size_t& size );
+        
+        /**
+         * Backing storage of a compiled map: either a mapping (_mappedData) or a heap copy of the file
+         * (_fileBuffer). FALSE _ownsPlaneMaps means the plane arrays point into that storage.
+         */
+        void* _mappedData = nullptr;
+        size_t _mappedSize = 0;
+        unsigned char* _fileBuffer = nullptr;
+        bool _ownsPlaneMaps = true;
+        
+        /**
+         * Unmaps or frees the backing storage of a compiled map.
+         */
+        void releaseFileData();
         
+        bool _loaded = false;
+    
     };
 }
 
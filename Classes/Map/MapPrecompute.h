@@ -0,0 +1,199 @@
+//
+//  MapPrecompute.h
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef MapPrecompute_h
+#define MapPrecompute_h
+
+#include <algorithm>
+#include <vector>
+
+#include "MapBinaryFormat.h"
+
+/**
+ * Facts derived from the tiles and planes of a map. tools/mapcompiler runs these once and stores the results in
+ * the compiled map; MapInfo only runs them when it loads a JSON or TMX map, so both always agree.
+ *
+ * This header is shared with the compiler tool, so it must not depend on cocos2d.
+ */
+namespace mikedotcpp
+{
+    /**
+     * MAP_TILE_FLAG_* bits of a tile. hasField tells which MapBinaryTileString fields are set (after the billboard
+     * and model rules of MapInfo::loadJSONTiles).
+     */
+    inline uint32_t computeTileFlags( const bool hasField[TILE_STRING_COUNT], int tag )
+    {
+        bool hasSides = hasField[TILE_TEXTURE_ALL] || ( hasField[TILE_TEXTURE_NORTH] && hasField[TILE_TEXTURE_EAST] &&
+                                                        hasField[TILE_TEXTURE_SOUTH] && hasField[TILE_TEXTURE_WEST] );
+        uint32_t flags = 0;
+        if( hasSides && !hasField[TILE_BILLBOARD_TEXTURE] && !hasField[TILE_MODEL] )
+        {
+            flags |= MAP_TILE_FLAG_SOLID;
+        }
+        if( tag == MAP_BLOCKING_TAG )
+        {
+            flags |= MAP_TILE_FLAG_BLOCKING;
+        }
+
+        int faceCount = 0;
+        for( int field = TILE_TEXTURE_NORTH; field <= TILE_TEXTURE_CENTER_SPAN_EW; ++field )
+        {
+            faceCount += hasField[field] ? 1 : 0;
+        }
+        if( faceCount == 1 && !hasField[TILE_BILLBOARD_TEXTURE] && !hasField[TILE_MODEL] )
+        {
+            flags |= hasField[TILE_TEXTURE_CENTER_SPAN_NS] ? MAP_TILE_FLAG_DOOR_NS : 0;
+            flags |= hasField[TILE_TEXTURE_CENTER_SPAN_EW] ? MAP_TILE_FLAG_DOOR_EW : 0;
+        }
+        return flags;
+    }
+
+    /**
+     * Counts the placements of every tile over all planes (planeMaps hold mapSize 1-based tile indices each).
+     */
+    inline void computeTileInstanceCounts( const std::vector< const uint16_t* >& planeMaps, size_t mapSize, size_t tileCount,
+                                           std::vector< uint32_t >& counts )
+    {
+        counts.assign( tileCount, 0 );
+        for( const uint16_t* map : planeMaps )
+        {
+            for( size_t i = 0; i < mapSize; ++i )
+            {
+                if( map[i] > 0 && map[i] <= tileCount )
+                {
+                    ++counts[ map[i] - 1 ];
+                }
+            }
+        }
+    }
+
+    /**
+     * Groups the planes by height: levels ascend by height and order lists the plane indices of each level.
+     */
+    inline void computePlaneLevels( const std::vector< int >& heights, std::vector< MapBinaryPlaneLevel >& levels,
+                                    std::vector< uint16_t >& order )
+    {
+        order.resize( heights.size() );
+        for( size_t i = 0; i < order.size(); ++i )
+        {
+            order[i] = (uint16_t)i;
+        }
+        std::stable_sort( order.begin(), order.end(), [&heights]( uint16_t a, uint16_t b )
+        {
+            return heights[a] < heights[b];
+        } );
+
+        levels.clear();
+        for( size_t i = 0; i < order.size(); ++i )
+        {
+            if( levels.empty() || levels.back().height != heights[ order[i] ] )
+            {
+                MapBinaryPlaneLevel level = { heights[ order[i] ], (uint32_t)i, 0 };
+                levels.push_back( level );
+            }
+            ++levels.back().count;
+        }
+    }
+
+    /**
+     * Returns the index of the level at height, or -1.
+     */
+    inline int findPlaneLevel( const std::vector< MapBinaryPlaneLevel >& levels, float height )
+    {
+        auto found = std::lower_bound( levels.begin(), levels.end(), height, []( const MapBinaryPlaneLevel& level, float value )
+        {
+            return level.height < value;
+        } );
+        return ( found != levels.end() && found->height == height ) ? (int)( found - levels.begin() ) : -1;
+    }
+
+    /**
+     * Fills width * height MAP_CELL_* flags per plane. A face is hidden by a solid cell next to it on the same plane
+     * or, for the top and bottom faces, on a plane one tileSize above or below. Faces on the map edge stay exposed.
+     *
+     * Neighbours follow the block orientation of BlockManager::orientSpriteFace: map columns run along +z and map
+     * rows along -x.
+     */
+    inline void computeCellFlags( const std::vector< const uint16_t* >& planeMaps, const std::vector< int >& heights,
+                                  int width, int height, int tileSize, const std::vector< uint32_t >& tileFlags,
+                                  const std::vector< MapBinaryPlaneLevel >& levels, const std::vector< uint16_t >& order,
+                                  std::vector< uint8_t >& cellFlags )
+    {
+        size_t mapSize = (size_t)width * height;
+        cellFlags.assign( planeMaps.size() * mapSize, 0 );
+        for( size_t plane = 0; plane < planeMaps.size(); ++plane )
+        {
+            for( size_t i = 0; i < mapSize; ++i )
+            {
+                uint16_t tile = planeMaps[plane][i];
+                uint32_t flags = ( tile > 0 && tile <= tileFlags.size() ) ? tileFlags[ tile - 1 ] : 0;
+                if( flags & MAP_TILE_FLAG_SOLID )
+                {
+                    cellFlags[ plane * mapSize + i ] = MAP_CELL_SOLID;
+                }
+                else if( !( flags & MAP_TILE_FLAG_BLOCKING ) )
+                {
+                    cellFlags[ plane * mapSize + i ] = MAP_CELL_WALKABLE;
+                }
+            }
+        }
+
+        auto isSolid = [&]( size_t plane, int x, int y ) -> bool
+        {
+            if( x < 0 || y < 0 || x >= width || y >= height )
+            {
+                return false;
+            }
+            return ( cellFlags[ plane * mapSize + y * width + x ] & MAP_CELL_SOLID ) != 0;
+        };
+        auto isLevelSolid = [&]( int level, int x, int y ) -> bool
+        {
+            if( level < 0 )
+            {
+                return false;
+            }
+            for( uint32_t i = 0; i < levels[level].count; ++i )
+            {
+                if( isSolid( order[ levels[level].first + i ], x, y ) )
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // FaceDirection order: north, south, east, west.
+        const int sideX[] = { -1, 1, 0, 0 };
+        const int sideY[] = { 0, 0, -1, 1 };
+        for( size_t plane = 0; plane < planeMaps.size(); ++plane )
+        {
+            int above = findPlaneLevel( levels, (float)( heights[plane] + tileSize ) );
+            int below = findPlaneLevel( levels, (float)( heights[plane] - tileSize ) );
+            for( int y = 0; y < height; ++y )
+            {
+                for( int x = 0; x < width; ++x )
+                {
+                    if( planeMaps[plane][ y * width + x ] == 0 )
+                    {
+                        continue;
+                    }
+                    uint8_t exposed = 0;
+                    for( int side = 0; side < 4; ++side )
+                    {
+                        exposed |= isSolid( plane, x + sideX[side], y + sideY[side] ) ? 0 : ( 1 << side );
+                    }
+                    exposed |= isLevelSolid( above, x, y ) ? 0 : ( 1 << 4 );
+                    exposed |= isLevelSolid( below, x, y ) ? 0 : ( 1 << 5 );
+                    cellFlags[ plane * mapSize + y * width + x ] |= exposed;
+                }
+            }
+        }
+    }
+}
+
+#endif /* MapPrecompute_h */
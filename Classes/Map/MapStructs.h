@@ -16,14 +16,20 @@ namespace mikedotcpp
      */
     struct Tile;
     typedef std::vector< Tile > TileCollection;
+    struct TileDescriptor;
+    typedef std::vector< TileDescriptor > TileDescriptorCollection;
     struct Plane;
     typedef std::vector< Plane > PlaneCollection;
+    struct MapChunk;
+    typedef std::vector< MapChunk > ChunkCollection;
     struct Actor;
     typedef std::vector< Actor > ActorCollection;
     struct Behavior;
     typedef std::vector< Behavior > BehaviorCollection;
     struct Trigger;
     typedef std::vector< Trigger > TriggerCollection;
+    struct Light;
+    typedef std::vector< Light > LightCollection;
     
     /**
      * The basic building block for tile sets in raycast games. The basic default struct conforms to the data
@@ -97,6 +103,72 @@ namespace mikedotcpp
          * An optional tag to link this tile to a trigger or other action. Used for doors, pushwalls, etc.
          */
         int tag = -1;
+        
+        /**
+         * Added to the mip level the GPU selects for this tile's textures. Positive values sample smaller mips
+         * (blurrier, less bandwidth), negative values sharper ones. Only meaningful when the textures have mipmaps
+         * (see MapInfo::generateMipmaps).
+         */
+        float textureLodBias = 0.0f;
+    };
+    
+    /**
+     * Parsed Tile::textureWrapMode, Tile::textureMinFilter and Tile::textureMagFilter. "unset" means the map did not
+     * specify the parameter.
+     */
+    enum class TextureWrapMode : uint8_t
+    {
+        unset, clampToEdge, repeat
+    };
+    
+    enum class TextureFilter : uint8_t
+    {
+        unset, nearest, linear, linearMipmapLinear
+    };
+    
+    /**
+     * TileDescriptor::flags bits.
+     */
+    enum TileDescriptorFlags : uint8_t
+    {
+        TILE_FLAG_BILLBOARD         = 1 << 0,
+        TILE_FLAG_MODEL             = 1 << 1,
+        TILE_FLAG_TEXTURE_ALL       = 1 << 2,
+        TILE_FLAG_CUSTOM_TEX_PARAMS = 1 << 3
+    };
+    
+    /**
+     * Compact runtime form of a Tile, built once at load (see MapInfo::tileDescriptors). Every string field is an
+     * id in MapInfo::strings and the texture parameters are parsed, so code that runs per tile instance neither
+     * copies nor compares strings.
+     */
+    struct TileDescriptor
+    {
+        /**
+         * String ids of the Tile fields, indexed by MapBinaryTileString. STRING_ID_NONE for empty fields.
+         */
+        StringID strings[TILE_STRING_COUNT];
+        
+        int tag = -1;
+        float textureLodBias = 0.0f;
+        TextureWrapMode wrapMode = TextureWrapMode::unset;
+        TextureFilter minFilter = TextureFilter::unset;
+        TextureFilter magFilter = TextureFilter::unset;
+        
+        /**
+         * TileDescriptorFlags bits.
+         */
+        uint8_t flags = 0;
+        
+        inline StringID get( MapBinaryTileString field ) const
+        {
+            return strings[field];
+        }
+        
+        inline bool hasFlag( TileDescriptorFlags flag ) const
+        {
+            return ( flags & flag ) != 0;
+        }
     };
     
     /**
@@ -111,9 +183,28 @@ namespace mikedotcpp
         
         /**
          * Defines a layer of map spots that create the layout of the level. Indexes into tiles array. Index zero
-         * (0) is considered void and is ignored.
+         * (0) is considered void and is ignored. Either owned by the MapInfo or pointing straight into a mapped
+         * compiled map file (see MapBinaryFormat.h).
          */
-        int* map;
+        uint16_t* map;
+    };
+    
+    /**
+     * A chunkSize * chunkSize block of one plane of a chunked (streamed) map, see MapChunkStreamer.
+     */
+    struct MapChunk
+    {
+        /**
+         * Tile indices of the chunk, row-major within the chunk, inside the mapped compiled map. The streamer
+         * copies them out as the player approaches; they are not read directly.
+         */
+        uint16_t* cells;
+        
+        /**
+         * The distinct tiles placed in this chunk and how many times (see MapBinaryTileUsage).
+         */
+        const MapBinaryTileUsage* usage;
+        int usageCount;
     };
     
     /**
@@ -157,6 +248,34 @@ namespace mikedotcpp
         std::string onCreate;
     };
     
+    /**
+     * A static point light, baked into the light map when the map loads (see LightMap). Unlike an Actor it may sit
+     * anywhere in a cell: x and y are in cells (the centre of column 2 is x = 2.5).
+     */
+    struct Light
+    {
+        /**
+         * COLUMN and ROW position, in cells.
+         */
+        float x;
+        float y;
+        
+        /**
+         * Height in the units of Plane::height; the centre of the blocks of a plane at height 0 is at 0.
+         */
+        float height = 0.0f;
+        
+        /**
+         * Linear RGB; values above 1 brighten the faces the light reaches.
+         */
+        float color[3] = { 1.0f, 1.0f, 1.0f };
+        
+        /**
+         * Distance (in cells) at which the light has faded out.
+         */
+        float radius = 4.0f;
+    };
+    
     /**
      *  -- DEPRECATED --
      */
@@ -164,6 +283,29 @@ namespace mikedotcpp
     {
         bool continueRaycast = false;
     };
+    
+    /**
+     * Result of MapInfo::applyEdits: what the running map has to rebuild after an edited copy was merged into it.
+     */
+    struct MapEdit
+    {
+        /**
+         * The edit changed something the blocks and raycaster were sized or configured for (dimensions, planes,
+         * rendering path, tile count, textures settings, chunking, whether there are lights at all); nothing was
+         * applied and the map must be loaded again.
+         */
+        bool requiresFullReload = false;
+        
+        /**
+         * Tiles whose definition or number of placements changed; their blocks must be recreated.
+         */
+        std::vector< int > changedTiles;
+        
+        /**
+         * Number of map cells that now hold a different tile.
+         */
+        int changedCells = 0;
+    };
 }
 
 
@@ -0,0 +1,29 @@
+//
+//  StringPool.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "StringPool.hpp"
+
+using namespace mikedotcpp;
+
+StringPool::StringPool()
+{
+    intern( "" );
+}
+
+StringID StringPool::intern( const std::string& value )
+{
+    auto found = _ids.find( value );
+    if( found != _ids.end() )
+    {
+        return found->second;
+    }
+    StringID id = (StringID)_strings.size();
+    _strings.push_back( value );
+    _ids.emplace( value, id );
+    return id;
+}
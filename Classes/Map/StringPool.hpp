@@ -0,0 +1,69 @@
+//
+//  StringPool.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef StringPool_hpp
+#define StringPool_hpp
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Id of the empty string in every pool.
+ */
+#define STRING_ID_NONE 0
+
+namespace mikedotcpp
+{
+    /**
+     * Interned string id. Equal strings of the same pool have equal ids, so they can be compared and used as
+     * array indices without touching the characters.
+     */
+    typedef uint32_t StringID;
+    
+    /**
+     * Deduplicating string table built at map load (see MapInfo::strings). Strings are never removed, and
+     * references returned by get() stay valid for the lifetime of the pool.
+     */
+    class StringPool
+    {
+    public:
+        StringPool();
+        
+        /**
+         * Returns the id of value, adding it on first use.
+         */
+        StringID intern( const std::string& value );
+        
+        /**
+         * Returns the string of an id returned by intern().
+         */
+        inline const std::string& get( StringID id ) const
+        {
+            return _strings[id];
+        }
+        
+        /**
+         * Number of distinct strings, including the empty string. Ids are always below this value.
+         */
+        inline size_t size() const
+        {
+            return _strings.size();
+        }
+    
+    protected:
+        /**
+         * A deque, so growing the pool never moves existing strings.
+         */
+        std::deque< std::string > _strings;
+        std::unordered_map< std::string, StringID > _ids;
+    };
+}
+
+#endif /* StringPool_hpp */
@@ -10,6 +10,90 @@
 
 using namespace mikedotcpp;
 
+#define PROGRAM_CACHE_KEY_PREFIX "BatchedGLProgram:"
+#define PROGRAM_BINARY_DIRECTORY "programcache/"
+#define PROGRAM_BINARY_MAGIC 0x42475042 // 'BGPB'
+
+//
+// NOTE: Program binaries are core in desktop GL 4.1 (GL_ARB_get_program_binary) and an extension on GLES2
+//       (GL_OES_get_program_binary). The legacy Mac context and iOS GLES2 expose neither, so on those platforms
+//       only the in-memory de-duplication is used.
+//
+#if ( CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID ) && defined( GL_OES_get_program_binary )
+#define PROGRAM_BINARY_SUPPORTED 1
+#define PROGRAM_BINARY_EXTENSION "GL_OES_get_program_binary"
+#define PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#define PROGRAM_BINARY_FORMAT_COUNT GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#define getProgramBinary glGetProgramBinaryOES
+#define programBinary glProgramBinaryOES
+#elif ( CC_TARGET_PLATFORM == CC_PLATFORM_WIN32 || CC_TARGET_PLATFORM == CC_PLATFORM_LINUX ) && defined( GL_ARB_get_program_binary )
+#define PROGRAM_BINARY_SUPPORTED 1
+#define PROGRAM_BINARY_EXTENSION "GL_ARB_get_program_binary"
+#define PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH
+#define PROGRAM_BINARY_FORMAT_COUNT GL_NUM_PROGRAM_BINARY_FORMATS
+#define getProgramBinary glGetProgramBinary
+#define programBinary glProgramBinary
+#else
+#define PROGRAM_BINARY_SUPPORTED 0
+#endif
+
+bool BatchedGLProgram::s_binaryCacheEnabled = false;
+
+/**
+ * Same conversion as the (file-local) cocos2d::GLProgram helper: "A=1;B" becomes "#define A=1\n#define B\n".
+ */
+static void replaceDefines( const std::string& compileTimeDefines, std::string& out )
+{
+    if( !compileTimeDefines.empty() )
+    {
+        auto copyDefines = compileTimeDefines;
+        if( copyDefines[copyDefines.length()-1] != ';' )
+        {
+            copyDefines.append( 1, ';' );
+        }
+        
+        std::string currentDefine;
+        for( auto itChar: copyDefines )
+        {
+            if( itChar == ';' )
+            {
+                if( !currentDefine.empty() )
+                {
+                    out.append( "\n#define " + currentDefine );
+                    currentDefine.clear();
+                }
+            }
+            else
+            {
+                currentDefine.append( 1, itChar );
+            }
+        }
+        out += "\n";
+    }
+}
+
+/**
+ * TRUE when the current context can both save and load program binaries.
+ */
+static bool isProgramBinarySupported()
+{
+#if PROGRAM_BINARY_SUPPORTED
+    static int supported = -1;
+    if( supported < 0 )
+    {
+        GLint formatCount = 0;
+        if( cocos2d::Configuration::getInstance()->checkForGLExtension( PROGRAM_BINARY_EXTENSION ) )
+        {
+            glGetIntegerv( PROGRAM_BINARY_FORMAT_COUNT, &formatCount );
+        }
+        supported = ( formatCount > 0 ) ? 1 : 0;
+    }
+    return supported == 1;
+#else
+    return false;
+#endif
+}
+
 static const char * COCOS2D_SHADER_UNIFORMS =
 "uniform mat4 CC_PMatrix;\n"
 "uniform mat4 CC_MVMatrix;\n"
@@ -33,12 +117,29 @@ BatchedGLProgram::BatchedGLProgram()
     memset(_builtInUniforms, 0, sizeof(_builtInUniforms));
 }
 
-BatchedGLProgram* BatchedGLProgram::createWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename)
+BatchedGLProgram* BatchedGLProgram::getOrCreateWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& compileTimeDefines)
+{
+    std::string key = PROGRAM_CACHE_KEY_PREFIX + vShaderFilename + "|" + fShaderFilename + "|" + compileTimeDefines;
+    auto programCache = cocos2d::GLProgramCache::getInstance();
+    
+    // Only BatchedGLPrograms are ever stored under PROGRAM_CACHE_KEY_PREFIX.
+    BatchedGLProgram* program = static_cast< BatchedGLProgram* >( programCache->getGLProgram( key ) );
+    if( !program )
+    {
+        program = createWithFilenames( vShaderFilename, fShaderFilename, compileTimeDefines );
+        if( program )
+        {
+            programCache->addGLProgram( program, key );
+        }
+    }
+    return program;
+}
+
+BatchedGLProgram* BatchedGLProgram::createWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& compileTimeDefines)
 {
     auto ret = new (std::nothrow) BatchedGLProgram();
-    if( ret && ret->initWithFilenames( vShaderFilename, fShaderFilename ) )
+    if( ret && ret->initWithFilenames( vShaderFilename, fShaderFilename, compileTimeDefines ) )
     {
-        ret->link();
         ret->updateUniforms();
         ret->autorelease();
         return ret;
@@ -48,23 +149,57 @@ BatchedGLProgram* BatchedGLProgram::createWithFilenames(const std::string& vShad
     return nullptr;
 }
 
-bool BatchedGLProgram::initWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename)
+/**
+ * Unlike the base class, this also links the program (or loads it from the binary cache).
+ */
+bool BatchedGLProgram::initWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& compileTimeDefines)
 {
     auto fileUtils = cocos2d::FileUtils::getInstance();
     std::string vertexSource = fileUtils->getStringFromFile(cocos2d::FileUtils::getInstance()->fullPathForFilename(vShaderFilename));
     std::string fragmentSource = fileUtils->getStringFromFile(cocos2d::FileUtils::getInstance()->fullPathForFilename(fShaderFilename));
     
-    return initWithByteArrays(vertexSource.c_str(), fragmentSource.c_str());
+    std::string binaryPath;
+    if( s_binaryCacheEnabled && isProgramBinarySupported() )
+    {
+        binaryPath = getBinaryCachePath( vertexSource, fragmentSource, compileTimeDefines );
+        if( initWithBinaryFile( binaryPath ) )
+        {
+            return true;
+        }
+    }
+    
+    if( !initWithByteArrays( vertexSource.c_str(), fragmentSource.c_str(), compileTimeDefines ) )
+    {
+        return false;
+    }
+    
+#if PROGRAM_BINARY_SUPPORTED && ( CC_TARGET_PLATFORM != CC_PLATFORM_ANDROID )
+    if( !binaryPath.empty() )
+    {
+        glProgramParameteri( _program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+    }
+#endif
+    
+    if( !link() )
+    {
+        return false;
+    }
+    
+    if( !binaryPath.empty() )
+    {
+        saveBinaryFile( binaryPath );
+    }
+    return true;
 }
 
-bool BatchedGLProgram::initWithByteArrays(const GLchar* vShaderByteArray, const GLchar* fShaderByteArray )
+bool BatchedGLProgram::initWithByteArrays(const GLchar* vShaderByteArray, const GLchar* fShaderByteArray, const std::string& compileTimeDefines)
 {
     _program = glCreateProgram();
     CHECK_GL_ERROR_DEBUG();
 
     // convert defines here. If we do it in "compileShader" we will do it twice.
-    // a cache for the defines could be useful, but seems like overkill at this point
     std::string replacedDefines = "";
+    replaceDefines( compileTimeDefines, replacedDefines );
 
     _vertShader = _fragShader = 0;
 
@@ -150,3 +285,112 @@ bool BatchedGLProgram::compileShader(GLuint* shader, GLenum type, const GLchar*
     
     return (status == GL_TRUE);
 }
+
+void BatchedGLProgram::setBinaryCacheEnabled( bool enabled )
+{
+    s_binaryCacheEnabled = enabled;
+}
+
+bool BatchedGLProgram::isBinaryCacheEnabled()
+{
+    return s_binaryCacheEnabled;
+}
+
+std::string BatchedGLProgram::getBinaryCachePath( const std::string& vertexSource, const std::string& fragmentSource, const std::string& compileTimeDefines )
+{
+    const char* vendor = (const char*)glGetString( GL_VENDOR );
+    const char* renderer = (const char*)glGetString( GL_RENDERER );
+    const char* version = (const char*)glGetString( GL_VERSION );
+    
+    std::string key;
+    key.append( vendor ? vendor : "" ).append( 1, '\0' );
+    key.append( renderer ? renderer : "" ).append( 1, '\0' );
+    key.append( version ? version : "" ).append( 1, '\0' );
+    key.append( COCOS2D_SHADER_UNIFORMS ).append( 1, '\0' );
+    key.append( compileTimeDefines ).append( 1, '\0' );
+    key.append( vertexSource ).append( 1, '\0' );
+    key.append( fragmentSource );
+    
+    std::string directory = cocos2d::FileUtils::getInstance()->getWritablePath() + PROGRAM_BINARY_DIRECTORY;
+    return directory + std::to_string( std::hash< std::string >()( key ) ) + ".bin";
+}
+
+bool BatchedGLProgram::initWithBinaryFile( const std::string& path )
+{
+#if PROGRAM_BINARY_SUPPORTED
+    auto fileUtils = cocos2d::FileUtils::getInstance();
+    if( !fileUtils->isFileExist( path ) )
+    {
+        return false;
+    }
+    
+    cocos2d::Data data = fileUtils->getDataFromFile( path );
+    if( data.getSize() <= sizeof( GLuint ) * 2 )
+    {
+        return false;
+    }
+    
+    const GLuint* header = (const GLuint*)data.getBytes();
+    if( header[0] != PROGRAM_BINARY_MAGIC )
+    {
+        return false;
+    }
+    
+    _program = glCreateProgram();
+    _vertShader = _fragShader = 0;
+    programBinary( _program, (GLenum)header[1], data.getBytes() + sizeof( GLuint ) * 2, (GLsizei)( data.getSize() - sizeof( GLuint ) * 2 ) );
+    
+    GLint status = GL_FALSE;
+    glGetProgramiv( _program, GL_LINK_STATUS, &status );
+    if( status == GL_FALSE )
+    {
+        // Driver rejected the binary (e.g. after an update that kept the version string). Fall back to source.
+        CCLOG( "BatchedGLProgram: discarding stale program binary %s", path.c_str() );
+        cocos2d::GL::deleteProgram( _program );
+        _program = 0;
+        fileUtils->removeFile( path );
+        return false;
+    }
+    
+    _hashForUniforms.clear();
+    parseVertexAttribs();
+    parseUniforms();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BatchedGLProgram::saveBinaryFile( const std::string& path )
+{
+#if PROGRAM_BINARY_SUPPORTED
+    GLint length = 0;
+    glGetProgramiv( _program, PROGRAM_BINARY_LENGTH, &length );
+    if( length <= 0 )
+    {
+        return;
+    }
+    
+    std::vector< unsigned char > buffer( sizeof( GLuint ) * 2 + length );
+    GLenum format = 0;
+    GLsizei written = 0;
+    getProgramBinary( _program, length, &written, &format, &buffer[ sizeof( GLuint ) * 2 ] );
+    if( written <= 0 )
+    {
+        return;
+    }
+    
+    GLuint header[2] = { PROGRAM_BINARY_MAGIC, (GLuint)format };
+    memcpy( &buffer[0], header, sizeof( header ) );
+    
+    auto fileUtils = cocos2d::FileUtils::getInstance();
+    fileUtils->createDirectory( fileUtils->getWritablePath() + PROGRAM_BINARY_DIRECTORY );
+    
+    cocos2d::Data data;
+    data.copy( &buffer[0], sizeof( header ) + written );
+    if( !fileUtils->writeDataToFile( data, path ) )
+    {
+        CCLOG( "BatchedGLProgram: failed to write program binary %s", path.c_str() );
+    }
+#endif
+}
@@ -16,15 +16,58 @@ namespace mikedotcpp
     /**
      * It is annoying, but I have to write my own GL Program class just so that I can put a simple line of text
      * at the beginning of a vertex shader. This is all in support of instancing.
+     *
+     * Programs should be obtained through getOrCreateWithFilenames(), which shares one linked program per
+     * (vertex file, fragment file, defines) through the GLProgramCache. Where the driver supports it
+     * (GL_ARB_get_program_binary / GL_OES_get_program_binary) linked programs can also be stored on disk and
+     * reloaded on the next launch instead of being compiled again; see setBinaryCacheEnabled().
      */
     class BatchedGLProgram : public cocos2d::GLProgram
     {
     public:
         BatchedGLProgram();
-        static BatchedGLProgram* createWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename);
-        bool initWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename);
-        bool initWithByteArrays(const GLchar* vShaderByteArray, const GLchar* fShaderByteArray );
+        
+        /**
+         * Returns the shared program for these shader files and compile-time defines (same "A=1;B" format as
+         * cocos2d::GLProgram), creating and caching it on first use. Returns nullptr if the program fails to build.
+         */
+        static BatchedGLProgram* getOrCreateWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& compileTimeDefines="");
+        
+        /**
+         * Always builds a new, unshared program. Prefer getOrCreateWithFilenames().
+         */
+        static BatchedGLProgram* createWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& compileTimeDefines="");
+        
+        bool initWithFilenames(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& compileTimeDefines="");
+        bool initWithByteArrays(const GLchar* vShaderByteArray, const GLchar* fShaderByteArray, const std::string& compileTimeDefines="");
         bool compileShader(GLuint * shader, GLenum type, const GLchar* source, const std::string& convertedDefines);
+        
+        /**
+         * Turns the on-disk program binary cache on or off (off by default). Has no effect on drivers without
+         * program binary support.
+         */
+        static void setBinaryCacheEnabled( bool enabled );
+        static bool isBinaryCacheEnabled();
+        
+    protected:
+        /**
+         * Name of the binary cache file for the program sources. The name hashes the sources, the defines and the
+         * GL vendor/renderer/version strings, so a driver update never loads a stale binary.
+         */
+        static std::string getBinaryCachePath( const std::string& vertexSource, const std::string& fragmentSource, const std::string& compileTimeDefines );
+        
+        /**
+         * Creates _program from a cached binary. Returns false (leaving no program behind) if there is no usable
+         * binary, in which case the caller compiles from source.
+         */
+        bool initWithBinaryFile( const std::string& path );
+        
+        /**
+         * Writes the linked _program to the binary cache.
+         */
+        void saveBinaryFile( const std::string& path );
+        
+        static bool s_binaryCacheEnabled;
     };
 }
 
@@ -12,7 +12,7 @@
 using namespace mikedotcpp;
 
 void BatchedMesh::draw( cocos2d::Renderer* renderer, float globalZOrder, const cocos2d::Mat4& transform, uint32_t flags, unsigned int lightMask,
-                       const cocos2d::Vec4& color, bool forceDepthWrite, int instanceCount, const std::vector< cocos2d::Vec3 >& positionPalette )
+                       const cocos2d::Vec4& color, bool forceDepthWrite, int instanceCount, const InstanceSpan& positionPalette )
 {
     if( ! isVisible() )
     {
@@ -43,6 +43,8 @@ void BatchedMesh::draw( cocos2d::Renderer* renderer, float globalZOrder, const c
     _material->getStateBlock()->setBlend(_force2DQueue || isTransparent);
     
     _meshCommand.instanceCount = instanceCount;
+    _meshCommand.stateKey = getStateKey();
+    _meshCommand.stateKey.blend = _meshCommand.stateKey.blend || isTransparent;
     
     // set default uniforms for Mesh
     // 'u_color' and others
@@ -63,13 +65,29 @@ void BatchedMesh::draw( cocos2d::Renderer* renderer, float globalZOrder, const c
             setLightUniforms(pass, scene, color, lightMask);
         }
         
-        if( positionPalette.size() > 0 )
+        if( positionPalette.count > 0 )
         {
-            programState->setUniformVec3v( "u_posPalette", (GLsizei)positionPalette.size(), &positionPalette[0] );
+            // NOTE: Only the pointer is stored here; the InstanceArena keeps the data alive until it is rendered.
+            programState->setUniformVec4v( "u_posPalette", (GLsizei)positionPalette.count, positionPalette.data );
         }
     }
     
-    renderer->addCommand( &_meshCommand );
+    BatchedMeshCommand::queue( renderer, &_meshCommand );
+}
+
+BatchedStateKey BatchedMesh::getStateKey()
+{
+    BatchedStateKey key;
+    if( _material )
+    {
+        key.program = _material->getTechnique()->getPassByIndex( 0 )->getGLProgramState()->getGLProgram()->getProgram();
+    }
+    cocos2d::Texture2D* diffuse = getTexture( cocos2d::NTextureData::Usage::Diffuse );
+    cocos2d::Texture2D* normal = getTexture( cocos2d::NTextureData::Usage::Normal );
+    key.diffuse = diffuse ? diffuse->getName() : 0;
+    key.normal = normal ? normal->getName() : 0;
+    key.blend = _isTransparent || _force2DQueue;
+    return key;
 }
 
 BatchedMesh* BatchedMesh::create(const std::vector<float>& vertices, int perVertexSizeInFloat,
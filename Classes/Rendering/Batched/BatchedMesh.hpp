@@ -11,6 +11,7 @@
 
 #include "cocos2d.h"
 #include "BatchedMeshCommand.hpp"
+#include "InstanceArena.hpp"
 
 namespace mikedotcpp
 {
@@ -31,7 +32,12 @@ namespace mikedotcpp
         
         void draw( cocos2d::Renderer* renderer, float globalZOrder, const cocos2d::Mat4& transform, uint32_t flags,
                   unsigned int lightMask, const cocos2d::Vec4& color, bool forceDepthWrite,
-                  int instanceCount, const std::vector< cocos2d::Vec3 >& positionPalette );
+                  int instanceCount, const InstanceSpan& positionPalette );
+        
+        /**
+         * Returns the program, textures and blending this mesh draws with (see BatchedStateKey).
+         */
+        BatchedStateKey getStateKey();
         
     };
 }
@@ -14,13 +14,49 @@
 
 using namespace mikedotcpp;
 
+cocos2d::Pass* BatchedMeshCommand::s_openPass = nullptr;
+BatchedStateKey BatchedMeshCommand::s_openKey;
+BatchedDrawStats BatchedMeshCommand::s_currentStats;
+BatchedDrawStats BatchedMeshCommand::s_frameStats;
+std::vector< BatchedMeshCommand* > BatchedMeshCommand::s_queued;
+cocos2d::CustomCommand BatchedMeshCommand::s_drawCommand;
+
 void BatchedMeshCommand::batchDraw()
 {
     if( _material )
     {
         for( const auto& pass: _material->getTechnique()->getPasses() )
         {
-            pass->bind(_mv);
+            bool canShareState = ( s_openPass != nullptr && s_openKey.program == stateKey.program && s_openKey.blend == stateKey.blend );
+            bool isFirstBind = ( s_openPass == nullptr );
+            
+            if( isFirstBind || s_openKey.program != stateKey.program )
+            {
+                ++s_currentStats.programSwitches;
+            }
+            if( isFirstBind || s_openKey.diffuse != stateKey.diffuse )
+            {
+                ++s_currentStats.textureBinds;
+            }
+            if( stateKey.normal != 0 && ( isFirstBind || s_openKey.normal != stateKey.normal ) )
+            {
+                ++s_currentStats.textureBinds;
+            }
+            
+            if( canShareState )
+            {
+                // Same program and render state as the open pass: only the vertex layout and uniforms change.
+                auto glProgramState = pass->getGLProgramState();
+                pass->getVertexAttributeBinding()->bind();
+                glProgramState->applyGLProgram( _mv );
+                glProgramState->applyUniforms();
+            }
+            else
+            {
+                closeOpenPass();
+                pass->bind( _mv );
+                ++s_currentStats.stateBinds;
+            }
             
             //FOR MOBILE
 #if CC_TARGET_PLATFORM == CC_PLATFORM_IOS
@@ -30,12 +66,15 @@ void BatchedMeshCommand::batchDraw()
             glDrawElementsInstancedARB( _primitive, (GLsizei)_indexCount, _indexFormat, 0, instanceCount );
 #endif
             CC_INCREMENT_GL_DRAWN_BATCHES_AND_VERTICES(1, _indexCount);
+            ++s_currentStats.drawCalls;
             
-            pass->unbind();
+            s_openPass = pass;
+            s_openKey = stateKey;
         }
     }
     else
     {
+        closeOpenPass();
         _glProgramState->applyGLProgram(_mv);
         
         // set render state
@@ -44,5 +83,55 @@ void BatchedMeshCommand::batchDraw()
         // Draw
         glDrawElements(_primitive, (GLsizei)_indexCount, _indexFormat, 0);
         CC_INCREMENT_GL_DRAWN_BATCHES_AND_VERTICES(1, _indexCount);
+        ++s_currentStats.drawCalls;
+    }
+}
+
+void BatchedMeshCommand::queue( cocos2d::Renderer* renderer, BatchedMeshCommand* command )
+{
+    if( command->isSkipBatching() )
+    {
+        renderer->addCommand( command );
+        return;
+    }
+    
+    // The whole frame draws where its first command was queued; the commands are opaque and depth tested.
+    if( s_queued.empty() )
+    {
+        s_drawCommand.init( command->getGlobalOrder() );
+        s_drawCommand.set3D( command->is3D() );
+        s_drawCommand.func = &BatchedMeshCommand::drawQueued;
+        renderer->addCommand( &s_drawCommand );
+    }
+    s_queued.push_back( command );
+}
+
+void BatchedMeshCommand::drawQueued()
+{
+    for( auto command : s_queued )
+    {
+        command->batchDraw();
+    }
+    closeOpenPass();
+    s_queued.clear();
+}
+
+void BatchedMeshCommand::closeOpenPass()
+{
+    if( s_openPass )
+    {
+        s_openPass->unbind();
+        s_openPass = nullptr;
     }
 }
+
+void BatchedMeshCommand::beginFrame()
+{
+    s_frameStats = s_currentStats;
+    s_currentStats = BatchedDrawStats();
+}
+
+const BatchedDrawStats& BatchedMeshCommand::getFrameStats()
+{
+    return s_frameStats;
+}
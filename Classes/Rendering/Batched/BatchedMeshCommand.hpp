@@ -13,15 +13,101 @@
 
 namespace mikedotcpp
 {
+    /**
+     * The GL state an instanced draw depends on. Consecutive commands with equal keys can share a bind. Keys are
+     * ordered by program first, then textures, then blending, which is the order blocks are sorted in for drawing.
+     */
+    struct BatchedStateKey
+    {
+        GLuint program = 0;
+        GLuint diffuse = 0;
+        GLuint normal = 0;
+        bool blend = false;
+        
+        inline bool operator<( const BatchedStateKey& other ) const
+        {
+            if( program != other.program ) return program < other.program;
+            if( diffuse != other.diffuse ) return diffuse < other.diffuse;
+            if( normal != other.normal ) return normal < other.normal;
+            return blend < other.blend;
+        }
+    };
+    
+    /**
+     * Per-frame totals for instanced drawing.
+     */
+    struct BatchedDrawStats
+    {
+        int programSwitches = 0;
+        int textureBinds = 0;
+        int stateBinds = 0;
+        int drawCalls = 0;
+    };
+    
     /**
      * Created in support of instanced geometry rendering.
+     *
+     * Opaque instanced commands are not handed to the Renderer one by one: queue() collects them and a single
+     * CustomCommand, queued with the first of them, draws them all in order. batchDraw() leaves its last pass bound
+     * and the next command only rebinds what actually differs: the VAO and the uniforms (position palette,
+     * textures) always, the program and render state only when the program or blending changes. The custom
+     * command unbinds whatever is still open before it returns, so no other command (stock meshes included) ever
+     * runs with one of these passes bound.
      */
     class BatchedMeshCommand : public cocos2d::MeshCommand
     {
     public:
         int instanceCount = 0;
         
-        void batchDraw();
+        /**
+         * Filled in by BatchedMesh::draw before the command is queued.
+         */
+        BatchedStateKey stateKey;
+        
+        void batchDraw() override;
+        
+        /**
+         * Queues the command for this frame's instanced draw. Transparent commands (which skip batching) go to the
+         * Renderer as usual.
+         */
+        static void queue( cocos2d::Renderer* renderer, BatchedMeshCommand* command );
+        
+        /**
+         * Publishes the counters of the frame that was just rendered and starts counting a new one. Call once per
+         * frame, before any BatchedMeshCommand is queued.
+         */
+        static void beginFrame();
+        
+        /**
+         * Counters of the last fully rendered frame.
+         */
+        static const BatchedDrawStats& getFrameStats();
+        
+    protected:
+        /**
+         * The pass left bound by the previous batchDraw() in the current run, and the state it was bound with.
+         */
+        static cocos2d::Pass* s_openPass;
+        static BatchedStateKey s_openKey;
+        
+        static BatchedDrawStats s_currentStats;
+        static BatchedDrawStats s_frameStats;
+        
+        /**
+         * The commands queued since s_drawCommand last ran, and the command that draws them.
+         */
+        static std::vector< BatchedMeshCommand* > s_queued;
+        static cocos2d::CustomCommand s_drawCommand;
+        
+        /**
+         * s_drawCommand's function: draws every queued command, then closes the open pass.
+         */
+        static void drawQueued();
+        
+        /**
+         * Unbinds s_openPass, if any.
+         */
+        static void closeOpenPass();
     };
 }
 
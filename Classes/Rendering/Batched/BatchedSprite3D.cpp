@@ -39,17 +39,16 @@ BatchedSprite3D* BatchedSprite3D::create( const std::string &modelPath )
 
 /**
  * NOTE: The content of this function is basically the same as the base-class version except for adding two new
- *       variables: _instanceCount and _positionPalette.
+ *       variables: _instanceCount and _positionPalette, and replacing node-level culling with an empty-batch check.
  */
 void BatchedSprite3D::draw( cocos2d::Renderer *renderer, const cocos2d::Mat4 &transform, uint32_t flags)
 {
-#if CC_USE_CULLING
-    // camera clipping
-    if( _children.size() == 0 && cocos2d::Camera::getVisitingCamera() && !cocos2d::Camera::getVisitingCamera()->isVisibleInFrustum( &getAABB() ) && _instanceCount > 1 )
+    // Instances are frustum culled one by one before submission (see InstanceCuller). The node AABB only covers a
+    // single cube at the origin, so the base-class node-level test would reject visible instances.
+    if( _instanceCount == 0 )
     {
         return;
     }
-#endif
     
     if( _skeleton )
     {
@@ -105,12 +104,12 @@ int BatchedSprite3D::getInstanceCount()
     return _instanceCount;
 }
 
-void BatchedSprite3D::setPositionPalette( const std::vector< cocos2d::Vec3 >& positionArray )
+void BatchedSprite3D::setPositionPalette( const InstanceSpan& positions )
 {
-    _positionPalette = positionArray;
+    _positionPalette = positions;
 }
 
-cocos2d::Vec3* BatchedSprite3D::getPositionPalette()
+const cocos2d::Vec4* BatchedSprite3D::getPositionPalette()
 {
-    return &_positionPalette[0];
+    return _positionPalette.data;
 }
@@ -11,6 +11,7 @@
 
 #include "cocos2d.h"
 #include "BatchedMesh.hpp"
+#include "InstanceArena.hpp"
 
 namespace mikedotcpp
 {
@@ -31,7 +32,10 @@ namespace mikedotcpp
     private:
         int _instanceCount = 0;
         
-        std::vector< cocos2d::Vec3 > _positionPalette;
+        /**
+         * A view into the InstanceArena owned by the FPRenderLayer; this object never owns the positions.
+         */
+        InstanceSpan _positionPalette;
         
         BatchedSprite3D(){};
         
@@ -39,8 +43,8 @@ namespace mikedotcpp
         void setInstanceCount( int count );
         int getInstanceCount();
         
-        void setPositionPalette( const std::vector< cocos2d::Vec3 >& positionArray );
-        cocos2d::Vec3* getPositionPalette();
+        void setPositionPalette( const InstanceSpan& positions );
+        const cocos2d::Vec4* getPositionPalette();
     };
 }
 
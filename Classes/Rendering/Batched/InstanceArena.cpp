@@ -0,0 +1,72 @@
+//
+//  InstanceArena.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "InstanceArena.hpp"
+
+using namespace mikedotcpp;
+
+void InstanceArena::init( const std::vector< int >& capacities )
+{
+    int regionCount = (int)capacities.size();
+    _offsets.assign( regionCount, 0 );
+    _capacities.assign( regionCount, 0 );
+    _counts.assign( regionCount, 0 );
+    
+    int total = 0;
+    for( int i = 0; i < regionCount; ++i )
+    {
+        _offsets[i] = total;
+        _capacities[i] = MAX( 0, MIN( capacities[i], MAX_INSTANCES_PER_DRAW ) );
+        total += _capacities[i];
+    }
+    
+    _buffers[0].assign( total, cocos2d::Vec4::ZERO );
+    _buffers[1].assign( total, cocos2d::Vec4::ZERO );
+    _current = 0;
+}
+
+void InstanceArena::beginFrame()
+{
+    _current ^= 1;
+    std::fill( _counts.begin(), _counts.end(), 0 );
+}
+
+InstanceSpan InstanceArena::getSpan( int region ) const
+{
+    InstanceSpan span;
+    span.count = _counts[ region ];
+    if( span.count > 0 )
+    {
+        span.data = &_buffers[ _current ][ _offsets[ region ] ];
+    }
+    return span;
+}
+
+int InstanceArena::getCount( int region ) const
+{
+    return _counts[ region ];
+}
+
+cocos2d::Vec4* InstanceArena::getRegionData( int region )
+{
+    if( _capacities[ region ] == 0 )
+    {
+        return nullptr;
+    }
+    return &_buffers[ _current ][ _offsets[ region ] ];
+}
+
+void InstanceArena::truncate( int region, int count )
+{
+    _counts[ region ] = MAX( 0, MIN( count, _counts[ region ] ) );
+}
+
+int InstanceArena::getRegionCount() const
+{
+    return (int)_counts.size();
+}
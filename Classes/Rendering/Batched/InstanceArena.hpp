@@ -0,0 +1,119 @@
+//
+//  InstanceArena.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef InstanceArena_hpp
+#define InstanceArena_hpp
+
+#include "cocos2d.h"
+
+/**
+ * Must match MAX_POSITION_COUNT in block.vsh. Instances beyond this count are dropped for the frame.
+ */
+#define MAX_INSTANCES_PER_DRAW 600
+
+namespace mikedotcpp
+{
+    /**
+     * A read-only view of a run of instances that lives inside an InstanceArena. Each instance is a world position
+     * in xyz plus a per-instance material selector in w (unused by the per-tile material path). Spans are cheap to
+     * copy and never own their data.
+     */
+    struct InstanceSpan
+    {
+        const cocos2d::Vec4* data = nullptr;
+        int count = 0;
+    };
+    
+    /**
+     * Frame-owned storage for per-instance data used by geometry-instanced rendering. Every tile type owns a
+     * fixed region of the arena (sized once at map load) that the FPRenderLayer fills in place while raycasting.
+     * The BatchedSprite3D objects only ever hold an InstanceSpan into that region, so nothing is copied or
+     * reallocated from frame to frame.
+     *
+     * Ownership/lifetime: the arena is double-buffered. GLProgramState keeps a *pointer* to the position palette
+     * (see UniformValue::setVec4v) and the renderer dereferences it after visit() has returned, so the buffer
+     * written during a frame must stay untouched until that frame has been rendered. beginFrame() flips to the
+     * other buffer, which means a span is valid for the frame it was written in and the one after it. Only the
+     * thread that visits the scene graph (the render thread) may touch the arena.
+     */
+    class InstanceArena
+    {
+    public:
+        /**
+         * Sizes one region per entry in capacities. Each capacity is clamped to MAX_INSTANCES_PER_DRAW. This is
+         * the only place memory is allocated.
+         */
+        void init( const std::vector< int >& capacities );
+        
+        /**
+         * Flips to the other buffer and resets every region to zero instances.
+         */
+        void beginFrame();
+        
+        /**
+         * Appends an instance to the region. Returns false (and drops the instance) when the region is full.
+         */
+        inline bool push( int region, const cocos2d::Vec4& instance )
+        {
+            int count = _counts[ region ];
+            if( count >= _capacities[ region ] )
+            {
+                return false;
+            }
+            _buffers[ _current ][ _offsets[ region ] + count ] = instance;
+            _counts[ region ] = count + 1;
+            return true;
+        }
+        
+        /**
+         * Returns a view of everything written into the region during the current frame.
+         */
+        InstanceSpan getSpan( int region ) const;
+        
+        /**
+         * Number of instances written into the region during the current frame.
+         */
+        int getCount( int region ) const;
+        
+        /**
+         * Writable pointer to the first instance of the region in the current buffer (nullptr for an empty region).
+         * Used to filter instances in place before they are submitted.
+         */
+        cocos2d::Vec4* getRegionData( int region );
+        
+        /**
+         * Drops every instance past count from the region. Can only shrink a region.
+         */
+        void truncate( int region, int count );
+        
+        /**
+         * Number of regions (tile types) in the arena.
+         */
+        int getRegionCount() const;
+        
+    protected:
+        /**
+         * The two instance buffers. Only _buffers[_current] is written to during a frame.
+         */
+        std::vector< cocos2d::Vec4 > _buffers[2];
+        
+        /**
+         * Per-region offset into each buffer, capacity and current fill count.
+         */
+        std::vector< int > _offsets;
+        std::vector< int > _capacities;
+        std::vector< int > _counts;
+        
+        /**
+         * Index of the buffer being written this frame.
+         */
+        int _current = 0;
+    };
+}
+
+#endif /* InstanceArena_hpp */
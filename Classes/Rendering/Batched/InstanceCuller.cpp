@@ -0,0 +1,110 @@
+//
+//  InstanceCuller.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "InstanceCuller.hpp"
+
+using namespace mikedotcpp;
+
+void InstanceCuller::update( const cocos2d::Camera* camera )
+{
+    // Gribb/Hartmann plane extraction. Mat4 is column-major, so row r of the matrix is m[r], m[4+r], m[8+r], m[12+r].
+    const float* m = camera->getViewProjectionMatrix().m;
+    const int rows[6] = { 0, 0, 1, 1, 2, 2 };
+    const float signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+    for( int i = 0; i < 6; ++i )
+    {
+        int r = rows[i];
+        float x = m[3] + signs[i] * m[r];
+        float y = m[7] + signs[i] * m[4 + r];
+        float z = m[11] + signs[i] * m[8 + r];
+        float w = m[15] + signs[i] * m[12 + r];
+        float length = sqrtf( x * x + y * y + z * z );
+        float inverse = ( length > 0.0f ) ? 1.0f / length : 0.0f;
+        _planeX[i] = x * inverse;
+        _planeY[i] = y * inverse;
+        _planeZ[i] = z * inverse;
+        _planeW[i] = w * inverse;
+    }
+    
+    const cocos2d::Mat4& world = camera->getNodeToWorldTransform();
+    _eye.set( world.m[12], world.m[13], world.m[14] );
+    resetStats();
+}
+
+void InstanceCuller::setRadius( float radius )
+{
+    _radius = radius;
+}
+
+void InstanceCuller::setMaxDistance( float distance )
+{
+    _maxDistance = MAX( 0.0f, distance );
+}
+
+float InstanceCuller::getMaxDistance() const
+{
+    return _maxDistance;
+}
+
+int InstanceCuller::cull( cocos2d::Vec4* instances, int count )
+{
+    if( count <= 0 )
+    {
+        return 0;
+    }
+    if( _visible.size() < count )
+    {
+        _visible.resize( count );
+    }
+    
+    const float radius = -_radius;
+    const float maxDistance = ( _maxDistance > 0.0f ) ? _maxDistance + _radius : FLT_MAX;
+    const float maxDistanceSq = ( maxDistance < FLT_MAX ) ? maxDistance * maxDistance : FLT_MAX;
+    const float ex = _eye.x, ey = _eye.y, ez = _eye.z;
+    unsigned char* visible = &_visible[0];
+    
+    // Pass 1: branch-free visibility test.
+    for( int i = 0; i < count; ++i )
+    {
+        const float x = instances[i].x;
+        const float y = instances[i].y;
+        const float z = instances[i].z;
+        unsigned char inside = 1;
+        for( int p = 0; p < 6; ++p )
+        {
+            inside &= ( _planeX[p] * x + _planeY[p] * y + _planeZ[p] * z + _planeW[p] >= radius );
+        }
+        const float dx = x - ex, dy = y - ey, dz = z - ez;
+        inside &= ( dx * dx + dy * dy + dz * dz <= maxDistanceSq );
+        visible[i] = inside;
+    }
+    
+    // Pass 2: compact the survivors to the front of the run.
+    int kept = 0;
+    for( int i = 0; i < count; ++i )
+    {
+        if( visible[i] )
+        {
+            instances[kept++] = instances[i];
+        }
+    }
+    
+    _stats.submitted += kept;
+    _stats.culled += count - kept;
+    return kept;
+}
+
+void InstanceCuller::resetStats()
+{
+    _stats = InstanceCullStats();
+}
+
+const InstanceCullStats& InstanceCuller::getStats() const
+{
+    return _stats;
+}
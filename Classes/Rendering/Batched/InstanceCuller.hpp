@@ -0,0 +1,97 @@
+//
+//  InstanceCuller.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef InstanceCuller_hpp
+#define InstanceCuller_hpp
+
+#include "cocos2d.h"
+
+namespace mikedotcpp
+{
+    /**
+     * Per-frame totals reported by the InstanceCuller.
+     */
+    struct InstanceCullStats
+    {
+        int submitted = 0;
+        int culled = 0;
+    };
+    
+    /**
+     * Rejects instances whose bounding sphere lies outside the camera frustum (or beyond an optional maximum
+     * distance) before they are submitted for instanced drawing. The raycaster returns every tile hit along the
+     * ray fan, including tiles behind the player or above/below the current pitch, and the instanced draw path has
+     * no node-level culling, so this is the only place those instances are discarded.
+     *
+     * The frustum is kept as six planes in structure-of-arrays form and the visibility test is a branch-free loop,
+     * which the compiler can auto-vectorize on both NEON and SSE targets.
+     */
+    class InstanceCuller
+    {
+    public:
+        /**
+         * Extracts the frustum planes from the camera's view-projection matrix and records the eye position used
+         * by the distance cutoff. Call once per frame, before cull().
+         */
+        void update( const cocos2d::Camera* camera );
+        
+        /**
+         * Radius of the bounding sphere around each instance position.
+         */
+        void setRadius( float radius );
+        
+        /**
+         * Instances further than this from the camera are culled. Zero (the default) disables the cutoff.
+         */
+        void setMaxDistance( float distance );
+        float getMaxDistance() const;
+        
+        /**
+         * Compacts the instances in place, keeping only the visible ones (order is preserved). Returns the number
+         * of instances kept.
+         */
+        int cull( cocos2d::Vec4* instances, int count );
+        
+        /**
+         * Clears the submitted/culled counters. update() does this automatically.
+         */
+        void resetStats();
+        
+        /**
+         * Returns the counters accumulated since the last update().
+         */
+        const InstanceCullStats& getStats() const;
+        
+    protected:
+        /**
+         * Frustum planes (left, right, bottom, top, near, far) as normalized ( x, y, z, w ) components. A point p is
+         * inside a plane when x*p.x + y*p.y + z*p.z + w >= 0.
+         */
+        float _planeX[6];
+        float _planeY[6];
+        float _planeZ[6];
+        float _planeW[6];
+        
+        /**
+         * Camera position in world space.
+         */
+        cocos2d::Vec3 _eye;
+        
+        float _radius = 0.0f;
+        float _maxDistance = 0.0f;
+        
+        InstanceCullStats _stats;
+        
+        /**
+         * Scratch visibility flags, one per instance. Grows to the largest count seen and is never shrunk.
+         */
+        std::vector< unsigned char > _visible;
+    };
+}
+
+#endif /* InstanceCuller_hpp */
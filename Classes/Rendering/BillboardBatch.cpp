@@ -0,0 +1,437 @@
+//
+//  BillboardBatch.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "BillboardBatch.hpp"
+#include "Batched/BatchedGLProgram.hpp"
+
+#if CC_TARGET_PLATFORM == CC_PLATFORM_IOS
+#include <OpenGLES/ES2/glext.h>
+#endif
+
+#define BILLBOARD_VERTEX_SHADER "shaders/billboard.vsh"
+#define BILLBOARD_INSTANCED_VERTEX_SHADER "shaders/billboard_instanced.vsh"
+#define BILLBOARD_FRAGMENT_SHADER "shaders/billboard.fsh"
+#define BILLBOARD_ALPHA_TEXTURE_UNIFORM "u_alphaTextureEnabled"
+#define BILLBOARD_LOD_BIAS_UNIFORM "u_lodBias"
+#define BILLBOARD_INSTANCES_UNIFORM "u_instances"
+#define BILLBOARD_CAMERA_POSITION_UNIFORM "u_cameraPosition"
+
+/**
+ * The indices are 16 bit, so one vertex buffer holds at most 65536 / 4 quads.
+ */
+#define MAX_BATCHED_BILLBOARDS 16384
+
+/**
+ * Instanced path: vectors per instance record and records per draw. Must match billboard_instanced.vsh; the
+ * palette uses the same 600 vectors as block.vsh's u_posPalette.
+ */
+#define BILLBOARD_INSTANCE_VECTORS 3
+#define MAX_BILLBOARD_INSTANCES_PER_DRAW 200
+
+using namespace mikedotcpp;
+
+BillboardBatch::BillboardBatch()
+{
+}
+
+BillboardBatch::~BillboardBatch()
+{
+    for( auto& source : _sources )
+    {
+        CC_SAFE_RELEASE( source.texture );
+    }
+    if( _vertexBuffer )
+    {
+        glDeleteBuffers( 1, &_vertexBuffer );
+    }
+    if( _indexBuffer )
+    {
+        glDeleteBuffers( 1, &_indexBuffer );
+    }
+    if( _cornerBuffer )
+    {
+        glDeleteBuffers( 1, &_cornerBuffer );
+    }
+}
+
+bool BillboardBatch::init()
+{
+    if( !cocos2d::Node::init() )
+    {
+        return false;
+    }
+    cocos2d::Configuration* config = cocos2d::Configuration::getInstance();
+    bool instancingSupported = config->checkForGLExtension( "GL_EXT_draw_instanced" ) || config->checkForGLExtension( "GL_ARB_draw_instanced" );
+    _program = instancingSupported ? getProgram( true ) : nullptr;
+    _instanced = _program != nullptr;
+    if( instancingSupported && !_instanced )
+    {
+        CCLOG( "BillboardBatch - the instanced billboard program failed to build, billboards are built on the CPU." );
+    }
+    if( !_instanced )
+    {
+        _program = getProgram( false );
+    }
+    if( !_program )
+    {
+        // Nothing is drawn, but the batch still accepts billboards.
+        cocos2d::log( "BillboardBatch - the billboard program failed to build!" );
+        return true;
+    }
+    
+    _alphaTextureLocation = _program->getUniformLocation( BILLBOARD_ALPHA_TEXTURE_UNIFORM );
+    _lodBiasLocation = _program->getUniformLocation( BILLBOARD_LOD_BIAS_UNIFORM );
+    if( _instanced )
+    {
+        _instancesLocation = _program->getUniformLocation( BILLBOARD_INSTANCES_UNIFORM );
+        _cameraPositionLocation = _program->getUniformLocation( BILLBOARD_CAMERA_POSITION_UNIFORM );
+        
+        // Corners of the unit quad in the order of the quad indices: bottom-left, bottom-right, top-left, top-right.
+        GLfloat corners[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+        glGenBuffers( 1, &_cornerBuffer );
+        glBindBuffer( GL_ARRAY_BUFFER, _cornerBuffer );
+        glBufferData( GL_ARRAY_BUFFER, sizeof( corners ), corners, GL_STATIC_DRAW );
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    }
+    
+    // Every quad uses the same 6 indices relative to its first vertex, so the index buffer never changes.
+    std::vector< GLushort > indices( MAX_BATCHED_BILLBOARDS * 6 );
+    for( int i = 0; i < MAX_BATCHED_BILLBOARDS; ++i )
+    {
+        GLushort first = (GLushort)( i * 4 );
+        GLushort quad[] = { first, (GLushort)( first + 1 ), (GLushort)( first + 2 ),
+                            (GLushort)( first + 3 ), (GLushort)( first + 2 ), (GLushort)( first + 1 ) };
+        std::copy( quad, quad + 6, indices.begin() + i * 6 );
+    }
+    glGenBuffers( 1, &_vertexBuffer );
+    glGenBuffers( 1, &_indexBuffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indexBuffer );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLushort ) * indices.size(), &indices[0], GL_STATIC_DRAW );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    return true;
+}
+
+cocos2d::GLProgram* BillboardBatch::getProgram( bool instanced )
+{
+    if( instanced )
+    {
+        // gl_InstanceID needs the #extension directive BatchedGLProgram adds to its vertex shaders.
+        return BatchedGLProgram::getOrCreateWithFilenames( BILLBOARD_INSTANCED_VERTEX_SHADER, BILLBOARD_FRAGMENT_SHADER );
+    }
+    
+    cocos2d::GLProgramCache* programCache = cocos2d::GLProgramCache::getInstance();
+    cocos2d::GLProgram* program = programCache->getGLProgram( BILLBOARD_VERTEX_SHADER );
+    if( !program )
+    {
+        program = cocos2d::GLProgram::createWithFilenames( BILLBOARD_VERTEX_SHADER, BILLBOARD_FRAGMENT_SHADER );
+        if( program )
+        {
+            programCache->addGLProgram( program, BILLBOARD_VERTEX_SHADER );
+        }
+    }
+    return program;
+}
+
+void BillboardBatch::setSource( int sourceIndex, cocos2d::SpriteFrame* frame, float scale, float lodBias )
+{
+    if( _sources.size() <= sourceIndex )
+    {
+        _sources.resize( sourceIndex + 1 );
+    }
+    Source& source = _sources[sourceIndex];
+    CC_SAFE_RELEASE_NULL( source.texture );
+    if( !frame || !frame->getTexture() )
+    {
+        return;
+    }
+    source.texture = frame->getTexture();
+    source.texture->retain();
+    source.lodBias = lodBias;
+    
+    // Same texture coordinates as cocos2d::Sprite::setTextureCoords, for rotated frames too.
+    float atlasWidth = source.texture->getPixelsWide();
+    float atlasHeight = source.texture->getPixelsHigh();
+    cocos2d::Rect rect = frame->getRectInPixels();
+    float u0 = rect.origin.x / atlasWidth;
+    float v0 = rect.origin.y / atlasHeight;
+    if( frame->isRotated() )
+    {
+        float u1 = ( rect.origin.x + rect.size.height ) / atlasWidth;
+        float v1 = ( rect.origin.y + rect.size.width ) / atlasHeight;
+        source.uv[0] = cocos2d::Tex2F( u0, v0 );
+        source.uv[1] = cocos2d::Tex2F( u0, v1 );
+        source.uv[2] = cocos2d::Tex2F( u1, v0 );
+        source.uv[3] = cocos2d::Tex2F( u1, v1 );
+        source.uvRect = cocos2d::Vec4( u0, v1, u1, v0 );
+        source.rotated = 1.0f;
+    }
+    else
+    {
+        float u1 = ( rect.origin.x + rect.size.width ) / atlasWidth;
+        float v1 = ( rect.origin.y + rect.size.height ) / atlasHeight;
+        source.uv[0] = cocos2d::Tex2F( u0, v1 );
+        source.uv[1] = cocos2d::Tex2F( u1, v1 );
+        source.uv[2] = cocos2d::Tex2F( u0, v0 );
+        source.uv[3] = cocos2d::Tex2F( u1, v0 );
+        source.uvRect = cocos2d::Vec4( u0, v0, u1, v1 );
+        source.rotated = 0.0f;
+    }
+    
+    // A centered (anchor 0.5, 0.5) sprite of the frame: trimmed frames keep their offset inside the original size.
+    cocos2d::Size size = frame->getRect().size;
+    cocos2d::Vec2 offset = frame->getOffset();
+    source.left = ( offset.x - size.width * 0.5f ) * scale;
+    source.right = ( offset.x + size.width * 0.5f ) * scale;
+    source.bottom = ( offset.y - size.height * 0.5f ) * scale;
+    source.top = ( offset.y + size.height * 0.5f ) * scale;
+}
+
+bool BillboardBatch::hasSource( int sourceIndex ) const
+{
+    return sourceIndex < _sources.size() && _sources[sourceIndex].texture != nullptr;
+}
+
+void BillboardBatch::clear()
+{
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    _sourceIndices.clear();
+}
+
+void BillboardBatch::add( int sourceIndex, const cocos2d::Vec3& position )
+{
+    if( !hasSource( sourceIndex ) || _x.size() >= MAX_BATCHED_BILLBOARDS )
+    {
+        return;
+    }
+    _x.push_back( position.x );
+    _y.push_back( position.y );
+    _z.push_back( position.z );
+    _sourceIndices.push_back( (uint16_t)sourceIndex );
+}
+
+int BillboardBatch::getCount() const
+{
+    return (int)_x.size();
+}
+
+int BillboardBatch::getDrawCount() const
+{
+    return _drawCount;
+}
+
+bool BillboardBatch::isInstanced() const
+{
+    return _instanced;
+}
+
+void BillboardBatch::draw( cocos2d::Renderer* renderer, const cocos2d::Mat4& transform, uint32_t flags )
+{
+    int count = (int)_x.size();
+    _ranges.clear();
+    if( count == 0 || _program == nullptr )
+    {
+        _drawCount = 0;
+        return;
+    }
+    
+    const cocos2d::Mat4& cameraWorld = cocos2d::Camera::getVisitingCamera()->getNodeToWorldTransform();
+    _cameraPosition.set( cameraWorld.m[12], cameraWorld.m[13], cameraWorld.m[14] );
+    float eyeX = _cameraPosition.x;
+    float eyeZ = _cameraPosition.z;
+    
+    // Branch-free over the parallel arrays (auto-vectorized): the squared distance to the camera and, for the CPU
+    // path, the horizontal right vector of each quad: the direction from the camera turned a quarter around the up
+    // axis, as in FPBillBoard. The instanced path leaves the right vector to the vertex shader.
+    _distances.resize( count );
+    const float* x = &_x[0];
+    const float* z = &_z[0];
+    float* distances = &_distances[0];
+    if( _instanced )
+    {
+        for( int i = 0; i < count; ++i )
+        {
+            float dx = x[i] - eyeX;
+            float dz = z[i] - eyeZ;
+            distances[i] = dx * dx + dz * dz;
+        }
+    }
+    else
+    {
+        _rightX.resize( count );
+        _rightZ.resize( count );
+        float* rightX = &_rightX[0];
+        float* rightZ = &_rightZ[0];
+        for( int i = 0; i < count; ++i )
+        {
+            float dx = x[i] - eyeX;
+            float dz = z[i] - eyeZ;
+            float lengthSquared = dx * dx + dz * dz;
+            float inverseLength = 1.0f / sqrtf( lengthSquared + MATH_FLOAT_SMALL );
+            rightX[i] = -dz * inverseLength;
+            rightZ[i] = dx * inverseLength;
+            distances[i] = lengthSquared;
+        }
+    }
+    
+    // By texture and bias, so each pair is one draw, then front to back so the depth test rejects hidden texels early.
+    _order.resize( count );
+    for( int i = 0; i < count; ++i )
+    {
+        _order[i] = i;
+    }
+    std::sort( _order.begin(), _order.end(), [this]( int a, int b )
+    {
+        const Source& sourceA = _sources[ _sourceIndices[a] ];
+        const Source& sourceB = _sources[ _sourceIndices[b] ];
+        GLuint textureA = sourceA.texture->getName();
+        GLuint textureB = sourceB.texture->getName();
+        if( textureA != textureB )
+        {
+            return textureA < textureB;
+        }
+        return ( sourceA.lodBias != sourceB.lodBias ) ? sourceA.lodBias < sourceB.lodBias : _distances[a] < _distances[b];
+    } );
+    
+    if( _instanced )
+    {
+        _instances.resize( count * BILLBOARD_INSTANCE_VECTORS );
+    }
+    else
+    {
+        _vertices.resize( count * 4 );
+    }
+    cocos2d::Color4B white = cocos2d::Color4B::WHITE;
+    for( int quad = 0; quad < count; ++quad )
+    {
+        int i = _order[quad];
+        const Source& source = _sources[ _sourceIndices[i] ];
+        if( _instanced )
+        {
+            cocos2d::Vec4* instance = &_instances[ quad * BILLBOARD_INSTANCE_VECTORS ];
+            instance[0].set( _x[i], _y[i], _z[i], source.rotated );
+            instance[1].set( source.left, source.right, source.bottom, source.top );
+            instance[2] = source.uvRect;
+        }
+        else
+        {
+            float across[] = { source.left, source.right, source.left, source.right };
+            float up[] = { source.bottom, source.bottom, source.top, source.top };
+            cocos2d::V3F_C4B_T2F* vertex = &_vertices[ quad * 4 ];
+            for( int corner = 0; corner < 4; ++corner )
+            {
+                vertex[corner].vertices = cocos2d::Vec3( _x[i] + _rightX[i] * across[corner], _y[i] + up[corner], _z[i] + _rightZ[i] * across[corner] );
+                vertex[corner].colors = white;
+                vertex[corner].texCoords = source.uv[corner];
+            }
+        }
+        
+        if( _ranges.empty() || _ranges.back().texture != source.texture || _ranges.back().lodBias != source.lodBias )
+        {
+            DrawRange range = { source.texture, source.lodBias, quad, 0 };
+            _ranges.push_back( range );
+        }
+        ++_ranges.back().quadCount;
+    }
+    
+    // The vertices are in world space; the command only needs the depth of the batch's own node.
+    _command.init( _globalZOrder, transform, flags | FLAGS_RENDER_AS_3D );
+    _command.setTransparent( false );
+    if( _instanced )
+    {
+        _command.func = CC_CALLBACK_0( BillboardBatch::onDrawInstanced, this );
+    }
+    else
+    {
+        _command.func = CC_CALLBACK_0( BillboardBatch::onDraw, this );
+    }
+    renderer->addCommand( &_command );
+}
+
+void BillboardBatch::onDraw()
+{
+    _program->use();
+    _program->setUniformsForBuiltins( cocos2d::Mat4::IDENTITY );
+    
+    // Orphans last frame's storage so the driver doesn't wait for draws still reading it.
+    cocos2d::GL::bindVAO( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, _vertexBuffer );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( cocos2d::V3F_C4B_T2F ) * _vertices.size(), nullptr, GL_DYNAMIC_DRAW );
+    glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( cocos2d::V3F_C4B_T2F ) * _vertices.size(), &_vertices[0] );
+    
+    cocos2d::GL::enableVertexAttribs( cocos2d::GL::VERTEX_ATTRIB_FLAG_POS_COLOR_TEX );
+    glVertexAttribPointer( cocos2d::GLProgram::VERTEX_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof( cocos2d::V3F_C4B_T2F ), (GLvoid*)offsetof( cocos2d::V3F_C4B_T2F, vertices ) );
+    glVertexAttribPointer( cocos2d::GLProgram::VERTEX_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof( cocos2d::V3F_C4B_T2F ), (GLvoid*)offsetof( cocos2d::V3F_C4B_T2F, colors ) );
+    glVertexAttribPointer( cocos2d::GLProgram::VERTEX_ATTRIB_TEX_COORD, 2, GL_FLOAT, GL_FALSE, sizeof( cocos2d::V3F_C4B_T2F ), (GLvoid*)offsetof( cocos2d::V3F_C4B_T2F, texCoords ) );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indexBuffer );
+    
+    for( const auto& range : _ranges )
+    {
+        bindRangeTexture( range );
+        glDrawElements( GL_TRIANGLES, range.quadCount * 6, GL_UNSIGNED_SHORT, (GLvoid*)( range.firstQuad * 6 * sizeof( GLushort ) ) );
+        CC_INCREMENT_GL_DRAWN_BATCHES_AND_VERTICES( 1, range.quadCount * 4 );
+    }
+    _drawCount = (int)_ranges.size();
+    
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+void BillboardBatch::onDrawInstanced()
+{
+    _program->use();
+    _program->setUniformsForBuiltins( cocos2d::Mat4::IDENTITY );
+    _program->setUniformLocationWith3f( _cameraPositionLocation, _cameraPosition.x, _cameraPosition.y, _cameraPosition.z );
+    
+    cocos2d::GL::bindVAO( 0 );
+    cocos2d::GL::enableVertexAttribs( cocos2d::GL::VERTEX_ATTRIB_FLAG_POSITION );
+    glBindBuffer( GL_ARRAY_BUFFER, _cornerBuffer );
+    glVertexAttribPointer( cocos2d::GLProgram::VERTEX_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indexBuffer );
+    
+    _drawCount = 0;
+    for( const auto& range : _ranges )
+    {
+        bindRangeTexture( range );
+        for( int first = 0; first < range.quadCount; first += MAX_BILLBOARD_INSTANCES_PER_DRAW )
+        {
+            int instanceCount = std::min( range.quadCount - first, MAX_BILLBOARD_INSTANCES_PER_DRAW );
+            
+            // Straight to GL: the palette changes every draw, so the program's uniform cache would only copy it.
+            const cocos2d::Vec4* instances = &_instances[ ( range.firstQuad + first ) * BILLBOARD_INSTANCE_VECTORS ];
+            glUniform4fv( _instancesLocation, instanceCount * BILLBOARD_INSTANCE_VECTORS, (const GLfloat*)instances );
+            
+            //FOR MOBILE
+#if CC_TARGET_PLATFORM == CC_PLATFORM_IOS
+            glDrawElementsInstancedEXT( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, instanceCount );
+#else
+            //FOR DESKTOP:
+            glDrawElementsInstancedARB( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, instanceCount );
+#endif
+            CC_INCREMENT_GL_DRAWN_BATCHES_AND_VERTICES( 1, instanceCount * 4 );
+            ++_drawCount;
+        }
+    }
+    
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+void BillboardBatch::bindRangeTexture( const DrawRange& range )
+{
+    // ETC1 images keep their alpha in a second texture (see CompressedTextures).
+    GLuint alphaTexture = range.texture->getAlphaTextureName();
+    cocos2d::GL::bindTexture2DN( 0, range.texture->getName() );
+    if( alphaTexture )
+    {
+        cocos2d::GL::bindTexture2DN( 1, alphaTexture );
+    }
+    _program->setUniformLocationWith1f( _alphaTextureLocation, alphaTexture ? 1.0f : 0.0f );
+    _program->setUniformLocationWith1f( _lodBiasLocation, range.lodBias );
+}
@@ -0,0 +1,173 @@
+//
+//  BillboardBatch.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef BillboardBatch_hpp
+#define BillboardBatch_hpp
+
+#include "cocos2d.h"
+
+namespace mikedotcpp
+{
+    /**
+     * Draws every visible billboard tile of the sprite rendering path (pickups, decorations) from one dynamic
+     * vertex buffer. The raycaster's hits are collected with add() and, when the batch is drawn, turned into
+     * camera-facing quads in one pass over the positions, using the same z-axis (yaw only) lock as FPBillBoard:
+     * each quad turns to face the camera position and always stands upright.
+     *
+     * Quads are sorted by texture and mip level bias, then front to back, and drawn with one call per texture and
+     * bias. They go through the opaque 3D queue with an alpha test instead of blending, so they write depth and need
+     * no back-to-front order among themselves.
+     *
+     * With geometry instancing (GL_EXT_draw_instanced / GL_ARB_draw_instanced) the quads are not built on the CPU:
+     * each billboard is one instance record (position, extents and atlas rect) in a uniform palette and the vertex
+     * shader (billboard_instanced.vsh) turns a shared unit quad towards the camera. Without it, or when the
+     * instanced program fails to build, the batch falls back to writing the quads into the dynamic vertex buffer.
+     */
+    class BillboardBatch : public cocos2d::Node
+    {
+    public:
+        CREATE_FUNC( BillboardBatch );
+        
+        virtual bool init() override;
+        
+        /**
+         * Sets the image the billboards of a source (the tile index) show, scaled by scale and sampled with a mip
+         * level bias of lodBias (Tile::textureLodBias). A NULL frame removes the source.
+         */
+        void setSource( int sourceIndex, cocos2d::SpriteFrame* frame, float scale, float lodBias=0.0f );
+        
+        /**
+         * TRUE if the source has an image.
+         */
+        bool hasSource( int sourceIndex ) const;
+        
+        /**
+         * Forgets the billboards of the previous frame.
+         */
+        void clear();
+        
+        /**
+         * Queues a billboard of a source, centered on position. Ignored for sources without an image.
+         */
+        void add( int sourceIndex, const cocos2d::Vec3& position );
+        
+        /**
+         * Number of billboards queued this frame and of draw calls used by the last draw.
+         */
+        int getCount() const;
+        int getDrawCount() const;
+        
+        /**
+         * TRUE when the billboards are oriented by the vertex shader (geometry instancing is supported).
+         */
+        bool isInstanced() const;
+        
+        virtual void draw( cocos2d::Renderer* renderer, const cocos2d::Mat4& transform, uint32_t flags ) override;
+    
+    CC_CONSTRUCTOR_ACCESS:
+        BillboardBatch();
+        virtual ~BillboardBatch();
+    
+    protected:
+        /**
+         * What the billboards of a source show: texture (retained), texture coordinates of the bottom-left,
+         * bottom-right, top-left and top-right corners, and the extents of the quad around its center in world
+         * units. Instanced path: the same coordinates as a rect (u0, v0, u1, v1, with v swapped for rotated frames)
+         * and rotated as 1.0 or 0.0, see billboard_instanced.vsh. lodBias is the mip level bias it is drawn with.
+         */
+        struct Source
+        {
+            cocos2d::Texture2D* texture = nullptr;
+            float lodBias = 0.0f;
+            cocos2d::Tex2F uv[4];
+            cocos2d::Vec4 uvRect;
+            float rotated = 0.0f;
+            float left = 0.0f;
+            float right = 0.0f;
+            float bottom = 0.0f;
+            float top = 0.0f;
+        };
+        std::vector< Source > _sources;
+        
+        /**
+         * Billboards queued this frame, as parallel arrays.
+         */
+        std::vector< float > _x;
+        std::vector< float > _y;
+        std::vector< float > _z;
+        std::vector< uint16_t > _sourceIndices;
+        
+        /**
+         * Per billboard scratch of draw(): horizontal right vector, squared distance to the camera, draw order.
+         */
+        std::vector< float > _rightX;
+        std::vector< float > _rightZ;
+        std::vector< float > _distances;
+        std::vector< int > _order;
+        
+        /**
+         * Consecutive quads of the vertex buffer that share a texture and a mip level bias.
+         */
+        struct DrawRange
+        {
+            cocos2d::Texture2D* texture;
+            float lodBias;
+            int firstQuad;
+            int quadCount;
+        };
+        std::vector< DrawRange > _ranges;
+        
+        std::vector< cocos2d::V3F_C4B_T2F > _vertices;
+        GLuint _vertexBuffer = 0;
+        GLuint _indexBuffer = 0;
+        
+        /**
+         * Instanced path: BILLBOARD_INSTANCE_VECTORS vectors per billboard in draw order, the unit quad shared by
+         * every instance and the camera position the quads turn towards.
+         */
+        bool _instanced = false;
+        std::vector< cocos2d::Vec4 > _instances;
+        GLuint _cornerBuffer = 0;
+        cocos2d::Vec3 _cameraPosition;
+        
+        cocos2d::GLProgram* _program = nullptr;
+        GLint _alphaTextureLocation = -1;
+        GLint _lodBiasLocation = -1;
+        GLint _instancesLocation = -1;
+        GLint _cameraPositionLocation = -1;
+        cocos2d::CustomCommand _command;
+        int _drawCount = 0;
+        
+        /**
+         * Render thread: uploads the quads built by draw() and issues one draw per range.
+         */
+        void onDraw();
+        
+        /**
+         * Render thread, instanced path: uploads the instance records of each range to the palette and draws them,
+         * MAX_BILLBOARD_INSTANCES_PER_DRAW at a time.
+         */
+        void onDrawInstanced();
+        
+        /**
+         * Binds the texture of a range (and its ETC1 alpha texture) and sets its mip level bias.
+         */
+        void bindRangeTexture( const DrawRange& range );
+        
+        /**
+         * Returns the shared billboard program (or its instanced variant, a BatchedGLProgram), compiling it on first
+         * use. NULL when it fails to build.
+         */
+        static cocos2d::GLProgram* getProgram( bool instanced );
+    
+    private:
+        CC_DISALLOW_COPY_AND_ASSIGN( BillboardBatch );
+    };
+}
+
+#endif /* BillboardBatch_hpp */
@@ -7,20 +7,63 @@
 //
 
 #include "BlockManager.hpp"
+#include "TextureAtlasBuilder.hpp"
+#include "CompressedTextures.hpp"
 #include "Batched/BatchedSprite3D.hpp"
 #include "Batched/BatchedGLProgram.hpp"
-#include "FPBillboard.hpp"
+#include "../Map/MapChunkStreamer.hpp"
+#include <chrono>
 
 using namespace mikedotcpp;
 
 #define RENDERING_PREREQUISITES_NOT_MET_MSG "!!!Geometry instancing unsupported on this device!!! Use the Sprite rendering path instead."
 
+#define MERGED_VERTEX_SHADER "shaders/block_merged.vsh"
+#define MERGED_FRAGMENT_SHADER "shaders/block.fsh"
+
+/**
+ * Must match MAX_MERGED_TILE_TYPES in block_merged.vsh.
+ */
+#define MAX_MERGED_TILE_TYPES 32
+
+/**
+ * Upper bound on the number of instanced draws used by the merged material.
+ */
+#define MAX_MERGED_BATCHES 8
+
+/**
+ * Vertex uniform vectors block_merged.vsh uses besides the position palette and the face rects (matrices, light,
+ * light map and LOD bias uniforms), rounded up.
+ */
+#define MERGED_RESERVED_UNIFORM_VECTORS 40
+
+/**
+ * Below this palette size the merged material would need too many draws to be worth it.
+ */
+#define MIN_MERGED_PALETTE_SIZE 64
+
+/**
+ * Sprite rendering path: fragment shader used (with the engine's noMVP sprite vertex shader) by the faces of
+ * tiles with a textureLodBias. The mesh and billboard shaders read the same uniform; the merged material reads one
+ * bias per tile type from u_lodBiases instead.
+ */
+#define LOD_BIAS_SPRITE_FRAGMENT_SHADER "shaders/sprite_lodbias.fsh"
+#define LOD_BIAS_UNIFORM "u_lodBias"
+#define MERGED_LOD_BIASES_UNIFORM "u_lodBiases"
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
 BlockManager::BlockManager()
 {
     CCLOG( "BlockManager::BlockManager() - Please pass a layer to the constructor!" );
 }
 
-BlockManager::BlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer )
+BlockManager::BlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer, bool deferBlocks )
 {
     cocos2d::Configuration* config = cocos2d::Configuration::getInstance();
     bool geometryInstancingSupported = config->checkForGLExtension( "GL_EXT_draw_instanced" ) || config->checkForGLExtension( "GL_ARB_draw_instanced" );
@@ -31,19 +74,96 @@ BlockManager::BlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer*
     if( prepRenderingSystem )
     {
         _contentScaleFactor = cocos2d::Director::getInstance()->getContentScaleFactor();
+        _mergedPaletteSize = getMergedPaletteSize( mapInfo, true );
+        _useMergedMaterial = _mergedPaletteSize > 0;
         loadTextures( mapInfo );
-        initBlockManager( mapInfo, layer );
+        if( deferBlocks )
+        {
+            beginBlockInit( mapInfo, layer );
+        }
+        else
+        {
+            initBlockManager( mapInfo, layer );
+        }
+    }
+}
+
+std::vector< std::string > BlockManager::getTextureFilenames( const mikedotcpp::MapInfo& mapInfo )
+{
+    // Mirrors loadTextures().
+    std::vector< std::string > filenames;
+    bool useMergedMaterial = getMergedPaletteSize( mapInfo, false ) > 0;
+    if( useMergedMaterial && mapInfo.diffuseAtlas.empty() )
+    {
+        // Packed from decoded images in loadTextures(), nothing to preload.
+    }
+    else if( useMergedMaterial )
+    {
+        filenames.push_back( CompressedTextures::resolve( mapInfo.diffuseAtlas + ".png" ) );
+        if( !mapInfo.normalAtlas.empty() )
+        {
+            filenames.push_back( CompressedTextures::resolve( mapInfo.normalAtlas + ".png" ) );
+        }
+    }
+    else if( mapInfo.useRealtimeLighting )
+    {
+        for( const auto& tile : mapInfo.tiles )
+        {
+            std::string diffuse[] = { tile.textureAll, tile.textureEast, tile.textureWest,
+                tile.textureNorth, tile.textureSouth, tile.textureCeiling, tile.textureFloor };
+            std::string normal[] = { tile.normalAll, tile.normalEast, tile.normalWest,
+                tile.normalNorth, tile.normalSouth, tile.normalCeiling, tile.normalFloor };
+            for( int j = 0; j < sizeof( diffuse )/sizeof( *diffuse ); ++j )
+            {
+                if( !diffuse[j].empty() )
+                {
+                    filenames.push_back( CompressedTextures::resolve( diffuse[j] ) );
+                    if( !normal[j].empty() )
+                    {
+                        filenames.push_back( CompressedTextures::resolve( normal[j] ) );
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        for( const auto& name : mapInfo.spritesheets )
+        {
+            filenames.push_back( CompressedTextures::resolve( name + ".png" ) );
+        }
     }
+    
+    std::sort( filenames.begin(), filenames.end() );
+    filenames.erase( std::unique( filenames.begin(), filenames.end() ), filenames.end() );
+    return filenames;
 }
 
 void BlockManager::loadTextures(  const mikedotcpp::MapInfo& mapInfo  )
 {
     cocos2d::SpriteFrameCache* frameCache = cocos2d::SpriteFrameCache::getInstance();
-    if( mapInfo.useRealtimeLighting )
+    if( _useMergedMaterial && mapInfo.diffuseAtlas.empty() )
+    {
+        packMergedAtlas( mapInfo );
+    }
+    else if( _useMergedMaterial )
+    {
+        std::string image = CompressedTextures::resolve( mapInfo.diffuseAtlas + ".png" );
+        frameCache->addSpriteFramesWithFile( mapInfo.diffuseAtlas + ".plist", image );
+        configureMapTexture( cocos2d::Director::getInstance()->getTextureCache()->addImage( image ), mapInfo );
+        if( !mapInfo.normalAtlas.empty() )
+        {
+            _mergedNormalTexture = cocos2d::Director::getInstance()->getTextureCache()->addImage( CompressedTextures::resolve( mapInfo.normalAtlas + ".png" ) );
+            CC_SAFE_RETAIN( _mergedNormalTexture );
+            configureMapTexture( _mergedNormalTexture, mapInfo );
+        }
+    }
+    else if( mapInfo.useRealtimeLighting )
     {
         for( int i = 0; i < mapInfo.tiles.size(); ++i )
         {
-            mikedotcpp::Tile tile = mapInfo.tiles[i];
+            const mikedotcpp::Tile& tile = mapInfo.tiles[i];
+            const mikedotcpp::TileDescriptor& descriptor = mapInfo.tileDescriptors[i];
             std::string diffuse[] = { tile.textureAll, tile.textureEast, tile.textureWest,
                 tile.textureNorth, tile.textureSouth, tile.textureCeiling, tile.textureFloor };
             std::string normal[] = { tile.normalAll, tile.normalEast, tile.normalWest,
@@ -54,13 +174,15 @@ void BlockManager::loadTextures(  const mikedotcpp::MapInfo& mapInfo  )
                 std::string normalName = normal[j];
                 if( !diffuseName.empty() )
                 {
-                    cocos2d::Sprite* sprite = cocos2d::Sprite::create( diffuseName );
-                    addCustomTexParams( tile, *sprite );
+                    cocos2d::Sprite* sprite = cocos2d::Sprite::create( CompressedTextures::resolve( diffuseName ) );
+                    configureMapTexture( sprite->getTexture(), mapInfo );
+                    addCustomTexParams( descriptor, *sprite );
                     frameCache->addSpriteFrame( sprite->getSpriteFrame(), diffuseName );
-                    sprite = cocos2d::Sprite::create( normalName );
+                    sprite = cocos2d::Sprite::create( CompressedTextures::resolve( normalName ) );
                     if( sprite )
                     {
-                        addCustomTexParams( tile, *sprite );
+                        configureMapTexture( sprite->getTexture(), mapInfo );
+                        addCustomTexParams( descriptor, *sprite );
                         frameCache->addSpriteFrame( sprite->getSpriteFrame(), normalName );
                     }
                 }
@@ -72,72 +194,314 @@ void BlockManager::loadTextures(  const mikedotcpp::MapInfo& mapInfo  )
         for( int i = 0; i < mapInfo.spritesheets.size(); ++i )
         {
             std::string name = mapInfo.spritesheets.at( i );
-            std::string image = name + ".png";
+            std::string image = CompressedTextures::resolve( name + ".png" );
             std::string plist = name + ".plist";
             frameCache->addSpriteFramesWithFile( plist, image );
+            configureMapTexture( cocos2d::Director::getInstance()->getTextureCache()->addImage( image ), mapInfo );
         }
     }
 }
 
-void BlockManager::addCustomTexParams( const mikedotcpp::Tile& tileData, cocos2d::Sprite& sprite )
+bool BlockManager::configureMapTexture( cocos2d::Texture2D* texture, const mikedotcpp::MapInfo& mapInfo )
 {
-    if( tileData.textureWrapMode.empty() )
+    if( !texture )
+    {
+        return false;
+    }
+    auto configured = _textureMipmaps.find( texture->getName() );
+    if( configured != _textureMipmaps.end() )
+    {
+        return configured->second;
+    }
+    
+    bool mipmapped = texture->hasMipmaps();
+    if( mapInfo.generateMipmaps && !mipmapped )
+    {
+        bool isPOT = ( texture->getPixelsWide() == cocos2d::ccNextPOT( texture->getPixelsWide() ) &&
+                       texture->getPixelsHigh() == cocos2d::ccNextPOT( texture->getPixelsHigh() ) );
+#if ( CC_TARGET_PLATFORM == CC_PLATFORM_MAC || CC_TARGET_PLATFORM == CC_PLATFORM_WIN32 || CC_TARGET_PLATFORM == CC_PLATFORM_LINUX )
+        bool canMipmapNPOT = true;
+#else
+        bool canMipmapNPOT = cocos2d::Configuration::getInstance()->checkForGLExtension( "GL_OES_texture_npot" );
+#endif
+        cocos2d::Texture2D::PixelFormat format = texture->getPixelFormat();
+        bool isCompressed = ( format >= cocos2d::Texture2D::PixelFormat::PVRTC4 && format <= cocos2d::Texture2D::PixelFormat::ATC_INTERPOLATED_ALPHA );
+        if( isCompressed )
+        {
+            // glGenerateMipmap can't write compressed levels; bake them with texcompiler --mipmaps.
+            CCLOG( "BlockManager::configureMapTexture - compressed texture %u has no mip levels.", texture->getName() );
+        }
+        else if( isPOT )
+        {
+            texture->generateMipmap();
+            mipmapped = true;
+        }
+        else if( canMipmapNPOT )
+        {
+            // Texture2D::generateMipmap insists on POT, which only GLES2 without GL_OES_texture_npot requires.
+            cocos2d::GL::bindTexture2D( texture->getName() );
+            glGenerateMipmap( GL_TEXTURE_2D );
+            mipmapped = true;
+        }
+        else
+        {
+            CCLOG( "BlockManager::configureMapTexture - %ix%i texture can't be mipmapped on this device.", texture->getPixelsWide(), texture->getPixelsHigh() );
+        }
+    }
+    
+    if( mipmapped )
+    {
+        cocos2d::Texture2D::TexParams texParams = { GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE };
+        texture->setTexParameters( texParams );
+    }
+    
+    if( mapInfo.maxAnisotropy > 1.0f && cocos2d::Configuration::getInstance()->checkForGLExtension( "GL_EXT_texture_filter_anisotropic" ) )
+    {
+        GLfloat maxSupported = 1.0f;
+        glGetFloatv( GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxSupported );
+        cocos2d::GL::bindTexture2D( texture->getName() );
+        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, MIN( mapInfo.maxAnisotropy, maxSupported ) );
+    }
+    
+    _textureMipmaps[ texture->getName() ] = mipmapped;
+    return mipmapped;
+}
+
+void BlockManager::addCustomTexParams( const mikedotcpp::TileDescriptor& descriptor, cocos2d::Sprite& sprite )
+{
+    if( !descriptor.hasFlag( TILE_FLAG_CUSTOM_TEX_PARAMS ) )
     {
         return;
     }
     cocos2d::Texture2D::TexParams texParams;
-    texParams.magFilter = ( tileData.textureMagFilter == "GL_LINEAR" ) ? GL_LINEAR : GL_NEAREST;
-    texParams.minFilter = ( tileData.textureMinFilter == "GL_LINEAR" ) ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
-    texParams.wrapS = ( tileData.textureWrapMode == "GL_REPEAT" ) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
-    texParams.wrapT = ( tileData.textureWrapMode == "GL_REPEAT" ) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    texParams.magFilter = ( descriptor.magFilter == TextureFilter::linear ) ? GL_LINEAR : GL_NEAREST;
+    // A mipmap min filter on a texture without mip levels samples nothing (incomplete texture).
+    auto mipmapped = _textureMipmaps.find( sprite.getTexture()->getName() );
+    bool hasMipmaps = ( mipmapped != _textureMipmaps.end() && mipmapped->second );
+    if( descriptor.minFilter == TextureFilter::nearest )
+    {
+        texParams.minFilter = GL_NEAREST;
+    }
+    else
+    {
+        texParams.minFilter = ( descriptor.minFilter == TextureFilter::linear || !hasMipmaps ) ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+    }
+    texParams.wrapS = ( descriptor.wrapMode == TextureWrapMode::repeat ) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    texParams.wrapT = texParams.wrapS;
     sprite.getTexture()->setTexParameters( texParams );
 }
 
 void BlockManager::initBlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer  )
+{
+    beginBlockInit( mapInfo, layer );
+    initNextBlocks( FLT_MAX );
+}
+
+void BlockManager::beginBlockInit( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer )
 {
     int tileCount = (int)mapInfo.tiles.size();
-    int planeCount = (int)mapInfo.planes.size();
-    int mapSize = mapInfo.width * mapInfo.height;
-    int* countCollection = getTileCollectionCounts( tileCount, planeCount, mapSize, mapInfo.planes );
+    _tileInstanceCounts = getInstanceCountsForMap( mapInfo );
     
-    _freeBlocks.reserve( planeCount );
-    _inUseBlocks.reserve( planeCount );
-    _instancedMeshes.reserve( tileCount );
+    // Indexed by tile, so single tiles can be rebuilt in place (see rebuildTiles).
+    _freeBlocks.resize( tileCount );
+    _inUseBlocks.resize( tileCount );
+    if( mapInfo.useRealtimeLighting && !_useMergedMaterial )
+    {
+        _instancedMeshes.resize( tileCount, nullptr );
+        _instanceCapacities.resize( tileCount, 0 );
+    }
+    
+    if( !mapInfo.useRealtimeLighting && _billboardBatch == nullptr )
+    {
+        _billboardBatch = BillboardBatch::create();
+        _billboardBatch->setCameraMask( (unsigned short)cocos2d::CameraFlag::USER1 );
+        _billboardBatch->retain();
+        layer->addChild( _billboardBatch );
+    }
     
-    for( int i = 0; i < tileCount; ++i )
+    _initMapInfo = &mapInfo;
+    _faceSources.clear();
+    _initLayer = layer;
+    _nextInitTile = 0;
+    
+    if( _useMergedMaterial )
+    {
+        initMergedBlocks( mapInfo, layer );
+        _nextInitTile = tileCount;
+    }
+}
+
+bool BlockManager::initNextBlocks( float timeBudget )
+{
+    if( _initMapInfo == nullptr )
+    {
+        return true;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    int tileCount = (int)_initMapInfo->tiles.size();
+    while( _nextInitTile < tileCount )
+    {
+        initTileBlocks( *_initMapInfo, _initLayer, _nextInitTile++ );
+        std::chrono::duration< float > elapsed = std::chrono::steady_clock::now() - start;
+        if( elapsed.count() >= timeBudget )
+        {
+            break;
+        }
+    }
+    
+    if( _nextInitTile < tileCount )
+    {
+        return false;
+    }
+    
+    if( _initMapInfo->useRealtimeLighting && !_useMergedMaterial )
+    {
+        sortMeshBlocksByState();
+    }
+    _faceSources.clear();
+    _initMapInfo = nullptr;
+    _initLayer = nullptr;
+    return true;
+}
+
+float BlockManager::getInitProgress() const
+{
+    if( _initMapInfo == nullptr || _initMapInfo->tiles.empty() )
+    {
+        return 1.0f;
+    }
+    return (float)_nextInitTile / _initMapInfo->tiles.size();
+}
+
+void BlockManager::initTileBlocks( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer, int tileIndex )
+{
+    Pool tileSet;
+    int count = _tileInstanceCounts[tileIndex];
+    const Tile& tileData = mapInfo.tiles[tileIndex];
+    const TileDescriptor& descriptor = mapInfo.tileDescriptors[tileIndex];
+    if( _billboardBatch && descriptor.hasFlag( TILE_FLAG_BILLBOARD ) )
+    {
+        _billboardBatch->setSource( tileIndex, getFaceSource( descriptor.get( TILE_BILLBOARD_TEXTURE ) ).frame, _contentScaleFactor, tileData.textureLodBias );
+        return;
+    }
+    int j = 0;
+    do
     {
-        Pool tileSet;
-        int count = countCollection[i];
-        int j = 0;
-        do
+        if( mapInfo.useRealtimeLighting )
         {
-            Tile tileData = mapInfo.tiles[i];
-            if( mapInfo.useRealtimeLighting )
+            // Only do this once for instanced geometry tilesets.
+            if( j == 0 ) 
             {
-                // Only do this once for instanced geometry tilesets.
-                if( j == 0 ) 
+                BatchedSprite3D* block = createMeshBlock( tileData );
+                _instancedMeshes[tileIndex] = block;
+                _instanceCapacities[tileIndex] = count;
+                if( count > 0 )
                 {
-                    BatchedSprite3D* block = createMeshBlock( tileData );
-                    _instancedMeshes.push_back( block );
-                    if( count > 0 )
-                    {
-                        layer->addChild( block );
-                    }
+                    layer->addChild( block );
                 }
             }
-            else
+        }
+        else
+        {
+            cocos2d::Sprite3D* block = createSpriteBlock( descriptor );
+            tileSet.push_back( block );
+            layer->addChild( block );
+            if( j == 0 )
             {
-                cocos2d::Sprite3D* block = createSpriteBlock( tileData );
-                tileSet.push_back( block );
-                layer->addChild( block );
+                // Every block of a tile has the same faces.
+                _faceTints.resize( std::max( _faceTints.size(), (size_t)( tileIndex + 1 ) * SPRITE_FACE_COUNT ), cocos2d::Color3B::WHITE );
+                for( auto face : block->getChildren() )
+                {
+                    if( face->getTag() >= 0 && face->getTag() < SPRITE_FACE_COUNT )
+                    {
+                        _faceTints[ tileIndex * SPRITE_FACE_COUNT + face->getTag() ] = face->getColor();
+                    }
+                }
             }
-            ++j;
-        } while( j < count );
-        _freeBlocks.push_back( tileSet );
-        _inUseBlocks.push_back( mikedotcpp::Pool() );
+        }
+        ++j;
+    } while( j < count );
+    _freeBlocks[tileIndex] = tileSet;
+}
+
+void BlockManager::releaseTileBlocks( int tileIndex )
+{
+    if( _billboardBatch )
+    {
+        _billboardBatch->setSource( tileIndex, nullptr, 0.0f );
+    }
+    for( auto block : _freeBlocks[tileIndex] )
+    {
+        block->removeFromParent();
+        block->release();
+    }
+    _freeBlocks[tileIndex].clear();
+    
+    if( tileIndex < _instancedMeshes.size() && _instancedMeshes[tileIndex] )
+    {
+        _instancedMeshes[tileIndex]->removeFromParent();
+        _instancedMeshes[tileIndex]->release();
+        _instancedMeshes[tileIndex] = nullptr;
+    }
+}
+
+bool BlockManager::rebuildTiles( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer, const std::vector< int >& tileIndices )
+{
+    if( _useMergedMaterial )
+    {
+        return false;
+    }
+    
+    reclaimAllBlocks();
+    _tileInstanceCounts = getInstanceCountsForMap( mapInfo );
+    if( mapInfo.useRealtimeLighting )
+    {
+        // Images named for the first time by the edit (and their custom parameters).
+        loadTextures( mapInfo );
+    }
+    
+    // Same setup as a deferred initialization, so the face sources resolve against the edited map.
+    _initMapInfo = &mapInfo;
+    _faceSources.clear();
+    for( int tileIndex : tileIndices )
+    {
+        releaseTileBlocks( tileIndex );
+        initTileBlocks( mapInfo, layer, tileIndex );
+    }
+    if( mapInfo.useRealtimeLighting )
+    {
+        sortMeshBlocksByState();
+    }
+    _faceSources.clear();
+    _initMapInfo = nullptr;
+    return true;
+}
+
+bool BlockManager::reloadTexture( const std::string& fullPath, const mikedotcpp::MapInfo& mapInfo )
+{
+    // TextureCache::reloadTexture would load images it doesn't hold yet.
+    cocos2d::TextureCache* textureCache = cocos2d::Director::getInstance()->getTextureCache();
+    cocos2d::Texture2D* texture = textureCache->getTextureForKey( fullPath );
+    if( !texture )
+    {
+        return false;
     }
     
-    delete countCollection;
+    // The upload replaces the GL name along with the parameters and mip levels.
+    _textureMipmaps.erase( texture->getName() );
+    if( !textureCache->reloadTexture( fullPath ) )
+    {
+        CCLOG( "BlockManager::reloadTexture - failed to reload %s.", fullPath.c_str() );
+        return false;
+    }
+    configureMapTexture( texture, mapInfo );
+    if( mapInfo.useRealtimeLighting && !_useMergedMaterial )
+    {
+        // Re-applies the tiles' custom texture parameters; the other images are already configured.
+        loadTextures( mapInfo );
+    }
+    return true;
 }
 
 mikedotcpp::BatchedSprite3D* BlockManager::createMeshBlock( const Tile& tileData )
@@ -146,116 +510,398 @@ mikedotcpp::BatchedSprite3D* BlockManager::createMeshBlock( const Tile& tileData
     block->setCameraMask( (unsigned short)cocos2d::CameraFlag::USER1 );
     block->retain();
     initMeshBlock( *block, tileData );
-    block->addChild( cocos2d::Node::create() ); // Note: This is hack to ensure the node is always visited (not culled).
     
-    BatchedGLProgram* shader = BatchedGLProgram::createWithFilenames( tileData.vertexShader, tileData.fragmentShader );
-    auto glProgramState = cocos2d::GLProgramState::getOrCreateWithGLProgram( shader );
+    BatchedGLProgram* shader = BatchedGLProgram::getOrCreateWithFilenames( tileData.vertexShader, tileData.fragmentShader );
+    // The program is shared between blocks, the uniform state (textures, position palette) is not.
+    auto glProgramState = cocos2d::GLProgramState::create( shader );
     block->setMaterial( cocos2d::Sprite3DMaterial::createWithGLStateProgram( glProgramState ) );
+    if( tileData.textureLodBias != 0.0f )
+    {
+        // Custom tile shaders may not declare the uniform, so it is only set when used.
+        for( const auto mesh : block->getMeshes() )
+        {
+            for( const auto pass : mesh->getMaterial()->getTechnique()->getPasses() )
+            {
+                pass->getGLProgramState()->setUniformFloat( LOD_BIAS_UNIFORM, tileData.textureLodBias );
+            }
+        }
+    }
     return block;
 }
 
-cocos2d::Sprite3D* BlockManager::createSpriteBlock( const Tile& tileData )
+void BlockManager::sortMeshBlocksByState()
 {
-    cocos2d::Sprite3D* block = cocos2d::Sprite3D::create();
-    block->setVisible( false );
-    block->setCameraMask( (unsigned short)cocos2d::CameraFlag::USER1 );
-    block->retain();
-    initSpriteBlock( *block, tileData );
-    return block;
+    std::vector< std::pair< BatchedStateKey, int > > order;
+    order.reserve( _instancedMeshes.size() );
+    for( int i = 0; i < _instancedMeshes.size(); ++i )
+    {
+        BatchedStateKey key;
+        if( _instancedMeshes[i]->getMeshCount() > 0 )
+        {
+            key = static_cast< BatchedMesh* >( _instancedMeshes[i]->getMeshByIndex( 0 ) )->getStateKey();
+        }
+        order.push_back( std::make_pair( key, i ) );
+    }
+    
+    std::stable_sort( order.begin(), order.end(), []( const std::pair< BatchedStateKey, int >& a, const std::pair< BatchedStateKey, int >& b )
+    {
+        return a.first < b.first;
+    } );
+    
+    // Children are visited (and their commands queued) in local z-order.
+    for( int rank = 0; rank < order.size(); ++rank )
+    {
+        _instancedMeshes[ order[rank].second ]->setLocalZOrder( rank );
+    }
 }
 
-void BlockManager::initMeshBlock( mikedotcpp::BatchedSprite3D& block, const mikedotcpp::Tile& tileData )
+void BlockManager::initMergedBlocks( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer )
 {
-    configureMeshFaces( block, tileData );
+    buildMergedMaterialTable( mapInfo );
+    
+    int totalInstances = 0;
+    for( int i = 0; i < _tileInstanceCounts.size(); ++i )
+    {
+        if( _instanceSelectors[i] >= 0.0f )
+        {
+            totalInstances += _tileInstanceCounts[i];
+        }
+    }
+    
+    // getMergedPaletteSize() made sure MAX_MERGED_BATCHES are enough.
+    int batchCount = MIN( MAX_MERGED_BATCHES, ( totalInstances + _mergedPaletteSize - 1 ) / _mergedPaletteSize );
+    for( int i = 0; i < batchCount; ++i )
+    {
+        BatchedSprite3D* block = createMergedMeshBlock( mapInfo );
+        _instancedMeshes.push_back( block );
+        _instanceCapacities.push_back( MIN( _mergedPaletteSize, totalInstances - i * _mergedPaletteSize ) );
+        layer->addChild( block );
+    }
+    CCLOG( "MERGED MATERIAL: %i instances in %i batches", totalInstances, batchCount );
 }
 
-int* BlockManager::getTileCollectionCounts( int tileCount, int planeCount, int mapSize, const std::vector< Plane >& planes ) const
+int BlockManager::getMergedPaletteSize( const mikedotcpp::MapInfo& mapInfo, bool logFallback )
 {
-    int* countCollection = new int[ tileCount ]{0};
-    for( int i = 0; i < planeCount; ++i )
+    if( !mapInfo.useRealtimeLighting || !mapInfo.useMergedMaterial )
     {
-        Plane mapPlane = planes[i];
-        for( int j = 0; j < mapSize; ++j )
+        return 0;
+    }
+    
+    std::string fallback;
+    GLint uniformVectors = 0;
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_WIN32) || (CC_TARGET_PLATFORM == CC_PLATFORM_MAC) || (CC_TARGET_PLATFORM == CC_PLATFORM_LINUX)
+    // Desktop GL before 4.1 only reports the limit in components.
+    glGetIntegerv( GL_MAX_VERTEX_UNIFORM_COMPONENTS, &uniformVectors );
+    uniformVectors /= 4;
+#else
+    glGetIntegerv( GL_MAX_VERTEX_UNIFORM_VECTORS, &uniformVectors );
+#endif
+    int paletteSize = MIN( MAX_INSTANCES_PER_DRAW, uniformVectors - MAX_MERGED_TILE_TYPES * FACES_PER_CUBE - MERGED_RESERVED_UNIFORM_VECTORS );
+    
+    int totalInstances = 0;
+    std::vector< int > counts = getInstanceCountsForMap( mapInfo );
+    for( int i = 0; i < counts.size(); ++i )
+    {
+        const Tile& tile = mapInfo.tiles[i];
+        totalInstances += ( tile.billboardTexture.empty() && tile.model.empty() ) ? counts[i] : 0;
+    }
+    
+    if( mapInfo.tiles.size() > MAX_MERGED_TILE_TYPES )
+    {
+        fallback = "the map has more than " + std::to_string( MAX_MERGED_TILE_TYPES ) + " tile types";
+    }
+    else if( paletteSize < MIN_MERGED_PALETTE_SIZE )
+    {
+        fallback = "only " + std::to_string( uniformVectors ) + " vertex uniform vectors";
+    }
+    else if( totalInstances > MAX_MERGED_BATCHES * paletteSize )
+    {
+        fallback = std::to_string( totalInstances ) + " tiles do not fit in " + std::to_string( MAX_MERGED_BATCHES ) + " draws";
+    }
+    
+    if( !fallback.empty() )
+    {
+        if( logFallback )
         {
-            int tileIndex = mapPlane.map[j];
-            if( tileIndex > 0 )
+            cocos2d::log( "BlockManager - not using the merged material (%s), drawing a material per tile instead.", fallback.c_str() );
+        }
+        return 0;
+    }
+    return paletteSize;
+}
+
+void BlockManager::packMergedAtlas( const mikedotcpp::MapInfo& mapInfo )
+{
+    TextureAtlasBuilder builder;
+    for( const auto& tile : mapInfo.tiles )
+    {
+        if( !tile.billboardTexture.empty() || !tile.model.empty() )
+        {
+            continue;
+        }
+        std::string diffuse[] = { tile.textureAll, tile.textureNorth, tile.textureSouth, tile.textureEast,
+                                  tile.textureWest, tile.textureCeiling, tile.textureFloor };
+        std::string normal[] = { tile.normalAll, tile.normalNorth, tile.normalSouth, tile.normalEast,
+                                 tile.normalWest, tile.normalCeiling, tile.normalFloor };
+        for( int j = 0; j < sizeof( diffuse )/sizeof( *diffuse ); ++j )
+        {
+            if( !diffuse[j].empty() )
             {
-                countCollection[ tileIndex - 1 ] += 1;
+                builder.addImage( diffuse[j], normal[j] );
             }
         }
     }
-    //
-    for( int i = 0; i < tileCount; ++i )
+    
+    if( !builder.build() )
     {
-        CCLOG( "COUNT FOR TILESET %i: %i", i+1, countCollection[i]  );
+        cocos2d::log( "BlockManager::packMergedAtlas - could not pack the tile images, the merged material will be untextured!" );
+        return;
     }
-    return countCollection;
+    builder.addSpriteFrames();
+    configureMapTexture( builder.getDiffuseTexture(), mapInfo );
+    _mergedNormalTexture = builder.getNormalTexture();
+    CC_SAFE_RETAIN( _mergedNormalTexture );
+    configureMapTexture( _mergedNormalTexture, mapInfo );
 }
 
-void BlockManager::initSpriteBlock( cocos2d::Sprite3D& block, const mikedotcpp::Tile& tileData )
+void BlockManager::buildMergedMaterialTable( const mikedotcpp::MapInfo& mapInfo )
 {
-    std::vector<std::string> names;
-    if( !tileData.billboardTexture.empty() )
+    int tileCount = (int)mapInfo.tiles.size();
+    
+    cocos2d::SpriteFrameCache* frameCache = cocos2d::SpriteFrameCache::getInstance();
+    _mergedFaceRects.assign( MAX_MERGED_TILE_TYPES * FACES_PER_CUBE, cocos2d::Vec4::ZERO );
+    _mergedLodBiases.assign( MAX_MERGED_TILE_TYPES / 4, cocos2d::Vec4::ZERO );
+    _instanceSelectors.assign( tileCount, -1.0f );
+    
+    for( int i = 0; i < tileCount && i < MAX_MERGED_TILE_TYPES; ++i )
     {
-        configureSpriteBillboard( block, tileData.billboardTexture );
+        const Tile& tile = mapInfo.tiles[i];
+        if( !tile.billboardTexture.empty() || !tile.model.empty() )
+        {
+            continue;
+        }
+        
+        // Ordered by FaceDirection.
+        const std::string* faces[] = { &tile.textureNorth, &tile.textureSouth, &tile.textureEast,
+                                       &tile.textureWest, &tile.textureCeiling, &tile.textureFloor };
+        int faceMask = 0;
+        for( int face = 0; face < FACES_PER_CUBE; ++face )
+        {
+            const std::string& name = tile.textureAll.empty() ? *faces[face] : tile.textureAll;
+            if( name.empty() )
+            {
+                continue;
+            }
+            cocos2d::SpriteFrame* frame = frameCache->getSpriteFrameByName( name );
+            if( !frame )
+            {
+                cocos2d::log( "BlockManager::buildMergedMaterialTable - SpriteFrame named %s missing!", name.c_str() );
+                continue;
+            }
+            CCASSERT( !frame->isRotated(), "Rotated frames are not supported by the merged material atlas." );
+            
+            float atlasWidth = frame->getTexture()->getPixelsWide();
+            float atlasHeight = frame->getTexture()->getPixelsHigh();
+            cocos2d::Rect rect = frame->getRectInPixels();
+            _mergedFaceRects[ i * FACES_PER_CUBE + face ] = cocos2d::Vec4( rect.origin.x / atlasWidth,
+                                                                          rect.origin.y / atlasHeight,
+                                                                          rect.size.width / atlasWidth,
+                                                                          rect.size.height / atlasHeight );
+            faceMask |= ( 1 << face );
+        }
+        
+        if( faceMask != 0 )
+        {
+            _instanceSelectors[i] = i * 64 + faceMask;
+            float* lodBiases = &_mergedLodBiases[ i / 4 ].x;
+            lodBiases[ i % 4 ] = tile.textureLodBias;
+        }
     }
-    else
+}
+
+mikedotcpp::BatchedSprite3D* BlockManager::createMergedMeshBlock( const mikedotcpp::MapInfo& mapInfo )
+{
+    BatchedSprite3D* block = BatchedSprite3D::create();
+    block->setCameraMask( (unsigned short)cocos2d::CameraFlag::USER1 );
+    block->retain();
+    
+    BatchedMesh* mesh = BatchedMesh::create( getCubeVertices(), CUBE_VERTEX_SIZE_IN_FLOATS, getCubeIndices(), getCubeVertexAttributes() );
+    cocos2d::SpriteFrame* frame = nullptr;
+    for( int i = 0; i < mapInfo.tiles.size() && !frame; ++i )
     {
-        if( !tileData.textureAll.empty() )
+        const Tile& tile = mapInfo.tiles[i];
+        std::string names[] = { tile.textureAll, tile.textureNorth, tile.textureSouth, tile.textureEast,
+                                tile.textureWest, tile.textureCeiling, tile.textureFloor };
+        for( int j = 0; j < sizeof( names )/sizeof( *names ) && !frame; ++j )
         {
-            names = { tileData.textureAll, tileData.textureAll, tileData.textureAll,
-                      tileData.textureAll, tileData.textureAll, tileData.textureAll,
-                      tileData.textureAll, tileData.textureAll };
+            frame = names[j].empty() ? nullptr : cocos2d::SpriteFrameCache::getInstance()->getSpriteFrameByName( names[j] );
         }
-        else
+    }
+    if( frame )
+    {
+        mesh->setTexture( frame->getTexture(), cocos2d::NTextureData::Usage::Diffuse );
+    }
+    if( _mergedNormalTexture )
+    {
+        mesh->setTexture( _mergedNormalTexture, cocos2d::NTextureData::Usage::Normal );
+    }
+    block->addMesh( mesh );
+    
+    std::string defines = "MAX_POSITION_COUNT " + std::to_string( _mergedPaletteSize ) + ";MERGED_LOD_BIAS";
+    BatchedGLProgram* shader = BatchedGLProgram::getOrCreateWithFilenames( MERGED_VERTEX_SHADER, MERGED_FRAGMENT_SHADER, defines );
+    // The program is shared between blocks, the uniform state (textures, position palette) is not.
+    auto glProgramState = cocos2d::GLProgramState::create( shader );
+    block->setMaterial( cocos2d::Sprite3DMaterial::createWithGLStateProgram( glProgramState ) );
+    
+    for( const auto pass : mesh->getMaterial()->getTechnique()->getPasses() )
+    {
+        // NOTE: Only the pointers are stored; _mergedFaceRects and _mergedLodBiases must outlive the block.
+        pass->getGLProgramState()->setUniformVec4v( "u_faceRects", (GLsizei)_mergedFaceRects.size(), &_mergedFaceRects[0] );
+        pass->getGLProgramState()->setUniformVec4v( MERGED_LOD_BIASES_UNIFORM, (GLsizei)_mergedLodBiases.size(), &_mergedLodBiases[0] );
+    }
+    return block;
+}
+
+cocos2d::Sprite3D* BlockManager::createSpriteBlock( const TileDescriptor& descriptor )
+{
+    cocos2d::Sprite3D* block = cocos2d::Sprite3D::create();
+    block->setVisible( false );
+    block->setCameraMask( (unsigned short)cocos2d::CameraFlag::USER1 );
+    block->retain();
+    initSpriteBlock( *block, descriptor );
+    if( descriptor.textureLodBias != 0.0f )
+    {
+        applySpriteLodBias( *block, descriptor.textureLodBias );
+    }
+    return block;
+}
+
+void BlockManager::applySpriteLodBias( cocos2d::Sprite3D& block, float lodBias )
+{
+    // One program state per bias value, so the faces of all tiles that share a bias still batch together.
+    cocos2d::GLProgramState* state = _lodBiasStates[lodBias];
+    if( !state )
+    {
+        cocos2d::GLProgram* program = cocos2d::GLProgramCache::getInstance()->getGLProgram( LOD_BIAS_SPRITE_FRAGMENT_SHADER );
+        if( !program )
+        {
+            std::string fragmentSource = cocos2d::FileUtils::getInstance()->getStringFromFile( LOD_BIAS_SPRITE_FRAGMENT_SHADER );
+            program = cocos2d::GLProgram::createWithByteArrays( cocos2d::ccPositionTextureColor_noMVP_vert, fragmentSource.c_str() );
+            cocos2d::GLProgramCache::getInstance()->addGLProgram( program, LOD_BIAS_SPRITE_FRAGMENT_SHADER );
+        }
+        state = cocos2d::GLProgramState::create( program );
+        state->setUniformFloat( LOD_BIAS_UNIFORM, lodBias );
+        state->retain();
+        _lodBiasStates[lodBias] = state;
+    }
+    
+    for( auto child : block.getChildren() )
+    {
+        cocos2d::Sprite* face = dynamic_cast< cocos2d::Sprite* >( child );
+        // ETC1 faces with a separate alpha texture keep the ETC1AS program (see CompressedTextures).
+        if( face && face->getTexture() && face->getTexture()->getAlphaTextureName() == 0 )
         {
-            names = { tileData.textureNorth, tileData.textureEast, tileData.textureSouth,
-                      tileData.textureWest, tileData.textureCeiling, tileData.textureFloor,
-                      tileData.textureCenterSpanNS, tileData.textureCenterSpanEW };
+            face->setGLProgramState( state );
         }
-        configureSpriteFaces( block, names );
     }
 }
 
-void BlockManager::configureSpriteBillboard( cocos2d::Sprite3D& block, const std::string& filename )
+void BlockManager::initMeshBlock( mikedotcpp::BatchedSprite3D& block, const mikedotcpp::Tile& tileData )
 {
-    mikedotcpp::FPBillBoard* board = mikedotcpp::FPBillBoard::create();
-    board->setSpriteFrame( filename );
-    board->setGlobalZOrder( -1 );
-    board->setScale( _contentScaleFactor );
-    board->setCameraMask( (unsigned short) cocos2d::CameraFlag::USER1 );
-    board->setVisible( true );
-    block.addChild( board );
+    configureMeshFaces( block, tileData );
 }
 
-void BlockManager::configureSpriteFaces( cocos2d::Sprite3D& block, const std::vector<std::string>& filenames )
+std::vector< int > BlockManager::getInstanceCountsForMap( const mikedotcpp::MapInfo& mapInfo )
 {
-    CCASSERT( filenames.size() == 8, "A filename is required for each side of a cube (8 including the center spaces)." );
+    std::vector< int > counts = mapInfo.tileInstanceCounts;
+    counts.resize( mapInfo.tiles.size(), 0 );
     
+    // Every plane of a resident column can hold at most tileMaxChunkInstances placements of a tile.
+    int residentChunks = MapChunkStreamer::getMaxResidentColumns() * (int)mapInfo.planes.size();
+    for( int i = 0; i < counts.size(); ++i )
+    {
+        if( mapInfo.isChunked() && i < mapInfo.tileMaxChunkInstances.size() )
+        {
+            counts[i] = MIN( counts[i], mapInfo.tileMaxChunkInstances[i] * residentChunks );
+        }
+        CCLOG( "COUNT FOR TILESET %i: %i", i+1, counts[i] );
+    }
+    return counts;
+}
+
+void BlockManager::initSpriteBlock( cocos2d::Sprite3D& block, const mikedotcpp::TileDescriptor& descriptor )
+{
+    if( descriptor.hasFlag( TILE_FLAG_TEXTURE_ALL ) )
+    {
+        StringID all = descriptor.get( TILE_TEXTURE_ALL );
+        StringID faces[SPRITE_FACE_COUNT] = { all, all, all, all, all, all, all, all };
+        configureSpriteFaces( block, faces );
+    }
+    else
+    {
+        StringID faces[SPRITE_FACE_COUNT] = { descriptor.get( TILE_TEXTURE_NORTH ), descriptor.get( TILE_TEXTURE_EAST ),
+                                              descriptor.get( TILE_TEXTURE_SOUTH ), descriptor.get( TILE_TEXTURE_WEST ),
+                                              descriptor.get( TILE_TEXTURE_CEILING ), descriptor.get( TILE_TEXTURE_FLOOR ),
+                                              descriptor.get( TILE_TEXTURE_CENTER_SPAN_NS ), descriptor.get( TILE_TEXTURE_CENTER_SPAN_EW ) };
+        configureSpriteFaces( block, faces );
+    }
+}
+
+const BlockManager::FaceSource& BlockManager::getFaceSource( StringID name )
+{
+    if( _faceSources.size() <= name )
+    {
+        _faceSources.resize( _initMapInfo->strings.size() );
+    }
+    FaceSource& source = _faceSources[name];
+    if( source.resolved )
+    {
+        return source;
+    }
+    
+    // Resolved once per distinct name, instead of once per face of every block.
+    const std::string& faceImage = _initMapInfo->strings.get( name );
+    cocos2d::SpriteFrameCache* frameCache = cocos2d::SpriteFrameCache::getInstance();
+    if( !faceImage.empty() && faceImage[0] == '#' )
+    {
+        unsigned long hex = std::strtoul( faceImage.substr( 1, 6 ).c_str(), nullptr, 16 );
+        int b = hex & 0xFF; hex >>= 8;
+        int g = hex & 0xFF; hex >>= 8;
+        int r = hex & 0xFF;
+        source.frame = frameCache->getSpriteFrameByName( WHITE_TILE );
+        source.color = cocos2d::Color3B( r, g, b );
+        source.tinted = true;
+    }
+    else if( !faceImage.empty() )
+    {
+        source.frame = frameCache->getSpriteFrameByName( faceImage );
+        if( !source.frame )
+        {
+            cocos2d::log( "BlockManager::configureFace - SpriteFrame named %s missing!", faceImage.c_str() );
+        }
+    }
+    source.resolved = true;
+    return source;
+}
+
+void BlockManager::configureSpriteFaces( cocos2d::Sprite3D& block, const StringID names[SPRITE_FACE_COUNT] )
+{
     int directions[] = { FaceDirection::north, FaceDirection::east, FaceDirection::south,
                          FaceDirection::west, FaceDirection::top, FaceDirection::bottom,
                          FaceDirection::centerSpanNS, FaceDirection::centerSpanEW };
-    for( int i = 0; i < filenames.size(); ++i )
+    for( int i = 0; i < SPRITE_FACE_COUNT; ++i )
     {
-        std::string textureName = filenames[i];
-        if( !textureName.empty() )
+        if( names[i] != STRING_ID_NONE )
         {
-            cocos2d::Sprite* face;
-            if( textureName[0] == '#' )
-            {
-                unsigned long hex = std::strtoul( textureName.substr( 1, 6 ).c_str(), nullptr, 16 );
-                int b = hex & 0xFF; hex >>= 8;
-                int g = hex & 0xFF; hex >>= 8;
-                int r = hex & 0xFF;
-                face = configureSpriteFace( WHITE_TILE );
-                face->setColor( cocos2d::Color3B( r, g, b ) );
-            }
-            else
-            {
-                face = configureSpriteFace( textureName );
-            }
+            const FaceSource& source = getFaceSource( names[i] );
+            cocos2d::Sprite* face = configureSpriteFace( source.frame );
             if( face )
             {
+                if( source.tinted )
+                {
+                    face->setColor( source.color );
+                }
+                face->setTag( directions[i] );
                 orientSpriteFace( face, directions[i] );
                 cocos2d::V3F_C4B_T2F_Quad quad = face->getQuad();
                 block.addChild( face );
@@ -264,83 +910,19 @@ void BlockManager::configureSpriteFaces( cocos2d::Sprite3D& block, const std::ve
     }
 }
 
-/*
- 
-    TODO: Break this function up a bit.
- 
- */
 void BlockManager::configureMeshFaces( BatchedSprite3D& block, const mikedotcpp::Tile& tileData )
 {
-    std::vector< cocos2d::MeshVertexAttrib > attributes =
-    {
-        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_POSITION,   3*sizeof(float) },
-        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_NORMAL,     3*sizeof(float) },
-        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_TANGENT,    3*sizeof(float) },
-        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_BINORMAL,   3*sizeof(float) },
-        { 2, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_TEX_COORD,  2*sizeof(float) }
-    };
-    float x = 0.0f, y = 0.0f, z = 0.0f, s = 64.0f;
-    std::vector< float > vertices;
+    std::vector< cocos2d::MeshVertexAttrib > attributes = getCubeVertexAttributes();
+    std::vector< float > vertices = getCubeVertices();
     cocos2d::MeshData::IndexArray meshIndices;
-    cocos2d::MeshData::IndexArray indices;
-    int perVertexSizeInFloat = 14;
-    //
-    FaceCoords northFace = getFaceTextureCoordinates();
-    FaceCoords eastFace = getFaceTextureCoordinates();
-    FaceCoords southFace = getFaceTextureCoordinates();
-    FaceCoords westFace = getFaceTextureCoordinates();
-    FaceCoords topFace = getFaceTextureCoordinates();
-    FaceCoords bottomFace = getFaceTextureCoordinates();
-    //
-    vertices.insert ( vertices.end(),
-    {
-        // position  normal  tangent binormal uv
-        // +x
-        x+s,y-s,z-s, 1,0,0,  0,0,-1, 0,-1,0, westFace.br.x, westFace.br.y,
-        x+s,y+s,z-s, 1,0,0,  0,0,-1, 0,-1,0, westFace.tr.x, westFace.tr.y,
-        x+s,y-s,z+s, 1,0,0,  0,0,-1, 0,-1,0, westFace.bl.x, westFace.bl.y,
-        x+s,y+s,z+s, 1,0,0,  0,0,-1, 0,-1,0, westFace.tl.x, westFace.tl.y,
-        // +y
-        x-s,y+s,z-s, 0,1,0,  1,0,0,  0,0,1,  topFace.br.x, topFace.br.y,
-        x+s,y+s,z-s, 0,1,0,  1,0,0,  0,0,1,  topFace.tr.x, topFace.tr.y,
-        x-s,y+s,z+s, 0,1,0,  1,0,0,  0,0,1,  topFace.bl.x, topFace.bl.y,
-        x+s,y+s,z+s, 0,1,0,  1,0,0,  0,0,1,  topFace.tl.x, topFace.tl.y,
-        // +z
-        x-s,y-s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.bl.x, northFace.bl.y,
-        x+s,y-s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.br.x, northFace.br.y,
-        x-s,y+s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.tl.x, northFace.tl.y,
-        x+s,y+s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.tr.x, northFace.tr.y,
-        // -x
-        x-s,y-s,z-s, -1,0,0, 0,0,1,  0,-1,0, eastFace.br.x, eastFace.br.y,
-        x-s,y+s,z-s, -1,0,0, 0,0,1,  0,-1,0, eastFace.tr.x, eastFace.tr.y,
-        x-s,y-s,z+s, -1,0,0, 0,0,1,  0,-1,0, eastFace.bl.x, eastFace.bl.y,
-        x-s,y+s,z+s, -1,0,0, 0,0,1,  0,-1,0, eastFace.tl.x, eastFace.tl.y,
-        // -y
-        x-s,y-s,z-s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.bl.x, bottomFace.bl.y,
-        x+s,y-s,z-s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.br.x, bottomFace.br.y,
-        x-s,y-s,z+s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.tl.x, bottomFace.tl.y,
-        x+s,y-s,z+s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.tr.x, bottomFace.tr.y,
-        // -z
-        x-s,y-s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.bl.x, southFace.bl.y,
-        x+s,y-s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.br.x, southFace.br.y,
-        x-s,y+s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.tl.x, southFace.tl.y,
-        x+s,y+s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.tr.x, southFace.tr.y,
-     });
+    int perVertexSizeInFloat = CUBE_VERTEX_SIZE_IN_FLOATS;
     //
     if( !tileData.textureAll.empty() )
     {
-        meshIndices.insert( meshIndices.end(),
-        {
-            0, 3, 2, 1, 3, 0,     // EAST
-            4, 6, 7, 4, 7, 5,     // TOP
-            8, 11, 10, 9, 11, 8,  // NORTH
-            12,  14,  15,  13,  12,  15, // WEST
-            16,  19,  18,  17,  19,  16, // BOTTOM
-            20,  22,  23,  21,  20,  23  // SOUTH
-        } );
+        meshIndices = getCubeIndices();
         BatchedMesh* proceduralMesh = BatchedMesh::create( vertices, perVertexSizeInFloat, meshIndices, attributes );
-        proceduralMesh->setTexture( tileData.textureAll, cocos2d::NTextureData::Usage::Diffuse );
-        proceduralMesh->setTexture( tileData.normalAll, cocos2d::NTextureData::Usage::Normal );
+        proceduralMesh->setTexture( CompressedTextures::resolve( tileData.textureAll ), cocos2d::NTextureData::Usage::Diffuse );
+        proceduralMesh->setTexture( CompressedTextures::resolve( tileData.normalAll ), cocos2d::NTextureData::Usage::Normal );
         block.addMesh( proceduralMesh );
     }
     else
@@ -384,14 +966,90 @@ void BlockManager::configureMeshFaces( BatchedSprite3D& block, const mikedotcpp:
                     meshIndices.insert( meshIndices.end(), { 16,  19,  18,  17,  19,  16 } );
                 }
                 BatchedMesh* proceduralMesh = BatchedMesh::create( vertices, perVertexSizeInFloat, meshIndices, attributes );
-                proceduralMesh->setTexture( diffuse, cocos2d::NTextureData::Usage::Diffuse );
-                proceduralMesh->setTexture( normal, cocos2d::NTextureData::Usage::Normal );
+                proceduralMesh->setTexture( CompressedTextures::resolve( diffuse ), cocos2d::NTextureData::Usage::Diffuse );
+                proceduralMesh->setTexture( CompressedTextures::resolve( normal ), cocos2d::NTextureData::Usage::Normal );
                 block.addMesh( proceduralMesh );
             }
         }
     }
 }
 
+std::vector< cocos2d::MeshVertexAttrib > BlockManager::getCubeVertexAttributes()
+{
+    std::vector< cocos2d::MeshVertexAttrib > attributes =
+    {
+        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_POSITION,   3*sizeof(float) },
+        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_NORMAL,     3*sizeof(float) },
+        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_TANGENT,    3*sizeof(float) },
+        { 3, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_BINORMAL,   3*sizeof(float) },
+        { 2, GL_FLOAT, cocos2d::GLProgram::VERTEX_ATTRIB_TEX_COORD,  2*sizeof(float) }
+    };
+    return attributes;
+}
+
+cocos2d::MeshData::IndexArray BlockManager::getCubeIndices()
+{
+    cocos2d::MeshData::IndexArray indices =
+    {
+        0, 3, 2, 1, 3, 0,     // EAST
+        4, 6, 7, 4, 7, 5,     // TOP
+        8, 11, 10, 9, 11, 8,  // NORTH
+        12,  14,  15,  13,  12,  15, // WEST
+        16,  19,  18,  17,  19,  16, // BOTTOM
+        20,  22,  23,  21,  20,  23  // SOUTH
+    };
+    return indices;
+}
+
+std::vector< float > BlockManager::getCubeVertices()
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f, s = 64.0f;
+    std::vector< float > vertices;
+    //
+    FaceCoords northFace = getFaceTextureCoordinates();
+    FaceCoords eastFace = getFaceTextureCoordinates();
+    FaceCoords southFace = getFaceTextureCoordinates();
+    FaceCoords westFace = getFaceTextureCoordinates();
+    FaceCoords topFace = getFaceTextureCoordinates();
+    FaceCoords bottomFace = getFaceTextureCoordinates();
+    //
+    vertices.insert ( vertices.end(),
+    {
+        // position  normal  tangent binormal uv
+        // +x
+        x+s,y-s,z-s, 1,0,0,  0,0,-1, 0,-1,0, westFace.br.x, westFace.br.y,
+        x+s,y+s,z-s, 1,0,0,  0,0,-1, 0,-1,0, westFace.tr.x, westFace.tr.y,
+        x+s,y-s,z+s, 1,0,0,  0,0,-1, 0,-1,0, westFace.bl.x, westFace.bl.y,
+        x+s,y+s,z+s, 1,0,0,  0,0,-1, 0,-1,0, westFace.tl.x, westFace.tl.y,
+        // +y
+        x-s,y+s,z-s, 0,1,0,  1,0,0,  0,0,1,  topFace.br.x, topFace.br.y,
+        x+s,y+s,z-s, 0,1,0,  1,0,0,  0,0,1,  topFace.tr.x, topFace.tr.y,
+        x-s,y+s,z+s, 0,1,0,  1,0,0,  0,0,1,  topFace.bl.x, topFace.bl.y,
+        x+s,y+s,z+s, 0,1,0,  1,0,0,  0,0,1,  topFace.tl.x, topFace.tl.y,
+        // +z
+        x-s,y-s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.bl.x, northFace.bl.y,
+        x+s,y-s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.br.x, northFace.br.y,
+        x-s,y+s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.tl.x, northFace.tl.y,
+        x+s,y+s,z+s, 0,0,1,  0,0,-1, 1,0,0,  northFace.tr.x, northFace.tr.y,
+        // -x
+        x-s,y-s,z-s, -1,0,0, 0,0,1,  0,-1,0, eastFace.br.x, eastFace.br.y,
+        x-s,y+s,z-s, -1,0,0, 0,0,1,  0,-1,0, eastFace.tr.x, eastFace.tr.y,
+        x-s,y-s,z+s, -1,0,0, 0,0,1,  0,-1,0, eastFace.bl.x, eastFace.bl.y,
+        x-s,y+s,z+s, -1,0,0, 0,0,1,  0,-1,0, eastFace.tl.x, eastFace.tl.y,
+        // -y
+        x-s,y-s,z-s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.bl.x, bottomFace.bl.y,
+        x+s,y-s,z-s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.br.x, bottomFace.br.y,
+        x-s,y-s,z+s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.tl.x, bottomFace.tl.y,
+        x+s,y-s,z+s, 0,-1,0, -1,0,0, 0,0,1,  bottomFace.tr.x, bottomFace.tr.y,
+        // -z
+        x-s,y-s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.bl.x, southFace.bl.y,
+        x+s,y-s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.br.x, southFace.br.y,
+        x-s,y+s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.tl.x, southFace.tl.y,
+        x+s,y+s,z-s, 0,0,-1,  0,0,1, 1,0,0,  southFace.tr.x, southFace.tr.y,
+     });
+    return vertices;
+}
+
 FaceCoords BlockManager::getFaceTextureCoordinates()
 {
     float left = 0;
@@ -409,20 +1067,21 @@ FaceCoords BlockManager::getFaceTextureCoordinates()
 BlockManager::~BlockManager()
 {
     CCLOG( "BlockManager deleted, release resources." );
+    CC_SAFE_RELEASE( _mergedNormalTexture );
+    CC_SAFE_RELEASE( _billboardBatch );
+    for( auto& entry : _lodBiasStates )
+    {
+        CC_SAFE_RELEASE( entry.second );
+    }
 }
 
-cocos2d::Sprite* BlockManager::configureSpriteFace( const std::string& faceImage )
+cocos2d::Sprite* BlockManager::configureSpriteFace( cocos2d::SpriteFrame* frame )
 {
     cocos2d::Sprite* face = cocos2d::Sprite::create();
-    if( face && !faceImage.empty() )
+    if( face && frame )
     {
-        cocos2d::SpriteFrame* frame = cocos2d::SpriteFrameCache::getInstance()->getSpriteFrameByName( faceImage );
-        if( !frame || frame == nullptr )
-        {
-            cocos2d::log( "BlockManager::configureFace - SpriteFrame named %s missing!", faceImage.c_str() );
-            return face;
-        }
         face->setSpriteFrame( frame );
+        CompressedTextures::configureSprite( face );
         face->setGlobalZOrder( -1 );
         face->setScale( _contentScaleFactor );
         face->setCameraMask( (unsigned short) cocos2d::CameraFlag::USER1 );
@@ -491,6 +1150,75 @@ cocos2d::Sprite3D* BlockManager::getBlock( int tilePropertiesIndex )
     return block;
 }
 
+bool BlockManager::addBillboard( int tileIndex, const cocos2d::Vec3& position )
+{
+    if( _billboardBatch == nullptr || !_billboardBatch->hasSource( tileIndex ) )
+    {
+        return false;
+    }
+    _billboardBatch->add( tileIndex, position );
+    return true;
+}
+
+void BlockManager::setExposedFaces( cocos2d::Sprite3D& block, uint8_t exposedFaces )
+{
+    for( auto child : block.getChildren() )
+    {
+        int direction = child->getTag();
+        if( direction >= FaceDirection::north && direction <= FaceDirection::bottom )
+        {
+            child->setVisible( ( exposedFaces & ( 1 << direction ) ) != 0 );
+        }
+    }
+}
+
+void BlockManager::setFaceLights( cocos2d::Sprite3D& block, const cocos2d::Color3B* lights )
+{
+    const cocos2d::Color3B* tints = &_faceTints[ block.getTag() * SPRITE_FACE_COUNT ];
+    for( auto child : block.getChildren() )
+    {
+        int direction = child->getTag();
+        if( direction >= 0 && direction < SPRITE_FACE_COUNT )
+        {
+            const cocos2d::Color3B& tint = tints[direction];
+            const cocos2d::Color3B& light = lights[direction];
+            child->setColor( cocos2d::Color3B( tint.r * light.r / 255, tint.g * light.g / 255, tint.b * light.b / 255 ) );
+        }
+    }
+}
+
+void BlockManager::applyLightMap( const mikedotcpp::LightMap& lightMap )
+{
+    for( auto state : getMeshProgramStates() )
+    {
+        lightMap.apply( state );
+    }
+}
+
+void BlockManager::applyLightGrid( const mikedotcpp::LightGrid& lightGrid )
+{
+    for( auto state : getMeshProgramStates() )
+    {
+        lightGrid.apply( state );
+    }
+}
+
+std::vector< cocos2d::GLProgramState* > BlockManager::getMeshProgramStates() const
+{
+    std::vector< cocos2d::GLProgramState* > states;
+    for( auto block : _instancedMeshes )
+    {
+        for( int i = 0; block && i < block->getMeshCount(); ++i )
+        {
+            for( const auto pass : block->getMeshByIndex( i )->getMaterial()->getTechnique()->getPasses() )
+            {
+                states.push_back( pass->getGLProgramState() );
+            }
+        }
+    }
+    return states;
+}
+
 mikedotcpp::BatchedSprite3D* BlockManager::getMeshBlock( int tileIndex )
 {
     mikedotcpp::BatchedSprite3D* block = nullptr;
@@ -501,6 +1229,26 @@ mikedotcpp::BatchedSprite3D* BlockManager::getMeshBlock( int tileIndex )
     return block;
 }
 
+const std::vector< int >& BlockManager::getTileInstanceCounts() const
+{
+    return _tileInstanceCounts;
+}
+
+const std::vector< int >& BlockManager::getInstanceCapacities() const
+{
+    return _instanceCapacities;
+}
+
+bool BlockManager::usesMergedMaterial() const
+{
+    return _useMergedMaterial;
+}
+
+float BlockManager::getInstanceSelector( int tileIndex ) const
+{
+    return _instanceSelectors[ tileIndex ];
+}
+
 void BlockManager::reclaimAllBlocks()
 {
     for( int i = 0; i < _inUseBlocks.size(); ++i )
@@ -519,4 +1267,9 @@ void BlockManager::reclaimAllBlocks()
     {
         _instancedMeshes[i]->setInstanceCount( 0 );
     }
+    
+    if( _billboardBatch )
+    {
+        _billboardBatch->clear();
+    }
 }
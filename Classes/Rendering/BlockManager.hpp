@@ -11,11 +11,20 @@
 
 #include "cocos2d.h"
 #include "../Map/MapInfo.hpp"
-#include "FPBillboard.hpp"
+#include "BillboardBatch.hpp"
+#include "LightMap.hpp"
+#include "LightGrid.hpp"
 #include "Batched/BatchedSprite3D.hpp"
 
 #define WHITE_TILE "whiteTile.png"
 
+/**
+ * Faces of a sprite-path block: the four sides, ceiling, floor and the two center spans.
+ */
+#define SPRITE_FACE_COUNT 8
+#define FACES_PER_CUBE 6
+#define CUBE_VERTEX_SIZE_IN_FLOATS 14
+
 enum FaceDirection
 {
     north, south, east, west, top, bottom, centerSpanNS, centerSpanEW
@@ -39,7 +48,8 @@ namespace mikedotcpp
      *
      * Sprite-Based:
      * Each block itself contains six sprites that comprise a cube. BlockManager will create and manage pools of
-     * Sprite3D container objects (the blocks), and Sprite objects (the faces).
+     * Sprite3D container objects (the blocks), and Sprite objects (the faces). Billboard tiles get no blocks: they
+     * are all drawn by one BillboardBatch.
      *
      * Mesh-Based:
      * Each block in this mode is a Sprite3D, but the mesh is programatically created and assigned to each tile.
@@ -50,6 +60,13 @@ namespace mikedotcpp
      * meshed-based rendering uses geometry instancing, which is not supported across all hardwarde. Thankfully, it
      * is supported as an extension to many OpenGL ES 2.0 implementations.
      *
+     * Merged-Material (mesh-based variant):
+     * Every tile type shares a single cube mesh, a single shader and one diffuse/normal atlas. Each instance carries
+     * a selector (tile type and face mask) that picks the atlas rect per face, so the whole wall set renders in one
+     * instanced draw per palette of visible tiles (MAX_INSTANCES_PER_DRAW, or fewer on devices with few vertex
+     * uniforms) no matter how many tile types the map defines. Maps past its limits fall back to a material per
+     * tile (see getMergedPaletteSize).
+     *
      * The BlockManager does not free allocated objects until the end of 
      * program execution.
      */
@@ -62,6 +79,37 @@ namespace mikedotcpp
          */
         cocos2d::Sprite3D* getBlock( int tilePropertiesIndex );
         
+        /**
+         * Sprite rendering path: queues a billboard of the tile at position for this frame. Returns FALSE, doing
+         * nothing, if the tile is not a billboard (use getBlock() then).
+         */
+        bool addBillboard( int tileIndex, const cocos2d::Vec3& position );
+        
+        /**
+         * Sprite rendering path: shows only the faces of a block in exposedFaces (MAP_CELL_EXPOSED_MASK bits, see
+         * MapInfo::getCellFlags), so faces pressed against a solid neighbour are not drawn. Center spans and
+         * billboards are always shown.
+         */
+        void setExposedFaces( cocos2d::Sprite3D& block, uint8_t exposedFaces );
+        
+        /**
+         * Sprite rendering path: colors each face of a block with its configured color (the '#' tint, or white)
+         * times its light, eight colors in FaceDirection order (see LightMap::getFaceColors).
+         */
+        void setFaceLights( cocos2d::Sprite3D& block, const cocos2d::Color3B* lights );
+        
+        /**
+         * Mesh rendering path: points every instanced mesh at the light map (see LightMap::apply). Blocks created
+         * or rebuilt afterwards need another call.
+         */
+        void applyLightMap( const mikedotcpp::LightMap& lightMap );
+        
+        /**
+         * Mesh rendering path: points every instanced mesh at the light grid (see LightGrid::apply). Blocks created
+         * or rebuilt afterwards need another call.
+         */
+        void applyLightGrid( const mikedotcpp::LightGrid& lightGrid );
+        
         /**
          * Returns the BatchedSprite3D object and tileIndex.
          */
@@ -73,12 +121,68 @@ namespace mikedotcpp
         void reclaimAllBlocks();
         
         /**
-         * Constructor/Destructor
+         * Returns the number of times each tile is placed in the map. This is the upper bound on how many
+         * instances of a tile can be visible in a single frame.
+         */
+        const std::vector< int >& getTileInstanceCounts() const;
+        
+        /**
+         * Returns the number of instances each instanced mesh (see getMeshBlock) can draw per frame. In the per-tile
+         * material mode this matches getTileInstanceCounts(); with the merged material there is one entry per batch.
+         */
+        const std::vector< int >& getInstanceCapacities() const;
+        
+        /**
+         * TRUE when every tile type is drawn by the shared merged-material mesh.
+         */
+        bool usesMergedMaterial() const;
+        
+        /**
+         * Returns the merged-material selector for the tile (tile index * 64 + face mask), or a negative value when
+         * the tile has no faces to draw.
+         */
+        float getInstanceSelector( int tileIndex ) const;
+        
+        /**
+         * Returns the image files the map pulls into the texture cache, so they can be decoded ahead of time (see
+         * TextureCache::addImageAsync). Anything not cached by then is loaded synchronously as usual.
+         */
+        static std::vector< std::string > getTextureFilenames( const mikedotcpp::MapInfo& mapInfo );
+        
+        /**
+         * Deferred construction only: creates the blocks of the next tiles until timeBudget (seconds) has elapsed,
+         * always at least one tile per call. Returns TRUE once every block exists. The MapInfo passed to the
+         * constructor must stay alive until then.
+         */
+        bool initNextBlocks( float timeBudget );
+        
+        /**
+         * Fraction [0, 1] of the tiles whose blocks have been created.
          */
-        BlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer );
+        float getInitProgress() const;
+        
+        /**
+         * Hot reload: recreates the blocks of the listed tiles from the (edited) map and resizes their pools to the
+         * current placements; every other block is kept. Returns FALSE, doing nothing, with the merged material,
+         * whose batches depend on every tile at once.
+         */
+        bool rebuildTiles( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer, const std::vector< int >& tileIndices );
+        
+        /**
+         * Hot reload: uploads the image at fullPath again into the texture the cache holds for it, so every sprite
+         * and mesh using it picks up the change, and re-applies the map's filtering settings. Returns FALSE when the
+         * image is not loaded.
+         */
+        bool reloadTexture( const std::string& fullPath, const mikedotcpp::MapInfo& mapInfo );
+        
+        /**
+         * Constructor/Destructor. When deferBlocks is TRUE only the textures are loaded; the blocks are created by
+         * calling initNextBlocks() until it returns TRUE.
+         */
+        BlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer, bool deferBlocks=false );
         BlockManager();
         ~BlockManager();
-        
+    
     protected:
         /**
          * Taken from the Director.
@@ -96,26 +200,83 @@ namespace mikedotcpp
          */
         std::vector< mikedotcpp::BatchedSprite3D* > _instancedMeshes;
         
+        /**
+         * Number of map spots that reference each tile (see getInstanceCountsForMap).
+         */
+        std::vector< int > _tileInstanceCounts;
+        
+        /**
+         * Per-frame instance capacity of each entry in _instancedMeshes.
+         */
+        std::vector< int > _instanceCapacities;
+        
+        /**
+         * Map and layer of a block initialization in progress (see initNextBlocks), and the next tile to create
+         * blocks for. _initMapInfo is NULL once every block exists.
+         */
+        const mikedotcpp::MapInfo* _initMapInfo = nullptr;
+        cocos2d::Layer* _initLayer = nullptr;
+        int _nextInitTile = 0;
+        
+        /**
+         * Textures already seen by configureMapTexture (GL name) and whether they have mip levels.
+         */
+        std::unordered_map< GLuint, bool > _textureMipmaps;
+        
+        /**
+         * Sprite rendering path: shared, retained program states of the faces of biased tiles, by bias.
+         */
+        std::map< float, cocos2d::GLProgramState* > _lodBiasStates;
+        
         /**
          * Configures the appropriate set of blocks according to the map settings. At this time it is not possible
          * to mix the two different rendering paths (sprite and mesh).
          */
         void initBlockManager( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer  );
         
+        /**
+         * Counts the tile placements and prepares the pools; blocks are then created tile by tile with
+         * initTileBlocks(). The merged-material batches are created here since there are only a few.
+         */
+        void beginBlockInit( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer );
+        
+        /**
+         * Creates the pool (sprite path) or instanced mesh (mesh path) of a single tile.
+         */
+        void initTileBlocks( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer, int tileIndex );
+        
+        /**
+         * Removes the blocks of a single tile from their layer and frees them. They must all be free.
+         */
+        void releaseTileBlocks( int tileIndex );
+        
         /**
          * Loads only the texture data specified by the MapInfo class.
          */
         void loadTextures( const mikedotcpp::MapInfo& mapInfo );
         
+        /**
+         * Applies the map-wide filtering settings (MapInfo::generateMipmaps, MapInfo::maxAnisotropy) to a texture
+         * the first time it is seen. Returns TRUE if the texture has mip levels.
+         */
+        bool configureMapTexture( cocos2d::Texture2D* texture, const mikedotcpp::MapInfo& mapInfo );
+        
+        /**
+         * Sprite rendering path: makes the faces of a block sample their texture with a mip level bias.
+         */
+        void applySpriteLodBias( cocos2d::Sprite3D& block, float lodBias );
+        
         /**
          * Adds some texture parameters defined by the map.
          */
-        void addCustomTexParams( const mikedotcpp::Tile& tileData, cocos2d::Sprite& sprite );
+        void addCustomTexParams( const mikedotcpp::TileDescriptor& descriptor, cocos2d::Sprite& sprite );
         
         /**
-         * Returns an array of integers that represent the number of instances for each tile defined by the map.
+         * Returns the number of instances needed for each tile defined by the map, from the counts precomputed
+         * with the map (MapInfo::tileInstanceCounts). Chunked maps cap them by what the resident chunks can hold
+         * (see MapChunkStreamer), so pools and instance buffers don't grow with the map.
          */
-        int* getTileCollectionCounts( int tileCount, int planeCount, int mapSize, const std::vector< Plane >& mapPlane ) const;
+        static std::vector< int > getInstanceCountsForMap( const mikedotcpp::MapInfo& mapInfo );
         
         //-----------------------------------------------------
         //
@@ -126,23 +287,24 @@ namespace mikedotcpp
         /**
          * Returns a properly created Sprite3D object.
          */
-        cocos2d::Sprite3D* createSpriteBlock( const Tile& tileData );
+        cocos2d::Sprite3D* createSpriteBlock( const TileDescriptor& descriptor );
         
         /**
-         * In charge of configuring faces and separate billboard objects.
+         * In charge of configuring the faces (billboard tiles are drawn by the _billboardBatch instead).
          */
-        void initSpriteBlock( cocos2d::Sprite3D& block, const mikedotcpp::Tile& tileData );
+        void initSpriteBlock( cocos2d::Sprite3D& block, const mikedotcpp::TileDescriptor& descriptor );
         
         /**
-         * Sets each face of a cube to a texture specified by the tile. Each texture is mapped to it's corresponding
-         * face according to the cardinal directions. If a filename begins with the '#', it is considered a hex color.
+         * Sets each face of a cube to a texture specified by the tile (MapInfo::strings ids, STRING_ID_NONE for no
+         * face). Each texture is mapped to it's corresponding face according to the cardinal directions. If a
+         * filename begins with the '#', it is considered a hex color.
          */
-        void configureSpriteFaces( cocos2d::Sprite3D& block, const std::vector<std::string>& filenames );
+        void configureSpriteFaces( cocos2d::Sprite3D& block, const StringID names[SPRITE_FACE_COUNT] );
         
         /**
-         * Retrieves sprites from the _faces pool and places/rotates them accordingly within the provided block.
+         * Creates a face sprite showing the frame (a blank sprite for NULL).
          */
-        cocos2d::Sprite* configureSpriteFace( const std::string& faceImage );
+        cocos2d::Sprite* configureSpriteFace( cocos2d::SpriteFrame* frame );
         
         /**
          * Places and rotates the face sprite according to it's FaceDirection.
@@ -150,9 +312,36 @@ namespace mikedotcpp
         void orientSpriteFace( cocos2d::Sprite* face, int direction );
         
         /**
-         * Special billboarded sprites that keep their z-axis rotation locked. Sprite rendering path only.
+         * Sprite rendering path: draws every billboard tile (their pools stay empty). Child of the map's layer.
+         */
+        mikedotcpp::BillboardBatch* _billboardBatch = nullptr;
+        
+        /**
+         * What a face name draws: a SpriteFrame, or the white tile tinted with a '#' color.
+         */
+        struct FaceSource
+        {
+            cocos2d::SpriteFrame* frame = nullptr;
+            cocos2d::Color3B color;
+            bool tinted = false;
+            bool resolved = false;
+        };
+        
+        /**
+         * Face sources by name id, resolved on first use while the blocks are created.
+         */
+        std::vector< FaceSource > _faceSources;
+        
+        /**
+         * Sprite rendering path: the color every face of a tile was configured with (tileIndex * SPRITE_FACE_COUNT +
+         * FaceDirection), for setFaceLights().
          */
-        void configureSpriteBillboard( cocos2d::Sprite3D& block, const std::string& filename );
+        std::vector< cocos2d::Color3B > _faceTints;
+        
+        /**
+         * Returns the (cached) FaceSource of a MapInfo::strings id of the map being initialized.
+         */
+        const FaceSource& getFaceSource( StringID name );
         
         //-----------------------------------------------------
         //
@@ -180,6 +369,91 @@ namespace mikedotcpp
          * Returns a standard set of normalized device coordinates for texturing.
          */
         FaceCoords getFaceTextureCoordinates();
+        
+        /**
+         * Orders the instanced blocks by program, textures and blending (via their local z-order) so consecutive
+         * instanced draws share as much GL state as possible. See BatchedMeshCommand.
+         */
+        void sortMeshBlocksByState();
+        
+        /**
+         * The program states of every pass of every instanced mesh.
+         */
+        std::vector< cocos2d::GLProgramState* > getMeshProgramStates() const;
+        
+        /**
+         * Vertex layout, vertices (position, normal, tangent, binormal, uv) and indices of the shared cube primitive.
+         */
+        std::vector< cocos2d::MeshVertexAttrib > getCubeVertexAttributes();
+        std::vector< float > getCubeVertices();
+        cocos2d::MeshData::IndexArray getCubeIndices();
+        
+        //-----------------------------------------------------
+        //
+        // MERGED MATERIAL
+        //
+        //-----------------------------------------------------
+    protected:
+        /**
+         * TRUE when the map asks for the merged material (mesh rendering path only).
+         */
+        bool _useMergedMaterial = false;
+        
+        /**
+         * Instances per merged-material draw, the size of the position palette block_merged.vsh is compiled with.
+         */
+        int _mergedPaletteSize = 0;
+        
+        /**
+         * Returns how many instances a merged-material draw can take on this device: the position palette shrinks
+         * to the vertex uniform vectors left next to the face rects. Returns 0, logging why, when the merged
+         * material can't draw the map (too many tile types or tiles, or too few uniforms); it is then drawn with a
+         * material per tile.
+         */
+        static int getMergedPaletteSize( const mikedotcpp::MapInfo& mapInfo, bool logFallback );
+        
+        /**
+         * Per-tile selector written into the w component of each instance. Negative for tiles without faces.
+         */
+        std::vector< float > _instanceSelectors;
+        
+        /**
+         * Atlas rect of every face of every tile type (tileIndex * FACES_PER_CUBE + FaceDirection). Uploaded as the
+         * u_faceRects uniform, which only stores a pointer to this data.
+         */
+        std::vector< cocos2d::Vec4 > _mergedFaceRects;
+        
+        /**
+         * textureLodBias of every tile type, four per vector (tileIndex / 4, component tileIndex % 4). Uploaded as the
+         * u_lodBiases uniform, which only stores a pointer to this data.
+         */
+        std::vector< cocos2d::Vec4 > _mergedLodBiases;
+        
+        /**
+         * Normal atlas of the merged material (retained), NULL when the map has no normal maps.
+         */
+        cocos2d::Texture2D* _mergedNormalTexture = nullptr;
+        
+        /**
+         * Creates enough merged-material batches to draw every placed tile.
+         */
+        void initMergedBlocks( const mikedotcpp::MapInfo& mapInfo, cocos2d::Layer* layer );
+        
+        /**
+         * Packs the face images of every cube tile (and their normal maps) into the merged-material atlases and
+         * registers them as SpriteFrames. Used when the map doesn't name a prebuilt materialAtlas.
+         */
+        void packMergedAtlas( const mikedotcpp::MapInfo& mapInfo );
+        
+        /**
+         * Resolves every tile face to a rect in the diffuse atlas and builds the per-tile selectors.
+         */
+        void buildMergedMaterialTable( const mikedotcpp::MapInfo& mapInfo );
+        
+        /**
+         * Returns one instanced cube that uses the merged material.
+         */
+        mikedotcpp::BatchedSprite3D* createMergedMeshBlock( const mikedotcpp::MapInfo& mapInfo );
     };
 }
 
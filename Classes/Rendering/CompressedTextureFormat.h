@@ -0,0 +1,30 @@
+//
+//  CompressedTextureFormat.h
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef CompressedTextureFormat_h
+#define CompressedTextureFormat_h
+
+/**
+ * GPU-compressed variants of the map images. Produced next to each PNG by tools/texcompiler and picked at runtime
+ * by CompressedTextures::resolve according to what the GL driver supports:
+ *
+ *     name.dds          S3TC: DXT1 for opaque images, DXT5 for images with alpha (desktop GL)
+ *     name.pkm          ETC1 color (GLES2 devices)
+ *     name.pkm@alpha    ETC1 alpha, stored in the red channel; only written for images with alpha
+ *
+ * The containers are the ones cocos2d::Image already loads (initWithS3TCData, initWithETCData) and the alpha file
+ * follows cocos2d::TextureCache's ETC1 alpha convention, so no engine changes are needed.
+ *
+ * This header is shared with the compiler tool, so it must not depend on cocos2d.
+ */
+#define COMPRESSED_TEXTURE_SOURCE_EXTENSION ".png"
+#define COMPRESSED_TEXTURE_S3TC_EXTENSION ".dds"
+#define COMPRESSED_TEXTURE_ETC_EXTENSION ".pkm"
+#define COMPRESSED_TEXTURE_ETC_ALPHA_SUFFIX "@alpha"
+
+#endif /* CompressedTextureFormat_h */
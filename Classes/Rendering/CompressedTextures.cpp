@@ -0,0 +1,59 @@
+//
+//  CompressedTextures.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "CompressedTextures.hpp"
+
+using namespace mikedotcpp;
+
+std::unordered_map< std::string, std::string > CompressedTextures::s_resolved;
+
+std::string CompressedTextures::resolve( const std::string& filename )
+{
+    auto cached = s_resolved.find( filename );
+    if( cached != s_resolved.end() )
+    {
+        return cached->second;
+    }
+    
+    std::string resolved = filename;
+    std::string extension = COMPRESSED_TEXTURE_SOURCE_EXTENSION;
+    if( filename.size() > extension.size() && filename.compare( filename.size() - extension.size(), extension.size(), extension ) == 0 )
+    {
+        std::string base = filename.substr( 0, filename.size() - extension.size() );
+        cocos2d::Configuration* configuration = cocos2d::Configuration::getInstance();
+        cocos2d::FileUtils* fileUtils = cocos2d::FileUtils::getInstance();
+        if( configuration->supportsS3TC() && fileUtils->isFileExist( base + COMPRESSED_TEXTURE_S3TC_EXTENSION ) )
+        {
+            resolved = base + COMPRESSED_TEXTURE_S3TC_EXTENSION;
+        }
+        else if( configuration->supportsETC() && fileUtils->isFileExist( base + COMPRESSED_TEXTURE_ETC_EXTENSION ) )
+        {
+            resolved = base + COMPRESSED_TEXTURE_ETC_EXTENSION;
+        }
+    }
+    
+    CCLOG( "CompressedTextures - %s loads as %s", filename.c_str(), resolved.c_str() );
+    s_resolved[filename] = resolved;
+    return resolved;
+}
+
+void CompressedTextures::configureSprite( cocos2d::Sprite* sprite )
+{
+    cocos2d::Texture2D* texture = sprite ? sprite->getTexture() : nullptr;
+    if( !texture || texture->getAlphaTextureName() == 0 )
+    {
+        return;
+    }
+    sprite->setGLProgramState( cocos2d::GLProgramState::getOrCreateWithGLProgramName( cocos2d::GLProgram::SHADER_NAME_ETC1AS_POSITION_TEXTURE_COLOR_NO_MVP, texture ) );
+    sprite->setBlendFunc( cocos2d::BlendFunc::ALPHA_PREMULTIPLIED );
+}
+
+void CompressedTextures::purge()
+{
+    s_resolved.clear();
+}
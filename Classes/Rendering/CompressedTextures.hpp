@@ -0,0 +1,47 @@
+//
+//  CompressedTextures.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef CompressedTextures_hpp
+#define CompressedTextures_hpp
+
+#include "cocos2d.h"
+#include "CompressedTextureFormat.h"
+
+namespace mikedotcpp
+{
+    /**
+     * Runtime selection of the GPU-compressed image variants written by tools/texcompiler (see
+     * CompressedTextureFormat.h). Map images are requested by their PNG name and swapped for the best variant the
+     * GL driver can upload directly: S3TC, then ETC1, then the PNG itself.
+     */
+    class CompressedTextures
+    {
+    public:
+        /**
+         * Returns the file to load for a PNG image. Names that are not PNG, and PNG without a supported compressed
+         * variant, are returned unchanged. Results are cached.
+         */
+        static std::string resolve( const std::string& filename );
+        
+        /**
+         * ETC1 has no alpha: textures loaded with an ETC1 alpha file need the engine's ETC1AS program (and
+         * premultiplied blending) to use it. Does nothing for other textures.
+         */
+        static void configureSprite( cocos2d::Sprite* sprite );
+        
+        /**
+         * Forgets the cached resolutions, e.g. after new variants were written.
+         */
+        static void purge();
+    
+    protected:
+        static std::unordered_map< std::string, std::string > s_resolved;
+    };
+}
+
+#endif /* CompressedTextures_hpp */
@@ -208,7 +208,7 @@ void FPBillBoard::draw( cocos2d::Renderer *renderer, const cocos2d::Mat4 &transf
 {
     //FIXME: frustum culling here
     flags |= Node::FLAGS_RENDER_AS_3D;
-    _trianglesCommand.init(0, _texture->getName(), getGLProgramState(), _blendFunc, _polyInfo.triangles, _modelViewTransform, flags);
+    _trianglesCommand.init(0, _texture, getGLProgramState(), _blendFunc, _polyInfo.triangles, _modelViewTransform, flags);
     _trianglesCommand.setTransparent(true);
     _trianglesCommand.set3D(true);
     renderer->addCommand(&_trianglesCommand);
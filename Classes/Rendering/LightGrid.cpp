@@ -0,0 +1,228 @@
+//
+//  LightGrid.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "LightGrid.hpp"
+
+#define LIGHT_GRID_UNIFORM "u_lightGrid"
+#define LIGHT_GRID_LIGHTS_UNIFORM "u_lightGridLights"
+#define LIGHT_GRID_ENABLED_UNIFORM "u_useLightGrid"
+#define LIGHT_GRID_LAYOUT_UNIFORM "u_lightGridLayout"
+#define LIGHT_GRID_EXTENT_UNIFORM "u_lightGridExtent"
+
+using namespace mikedotcpp;
+
+/**
+ * Stores cells as 8.8 fixed point, high byte first.
+ */
+static inline void encodeFixed( float cells, uint8_t* bytes )
+{
+    int value = (int)cocos2d::clampf( cells * 256.0f + 0.5f, 0.0f, 65535.0f );
+    bytes[0] = (uint8_t)( value >> 8 );
+    bytes[1] = (uint8_t)( value & 0xFF );
+}
+
+/**
+ * Stores a value in [-1, 1] (directions and cosines) in a byte.
+ */
+static inline uint8_t encodeSigned( float value )
+{
+    return (uint8_t)( cocos2d::clampf( value * 0.5f + 0.5f, 0.0f, 1.0f ) * 255.0f + 0.5f );
+}
+
+LightGrid::LightGrid( const MapInfo& mapInfo )
+{
+    _width = mapInfo.width;
+    _height = mapInfo.height;
+    _tileSize = (float)mapInfo.tileSize;
+    _clustersX = ( _width + LIGHT_GRID_CLUSTER_CELLS - 1 ) / LIGHT_GRID_CLUSTER_CELLS;
+    _clustersY = ( _height + LIGHT_GRID_CLUSTER_CELLS - 1 ) / LIGHT_GRID_CLUSTER_CELLS;
+    _layout = cocos2d::Vec4( _clustersX, _clustersY, LIGHT_GRID_CLUSTER_CELLS, _tileSize );
+    _extent = cocos2d::Vec2( _height, LIGHT_GRID_MAX_LIGHTS * LIGHT_GRID_TEXELS_PER_LIGHT );
+    if( _width > LIGHT_GRID_MAX_CELLS || _height > LIGHT_GRID_MAX_CELLS )
+    {
+        CCLOG( "LightGrid: %ix%i cells don't fit the grid, point and spot lights are not drawn.", _width, _height );
+        return;
+    }
+    
+    _clusterTexture = new (std::nothrow) cocos2d::Texture2D();
+    _lightTexture = new (std::nothrow) cocos2d::Texture2D();
+    if( _clusterTexture == nullptr || _lightTexture == nullptr )
+    {
+        // apply() and update() treat a missing cluster texture as a disabled grid.
+        cocos2d::log( "LightGrid: the grid textures could not be allocated, point and spot lights are not drawn." );
+        CC_SAFE_RELEASE_NULL( _clusterTexture );
+        CC_SAFE_RELEASE_NULL( _lightTexture );
+        return;
+    }
+    
+    int clusterTextureWidth = _clustersX * LIGHT_GRID_LIGHTS_PER_CLUSTER;
+    _clusters.assign( (size_t)clusterTextureWidth * _clustersY, 0 );
+    _uploadedClusters = _clusters;
+    _clusterTexture->initWithData( &_clusters[0], _clusters.size(), cocos2d::Texture2D::PixelFormat::I8, clusterTextureWidth,
+                                   _clustersY, cocos2d::Size( clusterTextureWidth, _clustersY ) );
+    
+    int lightTextureWidth = LIGHT_GRID_MAX_LIGHTS * LIGHT_GRID_TEXELS_PER_LIGHT;
+    std::vector< uint8_t > records( (size_t)lightTextureWidth * 4, 0 );
+    _lightTexture->initWithData( &records[0], records.size(), cocos2d::Texture2D::PixelFormat::RGBA8888, lightTextureWidth, 1,
+                                 cocos2d::Size( lightTextureWidth, 1 ) );
+    
+    // Texels are data, not colors: no filtering between them.
+    cocos2d::Texture2D::TexParams params = { GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE };
+    _clusterTexture->setTexParameters( params );
+    _lightTexture->setTexParameters( params );
+}
+
+LightGrid::~LightGrid()
+{
+    CC_SAFE_RELEASE( _clusterTexture );
+    CC_SAFE_RELEASE( _lightTexture );
+}
+
+void LightGrid::update( const std::vector< cocos2d::BaseLight* >& lights, const cocos2d::Vec3& eye )
+{
+    if( _clusterTexture == nullptr )
+    {
+        return;
+    }
+    
+    _sceneLights.clear();
+    for( const auto light : lights )
+    {
+        cocos2d::LightType type = light->getLightType();
+        if( !light->isEnabled() || ( type != cocos2d::LightType::POINT && type != cocos2d::LightType::SPOT ) )
+        {
+            continue;
+        }
+        GridLight gridLight;
+        const cocos2d::Mat4& transform = light->getNodeToWorldTransform();
+        gridLight.position = cocos2d::Vec3( transform.m[12], transform.m[13], transform.m[14] );
+        const cocos2d::Color3B& color = light->getDisplayedColor();
+        float intensity = light->getIntensity() / 255.0f;
+        gridLight.color = cocos2d::Vec3( color.r * intensity, color.g * intensity, color.b * intensity );
+        if( type == cocos2d::LightType::SPOT )
+        {
+            auto spotLight = static_cast< cocos2d::SpotLight* >( light );
+            gridLight.direction = spotLight->getDirectionInWorld();
+            gridLight.direction.normalize();
+            gridLight.radius = spotLight->getRange();
+            gridLight.innerCos = spotLight->getCosInnerAngle();
+            gridLight.outerCos = spotLight->getCosOuterAngle();
+        }
+        else
+        {
+            gridLight.direction = cocos2d::Vec3::ZERO;
+            gridLight.radius = static_cast< cocos2d::PointLight* >( light )->getRange();
+            gridLight.innerCos = -1.0f;
+            gridLight.outerCos = -1.0f;
+        }
+        gridLight.distance = eye.distanceSquared( gridLight.position );
+        if( gridLight.radius > 0.0f )
+        {
+            _sceneLights.push_back( gridLight );
+        }
+    }
+    
+    // Nearest first, so the lights that don't fit are the far ones.
+    std::sort( _sceneLights.begin(), _sceneLights.end(), []( const GridLight& a, const GridLight& b )
+    {
+        return a.distance < b.distance;
+    } );
+    _lightCount = std::min( (int)_sceneLights.size(), LIGHT_GRID_MAX_LIGHTS );
+    
+    std::fill( _clusters.begin(), _clusters.end(), 0 );
+    _records.assign( (size_t)_lightCount * LIGHT_GRID_TEXELS_PER_LIGHT * 4, 0 );
+    for( int i = 0; i < _lightCount; ++i )
+    {
+        encodeLight( _sceneLights[i], &_records[ (size_t)i * LIGHT_GRID_TEXELS_PER_LIGHT * 4 ] );
+        assignLight( _sceneLights[i], (uint8_t)( i + 1 ) );
+    }
+    
+    // Nothing is uploaded while the lights and the player stand still.
+    if( _clusters != _uploadedClusters )
+    {
+        _clusterTexture->updateWithData( &_clusters[0], 0, 0, _clustersX * LIGHT_GRID_LIGHTS_PER_CLUSTER, _clustersY );
+        _uploadedClusters = _clusters;
+    }
+    if( _lightCount > 0 && _records != _uploadedRecords )
+    {
+        _lightTexture->updateWithData( &_records[0], 0, 0, _lightCount * LIGHT_GRID_TEXELS_PER_LIGHT, 1 );
+        _uploadedRecords = _records;
+    }
+}
+
+void LightGrid::apply( cocos2d::GLProgramState* state ) const
+{
+    // Custom tile shaders may not read the grid.
+    if( state->getGLProgram()->getUniform( LIGHT_GRID_ENABLED_UNIFORM ) == nullptr )
+    {
+        return;
+    }
+    if( _clusterTexture == nullptr )
+    {
+        state->setUniformFloat( LIGHT_GRID_ENABLED_UNIFORM, 0.0f );
+        return;
+    }
+    state->setUniformTexture( LIGHT_GRID_UNIFORM, _clusterTexture );
+    state->setUniformTexture( LIGHT_GRID_LIGHTS_UNIFORM, _lightTexture );
+    state->setUniformVec4( LIGHT_GRID_LAYOUT_UNIFORM, _layout );
+    state->setUniformVec2( LIGHT_GRID_EXTENT_UNIFORM, _extent );
+    state->setUniformFloat( LIGHT_GRID_ENABLED_UNIFORM, 1.0f );
+}
+
+void LightGrid::encodeLight( const GridLight& light, uint8_t* texels ) const
+{
+    encodeFixed( light.position.x / _tileSize, &texels[0] );
+    encodeFixed( light.position.z / _tileSize, &texels[2] );
+    encodeFixed( light.position.y / _tileSize + LIGHT_GRID_HEIGHT_OFFSET, &texels[4] );
+    encodeFixed( light.radius / _tileSize, &texels[6] );
+    
+    const float color[] = { light.color.x, light.color.y, light.color.z };
+    const float direction[] = { light.direction.x, light.direction.y, light.direction.z };
+    for( int i = 0; i < 3; ++i )
+    {
+        texels[ 8 + i ] = (uint8_t)( cocos2d::clampf( color[i] / LIGHT_GRID_COLOR_SCALE, 0.0f, 1.0f ) * 255.0f + 0.5f );
+        texels[ 12 + i ] = encodeSigned( direction[i] );
+    }
+    texels[11] = encodeSigned( light.outerCos );
+    texels[15] = encodeSigned( light.innerCos );
+}
+
+void LightGrid::assignLight( const GridLight& light, uint8_t number )
+{
+    // In cells: columns run along +z and rows along -x (see GBRaycaster::tilePositionForCoord).
+    float column = light.position.z / _tileSize;
+    float row = _height - light.position.x / _tileSize;
+    float radius = light.radius / _tileSize;
+    float clusterCells = (float)LIGHT_GRID_CLUSTER_CELLS;
+    int minX = std::max( 0, (int)floorf( ( column - radius ) / clusterCells ) );
+    int maxX = std::min( _clustersX - 1, (int)floorf( ( column + radius ) / clusterCells ) );
+    int minY = std::max( 0, (int)floorf( ( row - radius ) / clusterCells ) );
+    int maxY = std::min( _clustersY - 1, (int)floorf( ( row + radius ) / clusterCells ) );
+    for( int y = minY; y <= maxY; ++y )
+    {
+        for( int x = minX; x <= maxX; ++x )
+        {
+            // Skips the corners of the bounds the range doesn't reach.
+            float nearestX = cocos2d::clampf( column, x * clusterCells, ( x + 1 ) * clusterCells ) - column;
+            float nearestY = cocos2d::clampf( row, y * clusterCells, ( y + 1 ) * clusterCells ) - row;
+            if( nearestX * nearestX + nearestY * nearestY > radius * radius )
+            {
+                continue;
+            }
+            uint8_t* slots = &_clusters[ ( (size_t)y * _clustersX + x ) * LIGHT_GRID_LIGHTS_PER_CLUSTER ];
+            for( int i = 0; i < LIGHT_GRID_LIGHTS_PER_CLUSTER; ++i )
+            {
+                if( slots[i] == 0 )
+                {
+                    slots[i] = number;
+                    break;
+                }
+            }
+        }
+    }
+}
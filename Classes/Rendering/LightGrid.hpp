@@ -0,0 +1,133 @@
+//
+//  LightGrid.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef LightGrid_hpp
+#define LightGrid_hpp
+
+#include "cocos2d.h"
+#include "../Map/MapInfo.hpp"
+
+/**
+ * Map cells along each edge of a cluster.
+ */
+#define LIGHT_GRID_CLUSTER_CELLS 2
+
+/**
+ * Lights a cluster can list; must match LIGHT_GRID_LIGHTS_PER_CLUSTER in block.vsh, block_merged.vsh and block.fsh.
+ */
+#define LIGHT_GRID_LIGHTS_PER_CLUSTER 16
+
+/**
+ * Lights per frame: a cluster lists each by a byte, 0 ending the list.
+ */
+#define LIGHT_GRID_MAX_LIGHTS 255
+
+/**
+ * Light positions are stored in 8.8 fixed point cells, so maps can be at most this many cells wide and high.
+ */
+#define LIGHT_GRID_MAX_CELLS 256
+
+/**
+ * Light texture encoding, shared with block.fsh: RGBA texels per light, cells added to light heights so they
+ * stay positive, and the brightest color channel a light can have.
+ */
+#define LIGHT_GRID_TEXELS_PER_LIGHT 4
+#define LIGHT_GRID_HEIGHT_OFFSET 128.0f
+#define LIGHT_GRID_COLOR_SCALE 4.0f
+
+namespace mikedotcpp
+{
+    /**
+     * Clustered forward lighting for the mesh rendering path. The point and spot lights of the scene are assigned
+     * each frame to the clusters (squares of LIGHT_GRID_CLUSTER_CELLS map cells, the full height of the map) their
+     * range reaches, and block.fsh only goes through the lights of the cluster a fragment lies in, so a map can
+     * carry far more lights than the shader could loop over.
+     *
+     * Two textures carry the grid (see apply()):
+     * - the cluster texture (luminance, clusters wide * LIGHT_GRID_LIGHTS_PER_CLUSTER by clusters high) holds the
+     *   light numbers of each cluster, index + 1, with 0 ending the list;
+     * - the light texture (RGBA, LIGHT_GRID_TEXELS_PER_LIGHT texels per light, one row) holds the x and z position
+     *   in 8.8 fixed point cells; the height (offset by LIGHT_GRID_HEIGHT_OFFSET cells) and range the same way;
+     *   the color times intensity over LIGHT_GRID_COLOR_SCALE with the cosine of the outer cone angle; and the
+     *   spot direction with the cosine of the inner cone angle. Point lights have no direction.
+     *
+     * Only what changed since the last frame is uploaded. Directional and ambient lights stay plain uniforms.
+     */
+    class LightGrid
+    {
+    public:
+        /**
+         * Creates the textures of a map. Maps larger than LIGHT_GRID_MAX_CELLS get none and draw no grid lights.
+         */
+        LightGrid( const MapInfo& mapInfo );
+        ~LightGrid();
+        
+        /**
+         * Rebuilds the grid from the enabled point and spot lights. Past LIGHT_GRID_MAX_LIGHTS, or
+         * LIGHT_GRID_LIGHTS_PER_CLUSTER in a cluster, the lights farthest from eye are dropped.
+         */
+        void update( const std::vector< cocos2d::BaseLight* >& lights, const cocos2d::Vec3& eye );
+        
+        /**
+         * Points the light grid uniforms of a mesh-path program state at the grid. States whose shader doesn't
+         * declare u_useLightGrid are left alone.
+         */
+        void apply( cocos2d::GLProgramState* state ) const;
+    
+    protected:
+        int _width = 0;
+        int _height = 0;
+        float _tileSize = 0.0f;
+        int _clustersX = 0;
+        int _clustersY = 0;
+        int _lightCount = 0;
+        
+        /**
+         * LIGHT_GRID_LIGHTS_PER_CLUSTER light numbers per cluster, and the light texels, as built by the last update
+         * and as last uploaded.
+         */
+        std::vector< uint8_t > _clusters;
+        std::vector< uint8_t > _records;
+        std::vector< uint8_t > _uploadedClusters;
+        std::vector< uint8_t > _uploadedRecords;
+        
+        cocos2d::Texture2D* _clusterTexture = nullptr;
+        cocos2d::Texture2D* _lightTexture = nullptr;
+        
+        /**
+         * Uniform values (see apply()): clusters wide, clusters high, cells per cluster and tile size; map height in
+         * cells and light texture width.
+         */
+        cocos2d::Vec4 _layout;
+        cocos2d::Vec2 _extent;
+        
+        /**
+         * A light of the scene in world units, before it is encoded.
+         */
+        struct GridLight
+        {
+            cocos2d::Vec3 position;
+            cocos2d::Vec3 color;
+            cocos2d::Vec3 direction;
+            float radius;
+            float innerCos;
+            float outerCos;
+            float distance;
+        };
+        std::vector< GridLight > _sceneLights;
+        
+        void encodeLight( const GridLight& light, uint8_t* texels ) const;
+        
+        /**
+         * Adds a light number to the clusters the light's range reaches on the map.
+         */
+        void assignLight( const GridLight& light, uint8_t number );
+    };
+}
+
+#endif /* LightGrid_hpp */
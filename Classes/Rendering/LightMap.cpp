@@ -0,0 +1,392 @@
+//
+//  LightMap.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "LightMap.hpp"
+#include "BlockManager.hpp"
+#include <chrono>
+
+#define LIGHT_MAP_UNIFORM "u_lightMap"
+#define LIGHT_MAP_ENABLED_UNIFORM "u_useLightMap"
+#define LIGHT_MAP_LAYOUT_UNIFORM "u_lightMapLayout"
+#define LIGHT_MAP_SIZE_UNIFORM "u_lightMapSize"
+#define LIGHT_MAP_LEVELS_UNIFORM "u_lightMapLevels"
+
+/**
+ * Shadow rays start this far (in tiles) off the face, so a face doesn't shadow itself.
+ */
+#define LIGHT_MAP_SURFACE_OFFSET 0.01f
+
+/**
+ * u_lightMapLevels entries past the map's levels; no block is drawn at this height.
+ */
+#define LIGHT_MAP_NO_LEVEL -1.0e9f
+
+/**
+ * Faces stored in the atlas: the cube faces, not the center spans.
+ */
+#define LIGHT_MAP_ATLAS_FACES 6
+
+using namespace mikedotcpp;
+
+/**
+ * Normals of the faces, in FaceDirection order. Center spans are lit from both sides.
+ */
+static const cocos2d::Vec3 FACE_NORMALS[SPRITE_FACE_COUNT] =
+{
+    cocos2d::Vec3( 0.0f, 0.0f, -1.0f ), cocos2d::Vec3( 0.0f, 0.0f, 1.0f ), cocos2d::Vec3( 1.0f, 0.0f, 0.0f ),
+    cocos2d::Vec3( -1.0f, 0.0f, 0.0f ), cocos2d::Vec3( 0.0f, 1.0f, 0.0f ), cocos2d::Vec3( 0.0f, -1.0f, 0.0f ),
+    cocos2d::Vec3( 1.0f, 0.0f, 0.0f ), cocos2d::Vec3( 0.0f, 0.0f, 1.0f )
+};
+
+static inline uint8_t toColorByte( float value )
+{
+    return (uint8_t)( cocos2d::clampf( value, 0.0f, 1.0f ) * 255.0f + 0.5f );
+}
+
+LightMap::LightMap( const MapInfo& mapInfo )
+{
+    auto start = std::chrono::steady_clock::now();
+    _width = mapInfo.width;
+    _height = mapInfo.height;
+    _tileSize = (float)mapInfo.tileSize;
+    
+    int levelCount = (int)mapInfo.planeLevels.size();
+    for( const auto& level : mapInfo.planeLevels )
+    {
+        _levelHeights.push_back( (float)level.height );
+    }
+    for( const auto& plane : mapInfo.planes )
+    {
+        _planeLevels.push_back( mapInfo.getPlaneLevel( (float)plane.height ) );
+    }
+    
+    size_t mapSize = (size_t)_width * _height;
+    _solidCells.assign( levelCount * mapSize, 0 );
+    for( int plane = 0; plane < mapInfo.planes.size(); ++plane )
+    {
+        int level = _planeLevels[plane];
+        for( size_t cell = 0; level >= 0 && cell < mapSize; ++cell )
+        {
+            if( mapInfo.getCellFlags( plane, (int)cell ) & MAP_CELL_SOLID )
+            {
+                _solidCells[ level * mapSize + cell ] = 1;
+            }
+        }
+    }
+    
+    // Lights move to world units: columns run along +z and rows along -x (see GBRaycaster::tilePositionForCoord).
+    for( const auto& light : mapInfo.lights )
+    {
+        if( light.radius > 0.0f )
+        {
+            BakedLight baked;
+            baked.position = cocos2d::Vec3( ( _height - light.y ) * _tileSize, light.height, light.x * _tileSize );
+            baked.color = cocos2d::Vec3( light.color[0], light.color[1], light.color[2] );
+            baked.radius = light.radius * _tileSize;
+            _lights.push_back( baked );
+        }
+    }
+    _ambient = cocos2d::Vec3( mapInfo.ambientLight[0], mapInfo.ambientLight[1], mapInfo.ambientLight[2] );
+    
+    // The sprite rendering path only needs the face averages.
+    bool useAtlas = mapInfo.useRealtimeLighting;
+    int maxSize = std::min( LIGHT_MAP_MAX_SIZE, cocos2d::Configuration::getInstance()->getMaxTextureSize() );
+    while( _texelsPerFace > 1 && ( 3 * _width * _texelsPerFace > maxSize || levelCount * 2 * _height * _texelsPerFace > maxSize ) )
+    {
+        --_texelsPerFace;
+    }
+    int atlasWidth = 3 * _width * _texelsPerFace;
+    int atlasHeight = levelCount * 2 * _height * _texelsPerFace;
+    if( useAtlas && ( atlasWidth > maxSize || atlasHeight > maxSize || levelCount > LIGHT_MAP_MAX_LEVELS ) )
+    {
+        CCLOG( "LightMap: %ix%i cells on %i levels don't fit the atlas, blocks are drawn unlit.", _width, _height, levelCount );
+        useAtlas = false;
+    }
+    
+    std::vector< uint8_t > atlas;
+    if( useAtlas )
+    {
+        atlas.assign( (size_t)atlasWidth * atlasHeight * 3, 0 );
+    }
+    bake( mapInfo, useAtlas ? &atlas : nullptr );
+    
+    if( useAtlas )
+    {
+        _texture = new (std::nothrow) cocos2d::Texture2D();
+    }
+    if( _texture )
+    {
+        _texture->initWithData( &atlas[0], atlas.size(), cocos2d::Texture2D::PixelFormat::RGB888, atlasWidth, atlasHeight,
+                                cocos2d::Size( atlasWidth, atlasHeight ) );
+        cocos2d::Texture2D::TexParams params = { GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE };
+        _texture->setTexParameters( params );
+    }
+    _layout = cocos2d::Vec4( _width, _height, _texelsPerFace, _tileSize );
+    _atlasSize = cocos2d::Vec2( atlasWidth, atlasHeight );
+    for( int i = 0; i < LIGHT_MAP_MAX_LEVELS; ++i )
+    {
+        _levelUniform[i] = ( i < levelCount ) ? _levelHeights[i] : LIGHT_MAP_NO_LEVEL;
+    }
+    
+    std::chrono::duration< float, std::milli > elapsed = std::chrono::steady_clock::now() - start;
+    CCLOG( "LightMap: %i lights baked in %.1f ms", (int)_lights.size(), elapsed.count() );
+}
+
+LightMap::~LightMap()
+{
+    CC_SAFE_RELEASE( _texture );
+}
+
+cocos2d::Texture2D* LightMap::getTexture() const
+{
+    return _texture;
+}
+
+const cocos2d::Color3B* LightMap::getFaceColors( int planeIndex, int cellIndex ) const
+{
+    static const cocos2d::Color3B unlit[SPRITE_FACE_COUNT] =
+    {
+        cocos2d::Color3B::WHITE, cocos2d::Color3B::WHITE, cocos2d::Color3B::WHITE, cocos2d::Color3B::WHITE,
+        cocos2d::Color3B::WHITE, cocos2d::Color3B::WHITE, cocos2d::Color3B::WHITE, cocos2d::Color3B::WHITE
+    };
+    int level = ( planeIndex >= 0 && planeIndex < _planeLevels.size() ) ? _planeLevels[planeIndex] : -1;
+    if( level < 0 )
+    {
+        return unlit;
+    }
+    return &_faceColors[ ( (size_t)level * _width * _height + cellIndex ) * SPRITE_FACE_COUNT ];
+}
+
+void LightMap::apply( cocos2d::GLProgramState* state ) const
+{
+    // Custom tile shaders may not sample the light map.
+    if( state->getGLProgram()->getUniform( LIGHT_MAP_ENABLED_UNIFORM ) == nullptr )
+    {
+        return;
+    }
+    if( _texture == nullptr )
+    {
+        state->setUniformFloat( LIGHT_MAP_ENABLED_UNIFORM, 0.0f );
+        return;
+    }
+    state->setUniformTexture( LIGHT_MAP_UNIFORM, _texture );
+    state->setUniformVec4( LIGHT_MAP_LAYOUT_UNIFORM, _layout );
+    state->setUniformVec2( LIGHT_MAP_SIZE_UNIFORM, _atlasSize );
+    // setUniformFloatv() would only keep a pointer into this light map, which the state can outlive.
+    std::array< float, LIGHT_MAP_MAX_LEVELS > levels = _levelUniform;
+    state->setUniformCallback( LIGHT_MAP_LEVELS_UNIFORM, [levels]( cocos2d::GLProgram* program, cocos2d::Uniform* uniform )
+    {
+        program->setUniformLocationWith1fv( uniform->location, levels.data(), LIGHT_MAP_MAX_LEVELS );
+    } );
+    state->setUniformFloat( LIGHT_MAP_ENABLED_UNIFORM, 1.0f );
+}
+
+void LightMap::bake( const MapInfo& mapInfo, std::vector< uint8_t >* atlas )
+{
+    int levelCount = (int)_levelHeights.size();
+    size_t mapSize = (size_t)_width * _height;
+    _faceColors.assign( levelCount * mapSize * SPRITE_FACE_COUNT, cocos2d::Color3B::WHITE );
+    
+    int texels = _texelsPerFace;
+    size_t atlasWidth = (size_t)3 * _width * texels;
+    // Half the diagonal of a block: a light farther than its radius plus this from the center reaches no face.
+    float blockReach = _tileSize * 0.87f;
+    std::vector< const BakedLight* > candidates;
+    for( int level = 0; level < levelCount; ++level )
+    {
+        const MapBinaryPlaneLevel& planeLevel = mapInfo.planeLevels[level];
+        for( int y = 0; y < _height; ++y )
+        {
+            for( int x = 0; x < _width; ++x )
+            {
+                // The faces drawn in this cell on any plane of the level.
+                int cell = y * _width + x;
+                uint8_t faces = 0;
+                for( uint32_t i = 0; i < planeLevel.count; ++i )
+                {
+                    int plane = mapInfo.planeOrder[ planeLevel.first + i ];
+                    uint16_t tile = mapInfo.getCell( plane, x, y );
+                    if( tile == 0 || tile > mapInfo.tileDescriptors.size() || mapInfo.tileDescriptors[ tile - 1 ].hasFlag( TILE_FLAG_BILLBOARD ) )
+                    {
+                        continue;
+                    }
+                    faces |= mapInfo.getCellFlags( plane, cell ) & MAP_CELL_EXPOSED_MASK;
+                    
+                    const TileDescriptor& descriptor = mapInfo.tileDescriptors[ tile - 1 ];
+                    bool textureAll = descriptor.hasFlag( TILE_FLAG_TEXTURE_ALL );
+                    if( !( mapInfo.tileFlags[ tile - 1 ] & MAP_TILE_FLAG_SOLID ) )
+                    {
+                        faces |= ( textureAll || descriptor.get( TILE_TEXTURE_CENTER_SPAN_NS ) != STRING_ID_NONE ) ? 1 << FaceDirection::centerSpanNS : 0;
+                        faces |= ( textureAll || descriptor.get( TILE_TEXTURE_CENTER_SPAN_EW ) != STRING_ID_NONE ) ? 1 << FaceDirection::centerSpanEW : 0;
+                    }
+                }
+                if( faces == 0 )
+                {
+                    continue;
+                }
+                
+                cocos2d::Vec3 center( ( _height - y - 0.5f ) * _tileSize, _levelHeights[level], ( x + 0.5f ) * _tileSize );
+                candidates.clear();
+                for( const auto& light : _lights )
+                {
+                    if( light.position.distance( center ) < light.radius + blockReach )
+                    {
+                        candidates.push_back( &light );
+                    }
+                }
+                
+                cocos2d::Color3B* colors = &_faceColors[ ( level * mapSize + cell ) * SPRITE_FACE_COUNT ];
+                for( int direction = 0; direction < SPRITE_FACE_COUNT; ++direction )
+                {
+                    if( !( faces & ( 1 << direction ) ) )
+                    {
+                        continue;
+                    }
+                    
+                    bool twoSided = ( direction >= FaceDirection::centerSpanNS );
+                    cocos2d::Vec3 sum;
+                    for( int row = 0; row < texels; ++row )
+                    {
+                        for( int column = 0; column < texels; ++column )
+                        {
+                            cocos2d::Vec3 point = getFacePoint( center, direction, ( column + 0.5f ) / texels, ( row + 0.5f ) / texels );
+                            cocos2d::Vec3 light = getIrradiance( point, FACE_NORMALS[direction], twoSided, candidates );
+                            sum += light;
+                            if( atlas && direction < LIGHT_MAP_ATLAS_FACES )
+                            {
+                                size_t u = ( ( direction % 3 ) * _width + x ) * texels + column;
+                                size_t v = ( ( level * 2 + direction / 3 ) * _height + y ) * texels + row;
+                                uint8_t* texel = &( *atlas )[ ( v * atlasWidth + u ) * 3 ];
+                                texel[0] = toColorByte( light.x );
+                                texel[1] = toColorByte( light.y );
+                                texel[2] = toColorByte( light.z );
+                            }
+                        }
+                    }
+                    sum *= 1.0f / ( texels * texels );
+                    colors[direction] = cocos2d::Color3B( toColorByte( sum.x ), toColorByte( sum.y ), toColorByte( sum.z ) );
+                }
+            }
+        }
+    }
+}
+
+cocos2d::Vec3 LightMap::getFacePoint( const cocos2d::Vec3& center, int direction, float s, float t ) const
+{
+    // Same face coordinates as lightMapCoord() in block.vsh: (z, y) on the x faces, (z, x) on the y faces and
+    // (x, y) on the z faces.
+    float half = _tileSize * 0.5f;
+    float across = ( s - 0.5f ) * _tileSize;
+    float up = ( t - 0.5f ) * _tileSize;
+    bool onX = ( direction == FaceDirection::east || direction == FaceDirection::west || direction == FaceDirection::centerSpanNS );
+    bool onY = ( direction == FaceDirection::top || direction == FaceDirection::bottom );
+    cocos2d::Vec3 acrossAxis = ( onX || onY ) ? cocos2d::Vec3::UNIT_Z : cocos2d::Vec3::UNIT_X;
+    cocos2d::Vec3 upAxis = onY ? cocos2d::Vec3::UNIT_X : cocos2d::Vec3::UNIT_Y;
+    float depth = ( direction >= FaceDirection::centerSpanNS ) ? 0.0f : half;
+    return center + FACE_NORMALS[direction] * depth + acrossAxis * across + upAxis * up;
+}
+
+cocos2d::Vec3 LightMap::getIrradiance( const cocos2d::Vec3& point, const cocos2d::Vec3& normal, bool twoSided,
+                                       const std::vector< const BakedLight* >& candidates ) const
+{
+    cocos2d::Vec3 irradiance = _ambient;
+    float offset = _tileSize * LIGHT_MAP_SURFACE_OFFSET;
+    for( const BakedLight* light : candidates )
+    {
+        cocos2d::Vec3 toLight = light->position - point;
+        float distance = toLight.length();
+        if( distance >= light->radius )
+        {
+            continue;
+        }
+        
+        // Range attenuation and diffuse term of block.fsh's point lights.
+        float range = distance / light->radius;
+        float attenuation = 1.0f - range * range;
+        float diffuse = ( distance > 0.0f ) ? normal.dot( toLight ) / distance : 1.0f;
+        cocos2d::Vec3 side = normal;
+        if( twoSided && diffuse < 0.0f )
+        {
+            diffuse = -diffuse;
+            side = -normal;
+        }
+        if( diffuse <= 0.0f || isOccluded( point + side * offset, light->position ) )
+        {
+            continue;
+        }
+        irradiance += light->color * ( attenuation * diffuse );
+    }
+    return irradiance;
+}
+
+bool LightMap::isOccluded( const cocos2d::Vec3& from, const cocos2d::Vec3& to ) const
+{
+    // Grid coordinates, in cells: x along the columns (+z), y along the rows (-x).
+    float x0 = from.z / _tileSize;
+    float y0 = _height - from.x / _tileSize;
+    float dx = to.z / _tileSize - x0;
+    float dy = ( _height - to.x / _tileSize ) - y0;
+    int cellX = (int)floorf( x0 );
+    int cellY = (int)floorf( y0 );
+    int stepX = ( dx > 0.0f ) ? 1 : -1;
+    int stepY = ( dy > 0.0f ) ? 1 : -1;
+    float deltaX = ( dx != 0.0f ) ? fabsf( 1.0f / dx ) : FLT_MAX;
+    float deltaY = ( dy != 0.0f ) ? fabsf( 1.0f / dy ) : FLT_MAX;
+    float nextX = ( dx != 0.0f ) ? ( ( dx > 0.0f ) ? cellX + 1 - x0 : x0 - cellX ) * deltaX : FLT_MAX;
+    float nextY = ( dy != 0.0f ) ? ( ( dy > 0.0f ) ? cellY + 1 - y0 : y0 - cellY ) * deltaY : FLT_MAX;
+    
+    // Each cell is tested against the heights the segment has while inside it.
+    float rise = to.y - from.y;
+    float enter = 0.0f;
+    while( true )
+    {
+        float exit = std::min( std::min( nextX, nextY ), 1.0f );
+        if( isSolidBetween( cellX, cellY, from.y + rise * enter, from.y + rise * exit ) )
+        {
+            return true;
+        }
+        if( exit >= 1.0f )
+        {
+            return false;
+        }
+        if( nextX < nextY )
+        {
+            cellX += stepX;
+            enter = nextX;
+            nextX += deltaX;
+        }
+        else
+        {
+            cellY += stepY;
+            enter = nextY;
+            nextY += deltaY;
+        }
+    }
+}
+
+bool LightMap::isSolidBetween( int x, int y, float fromHeight, float toHeight ) const
+{
+    if( x < 0 || y < 0 || x >= _width || y >= _height )
+    {
+        return false;
+    }
+    
+    // Grazing a block's surface doesn't count.
+    float low = std::min( fromHeight, toHeight );
+    float high = std::max( fromHeight, toHeight );
+    float half = _tileSize * ( 0.5f - LIGHT_MAP_SURFACE_OFFSET * 0.5f );
+    size_t mapSize = (size_t)_width * _height;
+    for( int level = 0; level < _levelHeights.size(); ++level )
+    {
+        if( _solidCells[ level * mapSize + y * _width + x ] && high > _levelHeights[level] - half && low < _levelHeights[level] + half )
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,142 @@
+//
+//  LightMap.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef LightMap_hpp
+#define LightMap_hpp
+
+#include "cocos2d.h"
+#include "../Map/MapInfo.hpp"
+#include <array>
+
+/**
+ * Texels along each edge of a baked face. Lowered for maps whose atlas would not fit LIGHT_MAP_MAX_SIZE.
+ */
+#define LIGHT_MAP_TEXELS_PER_FACE 4
+#define LIGHT_MAP_MAX_SIZE 4096
+
+/**
+ * Plane levels the mesh shaders can tell apart (u_lightMapLevels in block.vsh and block_merged.vsh).
+ */
+#define LIGHT_MAP_MAX_LEVELS 8
+
+namespace mikedotcpp
+{
+    /**
+     * Static lighting of the tile world, baked from MapInfo::lights. Every face of every block that is exposed on
+     * some plane receives the map's ambient light plus the lights that reach it: the same range attenuation and
+     * diffuse term as the point lights of block.fsh, with shadows traced through the solid cells of every plane
+     * level. The bake runs once per map activation; doors and pushwalls don't change it.
+     *
+     * Mesh rendering path: the six cube faces are stored as LIGHT_MAP_TEXELS_PER_FACE square patches in one RGB
+     * atlas that block.vsh / block_merged.vsh address from the instance position and normal, so any number of
+     * lights costs one texture read per pixel. For level L, cell (x, y) and face f (FaceDirection order) the patch
+     * starts at texel ( ( f % 3 ) * width + x, ( L * 2 + f / 3 ) * height + y ) * texelsPerFace.
+     *
+     * Sprite rendering path: each face is tinted with the average of its texels (getFaceColors), center spans
+     * included. Billboards and actors stay unlit.
+     *
+     * Chunked maps have no cell flags to find the exposed faces with and are not baked.
+     */
+    class LightMap
+    {
+    public:
+        /**
+         * Bakes the lights of the map. The atlas texture is only created for the mesh rendering path.
+         */
+        LightMap( const MapInfo& mapInfo );
+        ~LightMap();
+        
+        /**
+         * The atlas, or NULL (sprite rendering path, or a map too large for it).
+         */
+        cocos2d::Texture2D* getTexture() const;
+        
+        /**
+         * The light of the eight faces (FaceDirection order) of the block in a cell (cellIndex = y * width + x) of
+         * a plane, to multiply the face colors by. White where nothing was baked.
+         */
+        const cocos2d::Color3B* getFaceColors( int planeIndex, int cellIndex ) const;
+        
+        /**
+         * Points the light map uniforms of a mesh-path program state at the atlas. States whose shader doesn't
+         * declare u_useLightMap are left alone; without an atlas the shader is told not to sample it.
+         */
+        void apply( cocos2d::GLProgramState* state ) const;
+    
+    protected:
+        int _width = 0;
+        int _height = 0;
+        float _tileSize = 0.0f;
+        int _texelsPerFace = LIGHT_MAP_TEXELS_PER_FACE;
+        
+        /**
+         * Level (index into MapInfo::planeLevels) of every plane, and the height of every level.
+         */
+        std::vector< int > _planeLevels;
+        std::vector< float > _levelHeights;
+        
+        /**
+         * One byte per level and cell: TRUE when a plane of the level holds a solid tile there.
+         */
+        std::vector< uint8_t > _solidCells;
+        
+        /**
+         * Eight colors (FaceDirection order) per level and cell.
+         */
+        std::vector< cocos2d::Color3B > _faceColors;
+        
+        cocos2d::Texture2D* _texture = nullptr;
+        
+        /**
+         * Uniform values (see apply()): map width, height, texels per face and tile size; the atlas size; the level
+         * heights, padded with heights no instance has.
+         */
+        cocos2d::Vec4 _layout;
+        cocos2d::Vec2 _atlasSize;
+        std::array< float, LIGHT_MAP_MAX_LEVELS > _levelUniform;
+        
+        /**
+         * A light in world units.
+         */
+        struct BakedLight
+        {
+            cocos2d::Vec3 position;
+            cocos2d::Vec3 color;
+            float radius;
+        };
+        std::vector< BakedLight > _lights;
+        cocos2d::Vec3 _ambient;
+        
+        /**
+         * Fills _faceColors and, when atlas is not NULL, the patches of the exposed faces.
+         */
+        void bake( const MapInfo& mapInfo, std::vector< uint8_t >* atlas );
+        
+        /**
+         * World position of the point (s, t) of a face of the block centered on center, s and t in [0, 1]. Must
+         * match the face coordinates of the mesh shaders.
+         */
+        cocos2d::Vec3 getFacePoint( const cocos2d::Vec3& center, int direction, float s, float t ) const;
+        
+        /**
+         * Light arriving at a point of a face from the lights in candidates. Center spans (twoSided) are lit from
+         * either side.
+         */
+        cocos2d::Vec3 getIrradiance( const cocos2d::Vec3& point, const cocos2d::Vec3& normal, bool twoSided,
+                                     const std::vector< const BakedLight* >& candidates ) const;
+        
+        /**
+         * TRUE when a solid block lies between two points: a walk through the cells the segment crosses, testing
+         * the height range of the segment within each cell against the solid levels there.
+         */
+        bool isOccluded( const cocos2d::Vec3& from, const cocos2d::Vec3& to ) const;
+        bool isSolidBetween( int x, int y, float fromHeight, float toHeight ) const;
+    };
+}
+
+#endif /* LightMap_hpp */
@@ -7,6 +7,7 @@
 //
 
 #include "GBRaycaster.hpp"
+#include <cfloat>
 
 using namespace mikedotcpp;
 
@@ -32,11 +33,30 @@ GBRaycaster::GBRaycaster( const MapInfo& mapInfo, GBRaycasterInterface* delegate
     setMapHeight( mapInfo.height );
     setDelegate( delegate );
     _planes = mapInfo.planes;
+    _mapInfo = &mapInfo;
     preComputeRayAngles();
+    
+    if( mapInfo.isChunked() )
+    {
+        // Rays never leave the resident window; the start area is loaded before the first frame.
+        // Each column's behaviors are indexed as it becomes resident, so the index never covers the whole map.
+        _chunkStreamer = new MapChunkStreamer( mapInfo );
+        _maxRayCells = _chunkStreamer->getReach();
+        _columnBehaviors.assign( mapInfo.chunksWide * mapInfo.chunksHigh, nullptr );
+        _chunkStreamer->setColumnListener( CC_CALLBACK_2( GBRaycaster::onColumnResidencyChanged, this ) );
+        const Actor& player = mapInfo.actors[0];
+        _chunkStreamer->preload( player.z, player.x );
+    }
+    else
+    {
+        buildBehaviorIndex();
+    }
 }
 
 GBRaycaster::~GBRaycaster()
 {
+    // Evicting the resident columns frees their behavior indices.
+    delete _chunkStreamer;
     _rayAngles.clear();
     memset( &_rayAngles, 0, sizeof( _rayAngles ) );
     printf( "GBRaycaster deleted, release resources.\n" );
@@ -56,11 +76,8 @@ Point2i GBRaycaster::tileCoordForPosition( Point3f pos )
 Point2i GBRaycaster::tileCoordForPosition( float x, float y )
 {
     Point2i result;
-    static float mapHeightxTileHeight = _mapHeight * _tileHeight;
-    static float widthDivisor = 1 / _tileWidth;
-    static float heightDivisor = 1 / _tileHeight;
-    result.x = floorf( x * widthDivisor );
-    result.y = floorf( ( mapHeightxTileHeight - y ) * heightDivisor );
+    result.x = floorf( x * _tileWidthDivisor );
+    result.y = floorf( ( _mapHeight * _tileHeight - y ) * _tileHeightDivisor );
     return result;
 }
 
@@ -80,12 +97,13 @@ Point3f GBRaycaster::tilePositionForCoord( int x, int y )
 void GBRaycaster::preComputeRayAngles()
 {
     float fovRadians = _fov * MATH_PI / 180.0f;
-    float _viewDist = ( _rayCount/2.0f ) / tan( fovRadians/2.0f );
+    _viewDistance = ( _rayCount/2.0f ) / tan( fovRadians/2.0f );
+    _rayAngles.clear();
     _rayAngles.reserve( _rayCount );
     for ( int i = 0; i < _rayCount; i++)
     {
         float rayScreenPos = ( -_rayCount/2.0f + i );
-        float rayViewDist = sqrt( rayScreenPos*rayScreenPos + _viewDist*_viewDist );
+        float rayViewDist = sqrt( rayScreenPos*rayScreenPos + _viewDistance*_viewDistance );
         float rayAngle = asin( rayScreenPos / rayViewDist );
         _rayAngles.push_back( rayAngle );
     }
@@ -101,14 +119,19 @@ void GBRaycaster::castRays( Point3f playerPosition, float rotation )
 {
     assert( _delegate != nullptr && NO_DELEGATE_MSG );
     
+    _depthPlane = _mapInfo->getPlaneIndexForHeight( playerPosition.y );
     transposeAboutY( playerPosition );
     Point2i playerTileCoord = tileCoordForPosition( playerPosition );
     Point3f playerTilePosition = tilePositionForCoord( playerTileCoord );
     
     setPlayerTile( playerTileCoord, playerTilePosition );
     
+    _rayDepths.assign( _rayCount, FLT_MAX );
+    _castPosition = playerPosition;
+    _castRotation = rotation;
     for( int rayIndex = 0; rayIndex < _rayCount; rayIndex++ )
     {
+        _depthRay = rayIndex;
         float rayAngle = rotation + _rayAngles.at( rayIndex );
         rayAngle = fmodf( rayAngle, TWO_PI );
         rayAngle = ( rayAngle < 0 ) ? rayAngle + TWO_PI : rayAngle;
@@ -122,10 +145,13 @@ void GBRaycaster::setPlayerTile( Point2i playerTile, Point3f playerPosition )
     for( int i = 0; i < _planes.size(); ++i )
     {
         Plane plane = _planes[i];
-        int tileIndex = plane.map[index] - 1;
+        int tileIndex = getTileIndexAt( i, playerTile.x, playerTile.y );
         if( tileIndex >= 0 )
         {
-            Point3f tilePos = Point3f( playerPosition.y, plane.height, playerPosition.x );
+            // An open door the player stands in.
+            const MovingTile* door = ( _mapInfo->tileFlags[tileIndex] & MAP_TILE_FLAG_DOOR ) ? getMovingTile( i, playerTile.x, playerTile.y ) : nullptr;
+            Point3f tileCenter = door ? offsetByMovingTile( playerPosition, *door ) : playerPosition;
+            Point3f tilePos = Point3f( tileCenter.y, plane.height, tileCenter.x );
             _delegate->processHit( index, 0.0f, tilePos, tileIndex, i );
         }
     }
@@ -133,23 +159,24 @@ void GBRaycaster::setPlayerTile( Point2i playerTile, Point3f playerPosition )
 
 int GBRaycaster::getTileResourceIndex( Point3f position )
 {
-    Plane plane;
     Point3f transposedPosition = position;
     transposeAboutY( transposedPosition );
     int tileResourceIndex = -1;
-    for( int i = 0; i < _planes.size(); ++i )
+    int level = _mapInfo->getPlaneLevel( position.y );
+    if( level < 0 )
     {
-        plane = _planes[i];
-//        CCLOG( "PLANE_HEIGHT: %i  PLAYER_HEIGHT: %f", plane.height, position.y );
-        if( plane.height == position.y )
+        return tileResourceIndex;
+    }
+    
+    const MapBinaryPlaneLevel& planeLevel = _mapInfo->planeLevels[level];
+    Point2i positionTile = tileCoordForPosition( transposedPosition );
+    for( int j = 0; j < planeLevel.count; ++j )
+    {
+        int i = _mapInfo->planeOrder[ planeLevel.first + j ];
+        tileResourceIndex = getTileIndexAt( i, positionTile.x, positionTile.y );
+        if( tileResourceIndex >= 0 )
         {
-            Point2i positionTile = tileCoordForPosition( transposedPosition );
-            int tileIndex = getIndexFromMapCoord( positionTile );
-            tileResourceIndex = plane.map[tileIndex] - 1;
-            if( tileResourceIndex >= 0 )
-            {
-                break;
-            }
+            break;
         }
     }
     return tileResourceIndex;
@@ -168,8 +195,7 @@ float GBRaycaster::getTileResourceHeight( Point3f position )
         if( plane.height < position.y )
         {
             Point2i positionTile = tileCoordForPosition( transposedPosition );
-            int tileIndex = getIndexFromMapCoord( positionTile );
-            tileResourceIndex = plane.map[tileIndex] - 1;
+            tileResourceIndex = getTileIndexAt( i, positionTile.x, positionTile.y );
             if( tileResourceIndex >= 0 )
             {
                 tileResourceHeight = plane.height;
@@ -182,22 +208,185 @@ float GBRaycaster::getTileResourceHeight( Point3f position )
 
 void GBRaycaster::clearTileResourceAt( Point3f position )
 {
-    Plane plane;
+    int triggerCell = getTriggerCell( position );
+    int planeIndex = getTriggerPlane( triggerCell );
+    if( planeIndex >= 0 )
+    {
+        int width = (int)_mapWidth;
+        setTileIndexAt( planeIndex, triggerCell % width, ( triggerCell / width ) % (int)_mapHeight, -1 );
+    }
+}
+
+int GBRaycaster::getTriggerPlane( int triggerCell )
+{
+    if( triggerCell < 0 )
+    {
+        return -1;
+    }
+    
+    int width = (int)_mapWidth;
+    int height = (int)_mapHeight;
+    int x = triggerCell % width;
+    int y = ( triggerCell / width ) % height;
+    const MapBinaryPlaneLevel& planeLevel = _mapInfo->planeLevels[ triggerCell / ( width * height ) ];
+    for( int j = 0; j < planeLevel.count; ++j )
+    {
+        int i = _mapInfo->planeOrder[ planeLevel.first + j ];
+        if( getTileIndexAt( i, x, y ) >= 0 )
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void GBRaycaster::setTileIndexAt( int planeIndex, int x, int y, int tileIndex )
+{
+    if( _chunkStreamer )
+    {
+        _chunkStreamer->setCell( planeIndex, x, y, (uint16_t)( tileIndex + 1 ) );
+    }
+    else
+    {
+        _planes[planeIndex].map[ getIndexFromMapCoord( Point2i( x, y ) ) ] = (uint16_t)( tileIndex + 1 );
+    }
+    
+    // The cell triggers whatever the first plane of the level holds there now.
+    int level = _mapInfo->getPlaneLevel( _planes[planeIndex].height );
+    int16_t behavior = findCellBehavior( level, x, y );
+    if( _chunkStreamer )
+    {
+        int16_t* entry = getColumnBehaviorEntry( level, x, y );
+        if( entry )
+        {
+            *entry = behavior;
+        }
+    }
+    else
+    {
+        _cellBehaviors[ ( level * (int)_mapHeight + y ) * (int)_mapWidth + x ] = behavior;
+    }
+}
+
+int GBRaycaster::getTriggerCell( Point3f position )
+{
+    int level = _mapInfo->getPlaneLevel( position.y );
+    if( level < 0 )
+    {
+        return -1;
+    }
+    
     Point3f transposedPosition = position;
     transposeAboutY( transposedPosition );
-    int tileResourceIndex = -1;
-    for( int i = 0; i < _planes.size(); ++i )
+    Point2i positionTile = tileCoordForPosition( transposedPosition );
+    int width = (int)_mapWidth;
+    int height = (int)_mapHeight;
+    if( positionTile.x < 0 || positionTile.x >= width || positionTile.y < 0 || positionTile.y >= height )
     {
-        plane = _planes[i];
-        if( plane.height == position.y )
+        return -1;
+    }
+    return ( level * height + positionTile.y ) * width + positionTile.x;
+}
+
+void GBRaycaster::buildBehaviorIndex()
+{
+    if( _chunkStreamer )
+    {
+        // The other columns are indexed when they are loaded.
+        for( int column = 0; column < _columnBehaviors.size(); ++column )
         {
-            Point2i positionTile = tileCoordForPosition( transposedPosition );
-            int tileIndex = getIndexFromMapCoord( positionTile );
-            tileResourceIndex = plane.map[tileIndex] - 1;
-            if( tileResourceIndex >= 0 )
+            if( _columnBehaviors[column] )
             {
-                plane.map[tileIndex] = 0;
-                break;
+                buildColumnBehaviors( column );
+            }
+        }
+        return;
+    }
+    
+    int width = (int)_mapWidth;
+    int height = (int)_mapHeight;
+    _cellBehaviors.assign( _mapInfo->planeLevels.size() * width * height, -1 );
+    for( int level = 0; level < _mapInfo->planeLevels.size(); ++level )
+    {
+        int16_t* behaviors = &_cellBehaviors[ level * width * height ];
+        for( int y = 0; y < height; ++y )
+        {
+            for( int x = 0; x < width; ++x )
+            {
+                behaviors[ y * width + x ] = findCellBehavior( level, x, y );
+            }
+        }
+    }
+}
+
+int16_t GBRaycaster::findCellBehavior( int level, int x, int y )
+{
+    const MapBinaryPlaneLevel& planeLevel = _mapInfo->planeLevels[level];
+    for( int j = 0; j < planeLevel.count; ++j )
+    {
+        int tileIndex = getTileIndexAt( _mapInfo->planeOrder[ planeLevel.first + j ], x, y );
+        if( tileIndex >= 0 )
+        {
+            return (int16_t)_mapInfo->tileDescriptors[tileIndex].tag;
+        }
+    }
+    return -1;
+}
+
+int16_t* GBRaycaster::getColumnBehaviorEntry( int level, int x, int y ) const
+{
+    int chunkSize = _mapInfo->chunkSize;
+    int chunkX = x / chunkSize;
+    int chunkY = y / chunkSize;
+    int16_t* behaviors = _columnBehaviors[ chunkY * _mapInfo->chunksWide + chunkX ];
+    if( behaviors == nullptr )
+    {
+        return nullptr;
+    }
+    return &behaviors[ ( level * chunkSize + y - chunkY * chunkSize ) * chunkSize + x - chunkX * chunkSize ];
+}
+
+int GBRaycaster::getChunkedCellBehavior( int triggerCell ) const
+{
+    int width = (int)_mapWidth;
+    int height = (int)_mapHeight;
+    const int16_t* entry = getColumnBehaviorEntry( triggerCell / ( width * height ), triggerCell % width, ( triggerCell / width ) % height );
+    return entry ? *entry : -1;
+}
+
+void GBRaycaster::onColumnResidencyChanged( int column, bool resident )
+{
+    if( resident )
+    {
+        buildColumnBehaviors( column );
+    }
+    else
+    {
+        delete[] _columnBehaviors[column];
+        _columnBehaviors[column] = nullptr;
+    }
+}
+
+void GBRaycaster::buildColumnBehaviors( int column )
+{
+    int chunkSize = _mapInfo->chunkSize;
+    int levelCount = (int)_mapInfo->planeLevels.size();
+    if( _columnBehaviors[column] == nullptr )
+    {
+        _columnBehaviors[column] = new int16_t[ levelCount * chunkSize * chunkSize ];
+    }
+    
+    // Edge chunks reach past the map; getTileIndexAt() reads those cells as void.
+    int16_t* behaviors = _columnBehaviors[column];
+    int originX = ( column % _mapInfo->chunksWide ) * chunkSize;
+    int originY = ( column / _mapInfo->chunksWide ) * chunkSize;
+    for( int level = 0; level < levelCount; ++level )
+    {
+        for( int y = 0; y < chunkSize; ++y )
+        {
+            for( int x = 0; x < chunkSize; ++x )
+            {
+                behaviors[ ( level * chunkSize + y ) * chunkSize + x ] = findCellBehavior( level, originX + x, originY + y );
             }
         }
     }
@@ -239,8 +428,14 @@ void GBRaycaster::traceRayHorizontally( float rayAngle, Point3f raySinCos, Point
 void GBRaycaster::traceRay( Point3f rayPoint, Point3f rayPointChange, Point3f increment, float rayAngle )
 {
     int expectedX = 0, expectedY = 0;
+    int steps = 0;
     while( rayPoint.x >= 0 && rayPoint.x < _mapWidth * _tileWidth && rayPoint.y >= 0 && rayPoint.y < _mapHeight * _tileHeight )
     {
+        if( _maxRayCells > 0 && ++steps > _maxRayCells )
+        {
+            return;
+        }
+        
         int wallSub1 = MAX( 0, ( ( rayPoint.x + increment.x ) * _tileWidthDivisor ) );
         int wallSub2 = MIN( _mapHeight - 1, ( ( _mapHeight * _tileHeight - ( rayPoint.y + increment.y ) ) * _tileHeightDivisor ) );
         int index = getIndexFromMapCoord( Point2i( wallSub1, wallSub2 ) );
@@ -257,14 +452,39 @@ void GBRaycaster::traceRay( Point3f rayPoint, Point3f rayPointChange, Point3f in
         expectedX = wallSub1;
         expectedY = wallSub2;
         
+        // Walls being pushed through this cell are off their planes; they never stop the ray.
+        if( isLiftedCell( index ) )
+        {
+            addLiftedTiles( index, wallSub1, wallSub2, rayAngle );
+        }
+        
         // Draw sprites/meshes for each plane at this tile location.
         for( int i = 0; i < _planes.size(); ++i )
         {
             Plane plane = _planes[i];
-            int tileIndex = plane.map[index] - 1;
+            int tileIndex = getTileIndexAt( i, wallSub1, wallSub2 );
             if( tileIndex >= 0 )
             {
                 Point3f tilePos = tilePositionForCoord( wallSub1, wallSub2 );
+                uint32_t tileFlags = _mapInfo->tileFlags[tileIndex];
+                if( tileFlags & MAP_TILE_FLAG_DOOR )
+                {
+                    // Doors stop the ray where it crosses their plane, unless it goes through the opening.
+                    const MovingTile* door = getMovingTile( i, wallSub1, wallSub2 );
+                    float distance = 0.0f;
+                    if( i == _depthPlane && hitsDoor( rayPoint, rayPointChange, wallSub1, wallSub2, tileFlags, door, distance ) )
+                    {
+                        _rayDepths[_depthRay] = MIN( _rayDepths[_depthRay], distance );
+                        returnCount++;
+                    }
+                    tilePos = door ? offsetByMovingTile( tilePos, *door ) : tilePos;
+                }
+                else if( i == _depthPlane && ( tileFlags & MAP_TILE_FLAG_SOLID ) )
+                {
+                    // The ray enters the solid cell at rayPoint; the nearer of the vertical and horizontal traces wins.
+                    float distance = getCastDistance( rayPoint.x, rayPoint.y );
+                    _rayDepths[_depthRay] = MIN( _rayDepths[_depthRay], distance );
+                }
                 
                 bool continueProcessing = _delegate->processHit( index,
                                                                 rayAngle,
@@ -310,17 +530,247 @@ int GBRaycaster::getIndexFromMapCoord( Point2i coord )
     return index;
 }
 
+float GBRaycaster::getCastDistance( float x, float y )
+{
+    float deltaX = x - _castPosition.x;
+    float deltaY = y - _castPosition.y;
+    return sqrtf( deltaX * deltaX + deltaY * deltaY );
+}
+
+//==============================================================================
+//
+// MOVING TILES
+//
+//==============================================================================
+
+void GBRaycaster::setMovingTile( const MovingTile& tile )
+{
+    int mapSize = getMapSize();
+    int key = tile.planeIndex * mapSize + getIndexFromMapCoord( tile.cell );
+    auto slot = _movingSlots.find( key );
+    if( slot != _movingSlots.end() )
+    {
+        MovingTile& current = _movingTiles[slot->second];
+        if( current.cell.x == tile.cell.x && current.cell.y == tile.cell.y &&
+            current.direction.x == tile.direction.x && current.direction.y == tile.direction.y )
+        {
+            // The common case, once per frame per moving tile: it only went further.
+            current.amount = tile.amount;
+            current.tileIndex = tile.tileIndex;
+            return;
+        }
+        removeMovingTile( current.planeIndex, current.cell.x, current.cell.y );
+    }
+    
+    int index = (int)_movingTiles.size();
+    _movingTiles.push_back( tile );
+    _movingSlots[key] = index;
+    if( !( _mapInfo->tileFlags[tile.tileIndex] & MAP_TILE_FLAG_DOOR ) )
+    {
+        Point2i next( tile.cell.x + tile.direction.x, tile.cell.y + tile.direction.y );
+        _movingSlots[ tile.planeIndex * mapSize + getIndexFromMapCoord( next ) ] = index;
+        if( _liftedCells.empty() )
+        {
+            _liftedCells.assign( mapSize, 0 );
+        }
+        countLiftedTile( tile, 1 );
+    }
+}
+
+void GBRaycaster::removeMovingTile( int planeIndex, int x, int y )
+{
+    int mapSize = getMapSize();
+    auto slot = _movingSlots.find( planeIndex * mapSize + getIndexFromMapCoord( Point2i( x, y ) ) );
+    if( slot == _movingSlots.end() )
+    {
+        return;
+    }
+    
+    // The last tile takes the place of the removed one.
+    int index = slot->second;
+    MovingTile tile = _movingTiles[index];
+    bool lifted = !( _mapInfo->tileFlags[tile.tileIndex] & MAP_TILE_FLAG_DOOR );
+    Point2i next( tile.cell.x + tile.direction.x, tile.cell.y + tile.direction.y );
+    _movingSlots.erase( planeIndex * mapSize + getIndexFromMapCoord( tile.cell ) );
+    if( lifted )
+    {
+        _movingSlots.erase( planeIndex * mapSize + getIndexFromMapCoord( next ) );
+        countLiftedTile( tile, -1 );
+    }
+    
+    int last = (int)_movingTiles.size() - 1;
+    if( index != last )
+    {
+        const MovingTile& moved = _movingTiles[last];
+        _movingSlots[ moved.planeIndex * mapSize + getIndexFromMapCoord( moved.cell ) ] = index;
+        if( !( _mapInfo->tileFlags[moved.tileIndex] & MAP_TILE_FLAG_DOOR ) )
+        {
+            Point2i movedNext( moved.cell.x + moved.direction.x, moved.cell.y + moved.direction.y );
+            _movingSlots[ moved.planeIndex * mapSize + getIndexFromMapCoord( movedNext ) ] = index;
+        }
+        _movingTiles[index] = moved;
+    }
+    _movingTiles.pop_back();
+}
+
+void GBRaycaster::clearMovingTiles()
+{
+    _movingTiles.clear();
+    _movingSlots.clear();
+    _liftedCells.clear();
+}
+
+const MovingTile* GBRaycaster::getMovingTile( int planeIndex, int x, int y ) const
+{
+    if( _movingTiles.empty() )
+    {
+        return nullptr;
+    }
+    auto slot = _movingSlots.find( planeIndex * (int)( _mapWidth * _mapHeight ) + (int)_mapWidth * y + x );
+    return ( slot != _movingSlots.end() ) ? &_movingTiles[slot->second] : nullptr;
+}
+
+void GBRaycaster::countLiftedTile( const MovingTile& tile, int count )
+{
+    Point2i next( tile.cell.x + tile.direction.x, tile.cell.y + tile.direction.y );
+    _liftedCells[ getIndexFromMapCoord( tile.cell ) ] += count;
+    _liftedCells[ getIndexFromMapCoord( next ) ] += count;
+}
+
+bool GBRaycaster::hitsDoor( Point3f rayPoint, Point3f rayPointChange, int x, int y, uint32_t tileFlags, const MovingTile* door, float& distance )
+{
+    // The ray in cell units from the corner of the cell, along map columns (x) and rows (y).
+    float startX = rayPoint.x * _tileWidthDivisor - x;
+    float startY = ( _mapHeight * _tileHeight - rayPoint.y ) * _tileHeightDivisor - y;
+    float deltaX = rayPointChange.x * _tileWidthDivisor;
+    float deltaY = -rayPointChange.y * _tileHeightDivisor;
+    
+    // NS doors lie along the middle of the row, EW doors along the middle of the column.
+    bool alongRow = ( tileFlags & MAP_TILE_FLAG_DOOR_NS ) != 0;
+    float across = alongRow ? deltaY : deltaX;
+    if( across == 0.0f )
+    {
+        return false;
+    }
+    float step = ( 0.5f - ( alongRow ? startY : startX ) ) / across;
+    float along = alongRow ? startX + deltaX * step : startY + deltaY * step;
+    if( step < 0.0f || along < 0.0f || along > 1.0f )
+    {
+        return false;
+    }
+    
+    // An opening door covers [0, 1] of the cell moved by amount along direction.
+    if( door )
+    {
+        along -= door->amount * ( alongRow ? door->direction.x : door->direction.y );
+        if( along < 0.0f || along > 1.0f )
+        {
+            return false;
+        }
+    }
+    distance = getCastDistance( rayPoint.x + rayPointChange.x * step, rayPoint.y + rayPointChange.y * step );
+    return true;
+}
+
+Point3f GBRaycaster::offsetByMovingTile( Point3f tilePosition, const MovingTile& tile )
+{
+    // Map rows run against the y axis of the ray frame.
+    tilePosition.x += tile.direction.x * tile.amount * _tileWidth;
+    tilePosition.y -= tile.direction.y * tile.amount * _tileHeight;
+    return tilePosition;
+}
+
+void GBRaycaster::addLiftedTiles( int index, int x, int y, float rayAngle )
+{
+    for( int i = 0; i < _planes.size(); ++i )
+    {
+        const MovingTile* tile = getMovingTile( i, x, y );
+        if( tile && !( _mapInfo->tileFlags[tile->tileIndex] & MAP_TILE_FLAG_DOOR ) )
+        {
+            Point3f tilePos = offsetByMovingTile( tilePositionForCoord( tile->cell ), *tile );
+            _delegate->processHit( getIndexFromMapCoord( tile->cell ), rayAngle, Point3f( tilePos.y, _planes[i].height, tilePos.x ), tile->tileIndex, i );
+        }
+    }
+}
+
 //==============================================================================
 //
 // ACCESSORS AND MUTATORS
 //
 //==============================================================================
 
+Point2i GBRaycaster::getMapCoordForPosition( Point3f position )
+{
+    transposeAboutY( position );
+    return tileCoordForPosition( position );
+}
+
+MapChunkStreamer* GBRaycaster::getChunkStreamer()
+{
+    return _chunkStreamer;
+}
+
+const std::vector< float >& GBRaycaster::getRayDepths() const
+{
+    return _rayDepths;
+}
+
+bool GBRaycaster::isOccluded( Point3f position, float radius )
+{
+    if( _rayDepths.empty() )
+    {
+        return false;
+    }
+    
+    // Same frame as the rays: a ray at angle a points along ( cos a, sin a ).
+    transposeAboutY( position );
+    float deltaX = position.x - _castPosition.x;
+    float deltaY = position.y - _castPosition.y;
+    float distance = sqrtf( deltaX * deltaX + deltaY * deltaY );
+    if( distance <= radius )
+    {
+        return false;
+    }
+    
+    float angle = fmodf( atan2f( deltaY, deltaX ) - _castRotation, TWO_PI );
+    angle = ( angle > MATH_PI ) ? angle - TWO_PI : ( angle < -MATH_PI ) ? angle + TWO_PI : angle;
+    float halfSpan = atanf( radius / distance );
+    float firstAngle = MAX( angle - halfSpan, _rayAngles.front() );
+    float lastAngle = MIN( angle + halfSpan, _rayAngles.back() );
+    if( firstAngle > lastAngle )
+    {
+        return true;
+    }
+    
+    int first = MAX( 0, (int)floorf( _rayCount * 0.5f + _viewDistance * tanf( firstAngle ) ) );
+    int last = MIN( _rayCount - 1, (int)ceilf( _rayCount * 0.5f + _viewDistance * tanf( lastAngle ) ) );
+    float nearest = distance - radius;
+    for( int i = first; i <= last; ++i )
+    {
+        if( _rayDepths[i] > nearest )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GBRaycaster::setMaxRayCells( int cells )
+{
+    _maxRayCells = MAX( 0, cells );
+}
+
+int GBRaycaster::getMaxRayCells()
+{
+    return _maxRayCells;
+}
+
 void GBRaycaster::setRayCount( int count )
 {
     if( count > 0 )
     {
         _rayCount = count;
+        preComputeRayAngles();
     }
 }
 
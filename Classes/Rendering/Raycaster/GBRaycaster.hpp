@@ -12,6 +12,8 @@
 #include <stdio.h>
 #include "GBRTypes.hpp"
 #include "../../Map/MapInfo.hpp"
+#include "../../Map/MapChunkStreamer.hpp"
+#include <unordered_map>
 
 namespace mikedotcpp
 {
@@ -36,6 +38,21 @@ namespace mikedotcpp
         virtual bool processHit( int index, float angle, Point3f hit, int tileIndex, int planeIndex ) = 0;
     };
     
+    /**
+     * A tile the raycaster draws away from its cell, see GBRaycaster::setMovingTile(). Doors (MAP_TILE_FLAG_DOOR
+     * tiles) stay stored in their cell and slide their plane amount (0 closed to 1 open) of a tile along direction.
+     * Any other tile is lifted off its plane while it moves: it is drawn amount (0 to 1) of the way from cell to
+     * cell + direction, and found by the rays in both cells. Cells and directions are map coordinates.
+     */
+    struct MovingTile
+    {
+        int planeIndex;
+        int tileIndex;
+        Point2i cell;
+        Point2i direction;
+        float amount;
+    };
+    
     /**
      * Performs the classic grid-based raycasting algorithm seen in old-school first person
      * games such as: Wolfenstein3D, Shadowcaster, In Pursuit of Greed, Blake Stone,
@@ -101,10 +118,109 @@ namespace mikedotcpp
         float getTileResourceHeight( Point3f position );
         
         /**
-         * Resets the tile resource index to 0 at this position in the tilemap.
+         * Resets the tile resource index to 0 at this position in the tilemap. The behavior index follows.
          */
         void clearTileResourceAt( Point3f position );
         
+        /**
+         * The trigger cell a world position stands in: a map cell of the plane level at the position's height, as
+         * getTileResourceIndex() picks it. -1 off the map or between plane levels. Comparing the trigger cells of
+         * two positions tells whether a move crossed into another tile.
+         */
+        int getTriggerCell( Point3f position );
+        
+        /**
+         * Behavior index (the tag of its tile) of a trigger cell, or -1 for none. A lookup in the per-cell index;
+         * on chunked maps, cells of chunks that are not resident have none.
+         */
+        inline int getCellBehavior( int triggerCell ) const
+        {
+            if( triggerCell < 0 )
+            {
+                return -1;
+            }
+            return _chunkStreamer ? getChunkedCellBehavior( triggerCell ) : _cellBehaviors[triggerCell];
+        }
+        
+        /**
+         * The plane holding the tile of a trigger cell (the first of its level with a tile there), or -1.
+         */
+        int getTriggerPlane( int triggerCell );
+        
+        /**
+         * Writes a cell of a plane (tileIndex -1 for void) and updates the behavior index to match.
+         */
+        void setTileIndexAt( int planeIndex, int x, int y, int tileIndex );
+        
+        /**
+         * Fills the per-cell behavior index from the stored cells (of the resident chunks, on chunked maps). Done on
+         * construction; call again after the map's cells or tile tags change other than through
+         * clearTileResourceAt() and setTileIndexAt().
+         */
+        void buildBehaviorIndex();
+        
+        /**
+         * Adds a moving tile, or updates the one of the same plane and cell. Only the tiles that are moving (or
+         * doors that are not closed) need one, so the cost of animating them grows with their number alone. A lifted
+         * tile must have been cleared from its plane (setTileIndexAt) and must not share a cell with another one.
+         */
+        void setMovingTile( const MovingTile& tile );
+        
+        /**
+         * Removes the moving tile of a plane's cell; a door left without one is drawn closed.
+         */
+        void removeMovingTile( int planeIndex, int x, int y );
+        void clearMovingTiles();
+        
+        /**
+         * The moving tile of a plane's cell (or lifted tile moving into it), NULL when there is none.
+         */
+        const MovingTile* getMovingTile( int planeIndex, int x, int y ) const;
+        
+        /**
+         * TRUE when a lifted tile of any plane is in a map cell (index = y * width + x) or moving into it.
+         */
+        inline bool isLiftedCell( int index ) const
+        {
+            return !_liftedCells.empty() && _liftedCells[index] > 0;
+        }
+        
+        /**
+         * Returns the map coordinate of a world (camera) position.
+         */
+        Point2i getMapCoordForPosition( Point3f position );
+        
+        /**
+         * Returns the tile resource index (-1 for void) at a map coordinate of a plane. Goes through the chunk
+         * streamer for chunked maps.
+         */
+        inline int getTileIndexAt( int planeIndex, int x, int y )
+        {
+            if( _chunkStreamer )
+            {
+                return _chunkStreamer->getCell( planeIndex, x, y ) - 1;
+            }
+            return _planes[planeIndex].map[ (int)_mapWidth * y + x ] - 1;
+        }
+        
+        /**
+         * Chunked maps only (NULL otherwise): keeps the chunks around the player resident. Owned by the raycaster.
+         */
+        MapChunkStreamer* getChunkStreamer();
+        
+        /**
+         * The classic raycaster z-buffer, one entry per ray of the last castRays(): distance (world units, on the map
+         * plane) from the cast position to the first solid tile (MAP_TILE_FLAG_SOLID) of the plane at the cast
+         * height. FLT_MAX where the ray hit none before leaving the map (or _maxRayCells).
+         */
+        const std::vector< float >& getRayDepths() const;
+        
+        /**
+         * TRUE when a sprite of the given radius standing at a world position can't be seen from the last
+         * castRays(): it lies outside the rays' field of view or behind the depth of every ray that crosses it.
+         */
+        bool isOccluded( Point3f position, float radius );
+    
     protected:
         /**
          * Refers to the number of rays fired in raycasting algorithm. The classic
@@ -153,10 +269,59 @@ namespace mikedotcpp
          */
         std::vector< float > _rayAngles;
         
+        /**
+         * Distance from the eye to the projection plane, in rays: ray i points at atan( ( i - _rayCount/2 ) /
+         * _viewDistance ) from the view direction.
+         */
+        float _viewDistance = 0.0f;
+        
+        /**
+         * See getRayDepths(). Written while the rays are traced: the ray being traced, the cast position (transposed,
+         * like the ray points), the cast rotation and the plane whose solid tiles stop the depth.
+         */
+        std::vector< float > _rayDepths;
+        int _depthRay = 0;
+        Point3f _castPosition;
+        float _castRotation = 0.0f;
+        int _depthPlane = -1;
+        
         /**
          */
         mikedotcpp::PlaneCollection _planes;
         
+        /**
+         * The map being cast against, for its precomputed plane height index.
+         */
+        const MapInfo* _mapInfo = nullptr;
+        
+        /**
+         * See getChunkStreamer().
+         */
+        MapChunkStreamer* _chunkStreamer = nullptr;
+        
+        /**
+         * See getCellBehavior(): one entry per map cell per plane level (level * width * height + y * width + x).
+         * Chunked maps leave it empty and index each resident column of chunks in _columnBehaviors instead (level *
+         * chunkSize * chunkSize + y * chunkSize + x, within the chunk), NULL while the column is not resident.
+         */
+        std::vector< int16_t > _cellBehaviors;
+        std::vector< int16_t* > _columnBehaviors;
+        
+        /**
+         * See setMovingTile(). _movingSlots maps plane cells (planeIndex * map size + y * width + x) to their tile in
+         * _movingTiles, lifted tiles under both of their cells. _liftedCells counts the lifted tiles in each map cell;
+         * it stays empty until a tile is lifted.
+         */
+        std::vector< MovingTile > _movingTiles;
+        std::unordered_map< int, int > _movingSlots;
+        std::vector< uint8_t > _liftedCells;
+        
+        /**
+         * Maximum number of cells a ray is traced over, 0 for no limit (up to the map edge). Chunked maps limit rays
+         * to the cells the streamer keeps resident.
+         */
+        int _maxRayCells = 0;
+        
         /**
          * Conforms to the GBRaycasterInterface protocol. Intended to be used to notify the calling code when
          * specific types of entities are hit (walls/floors/ceilings/doors/objects/actors/etc.)
@@ -180,6 +345,49 @@ namespace mikedotcpp
          */
         int getIndexFromMapCoord( Point2i coord );
         
+        /**
+         * Distance, on the map plane, from the cast position to a point of the ray frame.
+         */
+        float getCastDistance( float x, float y );
+        
+        /**
+         * Where the ray (entering the cell at rayPoint) crosses the plane of a door tile with the given flags, when it
+         * does so through the part of the door still in the cell. distance receives the distance to the crossing.
+         */
+        bool hitsDoor( Point3f rayPoint, Point3f rayPointChange, int x, int y, uint32_t tileFlags, const MovingTile* door, float& distance );
+        
+        /**
+         * Moves a cell centre of the ray frame by how far a moving tile has gone.
+         */
+        Point3f offsetByMovingTile( Point3f tilePosition, const MovingTile& tile );
+        
+        /**
+         * Reports the lifted tiles moving through a map cell to the delegate, under the index of the cell they left.
+         */
+        void addLiftedTiles( int index, int x, int y, float rayAngle );
+        
+        /**
+         * Adds or subtracts (count -1) a lifted tile from the counts of its cells.
+         */
+        void countLiftedTile( const MovingTile& tile, int count );
+        
+        /**
+         * The behavior of the first plane of a level with a tile in the cell, or -1, as getTileResourceIndex() picks it.
+         */
+        int16_t findCellBehavior( int level, int x, int y );
+        
+        /**
+         * Chunked maps: the entry of a cell in its column's behavior index, NULL when the column is not resident.
+         */
+        int16_t* getColumnBehaviorEntry( int level, int x, int y ) const;
+        int getChunkedCellBehavior( int triggerCell ) const;
+        
+        /**
+         * Chunk streamer listener: indexes a column once it is resident and frees its index when it is evicted.
+         */
+        void onColumnResidencyChanged( int column, bool resident );
+        void buildColumnBehaviors( int column );
+        
         /*
             TODO: Verify that this is actually necessary...it may not be.
          */
@@ -239,6 +447,12 @@ namespace mikedotcpp
          */
         void setDelegate( GBRaycasterInterface* delegate );
         
+        /**
+         * _maxRayCells
+         */
+        void setMaxRayCells( int cells );
+        int getMaxRayCells();
+        
     };
     
 }
@@ -0,0 +1,267 @@
+//
+//  TextureAtlasBuilder.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#include "TextureAtlasBuilder.hpp"
+
+/**
+ * Edge pixels repeated around every image.
+ */
+#define ATLAS_PADDING 2
+
+/**
+ * Smallest atlas tried.
+ */
+#define ATLAS_MIN_SIZE 256
+
+using namespace mikedotcpp;
+
+void TextureAtlasBuilder::addImage( const std::string& diffuseFile, const std::string& normalFile )
+{
+    for( auto& entry : _entries )
+    {
+        if( entry.diffuseFile == diffuseFile )
+        {
+            if( entry.normalFile.empty() )
+            {
+                entry.normalFile = normalFile;
+            }
+            else if( !normalFile.empty() && normalFile != entry.normalFile )
+            {
+                CCLOG( "TextureAtlasBuilder - %s is paired with %s and %s, keeping the first.", diffuseFile.c_str(), entry.normalFile.c_str(), normalFile.c_str() );
+            }
+            return;
+        }
+    }
+    
+    Entry entry;
+    entry.diffuseFile = diffuseFile;
+    entry.normalFile = normalFile;
+    _entries.push_back( entry );
+}
+
+bool TextureAtlasBuilder::build()
+{
+    if( _entries.empty() )
+    {
+        return false;
+    }
+    
+    std::vector< std::vector< unsigned char > > diffusePixels( _entries.size() );
+    std::vector< std::vector< unsigned char > > normalPixels( _entries.size() );
+    std::vector< cocos2d::Size > sizes( _entries.size() );
+    bool hasNormals = false;
+    for( int i = 0; i < _entries.size(); ++i )
+    {
+        int width = 0, height = 0;
+        if( !decodeRGBA( _entries[i].diffuseFile, diffusePixels[i], width, height ) )
+        {
+            CCLOG( "TextureAtlasBuilder - %s could not be decoded!", _entries[i].diffuseFile.c_str() );
+        }
+        sizes[i] = cocos2d::Size( width, height );
+        
+        int normalWidth = 0, normalHeight = 0;
+        if( !_entries[i].normalFile.empty() && decodeRGBA( _entries[i].normalFile, normalPixels[i], normalWidth, normalHeight ) )
+        {
+            if( normalWidth != width || normalHeight != height )
+            {
+                CCLOG( "TextureAtlasBuilder - normal map %s does not match the size of %s, ignored.", _entries[i].normalFile.c_str(), _entries[i].diffuseFile.c_str() );
+                normalPixels[i].clear();
+            }
+            hasNormals = hasNormals || !normalPixels[i].empty();
+        }
+    }
+    
+    int maxSize = cocos2d::Configuration::getInstance()->getMaxTextureSize();
+    int atlasSize = ATLAS_MIN_SIZE;
+    while( !pack( sizes, atlasSize ) )
+    {
+        atlasSize *= 2;
+        if( atlasSize > maxSize )
+        {
+            CCLOG( "TextureAtlasBuilder - %i images don't fit in a %ix%i atlas!", (int)_entries.size(), maxSize, maxSize );
+            return false;
+        }
+    }
+    
+    std::vector< unsigned char > atlas( atlasSize * atlasSize * 4, 0 );
+    for( int i = 0; i < _entries.size(); ++i )
+    {
+        blit( diffusePixels[i], sizes[i].width, sizes[i].height, atlas, atlasSize, _entries[i].rect );
+    }
+    _diffuseTexture = createTexture( atlas, atlasSize );
+    
+    if( hasNormals )
+    {
+        // Flat normal (0, 0, 1) wherever an image has no normal map.
+        for( int i = 0; i < atlas.size(); i += 4 )
+        {
+            atlas[i] = 128;
+            atlas[i + 1] = 128;
+            atlas[i + 2] = 255;
+            atlas[i + 3] = 255;
+        }
+        for( int i = 0; i < _entries.size(); ++i )
+        {
+            if( !normalPixels[i].empty() )
+            {
+                blit( normalPixels[i], sizes[i].width, sizes[i].height, atlas, atlasSize, _entries[i].rect );
+            }
+        }
+        _normalTexture = createTexture( atlas, atlasSize );
+    }
+    
+    CCLOG( "TextureAtlasBuilder - packed %i images into %ix%i", (int)_entries.size(), atlasSize, atlasSize );
+    return _diffuseTexture != nullptr;
+}
+
+cocos2d::Texture2D* TextureAtlasBuilder::getDiffuseTexture() const
+{
+    return _diffuseTexture;
+}
+
+cocos2d::Texture2D* TextureAtlasBuilder::getNormalTexture() const
+{
+    return _normalTexture;
+}
+
+void TextureAtlasBuilder::addSpriteFrames() const
+{
+    if( !_diffuseTexture )
+    {
+        return;
+    }
+    cocos2d::SpriteFrameCache* frameCache = cocos2d::SpriteFrameCache::getInstance();
+    for( const auto& entry : _entries )
+    {
+        cocos2d::SpriteFrame* frame = cocos2d::SpriteFrame::createWithTexture( _diffuseTexture, CC_RECT_PIXELS_TO_POINTS( entry.rect ) );
+        frameCache->addSpriteFrame( frame, entry.diffuseFile );
+    }
+}
+
+bool TextureAtlasBuilder::decodeRGBA( const std::string& file, std::vector< unsigned char >& pixels, int& width, int& height )
+{
+    cocos2d::Image* image = new (std::nothrow) cocos2d::Image();
+    if( !image || !image->initWithImageFile( file ) )
+    {
+        CC_SAFE_RELEASE( image );
+        return false;
+    }
+    
+    width = image->getWidth();
+    height = image->getHeight();
+    const unsigned char* data = image->getData();
+    int pixelCount = width * height;
+    pixels.resize( pixelCount * 4 );
+    
+    bool decoded = true;
+    switch( image->getRenderFormat() )
+    {
+        case cocos2d::Texture2D::PixelFormat::RGBA8888:
+            memcpy( &pixels[0], data, pixelCount * 4 );
+            break;
+        case cocos2d::Texture2D::PixelFormat::RGB888:
+            for( int i = 0; i < pixelCount; ++i )
+            {
+                pixels[i * 4] = data[i * 3];
+                pixels[i * 4 + 1] = data[i * 3 + 1];
+                pixels[i * 4 + 2] = data[i * 3 + 2];
+                pixels[i * 4 + 3] = 255;
+            }
+            break;
+        case cocos2d::Texture2D::PixelFormat::I8:
+        case cocos2d::Texture2D::PixelFormat::AI88:
+        {
+            int stride = ( image->getRenderFormat() == cocos2d::Texture2D::PixelFormat::AI88 ) ? 2 : 1;
+            for( int i = 0; i < pixelCount; ++i )
+            {
+                pixels[i * 4] = pixels[i * 4 + 1] = pixels[i * 4 + 2] = data[i * stride];
+                pixels[i * 4 + 3] = ( stride == 2 ) ? data[i * stride + 1] : 255;
+            }
+            break;
+        }
+        default:
+            // Compressed formats can't be repacked on the CPU.
+            decoded = false;
+            break;
+    }
+    
+    image->release();
+    if( !decoded )
+    {
+        pixels.clear();
+        width = height = 0;
+    }
+    return decoded;
+}
+
+bool TextureAtlasBuilder::pack( const std::vector< cocos2d::Size >& sizes, int atlasSize )
+{
+    std::vector< int > order( sizes.size() );
+    for( int i = 0; i < order.size(); ++i )
+    {
+        order[i] = i;
+    }
+    std::stable_sort( order.begin(), order.end(), [&sizes]( int a, int b )
+    {
+        return sizes[a].height > sizes[b].height;
+    } );
+    
+    // Shelves: fill a row left to right, then start the next one below the tallest image of the row.
+    int x = 0, y = 0, shelfHeight = 0;
+    for( int index : order )
+    {
+        int width = (int)sizes[index].width + ATLAS_PADDING * 2;
+        int height = (int)sizes[index].height + ATLAS_PADDING * 2;
+        if( x + width > atlasSize )
+        {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        if( x + width > atlasSize || y + height > atlasSize )
+        {
+            return false;
+        }
+        _entries[index].rect = cocos2d::Rect( x + ATLAS_PADDING, y + ATLAS_PADDING, sizes[index].width, sizes[index].height );
+        x += width;
+        shelfHeight = MAX( shelfHeight, height );
+    }
+    return true;
+}
+
+void TextureAtlasBuilder::blit( const std::vector< unsigned char >& pixels, int width, int height,
+                                std::vector< unsigned char >& atlas, int atlasSize, const cocos2d::Rect& rect )
+{
+    if( pixels.empty() )
+    {
+        return;
+    }
+    int originX = (int)rect.origin.x;
+    int originY = (int)rect.origin.y;
+    for( int y = -ATLAS_PADDING; y < height + ATLAS_PADDING; ++y )
+    {
+        int sourceY = MAX( 0, MIN( height - 1, y ) );
+        for( int x = -ATLAS_PADDING; x < width + ATLAS_PADDING; ++x )
+        {
+            int sourceX = MAX( 0, MIN( width - 1, x ) );
+            memcpy( &atlas[ ( ( originY + y ) * atlasSize + originX + x ) * 4 ], &pixels[ ( sourceY * width + sourceX ) * 4 ], 4 );
+        }
+    }
+}
+
+cocos2d::Texture2D* TextureAtlasBuilder::createTexture( const std::vector< unsigned char >& atlas, int atlasSize )
+{
+    cocos2d::Texture2D* texture = new (std::nothrow) cocos2d::Texture2D();
+    if( texture && texture->initWithData( &atlas[0], atlas.size(), cocos2d::Texture2D::PixelFormat::RGBA8888, atlasSize, atlasSize, cocos2d::Size( atlasSize, atlasSize ) ) )
+    {
+        texture->autorelease();
+        return texture;
+    }
+    CC_SAFE_DELETE( texture );
+    return nullptr;
+}
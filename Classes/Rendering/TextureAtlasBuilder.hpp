@@ -0,0 +1,91 @@
+//
+//  TextureAtlasBuilder.hpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+
+#ifndef TextureAtlasBuilder_hpp
+#define TextureAtlasBuilder_hpp
+
+#include "cocos2d.h"
+
+namespace mikedotcpp
+{
+    /**
+     * Packs individual tile images into one diffuse atlas and, with the same layout, one normal-map atlas at load
+     * time. Used by the merged material when the map does not ship a prebuilt materialAtlas, so every tile type
+     * samples the same two textures and can be drawn by the same instanced mesh.
+     *
+     * Images are shelf-packed (tallest first) into the smallest square power-of-two texture that holds them, up to
+     * the device maximum. Each image is surrounded by ATLAS_PADDING pixels of its own edge so filtering never
+     * samples a neighbour.
+     */
+    class TextureAtlasBuilder
+    {
+    public:
+        /**
+         * Adds an image (file name, as for Sprite::create) and optionally the normal map drawn with it. Images
+         * without a normal map get a flat normal in the normal atlas. Adding the same image twice is a no-op.
+         */
+        void addImage( const std::string& diffuseFile, const std::string& normalFile="" );
+        
+        /**
+         * Decodes and packs every added image and creates the atlas textures. Returns FALSE if nothing was added
+         * or the images don't fit in the largest texture the device supports.
+         */
+        bool build();
+        
+        /**
+         * The atlas textures (autoreleased, retain to keep them). The normal atlas is NULL when none of the images
+         * had a normal map.
+         */
+        cocos2d::Texture2D* getDiffuseTexture() const;
+        cocos2d::Texture2D* getNormalTexture() const;
+        
+        /**
+         * Registers every added image as a SpriteFrame of the diffuse atlas, under its file name.
+         */
+        void addSpriteFrames() const;
+    
+    protected:
+        struct Entry
+        {
+            std::string diffuseFile;
+            std::string normalFile;
+            
+            /**
+             * Pixel rect in the atlases (origin top-left, padding excluded).
+             */
+            cocos2d::Rect rect;
+        };
+        
+        std::vector< Entry > _entries;
+        cocos2d::Texture2D* _diffuseTexture = nullptr;
+        cocos2d::Texture2D* _normalTexture = nullptr;
+        
+        /**
+         * Decodes an image file into tightly packed RGBA8888 rows (top row first).
+         */
+        static bool decodeRGBA( const std::string& file, std::vector< unsigned char >& pixels, int& width, int& height );
+        
+        /**
+         * Assigns Entry::rect for every entry in an atlas of the given size. Returns FALSE if they don't fit.
+         */
+        bool pack( const std::vector< cocos2d::Size >& sizes, int atlasSize );
+        
+        /**
+         * Copies an image into the atlas at rect and repeats its outermost pixels into the padding.
+         */
+        static void blit( const std::vector< unsigned char >& pixels, int width, int height,
+                          std::vector< unsigned char >& atlas, int atlasSize, const cocos2d::Rect& rect );
+        
+        /**
+         * Creates an autoreleased RGBA8888 texture from atlas pixels.
+         */
+        static cocos2d::Texture2D* createTexture( const std::vector< unsigned char >& atlas, int atlasSize );
+    };
+}
+
+#endif /* TextureAtlasBuilder_hpp */
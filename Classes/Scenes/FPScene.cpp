@@ -29,6 +29,7 @@ bool FPScene::init()
     
     _hudLayer = mikedotcpp::FPHUDLayer::create();
     addChild( _hudLayer );
+    _hudLayer->setRenderLayer( _game );
     
     return ret;
 }
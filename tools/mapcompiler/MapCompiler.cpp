@@ -0,0 +1,883 @@
+//
+//  MapCompiler.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+//  Compiles a JSON map definition into the binary map format described in Classes/Map/MapBinaryFormat.h.
+//
+//  usage: mapcompiler [--chunked] <input.json> [output.cwm]
+//
+//  The output defaults to the input path with its extension replaced by MAP_BINARY_EXTENSION. Maps larger than
+//  MAP_BINARY_CHUNKED_MIN_CELLS (or any map with --chunked) are written in chunks so they can be streamed.
+//
+//  The JSON is validated first (every rule MapInfo only checks with CCASSERT, which release builds compile out)
+//  and every problem is reported. The precomputed data of MapPrecompute.h is then stored alongside the map.
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "json/document.h"
+#include "Map/BehaviorScript.h"
+#include "Map/MapBinaryFormat.h"
+#include "Map/MapPrecompute.h"
+
+using namespace mikedotcpp;
+
+/**
+ * Deduplicating string table. Offset 0 is the empty string.
+ */
+class StringTable
+{
+public:
+    StringTable()
+    {
+        _data.push_back( '\0' );
+        _offsets[""] = 0;
+    }
+
+    uint32_t add( const std::string& value )
+    {
+        auto found = _offsets.find( value );
+        if( found != _offsets.end() )
+        {
+            return found->second;
+        }
+        uint32_t offset = (uint32_t)_data.size();
+        _data.insert( _data.end(), value.begin(), value.end() );
+        _data.push_back( '\0' );
+        _offsets[value] = offset;
+        return offset;
+    }
+
+    const std::vector< char >& getData() const
+    {
+        return _data;
+    }
+
+private:
+    std::vector< char > _data;
+    std::unordered_map< std::string, uint32_t > _offsets;
+};
+
+static bool fail( const std::string& message )
+{
+    fprintf( stderr, "mapcompiler: %s\n", message.c_str() );
+    return false;
+}
+
+static std::string getString( const rapidjson::Value& obj, const char* key )
+{
+    if( obj.HasMember( key ) && obj[key].IsString() )
+    {
+        return obj[key].GetString();
+    }
+    return "";
+}
+
+static int getInt( const rapidjson::Value& obj, const char* key, int fallback )
+{
+    if( obj.HasMember( key ) && obj[key].IsInt() )
+    {
+        return obj[key].GetInt();
+    }
+    return fallback;
+}
+
+static float getFloat( const rapidjson::Value& obj, const char* key, float fallback )
+{
+    if( obj.HasMember( key ) && obj[key].IsNumber() )
+    {
+        return (float)obj[key].GetDouble();
+    }
+    return fallback;
+}
+
+static bool getBool( const rapidjson::Value& obj, const char* key )
+{
+    return obj.HasMember( key ) && obj[key].IsBool() && obj[key].GetBool();
+}
+
+/**
+ * An [r, g, b] array of numbers.
+ */
+static bool isColor( const rapidjson::Value& value )
+{
+    return value.IsArray() && value.Size() == 3 && value[0].IsNumber() && value[1].IsNumber() && value[2].IsNumber();
+}
+
+/**
+ * Reads an [r, g, b] array into color; anything else leaves it unchanged.
+ */
+static void getColor( const rapidjson::Value& obj, const char* key, float color[3] )
+{
+    if( obj.HasMember( key ) && isColor( obj[key] ) )
+    {
+        for( rapidjson::SizeType i = 0; i < 3; ++i )
+        {
+            color[i] = (float)obj[key][i].GetDouble();
+        }
+    }
+}
+
+/**
+ * Collects every problem of a JSON map definition instead of stopping at the first one.
+ */
+class Validator
+{
+public:
+    void error( const std::string& where, const std::string& message )
+    {
+        fprintf( stderr, "mapcompiler: %s: %s\n", where.c_str(), message.c_str() );
+        ++_errorCount;
+    }
+
+    void require( const rapidjson::Value& obj, const std::string& where, const char* key, bool (rapidjson::Value::*isType)() const, const char* type )
+    {
+        if( !obj.HasMember( key ) )
+        {
+            error( where, std::string( "missing " ) + key );
+        }
+        else
+        {
+            optional( obj, where, key, isType, type );
+        }
+    }
+
+    void optional( const rapidjson::Value& obj, const std::string& where, const char* key, bool (rapidjson::Value::*isType)() const, const char* type )
+    {
+        if( obj.HasMember( key ) && !( obj[key].*isType )() )
+        {
+            error( where, std::string( key ) + " must be " + type );
+        }
+    }
+
+    int getErrorCount() const
+    {
+        return _errorCount;
+    }
+
+private:
+    int _errorCount = 0;
+};
+
+static bool validate( const rapidjson::Document& doc )
+{
+    Validator validator;
+    if( !doc.IsObject() )
+    {
+        validator.error( "map", "not a JSON object" );
+        return false;
+    }
+    const char* sections[] = { "properties", "tiles", "planes", "actors", "triggers" };
+    for( const char* section : sections )
+    {
+        if( !doc.HasMember( section ) )
+        {
+            validator.error( "map", std::string( "missing " ) + section );
+            return false;
+        }
+    }
+
+    const rapidjson::Value& props = doc["properties"];
+    if( !props.IsObject() )
+    {
+        validator.error( "properties", "must be an object" );
+        return false;
+    }
+    validator.require( props, "properties", "path", &rapidjson::Value::IsString, "a string" );
+    validator.require( props, "properties", "name", &rapidjson::Value::IsString, "a string" );
+    validator.require( props, "properties", "version", &rapidjson::Value::IsString, "a string" );
+    validator.require( props, "properties", "tileSize", &rapidjson::Value::IsInt, "an integer" );
+    validator.require( props, "properties", "width", &rapidjson::Value::IsInt, "an integer" );
+    validator.require( props, "properties", "height", &rapidjson::Value::IsInt, "an integer" );
+    validator.require( props, "properties", "useRealtimeLighting", &rapidjson::Value::IsBool, "a boolean" );
+    validator.optional( props, "properties", "useMergedMaterial", &rapidjson::Value::IsBool, "a boolean" );
+    validator.optional( props, "properties", "generateMipmaps", &rapidjson::Value::IsBool, "a boolean" );
+    validator.optional( props, "properties", "maxAnisotropy", &rapidjson::Value::IsNumber, "a number" );
+    validator.optional( props, "properties", "materialAtlas", &rapidjson::Value::IsObject, "an object" );
+    if( props.HasMember( "ambientLight" ) && !isColor( props["ambientLight"] ) )
+    {
+        validator.error( "properties", "ambientLight must be an array of 3 numbers" );
+    }
+    if( props.HasMember( "materialAtlas" ) && props["materialAtlas"].IsObject() )
+    {
+        validator.require( props["materialAtlas"], "properties.materialAtlas", "diffuse", &rapidjson::Value::IsString, "a string" );
+        validator.optional( props["materialAtlas"], "properties.materialAtlas", "normal", &rapidjson::Value::IsString, "a string" );
+    }
+    if( !getBool( props, "useRealtimeLighting" ) )
+    {
+        validator.require( props, "properties", "spritesheets", &rapidjson::Value::IsArray, "an array (required by the sprite-rendering path)" );
+    }
+    if( props.HasMember( "spritesheets" ) && props["spritesheets"].IsArray() )
+    {
+        for( rapidjson::SizeType i = 0; i < props["spritesheets"].Size(); ++i )
+        {
+            if( !props["spritesheets"][i].IsString() )
+            {
+                validator.error( "properties.spritesheets", "entry " + std::to_string( i ) + " must be a string" );
+            }
+        }
+    }
+
+    int behaviorCount = 0;
+    if( doc.HasMember( "behaviors" ) && doc["behaviors"].IsArray() )
+    {
+        const rapidjson::Value& array = doc["behaviors"];
+        behaviorCount = (int)array.Size();
+        for( rapidjson::SizeType i = 0; i < array.Size(); ++i )
+        {
+            std::string where = "behaviors[" + std::to_string( i ) + "]";
+            if( !array[i].IsObject() )
+            {
+                validator.error( where, "must be an object" );
+                continue;
+            }
+            const char* events[] = { "onEnter", "onExit", "onCreate" };
+            for( const char* event : events )
+            {
+                validator.optional( array[i], where, event, &rapidjson::Value::IsString, "a string" );
+                if( array[i].HasMember( event ) && array[i][event].IsString() )
+                {
+                    // Compiled again by MapInfo at load; this only reports the scripts it would drop.
+                    BehaviorProgram program;
+                    int32_t entry;
+                    std::string message;
+                    if( !compileBehaviorScript( array[i][event].GetString(), program, entry, message ) )
+                    {
+                        validator.error( where + "." + event, message );
+                    }
+                }
+            }
+        }
+    }
+
+    const rapidjson::Value& tileArray = doc["tiles"];
+    if( !tileArray.IsArray() )
+    {
+        validator.error( "tiles", "must be an array" );
+    }
+    else
+    {
+        for( rapidjson::SizeType i = 0; i < tileArray.Size(); ++i )
+        {
+            std::string where = "tiles[" + std::to_string( i ) + "]";
+            const rapidjson::Value& obj = tileArray[i];
+            if( !obj.IsObject() )
+            {
+                validator.error( where, "must be an object" );
+                continue;
+            }
+            for( int field = 0; field < TILE_STRING_COUNT; ++field )
+            {
+                validator.optional( obj, where, MAP_BINARY_TILE_KEYS[field], &rapidjson::Value::IsString, "a string" );
+            }
+            validator.optional( obj, where, "tag", &rapidjson::Value::IsInt, "an integer" );
+            validator.optional( obj, where, "textureLodBias", &rapidjson::Value::IsNumber, "a number" );
+            int tag = getInt( obj, "tag", -1 );
+            if( tag < -1 || ( tag >= behaviorCount && tag != MAP_BLOCKING_TAG ) )
+            {
+                validator.error( where, "tag " + std::to_string( tag ) + " does not name a behavior" );
+            }
+        }
+    }
+
+    const rapidjson::Value& planeArray = doc["planes"];
+    if( !planeArray.IsArray() || planeArray.Size() == 0 )
+    {
+        validator.error( "planes", "must be a non-empty array" );
+    }
+    else
+    {
+        for( rapidjson::SizeType i = 0; i < planeArray.Size(); ++i )
+        {
+            std::string where = "planes[" + std::to_string( i ) + "]";
+            if( !planeArray[i].IsObject() )
+            {
+                validator.error( where, "must be an object" );
+                continue;
+            }
+            validator.require( planeArray[i], where, "height", &rapidjson::Value::IsInt, "an integer" );
+            validator.require( planeArray[i], where, "map", &rapidjson::Value::IsArray, "an array" );
+            if( planeArray[i].HasMember( "map" ) && planeArray[i]["map"].IsArray() )
+            {
+                const rapidjson::Value& map = planeArray[i]["map"];
+                for( rapidjson::SizeType j = 0; j < map.Size(); ++j )
+                {
+                    if( !map[j].IsInt() )
+                    {
+                        validator.error( where, "map entry " + std::to_string( j ) + " must be an integer" );
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    const rapidjson::Value& actorArray = doc["actors"];
+    if( !actorArray.IsArray() || actorArray.Size() == 0 || !actorArray[0].IsObject() || getString( actorArray[0], "type" ) != "Player1" )
+    {
+        validator.error( "actors", "the first actor must be Player1" );
+    }
+    if( actorArray.IsArray() )
+    {
+        for( rapidjson::SizeType i = 0; i < actorArray.Size(); ++i )
+        {
+            std::string where = "actors[" + std::to_string( i ) + "]";
+            if( !actorArray[i].IsObject() )
+            {
+                validator.error( where, "must be an object" );
+                continue;
+            }
+            validator.require( actorArray[i], where, "type", &rapidjson::Value::IsString, "a string" );
+            validator.require( actorArray[i], where, "x", &rapidjson::Value::IsInt, "an integer" );
+            validator.require( actorArray[i], where, "y", &rapidjson::Value::IsInt, "an integer" );
+            validator.require( actorArray[i], where, "z", &rapidjson::Value::IsInt, "an integer" );
+            validator.require( actorArray[i], where, "yaw", &rapidjson::Value::IsNumber, "a number" );
+        }
+    }
+
+    if( doc.HasMember( "lights" ) && !doc["lights"].IsArray() )
+    {
+        validator.error( "lights", "must be an array" );
+    }
+    else if( doc.HasMember( "lights" ) )
+    {
+        const rapidjson::Value& lightArray = doc["lights"];
+        for( rapidjson::SizeType i = 0; i < lightArray.Size(); ++i )
+        {
+            std::string where = "lights[" + std::to_string( i ) + "]";
+            if( !lightArray[i].IsObject() )
+            {
+                validator.error( where, "must be an object" );
+                continue;
+            }
+            validator.require( lightArray[i], where, "x", &rapidjson::Value::IsNumber, "a number" );
+            validator.require( lightArray[i], where, "y", &rapidjson::Value::IsNumber, "a number" );
+            validator.optional( lightArray[i], where, "height", &rapidjson::Value::IsNumber, "a number" );
+            validator.optional( lightArray[i], where, "radius", &rapidjson::Value::IsNumber, "a number" );
+            if( lightArray[i].HasMember( "color" ) && !isColor( lightArray[i]["color"] ) )
+            {
+                validator.error( where, "color must be an array of 3 numbers" );
+            }
+            if( getFloat( lightArray[i], "radius", 1.0f ) <= 0.0f )
+            {
+                validator.error( where, "radius must be positive" );
+            }
+        }
+    }
+
+    const rapidjson::Value& triggerArray = doc["triggers"];
+    if( !triggerArray.IsArray() || triggerArray.Size() == 0 )
+    {
+        validator.error( "triggers", "must start with the default trigger" );
+    }
+    else
+    {
+        for( rapidjson::SizeType i = 0; i < triggerArray.Size(); ++i )
+        {
+            std::string where = "triggers[" + std::to_string( i ) + "]";
+            if( triggerArray[i].IsObject() )
+            {
+                validator.optional( triggerArray[i], where, "continueRaycast", &rapidjson::Value::IsBool, "a boolean" );
+            }
+            else
+            {
+                validator.error( where, "must be an object" );
+            }
+        }
+    }
+
+    if( validator.getErrorCount() > 0 )
+    {
+        fprintf( stderr, "mapcompiler: %i error(s)\n", validator.getErrorCount() );
+        return false;
+    }
+    return true;
+}
+
+static void align( std::vector< unsigned char >& buffer )
+{
+    while( buffer.size() % MAP_BINARY_ALIGNMENT != 0 )
+    {
+        buffer.push_back( 0 );
+    }
+}
+
+template< typename T >
+static uint32_t append( std::vector< unsigned char >& buffer, const std::vector< T >& records )
+{
+    align( buffer );
+    uint32_t offset = (uint32_t)buffer.size();
+    if( !records.empty() )
+    {
+        const unsigned char* bytes = (const unsigned char*)&records[0];
+        buffer.insert( buffer.end(), bytes, bytes + sizeof( T ) * records.size() );
+    }
+    return offset;
+}
+
+/**
+ * Tiles keep the same field rules as MapInfo::loadJSONTiles: a billboard ignores every other string, a model only
+ * keeps textureAll/normalAll.
+ */
+static bool isTileFieldAllowed( const rapidjson::Value& obj, int field )
+{
+    if( obj.HasMember( MAP_BINARY_TILE_KEYS[TILE_BILLBOARD_TEXTURE] ) )
+    {
+        return field == TILE_BILLBOARD_TEXTURE;
+    }
+    if( obj.HasMember( MAP_BINARY_TILE_KEYS[TILE_MODEL] ) )
+    {
+        return field == TILE_MODEL || field == TILE_TEXTURE_ALL || field == TILE_NORMAL_ALL;
+    }
+    return field != TILE_BILLBOARD_TEXTURE && field != TILE_MODEL;
+}
+
+/**
+ * Splits the planes into chunkSize * chunkSize blocks and collects the tile usage list of each one.
+ */
+static void buildChunks( const MapBinaryHeader& header, const std::vector< std::vector< uint16_t > >& planeMaps,
+                         std::vector< MapBinaryChunk >& chunks, std::vector< MapBinaryTileUsage >& usage,
+                         std::vector< std::vector< uint16_t > >& chunkCells )
+{
+    int chunkSize = (int)header.chunkSize;
+    int chunksWide = ( header.width + chunkSize - 1 ) / chunkSize;
+    int chunksHigh = ( header.height + chunkSize - 1 ) / chunkSize;
+    for( size_t plane = 0; plane < planeMaps.size(); ++plane )
+    {
+        for( int chunkY = 0; chunkY < chunksHigh; ++chunkY )
+        {
+            for( int chunkX = 0; chunkX < chunksWide; ++chunkX )
+            {
+                std::vector< uint16_t > cells( chunkSize * chunkSize, 0 );
+                std::vector< int > counts( header.tileCount + 1, 0 );
+                for( int y = 0; y < chunkSize && chunkY * chunkSize + y < header.height; ++y )
+                {
+                    for( int x = 0; x < chunkSize && chunkX * chunkSize + x < header.width; ++x )
+                    {
+                        uint16_t tile = planeMaps[plane][ ( chunkY * chunkSize + y ) * header.width + chunkX * chunkSize + x ];
+                        cells[ y * chunkSize + x ] = tile;
+                        ++counts[tile];
+                    }
+                }
+
+                MapBinaryChunk chunk;
+                chunk.cellOffset = 0;
+                chunk.usageIndex = (uint32_t)usage.size();
+                for( uint32_t tile = 1; tile <= header.tileCount; ++tile )
+                {
+                    if( counts[tile] > 0 )
+                    {
+                        MapBinaryTileUsage entry = { (uint16_t)tile, (uint16_t)counts[tile] };
+                        usage.push_back( entry );
+                    }
+                }
+                chunk.usageCount = (uint32_t)usage.size() - chunk.usageIndex;
+                chunks.push_back( chunk );
+                chunkCells.push_back( cells );
+            }
+        }
+    }
+}
+
+static bool compile( const rapidjson::Document& doc, bool forceChunked, std::vector< unsigned char >& output )
+{
+    if( !doc.IsObject() || !doc.HasMember( "properties" ) || !doc.HasMember( "tiles" ) || !doc.HasMember( "planes" ) || !doc.HasMember( "actors" ) )
+    {
+        return fail( "missing properties, tiles, planes or actors" );
+    }
+
+    StringTable strings;
+    MapBinaryHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, MAP_BINARY_MAGIC, sizeof( header.magic ) );
+    header.version = MAP_BINARY_VERSION;
+
+    //
+    // PROPERTIES
+    //
+    const rapidjson::Value& props = doc["properties"];
+    header.tileSize = getInt( props, "tileSize", 0 );
+    header.width = getInt( props, "width", 0 );
+    header.height = getInt( props, "height", 0 );
+    header.path = strings.add( getString( props, "path" ) );
+    header.name = strings.add( getString( props, "name" ) );
+    header.mapVersion = strings.add( getString( props, "version" ) );
+    if( header.width <= 0 || header.height <= 0 || header.tileSize <= 0 )
+    {
+        return fail( "properties must define a positive tileSize, width and height" );
+    }
+
+    if( getBool( props, "useRealtimeLighting" ) )
+    {
+        header.flags |= MAP_BINARY_FLAG_REALTIME_LIGHTING;
+        if( getBool( props, "useMergedMaterial" ) )
+        {
+            header.flags |= MAP_BINARY_FLAG_MERGED_MATERIAL;
+            if( props.HasMember( "materialAtlas" ) && props["materialAtlas"].IsObject() )
+            {
+                header.diffuseAtlas = strings.add( getString( props["materialAtlas"], "diffuse" ) );
+                header.normalAtlas = strings.add( getString( props["materialAtlas"], "normal" ) );
+            }
+        }
+    }
+
+    if( getBool( props, "generateMipmaps" ) )
+    {
+        header.flags |= MAP_BINARY_FLAG_GENERATE_MIPMAPS;
+    }
+    header.maxAnisotropy = getFloat( props, "maxAnisotropy", 1.0f );
+    header.ambientLight[0] = header.ambientLight[1] = header.ambientLight[2] = 1.0f;
+    getColor( props, "ambientLight", header.ambientLight );
+
+    std::vector< uint32_t > spritesheets;
+    if( props.HasMember( "spritesheets" ) && props["spritesheets"].IsArray() )
+    {
+        const rapidjson::Value& array = props["spritesheets"];
+        for( rapidjson::SizeType i = 0; i < array.Size(); ++i )
+        {
+            spritesheets.push_back( strings.add( array[i].GetString() ) );
+        }
+    }
+
+    //
+    // TILES
+    //
+    std::vector< MapBinaryTile > tiles;
+    const rapidjson::Value& tileArray = doc["tiles"];
+    for( rapidjson::SizeType i = 0; i < tileArray.Size(); ++i )
+    {
+        const rapidjson::Value& obj = tileArray[i];
+        MapBinaryTile tile;
+        memset( &tile, 0, sizeof( tile ) );
+        bool hasField[TILE_STRING_COUNT];
+        for( int field = 0; field < TILE_STRING_COUNT; ++field )
+        {
+            if( isTileFieldAllowed( obj, field ) )
+            {
+                tile.strings[field] = strings.add( getString( obj, MAP_BINARY_TILE_KEYS[field] ) );
+            }
+            hasField[field] = tile.strings[field] != 0;
+        }
+        tile.tag = getInt( obj, "tag", -1 );
+        tile.textureLodBias = getFloat( obj, "textureLodBias", 0.0f );
+        tile.flags = computeTileFlags( hasField, tile.tag );
+        tiles.push_back( tile );
+    }
+    if( tiles.size() >= 0xFFFF )
+    {
+        return fail( "too many tiles for 16-bit plane indices" );
+    }
+
+    //
+    // ACTORS
+    //
+    std::vector< MapBinaryActor > actors;
+    const rapidjson::Value& actorArray = doc["actors"];
+    for( rapidjson::SizeType i = 0; i < actorArray.Size(); ++i )
+    {
+        const rapidjson::Value& obj = actorArray[i];
+        MapBinaryActor actor;
+        actor.type = strings.add( getString( obj, "type" ) );
+        actor.x = getInt( obj, "x", 0 );
+        actor.y = getInt( obj, "y", 0 );
+        actor.z = getInt( obj, "z", 0 );
+        actor.yaw = ( obj.HasMember( "yaw" ) && obj["yaw"].IsNumber() ) ? (float)obj["yaw"].GetDouble() : 0.0f;
+        actors.push_back( actor );
+    }
+
+    //
+    // LIGHTS
+    //
+    std::vector< MapBinaryLight > lights;
+    if( doc.HasMember( "lights" ) && doc["lights"].IsArray() )
+    {
+        const rapidjson::Value& array = doc["lights"];
+        for( rapidjson::SizeType i = 0; i < array.Size(); ++i )
+        {
+            MapBinaryLight light;
+            light.x = getFloat( array[i], "x", 0.0f );
+            light.y = getFloat( array[i], "y", 0.0f );
+            light.height = getFloat( array[i], "height", 0.0f );
+            light.color[0] = light.color[1] = light.color[2] = 1.0f;
+            getColor( array[i], "color", light.color );
+            light.radius = getFloat( array[i], "radius", 4.0f );
+            lights.push_back( light );
+        }
+    }
+
+    //
+    // BEHAVIORS/TRIGGERS
+    //
+    std::vector< MapBinaryBehavior > behaviors;
+    if( doc.HasMember( "behaviors" ) && doc["behaviors"].IsArray() )
+    {
+        const rapidjson::Value& array = doc["behaviors"];
+        for( rapidjson::SizeType i = 0; i < array.Size(); ++i )
+        {
+            MapBinaryBehavior behavior;
+            behavior.onEnter = strings.add( getString( array[i], "onEnter" ) );
+            behavior.onExit = strings.add( getString( array[i], "onExit" ) );
+            behavior.onCreate = strings.add( getString( array[i], "onCreate" ) );
+            behaviors.push_back( behavior );
+        }
+    }
+
+    std::vector< MapBinaryTrigger > triggers;
+    if( doc.HasMember( "triggers" ) && doc["triggers"].IsArray() )
+    {
+        const rapidjson::Value& array = doc["triggers"];
+        for( rapidjson::SizeType i = 0; i < array.Size(); ++i )
+        {
+            MapBinaryTrigger trigger;
+            trigger.continueRaycast = getBool( array[i], "continueRaycast" ) ? 1 : 0;
+            triggers.push_back( trigger );
+        }
+    }
+
+    //
+    // PLANES
+    //
+    size_t mapSize = (size_t)header.width * header.height;
+    std::vector< MapBinaryPlane > planes;
+    std::vector< std::vector< uint16_t > > planeMaps;
+    const rapidjson::Value& planeArray = doc["planes"];
+    for( rapidjson::SizeType i = 0; i < planeArray.Size(); ++i )
+    {
+        const rapidjson::Value& obj = planeArray[i];
+        if( !obj.HasMember( "map" ) || !obj["map"].IsArray() || obj["map"].Size() != mapSize )
+        {
+            return fail( "plane " + std::to_string( i ) + " must have a width * height map array" );
+        }
+
+        const rapidjson::Value& mapArray = obj["map"];
+        std::vector< uint16_t > map( mapSize, 0 );
+        for( rapidjson::SizeType j = 0; j < mapArray.Size(); ++j )
+        {
+            int value = mapArray[j].GetInt();
+            if( value < 0 || value > (int)tiles.size() )
+            {
+                return fail( "plane " + std::to_string( i ) + " references undefined tile " + std::to_string( value ) );
+            }
+            map[j] = (uint16_t)value;
+        }
+
+        MapBinaryPlane plane;
+        plane.height = getInt( obj, "height", 0 );
+        plane.mapOffset = 0;
+        planes.push_back( plane );
+        planeMaps.push_back( map );
+    }
+
+    //
+    // PRECOMPUTED DATA
+    //
+    std::vector< const uint16_t* > mapPointers;
+    std::vector< int > heights;
+    for( size_t i = 0; i < planes.size(); ++i )
+    {
+        mapPointers.push_back( &planeMaps[i][0] );
+        heights.push_back( planes[i].height );
+    }
+
+    std::vector< uint32_t > instanceCounts;
+    computeTileInstanceCounts( mapPointers, mapSize, tiles.size(), instanceCounts );
+    std::vector< uint32_t > tileFlags;
+    for( size_t i = 0; i < tiles.size(); ++i )
+    {
+        tiles[i].instanceCount = instanceCounts[i];
+        tileFlags.push_back( tiles[i].flags );
+    }
+
+    std::vector< MapBinaryPlaneLevel > planeLevels;
+    std::vector< uint16_t > planeOrder;
+    computePlaneLevels( heights, planeLevels, planeOrder );
+
+    bool chunked = forceChunked || mapSize > MAP_BINARY_CHUNKED_MIN_CELLS;
+    std::vector< uint8_t > cellFlags;
+    if( !chunked )
+    {
+        computeCellFlags( mapPointers, heights, header.width, header.height, header.tileSize, tileFlags, planeLevels, planeOrder, cellFlags );
+    }
+
+    //
+    // LAYOUT
+    //
+    output.assign( sizeof( MapBinaryHeader ), 0 );
+
+    header.stringTableOffset = (uint32_t)output.size();
+    header.stringTableSize = (uint32_t)strings.getData().size();
+    output.insert( output.end(), strings.getData().begin(), strings.getData().end() );
+
+    header.spritesheetCount = (uint32_t)spritesheets.size();
+    header.spritesheetOffset = append( output, spritesheets );
+    // Tile records are patched once the chunks are known (maxChunkInstances).
+    header.tileCount = (uint32_t)tiles.size();
+    header.tileOffset = append( output, tiles );
+    header.actorCount = (uint32_t)actors.size();
+    header.actorOffset = append( output, actors );
+    header.behaviorCount = (uint32_t)behaviors.size();
+    header.behaviorOffset = append( output, behaviors );
+    header.triggerCount = (uint32_t)triggers.size();
+    header.triggerOffset = append( output, triggers );
+    header.lightCount = (uint32_t)lights.size();
+    header.lightOffset = append( output, lights );
+    header.planeLevelCount = (uint32_t)planeLevels.size();
+    header.planeLevelOffset = append( output, planeLevels );
+    header.planeOrderOffset = append( output, planeOrder );
+    header.cellFlagsOffset = chunked ? 0 : append( output, cellFlags );
+
+    // Plane (and chunk) records are written first and patched once the map offsets are known.
+    header.planeCount = (uint32_t)planes.size();
+    header.planeOffset = append( output, planes );
+    if( chunked )
+    {
+        header.flags |= MAP_BINARY_FLAG_CHUNKED;
+        header.chunkSize = MAP_BINARY_CHUNK_SIZE;
+
+        std::vector< MapBinaryChunk > chunks;
+        std::vector< MapBinaryTileUsage > usage;
+        std::vector< std::vector< uint16_t > > chunkCells;
+        buildChunks( header, planeMaps, chunks, usage, chunkCells );
+
+        for( const auto& entry : usage )
+        {
+            MapBinaryTile& tile = tiles[ entry.tile - 1 ];
+            tile.maxChunkInstances = std::max( tile.maxChunkInstances, (uint32_t)entry.count );
+        }
+        if( !tiles.empty() )
+        {
+            memcpy( &output[header.tileOffset], &tiles[0], sizeof( MapBinaryTile ) * tiles.size() );
+        }
+
+        header.chunkOffset = append( output, chunks );
+        header.tileUsageCount = (uint32_t)usage.size();
+        header.tileUsageOffset = append( output, usage );
+        for( size_t i = 0; i < chunks.size(); ++i )
+        {
+            chunks[i].cellOffset = append( output, chunkCells[i] );
+        }
+        if( !chunks.empty() )
+        {
+            memcpy( &output[header.chunkOffset], &chunks[0], sizeof( MapBinaryChunk ) * chunks.size() );
+        }
+    }
+    else
+    {
+        for( size_t i = 0; i < planes.size(); ++i )
+        {
+            planes[i].mapOffset = append( output, planeMaps[i] );
+        }
+        if( !planes.empty() )
+        {
+            memcpy( &output[header.planeOffset], &planes[0], sizeof( MapBinaryPlane ) * planes.size() );
+        }
+    }
+
+    align( output );
+    if( output.size() > UINT32_MAX )
+    {
+        return fail( "compiled map exceeds 4 GB" );
+    }
+    header.fileSize = (uint32_t)output.size();
+    memcpy( &output[0], &header, sizeof( header ) );
+    return true;
+}
+
+int main( int argc, char** argv )
+{
+    bool forceChunked = false;
+    std::vector< std::string > paths;
+    for( int i = 1; i < argc; ++i )
+    {
+        if( strcmp( argv[i], "--chunked" ) == 0 )
+        {
+            forceChunked = true;
+        }
+        else
+        {
+            paths.push_back( argv[i] );
+        }
+    }
+
+    if( paths.empty() )
+    {
+        fprintf( stderr, "usage: mapcompiler [--chunked] <input.json> [output%s]\n", MAP_BINARY_EXTENSION );
+        return 1;
+    }
+
+    std::string inputPath = paths[0];
+    std::string outputPath;
+    if( paths.size() > 1 )
+    {
+        outputPath = paths[1];
+    }
+    else
+    {
+        size_t dot = inputPath.find_last_of( '.' );
+        outputPath = inputPath.substr( 0, dot ) + MAP_BINARY_EXTENSION;
+    }
+
+    std::ifstream input( inputPath, std::ios::binary );
+    if( !input )
+    {
+        fail( "cannot open " + inputPath );
+        return 1;
+    }
+    std::stringstream json;
+    json << input.rdbuf();
+
+    rapidjson::Document doc;
+    doc.Parse( json.str().c_str() );
+    if( doc.HasParseError() )
+    {
+        fail( "invalid JSON in " + inputPath );
+        return 1;
+    }
+    if( !validate( doc ) )
+    {
+        return 1;
+    }
+
+    std::vector< unsigned char > output;
+    if( !compile( doc, forceChunked, output ) )
+    {
+        return 1;
+    }
+
+    // Written aside and renamed over the output, so a game that has the old file mapped (hot reload) keeps reading
+    // intact data instead of a truncated file.
+    std::string temporaryPath = outputPath + ".tmp";
+    {
+        std::ofstream file( temporaryPath, std::ios::binary );
+        file.write( (const char*)&output[0], output.size() );
+        if( !file )
+        {
+            fail( "cannot write " + temporaryPath );
+            return 1;
+        }
+    }
+    if( std::rename( temporaryPath.c_str(), outputPath.c_str() ) != 0 )
+    {
+        // Windows does not rename over an existing file.
+        std::remove( outputPath.c_str() );
+        if( std::rename( temporaryPath.c_str(), outputPath.c_str() ) != 0 )
+        {
+            fail( "cannot write " + outputPath );
+            return 1;
+        }
+    }
+
+    printf( "%s -> %s (%zu bytes)\n", inputPath.c_str(), outputPath.c_str(), output.size() );
+    return 0;
+}
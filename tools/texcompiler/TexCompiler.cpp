@@ -0,0 +1,422 @@
+//
+//  TexCompiler.cpp
+//  CocosWolf3D
+//
+//  Created by CocosWolf3D contributors on 10/18/26.
+//
+//
+//  Converts PNG map images (spritesheets, tile textures) into the GPU-compressed variants described in
+//  Classes/Rendering/CompressedTextureFormat.h, written next to each input.
+//
+//  usage: texcompiler [--s3tc] [--etc] [--mipmaps] <image.png>...
+//
+//  Without a format flag both variants are written. ETC1 encoding reuses the engine's encoder
+//  (cocos2d/cocos/base/etc1.cpp), which must be compiled in.
+//
+//  --mipmaps stores a full, box-filtered mip chain in the S3TC variant, since compressed levels can't be generated
+//  at load. PKM holds a single level, so the ETC1 variant is never mipmapped.
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <png.h>
+#include "base/etc1.h"
+#include "Rendering/CompressedTextureFormat.h"
+
+struct RGBAImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector< unsigned char > pixels;
+
+    bool hasAlpha() const
+    {
+        for( size_t i = 3; i < pixels.size(); i += 4 )
+        {
+            if( pixels[i] != 255 )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Pixel (x, y) with coordinates clamped to the image, for the partial blocks at the right and bottom edges.
+     */
+    const unsigned char* at( int x, int y ) const
+    {
+        x = x < width ? x : width - 1;
+        y = y < height ? y : height - 1;
+        return &pixels[ ( y * width + x ) * 4 ];
+    }
+};
+
+static bool fail( const std::string& message )
+{
+    fprintf( stderr, "texcompiler: %s\n", message.c_str() );
+    return false;
+}
+
+static bool writeFile( const std::string& path, const std::vector< unsigned char >& data )
+{
+    std::ofstream file( path, std::ios::binary );
+    file.write( (const char*)&data[0], data.size() );
+    return file ? true : fail( "cannot write " + path );
+}
+
+/**
+ * Halves an image (2x2 box filter, clamped at odd edges) for the next mip level.
+ */
+static RGBAImage downsample( const RGBAImage& image )
+{
+    RGBAImage half;
+    half.width = image.width > 1 ? image.width / 2 : 1;
+    half.height = image.height > 1 ? image.height / 2 : 1;
+    half.pixels.resize( half.width * half.height * 4 );
+    for( int y = 0; y < half.height; ++y )
+    {
+        for( int x = 0; x < half.width; ++x )
+        {
+            for( int c = 0; c < 4; ++c )
+            {
+                int sum = image.at( x * 2, y * 2 )[c] + image.at( x * 2 + 1, y * 2 )[c] +
+                          image.at( x * 2, y * 2 + 1 )[c] + image.at( x * 2 + 1, y * 2 + 1 )[c];
+                half.pixels[ ( y * half.width + x ) * 4 + c ] = (unsigned char)( ( sum + 2 ) / 4 );
+            }
+        }
+    }
+    return half;
+}
+
+static bool loadPNG( const std::string& path, RGBAImage& image )
+{
+    png_image png;
+    memset( &png, 0, sizeof( png ) );
+    png.version = PNG_IMAGE_VERSION;
+    if( !png_image_begin_read_from_file( &png, path.c_str() ) )
+    {
+        return fail( "cannot read " + path + ": " + png.message );
+    }
+    png.format = PNG_FORMAT_RGBA;
+    image.width = png.width;
+    image.height = png.height;
+    image.pixels.resize( PNG_IMAGE_SIZE( png ) );
+    if( !png_image_finish_read( &png, nullptr, &image.pixels[0], 0, nullptr ) )
+    {
+        return fail( "cannot decode " + path + ": " + png.message );
+    }
+    return true;
+}
+
+//==============================================================================
+//
+// S3TC
+//
+//==============================================================================
+
+static uint16_t packRGB565( const unsigned char* color )
+{
+    return (uint16_t)( ( ( color[0] >> 3 ) << 11 ) | ( ( color[1] >> 2 ) << 5 ) | ( color[2] >> 3 ) );
+}
+
+static void unpackRGB565( uint16_t packed, int* color )
+{
+    color[0] = ( ( packed >> 11 ) & 31 ) * 255 / 31;
+    color[1] = ( ( packed >> 5 ) & 63 ) * 255 / 63;
+    color[2] = ( packed & 31 ) * 255 / 31;
+}
+
+/**
+ * Encodes the color half of a block: the endpoints are the corners of the block's color bounding box, inset by a
+ * sixteenth to reduce the error of the interpolated colors. Always uses the four-color mode (color0 > color1).
+ */
+static void encodeColorBlock( const unsigned char block[16][4], unsigned char* output )
+{
+    unsigned char minColor[3] = { 255, 255, 255 };
+    unsigned char maxColor[3] = { 0, 0, 0 };
+    for( int i = 0; i < 16; ++i )
+    {
+        for( int c = 0; c < 3; ++c )
+        {
+            minColor[c] = block[i][c] < minColor[c] ? block[i][c] : minColor[c];
+            maxColor[c] = block[i][c] > maxColor[c] ? block[i][c] : maxColor[c];
+        }
+    }
+    for( int c = 0; c < 3; ++c )
+    {
+        int inset = ( maxColor[c] - minColor[c] ) >> 4;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+    }
+
+    uint16_t color0 = packRGB565( maxColor );
+    uint16_t color1 = packRGB565( minColor );
+    if( color0 < color1 )
+    {
+        std::swap( color0, color1 );
+    }
+
+    int palette[4][3];
+    unpackRGB565( color0, palette[0] );
+    unpackRGB565( color1, palette[1] );
+    for( int c = 0; c < 3; ++c )
+    {
+        palette[2][c] = ( 2 * palette[0][c] + palette[1][c] ) / 3;
+        palette[3][c] = ( palette[0][c] + 2 * palette[1][c] ) / 3;
+    }
+
+    uint32_t indices = 0;
+    if( color0 != color1 )
+    {
+        for( int i = 0; i < 16; ++i )
+        {
+            int best = 0, bestError = INT32_MAX;
+            for( int p = 0; p < 4; ++p )
+            {
+                int error = 0;
+                for( int c = 0; c < 3; ++c )
+                {
+                    int delta = block[i][c] - palette[p][c];
+                    error += delta * delta;
+                }
+                if( error < bestError )
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            indices |= (uint32_t)best << ( i * 2 );
+        }
+    }
+
+    output[0] = color0 & 0xFF;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xFF;
+    output[3] = color1 >> 8;
+    for( int i = 0; i < 4; ++i )
+    {
+        output[4 + i] = ( indices >> ( i * 8 ) ) & 0xFF;
+    }
+}
+
+/**
+ * Encodes the DXT5 alpha half of a block with the eight-value mode (alpha0 > alpha1).
+ */
+static void encodeAlphaBlock( const unsigned char block[16][4], unsigned char* output )
+{
+    int minAlpha = 255, maxAlpha = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+        minAlpha = block[i][3] < minAlpha ? block[i][3] : minAlpha;
+        maxAlpha = block[i][3] > maxAlpha ? block[i][3] : maxAlpha;
+    }
+
+    int palette[8];
+    palette[0] = maxAlpha;
+    palette[1] = minAlpha;
+    for( int p = 1; p < 7; ++p )
+    {
+        palette[p + 1] = ( ( 7 - p ) * maxAlpha + p * minAlpha ) / 7;
+    }
+
+    uint64_t indices = 0;
+    for( int i = 0; i < 16 && maxAlpha != minAlpha; ++i )
+    {
+        int best = 0, bestError = 256;
+        for( int p = 0; p < 8; ++p )
+        {
+            int error = abs( block[i][3] - palette[p] );
+            if( error < bestError )
+            {
+                best = p;
+                bestError = error;
+            }
+        }
+        indices |= (uint64_t)best << ( i * 3 );
+    }
+
+    output[0] = (unsigned char)maxAlpha;
+    output[1] = (unsigned char)minAlpha;
+    for( int i = 0; i < 6; ++i )
+    {
+        output[2 + i] = ( indices >> ( i * 8 ) ) & 0xFF;
+    }
+}
+
+/**
+ * Appends one DXT1 (or DXT5 with alpha) level.
+ */
+static void encodeS3TCLevel( const RGBAImage& image, bool alpha, std::vector< unsigned char >& output )
+{
+    int blocksWide = ( image.width + 3 ) / 4;
+    int blocksHigh = ( image.height + 3 ) / 4;
+    size_t offset = output.size();
+    output.resize( offset + blocksWide * blocksHigh * ( alpha ? 16 : 8 ) );
+
+    unsigned char* block = &output[offset];
+    unsigned char pixels[16][4];
+    for( int by = 0; by < blocksHigh; ++by )
+    {
+        for( int bx = 0; bx < blocksWide; ++bx )
+        {
+            for( int i = 0; i < 16; ++i )
+            {
+                memcpy( pixels[i], image.at( bx * 4 + i % 4, by * 4 + i / 4 ), 4 );
+            }
+            if( alpha )
+            {
+                encodeAlphaBlock( pixels, block );
+                block += 8;
+            }
+            encodeColorBlock( pixels, block );
+            block += 8;
+        }
+    }
+}
+
+/**
+ * Writes a DDS container in the layout cocos2d::Image::initWithS3TCData reads: "DDS " followed by the 124 byte
+ * surface description and the mip levels, largest first.
+ */
+static bool compileS3TC( const RGBAImage& image, bool mipmaps, const std::string& outputPath )
+{
+    bool alpha = image.hasAlpha();
+    uint32_t header[32] = {};
+    header[1] = 124;                                // size
+    header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000; // CAPS | HEIGHT | WIDTH | PIXELFORMAT | LINEARSIZE
+    header[3] = image.height;
+    header[4] = image.width;
+    header[5] = ( ( image.width + 3 ) / 4 ) * ( ( image.height + 3 ) / 4 ) * ( alpha ? 16 : 8 );
+    header[19] = 32;                                // pixel format size
+    header[20] = 0x4;                               // DDPF_FOURCC
+    header[27] = 0x1000;                            // DDSCAPS_TEXTURE
+
+    std::vector< unsigned char > output( sizeof( header ) );
+    uint32_t levels = 1;
+    encodeS3TCLevel( image, alpha, output );
+    for( RGBAImage level = image; mipmaps && ( level.width > 1 || level.height > 1 ); ++levels )
+    {
+        level = downsample( level );
+        encodeS3TCLevel( level, alpha, output );
+    }
+    header[7] = levels;
+    if( levels > 1 )
+    {
+        header[2] |= 0x20000;                       // MIPMAPCOUNT
+        header[27] |= 0x8 | 0x400000;               // DDSCAPS_COMPLEX | DDSCAPS_MIPMAP
+    }
+
+    memcpy( &output[0], header, sizeof( header ) );
+    memcpy( &output[0], "DDS ", 4 );
+    memcpy( &output[84], alpha ? "DXT5" : "DXT1", 4 );
+    return writeFile( outputPath, output );
+}
+
+//==============================================================================
+//
+// ETC1
+//
+//==============================================================================
+
+/**
+ * Encodes one channel set (RGB, or alpha replicated to RGB) as an ETC1 PKM file.
+ */
+static bool writePKM( const std::vector< unsigned char >& rgb, int width, int height, const std::string& outputPath )
+{
+    std::vector< unsigned char > output( ETC_PKM_HEADER_SIZE + etc1_get_encoded_data_size( width, height ) );
+    etc1_pkm_format_header( &output[0], width, height );
+    if( etc1_encode_image( &rgb[0], width, height, 3, width * 3, &output[ETC_PKM_HEADER_SIZE] ) != 0 )
+    {
+        return fail( "ETC1 encoding failed for " + outputPath );
+    }
+    return writeFile( outputPath, output );
+}
+
+static bool compileETC( const RGBAImage& image, const std::string& outputPath )
+{
+    int pixelCount = image.width * image.height;
+    std::vector< unsigned char > rgb( pixelCount * 3 );
+    for( int i = 0; i < pixelCount; ++i )
+    {
+        memcpy( &rgb[i * 3], &image.pixels[i * 4], 3 );
+    }
+    if( !writePKM( rgb, image.width, image.height, outputPath ) )
+    {
+        return false;
+    }
+
+    std::string alphaPath = outputPath + COMPRESSED_TEXTURE_ETC_ALPHA_SUFFIX;
+    if( !image.hasAlpha() )
+    {
+        // A stale alpha file would be picked up by the texture cache.
+        remove( alphaPath.c_str() );
+        return true;
+    }
+    for( int i = 0; i < pixelCount; ++i )
+    {
+        memset( &rgb[i * 3], image.pixels[i * 4 + 3], 3 );
+    }
+    return writePKM( rgb, image.width, image.height, alphaPath );
+}
+
+int main( int argc, char** argv )
+{
+    bool s3tc = false, etc = false, mipmaps = false;
+    std::vector< std::string > paths;
+    for( int i = 1; i < argc; ++i )
+    {
+        if( strcmp( argv[i], "--s3tc" ) == 0 )
+        {
+            s3tc = true;
+        }
+        else if( strcmp( argv[i], "--etc" ) == 0 )
+        {
+            etc = true;
+        }
+        else if( strcmp( argv[i], "--mipmaps" ) == 0 )
+        {
+            mipmaps = true;
+        }
+        else
+        {
+            paths.push_back( argv[i] );
+        }
+    }
+    if( !s3tc && !etc )
+    {
+        s3tc = etc = true;
+    }
+
+    if( paths.empty() )
+    {
+        fprintf( stderr, "usage: texcompiler [--s3tc] [--etc] [--mipmaps] <image%s>...\n", COMPRESSED_TEXTURE_SOURCE_EXTENSION );
+        return 1;
+    }
+
+    int result = 0;
+    for( const auto& path : paths )
+    {
+        RGBAImage image;
+        if( !loadPNG( path, image ) )
+        {
+            result = 1;
+            continue;
+        }
+
+        std::string base = path.substr( 0, path.find_last_of( '.' ) );
+        if( ( s3tc && !compileS3TC( image, mipmaps, base + COMPRESSED_TEXTURE_S3TC_EXTENSION ) ) ||
+            ( etc && !compileETC( image, base + COMPRESSED_TEXTURE_ETC_EXTENSION ) ) )
+        {
+            result = 1;
+            continue;
+        }
+        printf( "%s: %ix%i%s\n", path.c_str(), image.width, image.height, image.hasAlpha() ? " (alpha)" : "" );
+    }
+    return result;
+}